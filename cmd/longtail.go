@@ -3,9 +3,11 @@ package main
 import (
 	"context"
 	"fmt"
+	"io"
 	"log"
 	"net/url"
 	"os"
+	"os/signal"
 	"path"
 	"runtime"
 	"strings"
@@ -113,16 +115,98 @@ func getCompressionType(compressionAlgorithm *string) (uint32, error) {
 		return lib.GetLizardMinCompressionType(), nil
 	case "lizard_max":
 		return lib.GetLizardDefaultCompressionType(), nil
+	case "lizard_fast":
+		return lib.GetLizardFastCompressionType(), nil
 	case "zstd":
 		return lib.GetZStdMaxCompressionType(), nil
 	case "zstd_min":
 		return lib.GetZStdMinCompressionType(), nil
 	case "zstd_max":
 		return lib.GetZStdMaxCompressionType(), nil
+	case "zstd_dict":
+		return lib.GetZStdDictionaryDefaultCompressionType(), nil
+	case "zstd_dict_min":
+		return lib.GetZStdDictionaryMinCompressionType(), nil
+	case "zstd_dict_max":
+		return lib.GetZStdDictionaryMaxCompressionType(), nil
+	case "best":
+		return lib.GetBestOfCompressionType(), nil
 	}
 	return 0, fmt.Errorf("Unsupported compression algorithm: `%s`", *compressionAlgorithm)
 }
 
+const zstdDictionaryBlobName = "store.zdict"
+const zstdDictionaryMaxSize = 112640
+const zstdDictionarySampleSize = 4096
+const zstdDictionaryMaxSampleCount = 8192
+
+func isZStdDictionaryCompressionType(compressionType uint32) bool {
+	return compressionType == lib.GetZStdDictionaryMinCompressionType() ||
+		compressionType == lib.GetZStdDictionaryDefaultCompressionType() ||
+		compressionType == lib.GetZStdDictionaryMaxCompressionType()
+}
+
+// trainZStdDictionary samples the head of the files in a version, that is where the shared
+// boilerplate of small structured files (json, scripts) is
+func trainZStdDictionary(fileInfos lib.Longtail_FileInfos, rootPath string) ([]byte, error) {
+	paths := fileInfos.GetPaths()
+	fileSizes := fileInfos.GetFileSizes()
+	samples := make([][]byte, 0)
+	for i := uint32(0); i < fileInfos.GetFileCount() && len(samples) < zstdDictionaryMaxSampleCount; i++ {
+		sampleSize := fileSizes[i]
+		if sampleSize == 0 {
+			continue
+		}
+		if sampleSize > zstdDictionarySampleSize {
+			sampleSize = zstdDictionarySampleSize
+		}
+		f, err := os.Open(path.Join(rootPath, lib.GetPath(paths, i)))
+		if err != nil {
+			continue
+		}
+		sample := make([]byte, sampleSize)
+		_, err = io.ReadFull(f, sample)
+		f.Close()
+		if err != nil {
+			continue
+		}
+		samples = append(samples, sample)
+	}
+	return lib.TrainZStdDictionary(samples, zstdDictionaryMaxSize)
+}
+
+// createBestOfCompressionRegistry wraps compressionRegistry so the "best" compression algorithm
+// tries each of the candidate compression algorithms on every block
+func createBestOfCompressionRegistry(compressionRegistry lib.Longtail_CompressionRegistryAPI, candidateAlgorithms []string, maxSizeOverheadPercent uint32) (lib.Longtail_CompressionRegistryAPI, error) {
+	candidateTypes := make([]uint32, 0, len(candidateAlgorithms))
+	for _, candidateAlgorithm := range candidateAlgorithms {
+		candidateType, err := getCompressionType(&candidateAlgorithm)
+		if err != nil {
+			return compressionRegistry, err
+		}
+		if candidateType == noCompressionType || candidateType == lib.GetBestOfCompressionType() {
+			return compressionRegistry, fmt.Errorf("Unsupported best compression candidate: `%s`", candidateAlgorithm)
+		}
+		candidateTypes = append(candidateTypes, candidateType)
+	}
+	return lib.CreateBestOfCompressionRegistry(compressionRegistry, candidateTypes, maxSizeOverheadPercent)
+}
+
+// createCompressionRegistry includes the zstd dictionary compression types if the store has a dictionary
+func createCompressionRegistry(indexStore store.BlobStore) (lib.Longtail_CompressionRegistryAPI, error) {
+	dictionary, err := indexStore.GetBlob(context.Background(), zstdDictionaryBlobName)
+	if err != nil {
+		if store.IsNotExist(err) {
+			return lib.CreateDefaultCompressionRegistry(), nil
+		}
+		return lib.Longtail_CompressionRegistryAPI{}, err
+	}
+	if len(dictionary) == 0 {
+		return lib.CreateDefaultCompressionRegistry(), nil
+	}
+	return lib.CreateZStdDictionaryCompressionRegistry(dictionary)
+}
+
 func getCompressionTypesForFiles(fileInfos lib.Longtail_FileInfos, compressionType uint32) []uint32 {
 	pathCount := fileInfos.GetFileCount()
 	compressionTypes := make([]uint32, pathCount)
@@ -142,6 +226,9 @@ func createHashAPIFromIdentifier(hashIdentifier uint32) (lib.Longtail_HashAPI, e
 	if hashIdentifier == lib.GetBlake3HashIdentifier() {
 		return lib.CreateBlake3HashAPI(), nil
 	}
+	if hashIdentifier == lib.GetXXHash64HashIdentifier() {
+		return lib.CreateXXHash64HashAPI(), nil
+	}
 	return lib.Longtail_HashAPI{}, fmt.Errorf("not a supported hash identifier: `%d`", hashIdentifier)
 }
 
@@ -153,10 +240,45 @@ func createHashAPI(hashAlgorithm *string) (lib.Longtail_HashAPI, error) {
 		return createHashAPIFromIdentifier(lib.GetBlake2HashIdentifier())
 	case "blake3":
 		return createHashAPIFromIdentifier(lib.GetBlake3HashIdentifier())
+	case "xxhash64":
+		return createHashAPIFromIdentifier(lib.GetXXHash64HashIdentifier())
 	}
 	return lib.Longtail_HashAPI{}, fmt.Errorf("not a supportd hash api: `%s`", *hashAlgorithm)
 }
 
+func createJobAPI(jobScheduler *string, ioWorkerCount uint32) (lib.Longtail_JobAPI, error) {
+	switch *jobScheduler {
+	case "bikeshed":
+		return lib.CreateBikeshedJobAPIWithIOWorkers(uint32(runtime.NumCPU()), ioWorkerCount, lib.GetBikeshedDefaultProgressIntervalMS()), nil
+	case "workstealing":
+		return lib.CreateWorkStealingJobAPI(uint32(runtime.NumCPU())), nil
+	}
+	return lib.Longtail_JobAPI{}, fmt.Errorf("not a supported job scheduler: `%s`", *jobScheduler)
+}
+
+// cancelOnInterrupt cancels cancelToken when the process receives an interrupt signal,
+// the returned function stops listening and must be called before the token is disposed
+func cancelOnInterrupt(cancelAPI lib.Longtail_CancelAPI, cancelToken lib.Longtail_CancelToken) func() {
+	interrupt := make(chan os.Signal, 1)
+	done := make(chan struct{})
+	stopped := make(chan struct{})
+	signal.Notify(interrupt, os.Interrupt)
+	go func() {
+		defer close(stopped)
+		select {
+		case <-interrupt:
+			log.Printf("Interrupted, cancelling\n")
+			cancelAPI.Cancel(cancelToken)
+		case <-done:
+		}
+	}()
+	return func() {
+		signal.Stop(interrupt)
+		close(done)
+		<-stopped
+	}
+}
+
 func upSyncVersion(
 	blobStoreURI string,
 	sourceFolderPath string,
@@ -166,14 +288,30 @@ func upSyncVersion(
 	targetBlockSize uint32,
 	maxChunksPerBlock uint32,
 	compressionAlgorithm *string,
-	hashAlgorithm *string) error {
+	adaptiveCompression bool,
+	bestCompressionCandidates []string,
+	bestCompressionTolerance uint32,
+	hashAlgorithm *string,
+	jobScheduler *string,
+	ioWorkerCount uint32,
+	stats lib.Longtail_Stats) error {
 	//	defer un(trace("upSyncVersion " + targetFilePath))
 	fs := lib.CreateFSStorageAPI()
 	defer fs.Dispose()
-	jobs := lib.CreateBikeshedJobAPI(uint32(runtime.NumCPU()))
+	jobs, err := createJobAPI(jobScheduler, ioWorkerCount)
+	if err != nil {
+		return err
+	}
 	defer jobs.Dispose()
-	creg := lib.CreateDefaultCompressionRegistry()
-	defer creg.Dispose()
+
+	cancelAPI := lib.CreateAtomicCancelAPI()
+	defer cancelAPI.Dispose()
+	cancelToken, err := cancelAPI.CreateToken()
+	if err != nil {
+		return err
+	}
+	defer cancelAPI.DisposeToken(cancelToken)
+	defer cancelOnInterrupt(cancelAPI, cancelToken)()
 
 	//	log.Printf("Connecting to `%s`\n", blobStoreURI)
 	indexStore, err := createBlobStoreForURI(blobStoreURI)
@@ -228,6 +366,40 @@ func upSyncVersion(
 	if err != nil {
 		return err
 	}
+	if isZStdDictionaryCompressionType(compressionType) && !indexStore.HasBlob(context.Background(), zstdDictionaryBlobName) {
+		dictionary, err := trainZStdDictionary(fileInfos, sourceFolderPath)
+		if err != nil {
+			return err
+		}
+		// Blocks can only be decompressed with the dictionary they were compressed with so the dictionary
+		// is never replaced, if a concurrent upsync stored one first we use that one instead
+		_, err = indexStore.PutBlobIfAbsent(
+			context.Background(),
+			zstdDictionaryBlobName,
+			"application/octet-stream",
+			dictionary)
+		if err != nil {
+			return err
+		}
+	}
+
+	creg, err := createCompressionRegistry(indexStore)
+	if err != nil {
+		return err
+	}
+	if compressionType == lib.GetBestOfCompressionType() {
+		bestOfCreg, err := createBestOfCompressionRegistry(creg, bestCompressionCandidates, bestCompressionTolerance)
+		if err != nil {
+			creg.Dispose()
+			return err
+		}
+		creg = bestOfCreg
+	}
+	defer creg.Dispose()
+
+	if adaptiveCompression {
+		compressionType = lib.GetAdaptiveCompressionType(compressionType)
+	}
 	compressionTypes := getCompressionTypesForFiles(fileInfos, compressionType)
 
 	//	log.Printf("Indexing `%s`\n", sourceFolderPath)
@@ -237,6 +409,9 @@ func upSyncVersion(
 		jobs,
 		progress,
 		&progressData{task: "Indexing version"},
+		cancelAPI,
+		cancelToken,
+		stats,
 		sourceFolderPath,
 		fileInfos.GetPaths(),
 		fileInfos.GetFileSizes(),
@@ -271,6 +446,9 @@ func upSyncVersion(
 			jobs,
 			progress,
 			&progressData{task: "Writing content blocks"},
+			cancelAPI,
+			cancelToken,
+			stats,
 			missingContentIndex,
 			vindex,
 			sourceFolderPath,
@@ -310,23 +488,42 @@ func downSyncVersion(
 	targetChunkSize uint32,
 	targetBlockSize uint32,
 	maxChunksPerBlock uint32,
-	hashAlgorithm *string) error {
+	hashAlgorithm *string,
+	jobScheduler *string,
+	ioWorkerCount uint32,
+	stats lib.Longtail_Stats) error {
 	//	defer un(trace("downSyncVersion " + sourceFilePath))
 	fs := lib.CreateFSStorageAPI()
 	defer fs.Dispose()
-	jobs := lib.CreateBikeshedJobAPI(uint32(runtime.NumCPU()))
+	jobs, err := createJobAPI(jobScheduler, ioWorkerCount)
+	if err != nil {
+		return err
+	}
 	defer jobs.Dispose()
-	creg := lib.CreateDefaultCompressionRegistry()
-	defer creg.Dispose()
+
+	cancelAPI := lib.CreateAtomicCancelAPI()
+	defer cancelAPI.Dispose()
+	cancelToken, err := cancelAPI.CreateToken()
+	if err != nil {
+		return err
+	}
+	defer cancelAPI.DisposeToken(cancelToken)
+	defer cancelOnInterrupt(cancelAPI, cancelToken)()
 
 	//	log.Printf("Connecting to `%v`\n", blobStoreURI)
 	var indexStore store.BlobStore
-	indexStore, err := createBlobStoreForURI(blobStoreURI)
+	indexStore, err = createBlobStoreForURI(blobStoreURI)
 	if err != nil {
 		return err
 	}
 	defer indexStore.Close()
 
+	creg, err := createCompressionRegistry(indexStore)
+	if err != nil {
+		return err
+	}
+	defer creg.Dispose()
+
 	var hash lib.Longtail_HashAPI
 	//log.Printf("Fetching remote store index from `%s`\n", "store.lci")
 	var remoteContentIndex lib.Longtail_ContentIndex
@@ -389,6 +586,9 @@ func downSyncVersion(
 		jobs,
 		progress,
 		&progressData{task: "Indexing version"},
+		cancelAPI,
+		cancelToken,
+		stats,
 		targetFolderPath,
 		fileInfos.GetPaths(),
 		fileInfos.GetFileSizes(),
@@ -405,6 +605,7 @@ func downSyncVersion(
 		jobs,
 		progress,
 		&progressData{task: "Scanning local blocks"},
+		stats,
 		localCachePath)
 	if err != nil {
 		return err
@@ -461,6 +662,9 @@ func downSyncVersion(
 		jobs,
 		progress,
 		&progressData{task: "Updating version"},
+		cancelAPI,
+		cancelToken,
+		stats,
 		creg,
 		localContentIndex,
 		localVersionIndex,
@@ -474,6 +678,33 @@ func downSyncVersion(
 	return nil
 }
 
+func printStats(stats lib.Longtail_Stats) {
+	fmt.Printf("Bytes read:         %d\n", stats.GetBytesRead())
+	fmt.Printf("Bytes written:      %d\n", stats.GetBytesWritten())
+	fmt.Printf("Bytes hashed:       %d\n", stats.GetBytesHashed())
+	fmt.Printf("Bytes compressed:   %d\n", stats.GetBytesCompressed())
+	fmt.Printf("Bytes decompressed: %d\n", stats.GetBytesDecompressed())
+	fmt.Printf("Files opened:       %d\n", stats.GetFilesOpened())
+	fmt.Printf("Blocks read:        %d\n", stats.GetBlocksRead())
+	fmt.Printf("Jobs run:           %d\n", stats.GetJobsRun())
+	phaseNames := []string{"Hash assets", "Write blocks", "Scan blocks", "Write assets"}
+	for phase := 0; phase < lib.StatsPhaseCount; phase++ {
+		wallTime := time.Duration(stats.GetPhaseWallTimeUS(phase)) * time.Microsecond
+		cpuTime := time.Duration(stats.GetPhaseCPUTimeUS(phase)) * time.Microsecond
+		fmt.Printf("%-20s wall %v, cpu %v\n", phaseNames[phase]+":", wallTime, cpuTime)
+	}
+}
+
+func printMemStats(memTrackerAPI lib.Longtail_MemTrackerAPI) {
+	for tag := uint32(0); tag < lib.MemTagCount; tag++ {
+		tagStats, err := memTrackerAPI.GetTagStats(tag)
+		if err != nil {
+			continue
+		}
+		fmt.Printf("Memory %-12s peak %d bytes, %d allocations, %d bytes left in %d allocations\n", lib.GetMemTagName(tag)+":", tagStats.PeakBytes, tagStats.TotalCount, tagStats.CurrentBytes, tagStats.CurrentCount)
+	}
+}
+
 func parseLevel(lvl string) (int, error) {
 	switch strings.ToLower(lvl) {
 	case "debug":
@@ -497,15 +728,23 @@ var (
 	targetBlockSize   = kingpin.Flag("target-block-size", "Target block size").Default("524288").Uint32()
 	maxChunksPerBlock = kingpin.Flag("max-chunks-per-block", "Max chunks per block").Default("1024").Uint32()
 	storageURI        = kingpin.Flag("storage-uri", "Storage URI (only GCS bucket URI supported)").String()
-	hashing           = kingpin.Flag("hash-algorithm", "Hashing algorithm: blake2, blake3, meow").
+	hashing           = kingpin.Flag("hash-algorithm", "Hashing algorithm: blake2, blake3, meow, xxhash64").
 				Default("blake3").
-				Enum("meow", "blake2", "blake3")
+				Enum("meow", "blake2", "blake3", "xxhash64")
+	jobScheduler = kingpin.Flag("job-scheduler", "Job scheduler: bikeshed, workstealing").
+			Default("bikeshed").
+			Enum("bikeshed", "workstealing")
+	ioWorkerCount = kingpin.Flag("io-worker-count", "Extra workers for file reads and writes, zero runs them on the CPU workers").Default("0").Uint32()
+	tracePath     = kingpin.Flag("trace-path", "Write a Chrome trace (chrome://tracing, Perfetto) of the job system to this file").String()
+	poolAllocator = kingpin.Flag("pool-allocator", "Use pooled allocations with per thread caches instead of malloc").Bool()
+	trackMemory   = kingpin.Flag("track-memory", "Log current and peak memory per subsystem at the end of each operation and print it when done").Bool()
+	showStats     = kingpin.Flag("show-stats", "Print bytes read, written, hashed and compressed and time spent per phase when done").Bool()
 
 	commandUpSync     = kingpin.Command("upsync", "Upload a folder")
 	upSyncContentPath = commandUpSync.Flag("content-path", "Location to store blocks prepared for upload").Default(path.Join(os.TempDir(), "longtail_block_store")).String()
 	sourceFolderPath  = commandUpSync.Flag("source-path", "Source folder path").String()
 	targetFilePath    = commandUpSync.Flag("target-path", "Target file path relative to --storage-uri").String()
-	compression       = commandUpSync.Flag("compression-algorithm", "Compression algorithm: none, brotli[_min|_max], brotli_text[_min|_max], lizard[_min|_max], ztd[_min|_max]").
+	compression       = commandUpSync.Flag("compression-algorithm", "Compression algorithm: none, brotli[_min|_max], brotli_text[_min|_max], lizard[_min|_max|_fast], ztd[_min|_max], zstd_dict[_min|_max], best").
 				Default("zstd").
 				Enum(
 			"none",
@@ -518,9 +757,20 @@ var (
 			"lizard",
 			"lizard_min",
 			"lizard_max",
+			"lizard_fast",
 			"zstd",
 			"zstd_min",
-			"zstd_max")
+			"zstd_max",
+			"zstd_dict",
+			"zstd_dict_min",
+			"zstd_dict_max",
+			"best")
+
+	adaptiveCompression       = commandUpSync.Flag("adaptive-compression", "Store blocks that do not compress well uncompressed").Bool()
+	bestCompressionCandidates = commandUpSync.Flag("best-compression-candidate", "Compression algorithm tried by --compression-algorithm=best, repeat for each candidate, fastest to decompress first").
+					Default("lizard_max", "zstd_max", "brotli_max").
+					Strings()
+	bestCompressionTolerance = commandUpSync.Flag("best-compression-tolerance", "Percent larger than the smallest result --compression-algorithm=best accepts to use an earlier candidate").Default("0").Uint32()
 
 	commandDownSync     = kingpin.Command("downsync", "Download a folder")
 	downSyncContentPath = commandDownSync.Flag("content-path", "Location for downloaded/cached blocks").Default(path.Join(os.TempDir(), "longtail_block_store")).String()
@@ -537,6 +787,34 @@ func main() {
 	kingpin.CommandLine.DefaultEnvars()
 	kingpin.Parse()
 
+	// Must be the first thing the library allocates with and the last thing released
+	if *poolAllocator {
+		allocatorAPI := lib.CreatePoolAllocatorAPI()
+		err := lib.SetAllocatorAPI(allocatorAPI)
+		if err != nil {
+			log.Fatal(err)
+		}
+		defer func() {
+			err := lib.ClearAllocatorAPI()
+			if err != nil {
+				// Something allocated is still alive, the pool has to outlive it
+				log.Printf("Failed to clear the pool allocator: %v\n", err)
+				return
+			}
+			allocatorAPI.Dispose()
+		}()
+	}
+
+	if *trackMemory {
+		memTrackerAPI := lib.CreateMemTrackerAPI()
+		lib.SetMemTrackerAPI(memTrackerAPI)
+		defer func() {
+			printMemStats(memTrackerAPI)
+			lib.ClearMemTrackerAPI()
+			memTrackerAPI.Dispose()
+		}()
+	}
+
 	longtailLogLevel, err := parseLevel(*logLevel)
 	if err != nil {
 		log.Fatal(err)
@@ -549,14 +827,39 @@ func main() {
 	lib.SetAssert(cmdAssertFunc, nil)
 	defer lib.ClearAssert()
 
+	if *tracePath != "" {
+		traceAPI := lib.CreateChromeTraceAPI(lib.GetChromeTraceDefaultEventsPerThread())
+		lib.SetTraceAPI(traceAPI)
+		defer func() {
+			lib.ClearTraceAPI()
+			fs := lib.CreateFSStorageAPI()
+			defer fs.Dispose()
+			err := lib.WriteChromeTrace(traceAPI, fs, *tracePath)
+			if err != nil {
+				log.Printf("Failed to write trace: %v\n", err)
+			}
+			traceAPI.Dispose()
+		}()
+	}
+
+	var stats lib.Longtail_Stats
+	if *showStats {
+		lib.SetPlatformClocks()
+		stats = lib.CreateStats()
+		defer func() {
+			printStats(stats)
+			stats.Dispose()
+		}()
+	}
+
 	switch kingpin.Parse() {
 	case commandUpSync.FullCommand():
-		err := upSyncVersion(*storageURI, *sourceFolderPath, *targetFilePath, *upSyncContentPath, *targetChunkSize, *targetBlockSize, *maxChunksPerBlock, compression, hashing)
+		err := upSyncVersion(*storageURI, *sourceFolderPath, *targetFilePath, *upSyncContentPath, *targetChunkSize, *targetBlockSize, *maxChunksPerBlock, compression, *adaptiveCompression, *bestCompressionCandidates, *bestCompressionTolerance, hashing, jobScheduler, *ioWorkerCount, stats)
 		if err != nil {
 			log.Fatal(err)
 		}
 	case commandDownSync.FullCommand():
-		err := downSyncVersion(*storageURI, *sourceFilePath, *targetFolderPath, *downSyncContentPath, *targetChunkSize, *targetBlockSize, *maxChunksPerBlock, hashing)
+		err := downSyncVersion(*storageURI, *sourceFilePath, *targetFolderPath, *downSyncContentPath, *targetChunkSize, *targetBlockSize, *maxChunksPerBlock, hashing, jobScheduler, *ioWorkerCount, stats)
 		if err != nil {
 			log.Fatal(err)
 		}
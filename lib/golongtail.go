@@ -50,6 +50,72 @@ type Longtail_HashAPI struct {
 	cHashAPI *C.struct_Longtail_HashAPI
 }
 
+type Longtail_CancelAPI struct {
+	cCancelAPI *C.struct_Longtail_CancelAPI
+}
+
+type Longtail_CancelToken struct {
+	cCancelToken C.Longtail_CancelAPI_HCancelToken
+}
+
+type Longtail_TraceAPI struct {
+	cTraceAPI *C.struct_Longtail_TraceAPI
+}
+
+type Longtail_AllocatorAPI struct {
+	cAllocatorAPI *C.struct_Longtail_AllocatorAPI
+}
+
+type Longtail_PoolAllocatorStats struct {
+	SlabCount              uint64
+	SlabBytes              uint64
+	EmptySlabBytes         uint64
+	MaxShardEmptySlabBytes uint64
+	CreatedSlabCount       uint64
+	ReleasedSlabCount      uint64
+}
+
+type Longtail_MemTrackerAPI struct {
+	cMemTrackerAPI *C.struct_Longtail_MemTrackerAPI
+}
+
+type Longtail_MemTagStats struct {
+	CurrentBytes uint64
+	PeakBytes    uint64
+	CurrentCount uint64
+	TotalCount   uint64
+}
+
+const (
+	MemTagOther     = uint32(C.LONGTAIL_MEMTAG_OTHER)
+	MemTagIndex     = uint32(C.LONGTAIL_MEMTAG_INDEX)
+	MemTagBlockData = uint32(C.LONGTAIL_MEMTAG_BLOCK_DATA)
+	MemTagLookup    = uint32(C.LONGTAIL_MEMTAG_LOOKUP)
+	MemTagJobs      = uint32(C.LONGTAIL_MEMTAG_JOBS)
+	MemTagCount     = uint32(C.LONGTAIL_MEMTAG_COUNT)
+)
+
+type Longtail_SleepingJobs struct {
+	cSleepingJobs *C.struct_SleepingJobs
+}
+
+const (
+	JobChannelCPU = uint32(C.LONGTAIL_JOB_CHANNEL_CPU)
+	JobChannelIO  = uint32(C.LONGTAIL_JOB_CHANNEL_IO)
+)
+
+type Longtail_Stats struct {
+	cStats *C.struct_Longtail_Stats
+}
+
+const (
+	StatsPhaseHashAssets  = int(C.LONGTAIL_STATS_PHASE_HASH_ASSETS)
+	StatsPhaseWriteBlocks = int(C.LONGTAIL_STATS_PHASE_WRITE_BLOCKS)
+	StatsPhaseScanBlocks  = int(C.LONGTAIL_STATS_PHASE_SCAN_BLOCKS)
+	StatsPhaseWriteAssets = int(C.LONGTAIL_STATS_PHASE_WRITE_ASSETS)
+	StatsPhaseCount       = int(C.LONGTAIL_STATS_PHASE_COUNT)
+)
+
 var pointerIndex uint32
 var pointerStore [512]interface{}
 var pointerIndexer = (*[1 << 30]C.uint32_t)(C.malloc(4 * 512))
@@ -136,6 +202,32 @@ func WriteToStorage(storageAPI Longtail_StorageAPI, rootPath string, path string
 	return nil
 }
 
+// WriteToStorageInParts writes blockData to the file partSize bytes at a time so the file grows while it is open
+func WriteToStorageInParts(storageAPI Longtail_StorageAPI, rootPath string, path string, blockData []byte, partSize uint64) error {
+	cRootPath := C.CString(rootPath)
+	defer C.free(unsafe.Pointer(cRootPath))
+	cPath := C.CString(path)
+	defer C.free(unsafe.Pointer(cPath))
+	cFullPath := C.Storage_ConcatPath(storageAPI.cStorageAPI, cRootPath, cPath)
+	defer C.Longtail_Free(unsafe.Pointer(cFullPath))
+
+	errno := C.EnsureParentPathExists(storageAPI.cStorageAPI, cFullPath)
+	if errno != 0 {
+		return fmt.Errorf("WriteToStorageInParts: C.EnsureParentPathExists(`%s/%s`) failed with error %d", rootPath, path, errno)
+	}
+
+	blockSize := C.uint64_t(len(blockData))
+	var data unsafe.Pointer
+	if blockSize > 0 {
+		data = unsafe.Pointer(&blockData[0])
+	}
+	errno = C.Storage_WriteInParts(storageAPI.cStorageAPI, cFullPath, blockSize, data, C.uint64_t(partSize))
+	if errno != 0 {
+		return fmt.Errorf("WriteToStorageInParts: C.Storage_WriteInParts(`%s/%s`) failed with error %d", rootPath, path, errno)
+	}
+	return nil
+}
+
 type ProgressFunc func(context interface{}, total int, current int)
 
 type progressProxyData struct {
@@ -256,11 +348,66 @@ func CreateMeowHashAPI() Longtail_HashAPI {
 	return Longtail_HashAPI{cHashAPI: C.Longtail_CreateMeowHashAPI()}
 }
 
+// CreateXXHash64HashAPI ...
+func CreateXXHash64HashAPI() Longtail_HashAPI {
+	return Longtail_HashAPI{cHashAPI: C.Longtail_CreateXXHash64HashAPI()}
+}
+
 // Longtail_HashAPI.Dispose() ...
 func (hashAPI *Longtail_HashAPI) Dispose() {
 	C.Longtail_DisposeAPI(&hashAPI.cHashAPI.m_API)
 }
 
+// Longtail_HashAPI.HashBuffer() ...
+func (hashAPI *Longtail_HashAPI) HashBuffer(data []byte) (uint64, error) {
+	var hash C.uint64_t
+	var cData unsafe.Pointer
+	if len(data) > 0 {
+		cData = unsafe.Pointer(&data[0])
+	}
+	errno := C.HashAPI_HashBuffer(hashAPI.cHashAPI, C.uint32_t(len(data)), cData, &hash)
+	if errno != 0 {
+		return 0, fmt.Errorf("HashBuffer: C.HashAPI_HashBuffer() failed with error %d", errno)
+	}
+	return uint64(hash), nil
+}
+
+// Longtail_HashAPI.HashInParts() hashes data through a hash context, partSize bytes at a time
+func (hashAPI *Longtail_HashAPI) HashInParts(data []byte, partSize uint32) (uint64, error) {
+	var hash C.uint64_t
+	var cData unsafe.Pointer
+	if len(data) > 0 {
+		cData = unsafe.Pointer(&data[0])
+	}
+	errno := C.HashAPI_HashInParts(hashAPI.cHashAPI, C.uint32_t(len(data)), cData, C.uint32_t(partSize), &hash)
+	if errno != 0 {
+		return 0, fmt.Errorf("HashInParts: C.HashAPI_HashInParts() failed with error %d", errno)
+	}
+	return uint64(hash), nil
+}
+
+// Longtail_HashAPI.GetContextSize() ...
+func (hashAPI *Longtail_HashAPI) GetContextSize() uint32 {
+	return uint32(C.HashAPI_GetContextSize(hashAPI.cHashAPI))
+}
+
+// Longtail_HashAPI.HashInPlace() hashes data like HashInParts but keeps the hash context in contextMemory
+func (hashAPI *Longtail_HashAPI) HashInPlace(contextMemory []byte, data []byte, partSize uint32) (uint64, error) {
+	if len(contextMemory) < int(hashAPI.GetContextSize()+C.LONGTAIL_HASH_CONTEXT_ALIGNMENT) {
+		return 0, fmt.Errorf("HashInPlace: context memory of %d bytes is too small", len(contextMemory))
+	}
+	var hash C.uint64_t
+	var cData unsafe.Pointer
+	if len(data) > 0 {
+		cData = unsafe.Pointer(&data[0])
+	}
+	errno := C.HashAPI_HashInPlace(hashAPI.cHashAPI, unsafe.Pointer(&contextMemory[0]), C.uint32_t(len(data)), cData, C.uint32_t(partSize), &hash)
+	if errno != 0 {
+		return 0, fmt.Errorf("HashInPlace: C.HashAPI_HashInPlace() failed with error %d", errno)
+	}
+	return uint64(hash), nil
+}
+
 // GetBlake2HashIdentifier() ...
 func GetBlake2HashIdentifier() uint32 {
 	return uint32(C.GetBlake2HashIdentifier())
@@ -276,6 +423,11 @@ func GetMeowHashIdentifier() uint32 {
 	return uint32(C.GetMeowHashIdentifier())
 }
 
+// GetXXHash64HashIdentifier() ...
+func GetXXHash64HashIdentifier() uint32 {
+	return uint32(C.GetXXHash64HashIdentifier())
+}
+
 // CreateFSStorageAPI ...
 func CreateFSStorageAPI() Longtail_StorageAPI {
 	return Longtail_StorageAPI{cStorageAPI: C.Longtail_CreateFSStorageAPI()}
@@ -286,6 +438,28 @@ func CreateInMemStorageAPI() Longtail_StorageAPI {
 	return Longtail_StorageAPI{cStorageAPI: C.Longtail_CreateInMemStorageAPI()}
 }
 
+// CreateShapedStorageAPI wraps backingStorageAPI with latency, bandwidth and concurrency limits, zero disables a limit
+func CreateShapedStorageAPI(backingStorageAPI Longtail_StorageAPI, latencyUS uint64, readBytesPerSecond uint64, writeBytesPerSecond uint64, maxConcurrency uint32) Longtail_StorageAPI {
+	return Longtail_StorageAPI{cStorageAPI: C.Longtail_CreateShapedStorageAPI(
+		backingStorageAPI.cStorageAPI,
+		C.uint64_t(latencyUS),
+		C.uint64_t(readBytesPerSecond),
+		C.uint64_t(writeBytesPerSecond),
+		C.uint32_t(maxConcurrency))}
+}
+
+// CreateCacheStorageAPI caches files read from remoteStorageAPI in memory and in localCachePath of localStorageAPI, evicting the least recently used files
+func CreateCacheStorageAPI(remoteStorageAPI Longtail_StorageAPI, localStorageAPI Longtail_StorageAPI, localCachePath string, maxLocalCacheSize uint64, maxMemoryCacheSize uint64) Longtail_StorageAPI {
+	cLocalCachePath := C.CString(localCachePath)
+	defer C.free(unsafe.Pointer(cLocalCachePath))
+	return Longtail_StorageAPI{cStorageAPI: C.Longtail_CreateCacheStorageAPI(
+		remoteStorageAPI.cStorageAPI,
+		localStorageAPI.cStorageAPI,
+		cLocalCachePath,
+		C.uint64_t(maxLocalCacheSize),
+		C.uint64_t(maxMemoryCacheSize))}
+}
+
 // Longtail_StorageAPI.Dispose() ...
 func (storageAPI *Longtail_StorageAPI) Dispose() {
 	C.Longtail_DisposeAPI(&storageAPI.cStorageAPI.m_API)
@@ -316,16 +490,185 @@ func CreateBikeshedJobAPI(workerCount uint32) Longtail_JobAPI {
 	return Longtail_JobAPI{cJobAPI: C.Longtail_CreateBikeshedJobAPI(C.uint32_t(workerCount))}
 }
 
+// CreateBikeshedJobAPIWithProgressInterval ...
+func CreateBikeshedJobAPIWithProgressInterval(workerCount uint32, progressIntervalMS uint32) Longtail_JobAPI {
+	return Longtail_JobAPI{cJobAPI: C.Longtail_CreateBikeshedJobAPIWithProgressInterval(C.uint32_t(workerCount), C.uint32_t(progressIntervalMS))}
+}
+
+// GetBikeshedDefaultProgressIntervalMS ...
+func GetBikeshedDefaultProgressIntervalMS() uint32 {
+	return uint32(C.LONGTAIL_BIKESHED_DEFAULT_PROGRESS_INTERVAL_MS)
+}
+
+// CreateBikeshedJobAPIWithIOWorkers ...
+func CreateBikeshedJobAPIWithIOWorkers(workerCount uint32, ioWorkerCount uint32, progressIntervalMS uint32) Longtail_JobAPI {
+	return Longtail_JobAPI{cJobAPI: C.Longtail_CreateBikeshedJobAPIWithIOWorkers(C.uint32_t(workerCount), C.uint32_t(ioWorkerCount), C.uint32_t(progressIntervalMS))}
+}
+
+// CreateBikeshedJobAPIWithTaskCapacity ...
+func CreateBikeshedJobAPIWithTaskCapacity(workerCount uint32, ioWorkerCount uint32, progressIntervalMS uint32, initialTaskCapacity uint32) Longtail_JobAPI {
+	return Longtail_JobAPI{cJobAPI: C.Longtail_CreateBikeshedJobAPIWithTaskCapacity(C.uint32_t(workerCount), C.uint32_t(ioWorkerCount), C.uint32_t(progressIntervalMS), C.uint32_t(initialTaskCapacity))}
+}
+
+// CreateWorkStealingJobAPI ...
+func CreateWorkStealingJobAPI(workerCount uint32) Longtail_JobAPI {
+	return Longtail_JobAPI{cJobAPI: C.Longtail_CreateWorkStealingJobAPI(C.uint32_t(workerCount))}
+}
+
 // Longtail_JobAPI.Dispose() ...
 func (jobAPI *Longtail_JobAPI) Dispose() {
 	C.Longtail_DisposeAPI(&jobAPI.cJobAPI.m_API)
 }
 
+// StartSleepingJobs starts a job group of jobCount jobs that each sleep for sleepUS, created batchSize jobs at a time
+func StartSleepingJobs(jobAPI Longtail_JobAPI, jobCount uint32, batchSize uint32, channel uint32, sleepUS uint64) (Longtail_SleepingJobs, error) {
+	var jobs *C.struct_SleepingJobs
+	errno := C.SleepingJobs_Start(jobAPI.cJobAPI, C.uint32_t(jobCount), C.uint32_t(batchSize), C.uint32_t(channel), C.uint64_t(sleepUS), &jobs)
+	if errno != 0 {
+		return Longtail_SleepingJobs{cSleepingJobs: nil}, fmt.Errorf("StartSleepingJobs: C.SleepingJobs_Start(%d) failed with error %d", jobCount, errno)
+	}
+	return Longtail_SleepingJobs{cSleepingJobs: jobs}, nil
+}
+
+// Longtail_SleepingJobs.Wait() waits for the job group with a progress callback that counts its calls
+func (jobs *Longtail_SleepingJobs) Wait() error {
+	errno := C.SleepingJobs_Wait(jobs.cSleepingJobs)
+	if errno != 0 {
+		return fmt.Errorf("Wait: C.SleepingJobs_Wait() failed with error %d", errno)
+	}
+	return nil
+}
+
+// Longtail_SleepingJobs.Dispose() ...
+func (jobs *Longtail_SleepingJobs) Dispose() {
+	C.Longtail_Free(unsafe.Pointer(jobs.cSleepingJobs))
+}
+
+func (jobs *Longtail_SleepingJobs) GetStartedCount() int {
+	return int(C.Longtail_AtomicAdd32(&jobs.cSleepingJobs.m_StartedCount, 0))
+}
+
+func (jobs *Longtail_SleepingJobs) GetDoneCount() int {
+	return int(C.Longtail_AtomicAdd32(&jobs.cSleepingJobs.m_DoneCount, 0))
+}
+
+func (jobs *Longtail_SleepingJobs) GetMaxRunningCount() int {
+	return int(C.Longtail_AtomicAdd32(&jobs.cSleepingJobs.m_MaxRunningCount, 0))
+}
+
+func (jobs *Longtail_SleepingJobs) GetProgressCount() int {
+	return int(C.Longtail_AtomicAdd32(&jobs.cSleepingJobs.m_ProgressCount, 0))
+}
+
+// CreateAtomicCancelAPI ...
+func CreateAtomicCancelAPI() Longtail_CancelAPI {
+	return Longtail_CancelAPI{cCancelAPI: C.Longtail_CreateAtomicCancelAPI()}
+}
+
+// Longtail_CancelAPI.Dispose() ...
+func (cancelAPI *Longtail_CancelAPI) Dispose() {
+	C.Longtail_DisposeAPI(&cancelAPI.cCancelAPI.m_API)
+}
+
+// Longtail_CancelAPI.CreateToken() ...
+func (cancelAPI *Longtail_CancelAPI) CreateToken() (Longtail_CancelToken, error) {
+	var cCancelToken C.Longtail_CancelAPI_HCancelToken
+	errno := C.CancelAPI_CreateToken(cancelAPI.cCancelAPI, &cCancelToken)
+	if errno != 0 {
+		return Longtail_CancelToken{cCancelToken: nil}, fmt.Errorf("CreateToken: C.CancelAPI_CreateToken() failed with error %d", errno)
+	}
+	return Longtail_CancelToken{cCancelToken: cCancelToken}, nil
+}
+
+// Longtail_CancelAPI.Cancel() ...
+func (cancelAPI *Longtail_CancelAPI) Cancel(token Longtail_CancelToken) error {
+	errno := C.CancelAPI_Cancel(cancelAPI.cCancelAPI, token.cCancelToken)
+	if errno != 0 {
+		return fmt.Errorf("Cancel: C.CancelAPI_Cancel() failed with error %d", errno)
+	}
+	return nil
+}
+
+// Longtail_CancelAPI.DisposeToken() ...
+func (cancelAPI *Longtail_CancelAPI) DisposeToken(token Longtail_CancelToken) error {
+	errno := C.CancelAPI_DisposeToken(cancelAPI.cCancelAPI, token.cCancelToken)
+	if errno != 0 {
+		return fmt.Errorf("DisposeToken: C.CancelAPI_DisposeToken() failed with error %d", errno)
+	}
+	return nil
+}
+
 // Longtail_CreateDefaultCompressionRegistry ...
 func CreateDefaultCompressionRegistry() Longtail_CompressionRegistryAPI {
 	return Longtail_CompressionRegistryAPI{cCompressionRegistryAPI: C.CompressionRegistry_CreateDefault()}
 }
 
+// CreateZStdDictionaryCompressionRegistry ...
+func CreateZStdDictionaryCompressionRegistry(dictionary []byte) (Longtail_CompressionRegistryAPI, error) {
+	if len(dictionary) == 0 {
+		return Longtail_CompressionRegistryAPI{cCompressionRegistryAPI: nil}, fmt.Errorf("CreateZStdDictionaryCompressionRegistry: dictionary is empty")
+	}
+	registry := C.CompressionRegistry_CreateWithZStdDictionary(unsafe.Pointer(&dictionary[0]), C.size_t(len(dictionary)))
+	if registry == nil {
+		return Longtail_CompressionRegistryAPI{cCompressionRegistryAPI: nil}, fmt.Errorf("CreateZStdDictionaryCompressionRegistry: C.CompressionRegistry_CreateWithZStdDictionary() failed")
+	}
+	return Longtail_CompressionRegistryAPI{cCompressionRegistryAPI: registry}, nil
+}
+
+// CreateBestOfCompressionRegistry takes ownership of compressionRegistry if it succeeds
+func CreateBestOfCompressionRegistry(compressionRegistry Longtail_CompressionRegistryAPI, candidateTypes []uint32, maxSizeOverheadPercent uint32) (Longtail_CompressionRegistryAPI, error) {
+	if len(candidateTypes) == 0 || len(candidateTypes) > int(C.LONGTAIL_MAX_COMPRESSION_CANDIDATES) {
+		return Longtail_CompressionRegistryAPI{cCompressionRegistryAPI: nil}, fmt.Errorf("CreateBestOfCompressionRegistry: unsupported candidate count %d", len(candidateTypes))
+	}
+	registry := C.Longtail_CreateBestOfCompressionRegistry(
+		compressionRegistry.cCompressionRegistryAPI,
+		C.uint32_t(C.LONGTAIL_BEST_OF_COMPRESSION_TYPE),
+		C.uint32_t(len(candidateTypes)),
+		(*C.uint32_t)(unsafe.Pointer(&candidateTypes[0])),
+		C.uint32_t(maxSizeOverheadPercent))
+	if registry == nil {
+		return Longtail_CompressionRegistryAPI{cCompressionRegistryAPI: nil}, fmt.Errorf("CreateBestOfCompressionRegistry: C.Longtail_CreateBestOfCompressionRegistry() failed")
+	}
+	return Longtail_CompressionRegistryAPI{cCompressionRegistryAPI: registry}, nil
+}
+
+// TrainZStdDictionary ...
+func TrainZStdDictionary(samples [][]byte, maxDictionarySize uint32) ([]byte, error) {
+	sampleSizes := make([]C.size_t, 0, len(samples))
+	samplesBuffer := make([]byte, 0)
+	for _, sample := range samples {
+		if len(sample) == 0 {
+			continue
+		}
+		sampleSizes = append(sampleSizes, C.size_t(len(sample)))
+		samplesBuffer = append(samplesBuffer, sample...)
+	}
+	if len(sampleSizes) == 0 || maxDictionarySize == 0 {
+		return nil, fmt.Errorf("TrainZStdDictionary: no samples to train from")
+	}
+	dictionary := make([]byte, int(maxDictionarySize))
+	dictionarySize := C.size_t(0)
+	errno := C.Longtail_TrainZStdDictionary(
+		unsafe.Pointer(&samplesBuffer[0]),
+		(*C.size_t)(unsafe.Pointer(&sampleSizes[0])),
+		C.uint32_t(len(sampleSizes)),
+		C.size_t(maxDictionarySize),
+		unsafe.Pointer(&dictionary[0]),
+		&dictionarySize)
+	if errno != 0 {
+		return nil, fmt.Errorf("TrainZStdDictionary: C.Longtail_TrainZStdDictionary() failed with error %d", errno)
+	}
+	return dictionary[:int(dictionarySize)], nil
+}
+
+// GetZStdDictionaryID ...
+func GetZStdDictionaryID(dictionary []byte) uint32 {
+	if len(dictionary) == 0 {
+		return 0
+	}
+	return uint32(C.Longtail_GetZStdDictionaryId(unsafe.Pointer(&dictionary[0]), C.size_t(len(dictionary))))
+}
+
 // Longtail_CompressionRegistryAPI ...
 func (compressionRegistry *Longtail_CompressionRegistryAPI) Dispose() {
 	C.Longtail_DisposeAPI(&compressionRegistry.cCompressionRegistryAPI.m_API)
@@ -381,6 +724,11 @@ func GetLizardMaxCompressionType() uint32 {
 	return uint32(C.LONGTAIL_LIZARD_MAX_COMPRESSION_TYPE)
 }
 
+// GetLizardFastCompressionType ...
+func GetLizardFastCompressionType() uint32 {
+	return uint32(C.LONGTAIL_LIZARD_FAST_COMPRESSION_TYPE)
+}
+
 // GetZStdMinCompressionType ...
 func GetZStdMinCompressionType() uint32 {
 	return uint32(C.LONGTAIL_ZSTD_MIN_COMPRESSION_TYPE)
@@ -396,6 +744,34 @@ func GetZStdMaxCompressionType() uint32 {
 	return uint32(C.LONGTAIL_ZSTD_MAX_COMPRESSION_TYPE)
 }
 
+// GetZStdDictionaryMinCompressionType ...
+func GetZStdDictionaryMinCompressionType() uint32 {
+	return uint32(C.LONGTAIL_ZSTD_DICTIONARY_MIN_COMPRESSION_TYPE)
+}
+
+// GetZStdDictionaryDefaultCompressionType ...
+func GetZStdDictionaryDefaultCompressionType() uint32 {
+	return uint32(C.LONGTAIL_ZSTD_DICTIONARY_DEFAULT_COMPRESSION_TYPE)
+}
+
+// GetZStdDictionaryMaxCompressionType ...
+func GetZStdDictionaryMaxCompressionType() uint32 {
+	return uint32(C.LONGTAIL_ZSTD_DICTIONARY_MAX_COMPRESSION_TYPE)
+}
+
+// GetBestOfCompressionType ...
+func GetBestOfCompressionType() uint32 {
+	return uint32(C.LONGTAIL_BEST_OF_COMPRESSION_TYPE)
+}
+
+// GetAdaptiveCompressionType ...
+func GetAdaptiveCompressionType(compressionType uint32) uint32 {
+	if compressionType == GetNoCompressionType() {
+		return compressionType
+	}
+	return compressionType | uint32(C.LONGTAIL_ADAPTIVE_COMPRESSION_FLAG)
+}
+
 // LongtailAlloc ...
 func LongtailAlloc(size uint64) unsafe.Pointer {
 	return C.Longtail_Alloc(C.size_t(size))
@@ -437,6 +813,9 @@ func CreateVersionIndex(
 	jobAPI Longtail_JobAPI,
 	progressFunc ProgressFunc,
 	progressContext interface{},
+	cancelAPI Longtail_CancelAPI,
+	cancelToken Longtail_CancelToken,
+	stats Longtail_Stats,
 	rootPath string,
 	paths Longtail_Paths,
 	assetSizes []uint64,
@@ -466,6 +845,9 @@ func CreateVersionIndex(
 		jobAPI.cJobAPI,
 		(C.Longtail_JobAPI_ProgressFunc)(C.progressProxy),
 		cProgressProxyData,
+		cancelAPI.cCancelAPI,
+		cancelToken.cCancelToken,
+		stats.cStats,
 		cRootPath,
 		paths.cPaths,
 		(*C.uint64_t)(cAssetSizes),
@@ -552,6 +934,7 @@ func CreateContentIndex(
 		if errno != 0 {
 			return Longtail_ContentIndex{cContentIndex: nil}, fmt.Errorf("CreateContentIndex: C.Longtail_CreateContentIndex(%d) failed with error %d", chunkCount, errno)
 		}
+		return Longtail_ContentIndex{cContentIndex: cindex}, nil
 	}
 	var cChunkHashes *C.TLongtail_Hash
 	var cChunkSizes *C.uint32_t
@@ -635,6 +1018,9 @@ func WriteContent(
 	jobAPI Longtail_JobAPI,
 	progressFunc ProgressFunc,
 	progressContext interface{},
+	cancelAPI Longtail_CancelAPI,
+	cancelToken Longtail_CancelToken,
+	stats Longtail_Stats,
 	contentIndex Longtail_ContentIndex,
 	versionIndex Longtail_VersionIndex,
 	versionFolderPath string,
@@ -657,6 +1043,9 @@ func WriteContent(
 		jobAPI.cJobAPI,
 		(C.Longtail_JobAPI_ProgressFunc)(C.progressProxy),
 		cProgressProxyData,
+		cancelAPI.cCancelAPI,
+		cancelToken.cCancelToken,
+		stats.cStats,
 		contentIndex.cContentIndex,
 		versionIndex.cVersionIndex,
 		cVersionFolderPath,
@@ -674,6 +1063,7 @@ func ReadContent(
 	jobAPI Longtail_JobAPI,
 	progressFunc ProgressFunc,
 	progressContext interface{},
+	stats Longtail_Stats,
 	contentFolderPath string) (Longtail_ContentIndex, error) {
 
 	progressProxyData := makeProgressProxy(progressFunc, progressContext)
@@ -690,6 +1080,7 @@ func ReadContent(
 		jobAPI.cJobAPI,
 		(C.Longtail_JobAPI_ProgressFunc)(C.progressProxy),
 		cProgressProxyData,
+		stats.cStats,
 		cContentFolderPath,
 		&contentIndex)
 	if errno != 0 {
@@ -762,6 +1153,7 @@ func WriteVersion(
 	jobAPI Longtail_JobAPI,
 	progressFunc ProgressFunc,
 	progressContext interface{},
+	stats Longtail_Stats,
 	contentIndex Longtail_ContentIndex,
 	versionIndex Longtail_VersionIndex,
 	contentFolderPath string,
@@ -784,6 +1176,7 @@ func WriteVersion(
 		jobAPI.cJobAPI,
 		(C.Longtail_JobAPI_ProgressFunc)(C.progressProxy),
 		cProgressProxyData,
+		stats.cStats,
 		contentIndex.cContentIndex,
 		versionIndex.cVersionIndex,
 		cContentFolderPath,
@@ -814,6 +1207,9 @@ func ChangeVersion(
 	jobAPI Longtail_JobAPI,
 	progressFunc ProgressFunc,
 	progressContext interface{},
+	cancelAPI Longtail_CancelAPI,
+	cancelToken Longtail_CancelToken,
+	stats Longtail_Stats,
 	compressionRegistryAPI Longtail_CompressionRegistryAPI,
 	contentIndex Longtail_ContentIndex,
 	sourceVersionIndex Longtail_VersionIndex,
@@ -839,6 +1235,9 @@ func ChangeVersion(
 		jobAPI.cJobAPI,
 		(C.Longtail_JobAPI_ProgressFunc)(C.progressProxy),
 		cProgressProxyData,
+		cancelAPI.cCancelAPI,
+		cancelToken.cCancelToken,
+		stats.cStats,
 		compressionRegistryAPI.cCompressionRegistryAPI,
 		contentIndex.cContentIndex,
 		sourceVersionIndex.cVersionIndex,
@@ -884,6 +1283,195 @@ func SetLogLevel(level int) {
 	C.Longtail_SetLogLevel(C.int(level))
 }
 
+// CreateChromeTraceAPI ...
+func CreateChromeTraceAPI(eventsPerThread uint32) Longtail_TraceAPI {
+	return Longtail_TraceAPI{cTraceAPI: C.Longtail_CreateChromeTraceAPI(C.uint32_t(eventsPerThread))}
+}
+
+// GetChromeTraceDefaultEventsPerThread ...
+func GetChromeTraceDefaultEventsPerThread() uint32 {
+	return uint32(C.LONGTAIL_CHROMETRACE_DEFAULT_EVENTS_PER_THREAD)
+}
+
+// WriteChromeTrace ...
+func WriteChromeTrace(traceAPI Longtail_TraceAPI, storageAPI Longtail_StorageAPI, path string) error {
+	cPath := C.CString(path)
+	defer C.free(unsafe.Pointer(cPath))
+	errno := C.Longtail_ChromeTrace_Write(traceAPI.cTraceAPI, storageAPI.cStorageAPI, cPath)
+	if errno != 0 {
+		return fmt.Errorf("WriteChromeTrace: C.Longtail_ChromeTrace_Write(`%s`) failed with error %d", path, errno)
+	}
+	return nil
+}
+
+// Longtail_TraceAPI.Dispose() ...
+func (traceAPI *Longtail_TraceAPI) Dispose() {
+	C.Longtail_DisposeAPI(&traceAPI.cTraceAPI.m_API)
+}
+
+// Longtail_TraceAPI.TraceScope() records an empty scope on the calling thread
+func (traceAPI *Longtail_TraceAPI) TraceScope() {
+	C.TraceAPI_TraceScope(traceAPI.cTraceAPI)
+}
+
+//SetTraceAPI ...
+func SetTraceAPI(traceAPI Longtail_TraceAPI) {
+	C.Longtail_SetTraceAPI(traceAPI.cTraceAPI)
+}
+
+//ClearTraceAPI ...
+func ClearTraceAPI() {
+	C.Longtail_SetTraceAPI(nil)
+}
+
+// CreatePoolAllocatorAPI ...
+func CreatePoolAllocatorAPI() Longtail_AllocatorAPI {
+	return Longtail_AllocatorAPI{cAllocatorAPI: C.Longtail_CreatePoolAllocatorAPI()}
+}
+
+// CreateArenaAllocatorAPI ...
+func CreateArenaAllocatorAPI(chunkSize uint32) Longtail_AllocatorAPI {
+	return Longtail_AllocatorAPI{cAllocatorAPI: C.Longtail_CreateArenaAllocatorAPI(C.uint32_t(chunkSize))}
+}
+
+// Longtail_AllocatorAPI.Dispose() ...
+func (allocatorAPI *Longtail_AllocatorAPI) Dispose() {
+	C.Longtail_DisposeAPI(&allocatorAPI.cAllocatorAPI.m_API)
+}
+
+// Longtail_AllocatorAPI.GetPoolStats() is only valid for an allocator created with CreatePoolAllocatorAPI
+func (allocatorAPI *Longtail_AllocatorAPI) GetPoolStats() (Longtail_PoolAllocatorStats, error) {
+	var cStats C.struct_Longtail_PoolAllocatorStats
+	errno := C.Longtail_PoolAllocator_GetStats(allocatorAPI.cAllocatorAPI, &cStats)
+	if errno != 0 {
+		return Longtail_PoolAllocatorStats{}, fmt.Errorf("GetPoolStats: C.Longtail_PoolAllocator_GetStats() failed with error %d", errno)
+	}
+	return Longtail_PoolAllocatorStats{
+		SlabCount:              uint64(cStats.m_SlabCount),
+		SlabBytes:              uint64(cStats.m_SlabBytes),
+		EmptySlabBytes:         uint64(cStats.m_EmptySlabBytes),
+		MaxShardEmptySlabBytes: uint64(cStats.m_MaxShardEmptySlabBytes),
+		CreatedSlabCount:       uint64(cStats.m_CreatedSlabCount),
+		ReleasedSlabCount:      uint64(cStats.m_ReleasedSlabCount)}, nil
+}
+
+//SetAllocatorAPI must be called before anything is allocated by the library, fails if anything allocated is still alive
+func SetAllocatorAPI(allocatorAPI Longtail_AllocatorAPI) error {
+	errno := C.Longtail_SetAllocatorAPI(allocatorAPI.cAllocatorAPI)
+	if errno != 0 {
+		return fmt.Errorf("SetAllocatorAPI: C.Longtail_SetAllocatorAPI() failed with error %d", errno)
+	}
+	return nil
+}
+
+//ClearAllocatorAPI must be called after everything allocated by the library is released, fails if anything is still alive
+func ClearAllocatorAPI() error {
+	errno := C.Longtail_SetAllocatorAPI(nil)
+	if errno != 0 {
+		return fmt.Errorf("ClearAllocatorAPI: C.Longtail_SetAllocatorAPI() failed with error %d", errno)
+	}
+	return nil
+}
+
+// CreateMemTrackerAPI ...
+func CreateMemTrackerAPI() Longtail_MemTrackerAPI {
+	return Longtail_MemTrackerAPI{cMemTrackerAPI: C.Longtail_CreateMemTrackerAPI()}
+}
+
+// Longtail_MemTrackerAPI.Dispose() ...
+func (memTrackerAPI *Longtail_MemTrackerAPI) Dispose() {
+	C.Longtail_DisposeAPI(&memTrackerAPI.cMemTrackerAPI.m_API)
+}
+
+// Longtail_MemTrackerAPI.GetTagStats() ...
+func (memTrackerAPI *Longtail_MemTrackerAPI) GetTagStats(tag uint32) (Longtail_MemTagStats, error) {
+	var cStats C.struct_Longtail_MemTagStats
+	errno := C.MemTrackerAPI_GetTagStats(memTrackerAPI.cMemTrackerAPI, C.uint32_t(tag), &cStats)
+	if errno != 0 {
+		return Longtail_MemTagStats{}, fmt.Errorf("GetTagStats: C.MemTrackerAPI_GetTagStats() failed with error %d", errno)
+	}
+	return Longtail_MemTagStats{
+		CurrentBytes: uint64(cStats.m_CurrentBytes),
+		PeakBytes:    uint64(cStats.m_PeakBytes),
+		CurrentCount: uint64(cStats.m_CurrentCount),
+		TotalCount:   uint64(cStats.m_TotalCount)}, nil
+}
+
+// Longtail_MemTrackerAPI.ResetPeaks() ...
+func (memTrackerAPI *Longtail_MemTrackerAPI) ResetPeaks() {
+	C.MemTrackerAPI_ResetPeaks(memTrackerAPI.cMemTrackerAPI)
+}
+
+//GetMemTagName ...
+func GetMemTagName(tag uint32) string {
+	return C.GoString(C.Longtail_GetMemTagName(C.uint32_t(tag)))
+}
+
+//SetMemTrackerAPI must be called before anything is allocated by the library
+func SetMemTrackerAPI(memTrackerAPI Longtail_MemTrackerAPI) {
+	C.Longtail_SetMemTrackerAPI(memTrackerAPI.cMemTrackerAPI)
+}
+
+//ClearMemTrackerAPI must be called after everything allocated by the library is released
+func ClearMemTrackerAPI() {
+	C.Longtail_SetMemTrackerAPI(nil)
+}
+
+// CreateStats ...
+func CreateStats() Longtail_Stats {
+	return Longtail_Stats{cStats: C.CreateStats()}
+}
+
+// Longtail_Stats.Dispose() ...
+func (stats *Longtail_Stats) Dispose() {
+	C.Longtail_Free(unsafe.Pointer(stats.cStats))
+}
+
+func (stats *Longtail_Stats) GetBytesRead() uint64 {
+	return uint64(stats.cStats.m_BytesRead)
+}
+
+func (stats *Longtail_Stats) GetBytesWritten() uint64 {
+	return uint64(stats.cStats.m_BytesWritten)
+}
+
+func (stats *Longtail_Stats) GetBytesHashed() uint64 {
+	return uint64(stats.cStats.m_BytesHashed)
+}
+
+func (stats *Longtail_Stats) GetBytesCompressed() uint64 {
+	return uint64(stats.cStats.m_BytesCompressed)
+}
+
+func (stats *Longtail_Stats) GetBytesDecompressed() uint64 {
+	return uint64(stats.cStats.m_BytesDecompressed)
+}
+
+func (stats *Longtail_Stats) GetFilesOpened() uint64 {
+	return uint64(stats.cStats.m_FilesOpened)
+}
+
+func (stats *Longtail_Stats) GetBlocksRead() uint64 {
+	return uint64(stats.cStats.m_BlocksRead)
+}
+
+func (stats *Longtail_Stats) GetJobsRun() uint64 {
+	return uint64(stats.cStats.m_JobsRun)
+}
+
+func (stats *Longtail_Stats) GetPhaseWallTimeUS(phase int) uint64 {
+	return uint64(stats.cStats.m_PhaseWallTimeUS[phase])
+}
+
+func (stats *Longtail_Stats) GetPhaseCPUTimeUS(phase int) uint64 {
+	return uint64(stats.cStats.m_PhaseCPUTimeUS[phase])
+}
+
+//SetPlatformClocks measures phase times in Longtail_Stats
+func SetPlatformClocks() {
+	C.SetPlatformClocks()
+}
+
 var activeAssertFunc assertFunc
 var activeAssertContext interface{}
 
@@ -1,15 +1,26 @@
 #define _GNU_SOURCE
 #include "import/src/longtail.h"
+#include "import/lib/longtail_platform.h"
+#include "import/lib/atomiccancel/longtail_atomiccancel.h"
 #include "import/lib/bikeshed/longtail_bikeshed.h"
 #include "import/lib/blake2/longtail_blake2.h"
 #include "import/lib/blake3/longtail_blake3.h"
 #include "import/lib/brotli/longtail_brotli.h"
+#include "import/lib/cachestorage/longtail_cachestorage.h"
+#include "import/lib/chrometrace/longtail_chrometrace.h"
 #include "import/lib/filestorage/longtail_filestorage.h"
 #include "import/lib/lizard/longtail_lizard.h"
 #include "import/lib/memstorage/longtail_memstorage.h"
+#include "import/lib/memtracker/longtail_memtracker.h"
 #include "import/lib/meowhash/longtail_meowhash.h"
+#include "import/lib/poolallocator/longtail_poolallocator.h"
+#include "import/lib/shapedstorage/longtail_shapedstorage.h"
+#include "import/lib/workstealing/longtail_workstealing.h"
+#include "import/lib/xxhash64/longtail_xxhash64.h"
 #include "import/lib/zstd/longtail_zstd.h"
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
 void progressProxy(void* context, uint32_t total_count, uint32_t done_count);
 
@@ -30,6 +41,25 @@ static int Storage_Write(struct Longtail_StorageAPI* api, const char* path, uint
     return err;
 }
 
+static int Storage_WriteInParts(struct Longtail_StorageAPI* api, const char* path, uint64_t length, const void* input, uint64_t part_size)
+{
+    Longtail_StorageAPI_HOpenFile f;
+    int err = api->OpenWriteFile(api, path, 0, &f);
+    if (err)
+    {
+        return err;
+    }
+    uint64_t offset = 0;
+    while (offset < length && err == 0)
+    {
+        uint64_t size = (length - offset) < part_size ? (length - offset) : part_size;
+        err = api->Write(api, f, offset, size, &((const uint8_t*)input)[offset]);
+        offset += size;
+    }
+    api->CloseFile(api, f);
+    return err;
+}
+
 static uint64_t Storage_GetSize(struct Longtail_StorageAPI* api, const char* path)
 {
     Longtail_StorageAPI_HOpenFile f;
@@ -62,6 +92,186 @@ static char* Storage_ConcatPath(struct Longtail_StorageAPI* api, const char* roo
     return api->ConcatPath(api, root_path, sub_path);
 }
 
+static int CancelAPI_CreateToken(struct Longtail_CancelAPI* api, Longtail_CancelAPI_HCancelToken* out_token)
+{
+    return api->CreateToken(api, out_token);
+}
+
+static int CancelAPI_Cancel(struct Longtail_CancelAPI* api, Longtail_CancelAPI_HCancelToken token)
+{
+    return api->Cancel(api, token);
+}
+
+static int CancelAPI_DisposeToken(struct Longtail_CancelAPI* api, Longtail_CancelAPI_HCancelToken token)
+{
+    return api->DisposeToken(api, token);
+}
+
+static int MemTrackerAPI_GetTagStats(struct Longtail_MemTrackerAPI* api, uint32_t tag, struct Longtail_MemTagStats* out_stats)
+{
+    return api->GetTagStats(api, tag, out_stats);
+}
+
+static void MemTrackerAPI_ResetPeaks(struct Longtail_MemTrackerAPI* api)
+{
+    api->ResetPeaks(api);
+}
+
+static int HashAPI_HashBuffer(struct Longtail_HashAPI* api, uint32_t length, const void* data, uint64_t* out_hash)
+{
+    return api->HashBuffer(api, length, data, out_hash);
+}
+
+static int HashAPI_HashInParts(struct Longtail_HashAPI* api, uint32_t length, const void* data, uint32_t part_size, uint64_t* out_hash)
+{
+    Longtail_HashAPI_HContext context;
+    int err = api->BeginContext(api, &context);
+    if (err)
+    {
+        return err;
+    }
+    uint32_t offset = 0;
+    while (offset < length)
+    {
+        uint32_t size = (length - offset) < part_size ? (length - offset) : part_size;
+        api->Hash(api, context, size, &((const uint8_t*)data)[offset]);
+        offset += size;
+    }
+    *out_hash = api->EndContext(api, context);
+    return 0;
+}
+
+static uint32_t HashAPI_GetContextSize(struct Longtail_HashAPI* api)
+{
+    return api->GetContextSize(api);
+}
+
+// `context_memory` must hold GetContextSize + LONGTAIL_HASH_CONTEXT_ALIGNMENT bytes, the context is aligned inside it
+static int HashAPI_HashInPlace(struct Longtail_HashAPI* api, void* context_memory, uint32_t length, const void* data, uint32_t part_size, uint64_t* out_hash)
+{
+    void* aligned_memory = (void*)(((uintptr_t)context_memory + (LONGTAIL_HASH_CONTEXT_ALIGNMENT - 1)) & ~(uintptr_t)(LONGTAIL_HASH_CONTEXT_ALIGNMENT - 1));
+    Longtail_HashAPI_HContext context;
+    int err = api->BeginContextInPlace(api, aligned_memory, &context);
+    if (err)
+    {
+        return err;
+    }
+    uint32_t offset = 0;
+    while (offset < length)
+    {
+        uint32_t size = (length - offset) < part_size ? (length - offset) : part_size;
+        api->Hash(api, context, size, &((const uint8_t*)data)[offset]);
+        offset += size;
+    }
+    *out_hash = api->EndContextInPlace(api, context);
+    return 0;
+}
+
+// A job group of jobs that sleep for a while and record how many of them run at the same time
+struct SleepingJobs
+{
+    struct Longtail_JobAPI* m_JobAPI;
+    Longtail_JobAPI_Group m_Group;
+    uint64_t m_SleepUS;
+    TLongtail_Atomic32 m_StartedCount;
+    TLongtail_Atomic32 m_DoneCount;
+    TLongtail_Atomic32 m_RunningCount;
+    TLongtail_Atomic32 m_MaxRunningCount;
+    TLongtail_Atomic32 m_ProgressCount;
+};
+
+static void SleepingJobs_Job(void* context, int is_cancelled)
+{
+    struct SleepingJobs* jobs = (struct SleepingJobs*)context;
+    Longtail_AtomicAdd32(&jobs->m_StartedCount, 1);
+    int32_t running_count = Longtail_AtomicAdd32(&jobs->m_RunningCount, 1);
+    int32_t max_running_count = jobs->m_MaxRunningCount;
+    while (running_count > max_running_count && Longtail_CompareAndSwap32(&jobs->m_MaxRunningCount, max_running_count, running_count) != max_running_count)
+    {
+        max_running_count = jobs->m_MaxRunningCount;
+    }
+    Longtail_Sleep(jobs->m_SleepUS);
+    Longtail_AtomicAdd32(&jobs->m_RunningCount, -1);
+    Longtail_AtomicAdd32(&jobs->m_DoneCount, 1);
+}
+
+static void SleepingJobs_Progress(void* context, uint32_t total_count, uint32_t done_count)
+{
+    struct SleepingJobs* jobs = (struct SleepingJobs*)context;
+    Longtail_AtomicAdd32(&jobs->m_ProgressCount, 1);
+}
+
+// Reserves a group of `job_count` jobs, creates them `batch_size` at a time on `channel` and readies them
+static int SleepingJobs_Start(struct Longtail_JobAPI* job_api, uint32_t job_count, uint32_t batch_size, uint32_t channel, uint64_t sleep_us, struct SleepingJobs** out_jobs)
+{
+    size_t jobs_size = sizeof(struct SleepingJobs) + (sizeof(Longtail_JobAPI_JobFunc) + sizeof(void*)) * batch_size;
+    struct SleepingJobs* jobs = (struct SleepingJobs*)Longtail_Alloc(jobs_size);
+    if (!jobs)
+    {
+        return ENOMEM;
+    }
+    memset(jobs, 0, sizeof(struct SleepingJobs));
+    jobs->m_JobAPI = job_api;
+    jobs->m_SleepUS = sleep_us;
+    Longtail_JobAPI_JobFunc* funcs = (Longtail_JobAPI_JobFunc*)&jobs[1];
+    void** ctxs = (void**)&funcs[batch_size];
+    for (uint32_t i = 0; i < batch_size; ++i)
+    {
+        funcs[i] = SleepingJobs_Job;
+        ctxs[i] = jobs;
+    }
+    int err = job_api->ReserveJobs(job_api, job_count, 0, 0, &jobs->m_Group);
+    if (err)
+    {
+        Longtail_Free(jobs);
+        return err;
+    }
+    for (uint32_t offset = 0; offset < job_count; offset += batch_size)
+    {
+        uint32_t count = (job_count - offset) < batch_size ? (job_count - offset) : batch_size;
+        Longtail_JobAPI_Jobs batch;
+        err = job_api->CreateJobs(job_api, jobs->m_Group, channel, count, funcs, ctxs, &batch);
+        if (err)
+        {
+            break;
+        }
+        job_api->ReadyJobs(job_api, count, batch);
+    }
+    if (err)
+    {
+        job_api->WaitForAllJobs(job_api, jobs->m_Group, 0, 0);
+        Longtail_Free(jobs);
+        return err;
+    }
+    *out_jobs = jobs;
+    return 0;
+}
+
+static int SleepingJobs_Wait(struct SleepingJobs* jobs)
+{
+    return jobs->m_JobAPI->WaitForAllJobs(jobs->m_JobAPI, jobs->m_Group, jobs, SleepingJobs_Progress);
+}
+
+static void TraceAPI_TraceScope(struct Longtail_TraceAPI* api)
+{
+    api->EndScope(api, "TraceScope", api->BeginScope(api));
+}
+
+static void SetPlatformClocks()
+{
+    Longtail_SetClocks(Longtail_GetTimeUS, Longtail_GetProcessCPUTimeUS);
+}
+
+static struct Longtail_Stats* CreateStats()
+{
+    struct Longtail_Stats* stats = (struct Longtail_Stats*)Longtail_Alloc(sizeof(struct Longtail_Stats));
+    if (stats)
+    {
+        memset(stats, 0, sizeof(struct Longtail_Stats));
+    }
+    return stats;
+}
+
 static const char* GetPath(const uint32_t* name_offsets, const char* name_data, uint32_t index)
 {
     return &name_data[name_offsets[index]];
@@ -78,11 +288,20 @@ static const char* GetPath(const uint32_t* name_offsets, const char* name_data,
 #define  LONGTAIL_LIZARD_DEFAULT_COMPRESSION_TYPE  ((((uint32_t)'1') << 24) + (((uint32_t)'z') << 16) + (((uint32_t)'d') << 8) + ((uint32_t)'2'))
 #define  LONGTAIL_LIZARD_MAX_COMPRESSION_TYPE      ((((uint32_t)'1') << 24) + (((uint32_t)'z') << 16) + (((uint32_t)'d') << 8) + ((uint32_t)'3'))
 
+#define  LONGTAIL_LIZARD_FAST_COMPRESSION_TYPE     ((((uint32_t)'1') << 24) + (((uint32_t)'z') << 16) + (((uint32_t)'f') << 8) + ((uint32_t)'2'))
+
 #define  LONGTAIL_ZSTD_MIN_COMPRESSION_TYPE        ((((uint32_t)'z') << 24) + (((uint32_t)'t') << 16) + (((uint32_t)'d') << 8) + ((uint32_t)'1'))
 #define  LONGTAIL_ZSTD_DEFAULT_COMPRESSION_TYPE    ((((uint32_t)'z') << 24) + (((uint32_t)'t') << 16) + (((uint32_t)'d') << 8) + ((uint32_t)'2'))
 #define  LONGTAIL_ZSTD_MAX_COMPRESSION_TYPE        ((((uint32_t)'z') << 24) + (((uint32_t)'t') << 16) + (((uint32_t)'d') << 8) + ((uint32_t)'3'))
 
-static struct Longtail_CompressionRegistryAPI* CompressionRegistry_CreateDefault()
+#define  LONGTAIL_ZSTD_DICTIONARY_MIN_COMPRESSION_TYPE      ((((uint32_t)'z') << 24) + (((uint32_t)'t') << 16) + (((uint32_t)'d') << 8) + ((uint32_t)'a'))
+#define  LONGTAIL_ZSTD_DICTIONARY_DEFAULT_COMPRESSION_TYPE  ((((uint32_t)'z') << 24) + (((uint32_t)'t') << 16) + (((uint32_t)'d') << 8) + ((uint32_t)'b'))
+#define  LONGTAIL_ZSTD_DICTIONARY_MAX_COMPRESSION_TYPE      ((((uint32_t)'z') << 24) + (((uint32_t)'t') << 16) + (((uint32_t)'d') << 8) + ((uint32_t)'c'))
+
+#define  LONGTAIL_BEST_OF_COMPRESSION_TYPE          ((((uint32_t)'b') << 24) + (((uint32_t)'e') << 16) + (((uint32_t)'s') << 8) + ((uint32_t)'t'))
+
+// The zstd dictionary compression types are only registered if `zstd_dictionary` is given
+static struct Longtail_CompressionRegistryAPI* CompressionRegistry_CreateWithZStdDictionary(const void* zstd_dictionary, size_t zstd_dictionary_size)
 {
     struct Longtail_CompressionAPI* lizard_compression = Longtail_CreateLizardCompressionAPI();
     if (lizard_compression == 0)
@@ -105,7 +324,20 @@ static struct Longtail_CompressionRegistryAPI* CompressionRegistry_CreateDefault
         return 0;
     }
 
-    uint32_t compression_types[12] = {
+    struct Longtail_CompressionAPI* zstd_dictionary_compression = 0;
+    if (zstd_dictionary)
+    {
+        zstd_dictionary_compression = Longtail_CreateZStdDictionaryCompressionAPI(zstd_dictionary, zstd_dictionary_size);
+        if (zstd_dictionary_compression == 0)
+        {
+            Longtail_DisposeAPI(&lizard_compression->m_API);
+            Longtail_DisposeAPI(&brotli_compression->m_API);
+            Longtail_DisposeAPI(&zstd_compression->m_API);
+            return 0;
+        }
+    }
+
+    uint32_t compression_types[16] = {
         LONGTAIL_BROTLI_GENERIC_MIN_QUALITY_TYPE,
         LONGTAIL_BROTLI_GENERIC_DEFAULT_QUALITY_TYPE,
         LONGTAIL_BROTLI_GENERIC_MAX_QUALITY_TYPE,
@@ -117,10 +349,16 @@ static struct Longtail_CompressionRegistryAPI* CompressionRegistry_CreateDefault
         LONGTAIL_LIZARD_DEFAULT_COMPRESSION_TYPE,
         LONGTAIL_LIZARD_MAX_COMPRESSION_TYPE,
 
+        LONGTAIL_LIZARD_FAST_COMPRESSION_TYPE,
+
         LONGTAIL_ZSTD_MIN_COMPRESSION_TYPE,
         LONGTAIL_ZSTD_DEFAULT_COMPRESSION_TYPE,
-        LONGTAIL_ZSTD_MAX_COMPRESSION_TYPE};
-    struct Longtail_CompressionAPI* compression_apis[12] = {
+        LONGTAIL_ZSTD_MAX_COMPRESSION_TYPE,
+
+        LONGTAIL_ZSTD_DICTIONARY_MIN_COMPRESSION_TYPE,
+        LONGTAIL_ZSTD_DICTIONARY_DEFAULT_COMPRESSION_TYPE,
+        LONGTAIL_ZSTD_DICTIONARY_MAX_COMPRESSION_TYPE};
+    struct Longtail_CompressionAPI* compression_apis[16] = {
         brotli_compression,
         brotli_compression,
         brotli_compression,
@@ -130,10 +368,14 @@ static struct Longtail_CompressionRegistryAPI* CompressionRegistry_CreateDefault
         lizard_compression,
         lizard_compression,
         lizard_compression,
+        lizard_compression,
+        zstd_compression,
         zstd_compression,
         zstd_compression,
-        zstd_compression};
-    Longtail_CompressionAPI_HSettings compression_settings[12] = {
+        zstd_dictionary_compression,
+        zstd_dictionary_compression,
+        zstd_dictionary_compression};
+    Longtail_CompressionAPI_HSettings compression_settings[16] = {
         LONGTAIL_BROTLI_GENERIC_MIN_QUALITY,
         LONGTAIL_BROTLI_GENERIC_DEFAULT_QUALITY,
         LONGTAIL_BROTLI_GENERIC_MAX_QUALITY,
@@ -143,24 +385,33 @@ static struct Longtail_CompressionRegistryAPI* CompressionRegistry_CreateDefault
         LONGTAIL_LIZARD_MIN_COMPRESSION,
         LONGTAIL_LIZARD_DEFAULT_COMPRESSION,
         LONGTAIL_LIZARD_MAX_COMPRESSION,
+        LONGTAIL_LIZARD_FAST_COMPRESSION,
+        LONGTAIL_ZSTD_MIN_COMPRESSION,
+        LONGTAIL_ZSTD_DEFAULT_COMPRESSION,
+        LONGTAIL_ZSTD_MAX_COMPRESSION,
         LONGTAIL_ZSTD_MIN_COMPRESSION,
         LONGTAIL_ZSTD_DEFAULT_COMPRESSION,
         LONGTAIL_ZSTD_MAX_COMPRESSION};
 
-
     struct Longtail_CompressionRegistryAPI* registry = Longtail_CreateDefaultCompressionRegistry(
-        12,
+        zstd_dictionary_compression ? 16 : 13,
         (const uint32_t*)compression_types,
         (const struct Longtail_CompressionAPI **)compression_apis,
         (const Longtail_CompressionAPI_HSettings*)compression_settings);
     if (registry == 0)
     {
         SAFE_DISPOSE_API(lizard_compression);
+        SAFE_DISPOSE_API(zstd_dictionary_compression);
         return 0;
     }
     return registry;
 }
 
+static struct Longtail_CompressionRegistryAPI* CompressionRegistry_CreateDefault()
+{
+    return CompressionRegistry_CreateWithZStdDictionary(0, 0);
+}
+
 static uint32_t GetBlake2HashIdentifier()
 {
     return LONGTAIL_BLAKE2_HASH_TYPE;
@@ -175,3 +426,8 @@ static uint32_t GetMeowHashIdentifier()
 {
     return LONGTAIL_MEOW_HASH_TYPE;
 }
+
+static uint32_t GetXXHash64HashIdentifier()
+{
+    return LONGTAIL_XXHASH64_HASH_TYPE;
+}
@@ -1,9 +1,16 @@
 package lib
 
 import (
+	"bytes"
+	"encoding/json"
 	"fmt"
+	"math/rand"
 	"runtime"
+	"strings"
+	"sync"
+	"syscall"
 	"testing"
+	"time"
 )
 
 type progressData struct {
@@ -74,6 +81,9 @@ func CreateVersionIndexUtil(
 		jobAPI,
 		progressFunc,
 		progressContext,
+		Longtail_CancelAPI{},
+		Longtail_CancelToken{},
+		Longtail_Stats{},
 		versionPath,
 		fileInfos.GetPaths(),
 		fileInfos.GetFileSizes(),
@@ -136,6 +146,7 @@ func GetMissingContentUtil(
 			jobAPI,
 			progressFunc,
 			progressContext,
+			Longtail_Stats{},
 			contentPath)
 		if err != nil {
 			return Longtail_ContentIndex{cContentIndex: nil}, err
@@ -164,6 +175,9 @@ func GetMissingContentUtil(
 		jobAPI,
 		progressFunc,
 		progressContext,
+		Longtail_CancelAPI{},
+		Longtail_CancelToken{},
+		Longtail_Stats{},
 		missingContentIndex,
 		vindex,
 		versionPath,
@@ -273,6 +287,67 @@ func TestCreateVersionIndex(t *testing.T) {
 	}
 }
 
+func TestXXHash64Hash(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	hashAPI := CreateXXHash64HashAPI()
+	defer hashAPI.Dispose()
+
+	// Reference value from the xxHash test vectors, seed 0
+	expected := uint64(0x44bc2cf5ad770999)
+	if hash, err := hashAPI.HashBuffer([]byte("abc")); err != nil {
+		t.Errorf("HashBuffer() err = %q, want %q", err, error(nil))
+	} else if hash != expected {
+		t.Errorf("HashBuffer(\"abc\") = 0x%016x, want 0x%016x", hash, expected)
+	}
+	if hash, err := hashAPI.HashInParts([]byte("abc"), 1); err != nil {
+		t.Errorf("HashInParts() err = %q, want %q", err, error(nil))
+	} else if hash != expected {
+		t.Errorf("HashInParts(\"abc\", 1) = 0x%016x, want 0x%016x", hash, expected)
+	}
+
+	// Streaming through a context must match hashing the whole buffer, also across the 32 byte stripes
+	data := bytes.Repeat([]byte("0123456789abcdefghijklmnopqrstuvwxyz"), 1000)
+	whole, err := hashAPI.HashBuffer(data)
+	if err != nil {
+		t.Errorf("HashBuffer() err = %q, want %q", err, error(nil))
+	}
+	for _, partSize := range []uint32{1, 7, 32, 33, 4096} {
+		if hash, err := hashAPI.HashInParts(data, partSize); err != nil {
+			t.Errorf("HashInParts(%d) err = %q, want %q", partSize, err, error(nil))
+		} else if hash != whole {
+			t.Errorf("HashInParts(%d) = 0x%016x, want 0x%016x", partSize, hash, whole)
+		}
+	}
+
+	jobAPI := CreateBikeshedJobAPI(uint32(runtime.NumCPU()))
+	defer jobAPI.Dispose()
+	compressionRegistry := CreateDefaultCompressionRegistry()
+	defer compressionRegistry.Dispose()
+	storageAPI := CreateInMemStorageAPI()
+	defer storageAPI.Dispose()
+	for path, data := range roundTripAssets {
+		WriteToStorage(storageAPI, "version", path, data)
+	}
+	err = writeAndRestoreVersion(t, storageAPI, hashAPI, jobAPI, compressionRegistry, compressionRegistry, GetZStdDefaultCompressionType())
+	if err != nil {
+		t.Errorf("writeAndRestoreVersion() err = %q, want %q", err, error(nil))
+	} else {
+		checkRestoredAssets(t, storageAPI, roundTripAssets)
+	}
+	vi, err := CreateVersionIndexUtil(storageAPI, hashAPI, jobAPI, progress, &progressData{task: "Indexing", t: t}, "restored", GetZStdDefaultCompressionType(), 32768)
+	if err != nil {
+		t.Errorf("CreateVersionIndex() err = %q, want %q", err, error(nil))
+	} else {
+		if ret := vi.GetHashAPI(); ret != GetXXHash64HashIdentifier() {
+			t.Errorf("CreateVersionIndex() hash api = 0x%08x, want 0x%08x", ret, GetXXHash64HashIdentifier())
+		}
+		vi.Dispose()
+	}
+}
+
 func TestReadWriteVersionIndex(t *testing.T) {
 	l := SetLogger(logger, &loggerData{t: t})
 	defer ClearLogger(l)
@@ -309,6 +384,9 @@ func TestReadWriteVersionIndex(t *testing.T) {
 		jobAPI,
 		progress,
 		&progressData{task: "Indexing", t: t},
+		Longtail_CancelAPI{},
+		Longtail_CancelToken{},
+		Longtail_Stats{},
 		"",
 		fileInfos.GetPaths(),
 		fileInfos.GetFileSizes(),
@@ -464,10 +542,12 @@ func TestUpSyncVersion(t *testing.T) {
 	}
 
 	t.Logf("Updating remote index from `store`")
-	storeIndex, err = MergeContentIndex(storeIndex, missingContentIndex)
+	mergedStoreIndex, err := MergeContentIndex(storeIndex, missingContentIndex)
 	if err != nil {
 		t.Errorf("UpSyncVersion() MergeContentIndex() err = %q, want %q", err, error(nil))
 	}
+	storeIndex.Dispose()
+	storeIndex = mergedStoreIndex
 	WriteContentIndex(remoteStorageAPI, storeIndex, "store.lci")
 
 	t.Logf("Starting downsync to `current`")
@@ -498,6 +578,7 @@ func TestUpSyncVersion(t *testing.T) {
 			jobAPI,
 			progress,
 			&progressData{task: "Reading local cache", t: t},
+			Longtail_Stats{},
 			"cache")
 		if err != nil {
 			t.Errorf("UpSyncVersion() ReadContent(%s) = %q, want %q", "cache", err, error(nil))
@@ -506,6 +587,7 @@ func TestUpSyncVersion(t *testing.T) {
 	defer cacheContentIndex.Dispose()
 	t.Logf("Blocks in cacheContentIndex: %d", cacheContentIndex.GetBlockCount())
 
+	missingContentIndex.Dispose()
 	missingContentIndex, err = CreateMissingContent(
 		hashAPI,
 		cacheContentIndex,
@@ -526,6 +608,7 @@ func TestUpSyncVersion(t *testing.T) {
 	defer requestContent.Dispose()
 	t.Logf("Blocks in requestContent: %d", requestContent.GetBlockCount())
 
+	missingPaths.Dispose()
 	missingPaths, err = GetPathsForContentBlocks(requestContent)
 	if err != nil {
 		t.Errorf("UpSyncVersion() GetPathsForContentBlocks() = %q, want %q", err, error(nil))
@@ -584,6 +667,9 @@ func TestUpSyncVersion(t *testing.T) {
 		jobAPI,
 		progress,
 		&progressData{task: "Updating version", t: t},
+		Longtail_CancelAPI{},
+		Longtail_CancelToken{},
+		Longtail_Stats{},
 		compressionRegistry,
 		mergedCacheContentIndex,
 		currentVersionIndex,
@@ -595,3 +681,1575 @@ func TestUpSyncVersion(t *testing.T) {
 		t.Errorf("UpSyncVersion() ChangeVersion(%s, %s) = %q, want %q", "cache", "current", err, error(nil))
 	}
 }
+
+var roundTripAssets = map[string][]byte{
+	"first_folder/my_file.txt":         []byte("the content of my_file"),
+	"second_folder/my_second_file.txt": []byte("second file has different content than my_file"),
+	"top_level.txt":                    []byte("the top level file is also a text file with dummy content"),
+	"first_folder/empty/file/deeply/nested/file/in/lots/of/nests.txt": []byte{},
+	"large/repeating.txt": bytes.Repeat([]byte("a larger file that compresses well since it repeats itself "), 4096),
+}
+
+// writeAndRestoreVersion writes the content of `version` in storageAPI to `content` and then restores it to `restored`
+func writeAndRestoreVersion(
+	t *testing.T,
+	storageAPI Longtail_StorageAPI,
+	hashAPI Longtail_HashAPI,
+	jobAPI Longtail_JobAPI,
+	writeRegistry Longtail_CompressionRegistryAPI,
+	readRegistry Longtail_CompressionRegistryAPI,
+	compressionType uint32) error {
+
+	vi, err := CreateVersionIndexUtil(storageAPI, hashAPI, jobAPI, progress, &progressData{task: "Indexing", t: t}, "version", compressionType, 32768)
+	if err != nil {
+		return err
+	}
+	defer vi.Dispose()
+
+	emptyIndex, err := CreateContentIndex(hashAPI, 0, nil, nil, nil, 32768*12, 4096)
+	if err != nil {
+		return err
+	}
+	defer emptyIndex.Dispose()
+	ci, err := CreateMissingContent(hashAPI, emptyIndex, vi, 32768*12, 4096)
+	if err != nil {
+		return err
+	}
+	defer ci.Dispose()
+
+	err = WriteContent(storageAPI, storageAPI, writeRegistry, jobAPI, progress, &progressData{task: "Writing content", t: t}, Longtail_CancelAPI{}, Longtail_CancelToken{}, Longtail_Stats{}, ci, vi, "version", "content")
+	if err != nil {
+		return err
+	}
+	return WriteVersion(storageAPI, storageAPI, readRegistry, jobAPI, progress, &progressData{task: "Writing version", t: t}, Longtail_Stats{}, ci, vi, "content", "restored")
+}
+
+func checkRestoredAssets(t *testing.T, storageAPI Longtail_StorageAPI, assets map[string][]byte) {
+	for path, expected := range assets {
+		data, err := ReadFromStorage(storageAPI, "restored", path)
+		if err != nil {
+			t.Errorf("ReadFromStorage(%s) err = %q, want %q", path, err, error(nil))
+			continue
+		}
+		if !bytes.Equal(data, expected) {
+			t.Errorf("ReadFromStorage(%s) got %d bytes that differ from the %d bytes written", path, len(data), len(expected))
+		}
+	}
+}
+
+func TestCompressionLevelsRoundTrip(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	hashAPI := CreateBlake3HashAPI()
+	defer hashAPI.Dispose()
+	jobAPI := CreateBikeshedJobAPI(uint32(runtime.NumCPU()))
+	defer jobAPI.Dispose()
+	compressionRegistry := CreateDefaultCompressionRegistry()
+	defer compressionRegistry.Dispose()
+
+	compressionTypes := map[string]uint32{
+		"none":                 GetNoCompressionType(),
+		"brotli_min":           GetBrotliGenericMinCompressionType(),
+		"brotli":               GetBrotliGenericDefaultCompressionType(),
+		"brotli_max":           GetBrotliGenericMaxCompressionType(),
+		"brotli_text_min":      GetBrotliTextMinCompressionType(),
+		"brotli_text":          GetBrotliTextDefaultCompressionType(),
+		"brotli_text_max":      GetBrotliTextMaxCompressionType(),
+		"lizard_min":           GetLizardMinCompressionType(),
+		"lizard":               GetLizardDefaultCompressionType(),
+		"lizard_max":           GetLizardMaxCompressionType(),
+		"lizard_fast":          GetLizardFastCompressionType(),
+		"zstd_min":             GetZStdMinCompressionType(),
+		"zstd":                 GetZStdDefaultCompressionType(),
+		"zstd_max":             GetZStdMaxCompressionType(),
+		"adaptive_lizard_fast": GetAdaptiveCompressionType(GetLizardFastCompressionType()),
+	}
+	for name, compressionType := range compressionTypes {
+		storageAPI := CreateInMemStorageAPI()
+		for path, data := range roundTripAssets {
+			WriteToStorage(storageAPI, "version", path, data)
+		}
+		err := writeAndRestoreVersion(t, storageAPI, hashAPI, jobAPI, compressionRegistry, compressionRegistry, compressionType)
+		if err != nil {
+			t.Errorf("%s: writeAndRestoreVersion() err = %q, want %q", name, err, error(nil))
+		} else {
+			checkRestoredAssets(t, storageAPI, roundTripAssets)
+		}
+		storageAPI.Dispose()
+	}
+}
+
+func TestPoolAllocatorRoundTrip(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	// Shards are picked by thread id, keep the threads the same between round trips
+	runtime.LockOSThread()
+	defer runtime.UnlockOSThread()
+
+	poolAPI := CreatePoolAllocatorAPI()
+	defer poolAPI.Dispose()
+	err := SetAllocatorAPI(poolAPI)
+	if err != nil {
+		t.Fatalf("SetAllocatorAPI() err = %q, want %q", err, error(nil))
+	}
+
+	hashAPI := CreateBlake3HashAPI()
+	jobAPI := CreateBikeshedJobAPI(uint32(runtime.NumCPU()))
+	compressionRegistry := CreateDefaultCompressionRegistry()
+	roundTrip := func() {
+		storageAPI := CreateInMemStorageAPI()
+		defer storageAPI.Dispose()
+		for path, data := range roundTripAssets {
+			WriteToStorage(storageAPI, "version", path, data)
+		}
+		err := writeAndRestoreVersion(t, storageAPI, hashAPI, jobAPI, compressionRegistry, compressionRegistry, GetLizardDefaultCompressionType())
+		if err != nil {
+			t.Errorf("writeAndRestoreVersion() err = %q, want %q", err, error(nil))
+		} else {
+			checkRestoredAssets(t, storageAPI, roundTripAssets)
+		}
+	}
+
+	roundTrip()
+	first, _ := poolAPI.GetPoolStats()
+	if first.CreatedSlabCount == 0 {
+		t.Errorf("GetPoolStats() created slab count = %d, want more than 0", first.CreatedSlabCount)
+	}
+	// The storage is gone, the empty slabs the shards kept are handed out again by the second round trip
+	if first.SlabCount == 0 {
+		t.Errorf("GetPoolStats() slab count = %d, want more than 0", first.SlabCount)
+	}
+	roundTrip()
+	second, _ := poolAPI.GetPoolStats()
+	if created := second.CreatedSlabCount - first.CreatedSlabCount; created >= first.CreatedSlabCount {
+		t.Errorf("GetPoolStats() second round trip created %d slabs, want less than %d", created, first.CreatedSlabCount)
+	}
+
+	// The allocator can not be switched while anything allocated with it is alive
+	err = ClearAllocatorAPI()
+	if err == nil {
+		t.Errorf("ClearAllocatorAPI() err = %q, want an error while allocations are alive", err)
+	}
+	hashAPI.Dispose()
+	jobAPI.Dispose()
+	compressionRegistry.Dispose()
+
+	// Everything is freed, each shard keeps at most 256KB of empty slabs and returns the rest
+	released, _ := poolAPI.GetPoolStats()
+	if released.EmptySlabBytes != released.SlabBytes {
+		t.Errorf("GetPoolStats() empty slab bytes = %d, want %d", released.EmptySlabBytes, released.SlabBytes)
+	}
+	if released.MaxShardEmptySlabBytes > 256*1024 {
+		t.Errorf("GetPoolStats() max shard empty slab bytes = %d, want at most %d", released.MaxShardEmptySlabBytes, 256*1024)
+	}
+	if released.ReleasedSlabCount == 0 {
+		t.Errorf("GetPoolStats() released slab count = %d, want more than 0", released.ReleasedSlabCount)
+	}
+
+	err = ClearAllocatorAPI()
+	if err != nil {
+		t.Errorf("ClearAllocatorAPI() err = %q, want %q", err, error(nil))
+	}
+}
+
+func makeDictionarySamples(prefix string, count int) [][]byte {
+	samples := make([][]byte, count)
+	for i := 0; i < count; i++ {
+		samples[i] = []byte(fmt.Sprintf("{\"%s_name\": \"asset_%d\", \"%s_size\": %d, \"%s_flags\": [\"read\", \"write\"], \"%s_owner\": \"user_%d\"}", prefix, i, prefix, i*37, prefix, prefix, i%13))
+	}
+	return samples
+}
+
+func TestZStdDictionaryRoundTrip(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	hashAPI := CreateBlake3HashAPI()
+	defer hashAPI.Dispose()
+	jobAPI := CreateBikeshedJobAPI(uint32(runtime.NumCPU()))
+	defer jobAPI.Dispose()
+
+	dictionaryA, err := TrainZStdDictionary(makeDictionarySamples("alpha", 2000), 8192)
+	if err != nil {
+		t.Fatalf("TrainZStdDictionary() err = %q, want %q", err, error(nil))
+	}
+	dictionaryB, err := TrainZStdDictionary(makeDictionarySamples("beta", 2000), 8192)
+	if err != nil {
+		t.Fatalf("TrainZStdDictionary() err = %q, want %q", err, error(nil))
+	}
+	if GetZStdDictionaryID(dictionaryA) == GetZStdDictionaryID(dictionaryB) {
+		t.Fatalf("GetZStdDictionaryID() both dictionaries have id %08x", GetZStdDictionaryID(dictionaryA))
+	}
+	registryA, err := CreateZStdDictionaryCompressionRegistry(dictionaryA)
+	if err != nil {
+		t.Fatalf("CreateZStdDictionaryCompressionRegistry() err = %q, want %q", err, error(nil))
+	}
+	defer registryA.Dispose()
+	registryB, err := CreateZStdDictionaryCompressionRegistry(dictionaryB)
+	if err != nil {
+		t.Fatalf("CreateZStdDictionaryCompressionRegistry() err = %q, want %q", err, error(nil))
+	}
+	defer registryB.Dispose()
+
+	assets := make(map[string][]byte)
+	for i, sample := range makeDictionarySamples("alpha", 40) {
+		assets[fmt.Sprintf("small/%d.json", i)] = sample
+	}
+
+	storageAPI := CreateInMemStorageAPI()
+	defer storageAPI.Dispose()
+	for path, data := range assets {
+		WriteToStorage(storageAPI, "version", path, data)
+	}
+	err = writeAndRestoreVersion(t, storageAPI, hashAPI, jobAPI, registryA, registryA, GetZStdDictionaryDefaultCompressionType())
+	if err != nil {
+		t.Errorf("writeAndRestoreVersion() err = %q, want %q", err, error(nil))
+	}
+	checkRestoredAssets(t, storageAPI, assets)
+
+	// Content written with one dictionary can not be read with another
+	mismatchStorageAPI := CreateInMemStorageAPI()
+	defer mismatchStorageAPI.Dispose()
+	for path, data := range assets {
+		WriteToStorage(mismatchStorageAPI, "version", path, data)
+	}
+	err = writeAndRestoreVersion(t, mismatchStorageAPI, hashAPI, jobAPI, registryA, registryB, GetZStdDictionaryDefaultCompressionType())
+	expected := fmt.Sprintf("failed with error %d", int(syscall.EBADF))
+	if err == nil || !strings.HasSuffix(err.Error(), expected) {
+		t.Errorf("writeAndRestoreVersion() with mismatched dictionary err = %v, want it to end with %q", err, expected)
+	}
+}
+
+func findTempFiles(t *testing.T, storageAPI Longtail_StorageAPI, rootPath string) []string {
+	fileInfos, err := GetFilesRecursively(storageAPI, rootPath)
+	if err != nil {
+		return nil
+	}
+	defer fileInfos.Dispose()
+	paths := fileInfos.GetPaths()
+	tempFiles := []string{}
+	for i := uint32(0); i < paths.GetPathCount(); i++ {
+		path := GetPath(paths, i)
+		if strings.HasSuffix(path, ".tmp") {
+			tempFiles = append(tempFiles, path)
+		}
+	}
+	return tempFiles
+}
+
+func TestCancelWriteContentAndChangeVersion(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	storageAPI := CreateInMemStorageAPI()
+	defer storageAPI.Dispose()
+	hashAPI := CreateBlake3HashAPI()
+	defer hashAPI.Dispose()
+	jobAPI := CreateBikeshedJobAPI(uint32(runtime.NumCPU()))
+	defer jobAPI.Dispose()
+	compressionRegistry := CreateDefaultCompressionRegistry()
+	defer compressionRegistry.Dispose()
+	cancelAPI := CreateAtomicCancelAPI()
+	defer cancelAPI.Dispose()
+
+	for path, data := range roundTripAssets {
+		WriteToStorage(storageAPI, "version", path, data)
+	}
+	vi, err := CreateVersionIndexUtil(storageAPI, hashAPI, jobAPI, progress, &progressData{task: "Indexing", t: t}, "version", GetLizardDefaultCompressionType(), 32768)
+	if err != nil {
+		t.Fatalf("CreateVersionIndexUtil() err = %q, want %q", err, error(nil))
+	}
+	defer vi.Dispose()
+	emptyIndex, err := CreateContentIndex(hashAPI, 0, nil, nil, nil, 32768*12, 4096)
+	if err != nil {
+		t.Fatalf("CreateContentIndex() err = %q, want %q", err, error(nil))
+	}
+	defer emptyIndex.Dispose()
+	ci, err := CreateMissingContent(hashAPI, emptyIndex, vi, 32768*12, 4096)
+	if err != nil {
+		t.Fatalf("CreateMissingContent() err = %q, want %q", err, error(nil))
+	}
+	defer ci.Dispose()
+
+	expected := fmt.Sprintf("failed with error %d", int(syscall.ECANCELED))
+
+	cancelToken, err := cancelAPI.CreateToken()
+	if err != nil {
+		t.Fatalf("CreateToken() err = %q, want %q", err, error(nil))
+	}
+	defer cancelAPI.DisposeToken(cancelToken)
+	cancelAPI.Cancel(cancelToken)
+	err = WriteContent(storageAPI, storageAPI, compressionRegistry, jobAPI, progress, &progressData{task: "Writing content", t: t}, cancelAPI, cancelToken, Longtail_Stats{}, ci, vi, "version", "cancelled_content")
+	if err == nil || !strings.HasSuffix(err.Error(), expected) {
+		t.Errorf("WriteContent() cancelled err = %v, want it to end with %q", err, expected)
+	}
+	if tempFiles := findTempFiles(t, storageAPI, "cancelled_content"); len(tempFiles) != 0 {
+		t.Errorf("WriteContent() cancelled left temporary files %v", tempFiles)
+	}
+
+	err = WriteContent(storageAPI, storageAPI, compressionRegistry, jobAPI, progress, &progressData{task: "Writing content", t: t}, Longtail_CancelAPI{}, Longtail_CancelToken{}, Longtail_Stats{}, ci, vi, "version", "content")
+	if err != nil {
+		t.Fatalf("WriteContent() err = %q, want %q", err, error(nil))
+	}
+	currentIndex, err := CreateVersionIndexUtil(storageAPI, hashAPI, jobAPI, progress, &progressData{task: "Indexing", t: t}, "current", GetLizardDefaultCompressionType(), 32768)
+	if err != nil {
+		t.Fatalf("CreateVersionIndexUtil() err = %q, want %q", err, error(nil))
+	}
+	defer currentIndex.Dispose()
+	versionDiff, err := CreateVersionDiff(currentIndex, vi)
+	if err != nil {
+		t.Fatalf("CreateVersionDiff() err = %q, want %q", err, error(nil))
+	}
+	defer versionDiff.Dispose()
+	err = ChangeVersion(storageAPI, storageAPI, hashAPI, jobAPI, progress, &progressData{task: "Updating version", t: t}, cancelAPI, cancelToken, Longtail_Stats{}, compressionRegistry, ci, currentIndex, vi, versionDiff, "content", "current")
+	if err == nil || !strings.HasSuffix(err.Error(), expected) {
+		t.Errorf("ChangeVersion() cancelled err = %v, want it to end with %q", err, expected)
+	}
+	if tempFiles := findTempFiles(t, storageAPI, "current"); len(tempFiles) != 0 {
+		t.Errorf("ChangeVersion() cancelled left temporary files %v", tempFiles)
+	}
+}
+
+type cancellingProgressData struct {
+	once   sync.Once
+	start  time.Time
+	after  time.Duration
+	cancel func()
+}
+
+func cancellingProgress(context interface{}, total int, current int) {
+	p := context.(*cancellingProgressData)
+	if current >= total {
+		return
+	}
+	if p.start.IsZero() {
+		p.start = time.Now()
+	}
+	if time.Since(p.start) >= p.after {
+		p.once.Do(p.cancel)
+	}
+}
+
+func TestCancelInFlight(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	storageAPI := CreateInMemStorageAPI()
+	defer storageAPI.Dispose()
+	hashAPI := CreateBlake3HashAPI()
+	defer hashAPI.Dispose()
+	jobAPI := CreateBikeshedJobAPIWithProgressInterval(uint32(runtime.NumCPU()), 1)
+	defer jobAPI.Dispose()
+	compressionRegistry := CreateDefaultCompressionRegistry()
+	defer compressionRegistry.Dispose()
+	cancelAPI := CreateAtomicCancelAPI()
+	defer cancelAPI.Dispose()
+	// Slow writes to the version folder so a cancel lands while the large assets are half written
+	versionStorageAPI := CreateShapedStorageAPI(storageAPI, 0, 0, 64*1024*1024, 0)
+	defer versionStorageAPI.Dispose()
+
+	// Noisy data so the two large assets span hundreds of blocks and are written in several parts
+	assets := map[string][]byte{}
+	seed := uint32(1)
+	for i := 0; i < 10; i++ {
+		size := 65536 * (1 + i%4)
+		if i < 2 {
+			size = 12 * 1024 * 1024
+		}
+		data := make([]byte, size)
+		for d := range data {
+			seed = seed*1664525 + 1013904223
+			data[d] = byte(seed >> 24)
+		}
+		path := fmt.Sprintf("folder_%d/asset_%d.bin", i%3, i)
+		assets[path] = data
+		WriteToStorage(storageAPI, "version", path, data)
+	}
+	vi, err := CreateVersionIndexUtil(storageAPI, hashAPI, jobAPI, progress, &progressData{task: "Indexing", t: t}, "version", GetZStdDefaultCompressionType(), 32768)
+	if err != nil {
+		t.Fatalf("CreateVersionIndexUtil() err = %q, want %q", err, error(nil))
+	}
+	defer vi.Dispose()
+	emptyIndex, err := CreateContentIndex(hashAPI, 0, nil, nil, nil, 65536, 4096)
+	if err != nil {
+		t.Fatalf("CreateContentIndex() err = %q, want %q", err, error(nil))
+	}
+	defer emptyIndex.Dispose()
+	ci, err := CreateMissingContent(hashAPI, emptyIndex, vi, 65536, 4096)
+	if err != nil {
+		t.Fatalf("CreateMissingContent() err = %q, want %q", err, error(nil))
+	}
+	defer ci.Dispose()
+
+	expected := fmt.Sprintf("failed with error %d", int(syscall.ECANCELED))
+
+	// Cancel from another goroutine once the jobs are running
+	writeToken, err := cancelAPI.CreateToken()
+	if err != nil {
+		t.Fatalf("CreateToken() err = %q, want %q", err, error(nil))
+	}
+	defer cancelAPI.DisposeToken(writeToken)
+	started := make(chan struct{})
+	cancelled := make(chan struct{})
+	go func() {
+		<-started
+		cancelAPI.Cancel(writeToken)
+		close(cancelled)
+	}()
+	writeProgress := &cancellingProgressData{cancel: func() {
+		close(started)
+		<-cancelled
+	}}
+	err = WriteContent(storageAPI, storageAPI, compressionRegistry, jobAPI, cancellingProgress, writeProgress, cancelAPI, writeToken, Longtail_Stats{}, ci, vi, "version", "cancelled_content")
+	if err == nil || !strings.HasSuffix(err.Error(), expected) {
+		t.Errorf("WriteContent() cancelled err = %v, want it to end with %q", err, expected)
+	}
+	if tempFiles := findTempFiles(t, storageAPI, "cancelled_content"); len(tempFiles) != 0 {
+		t.Errorf("WriteContent() cancelled left temporary files %v", tempFiles)
+	}
+
+	err = WriteContent(storageAPI, storageAPI, compressionRegistry, jobAPI, progress, &progressData{task: "Writing content", t: t}, Longtail_CancelAPI{}, Longtail_CancelToken{}, Longtail_Stats{}, ci, vi, "version", "content")
+	if err != nil {
+		t.Fatalf("WriteContent() err = %q, want %q", err, error(nil))
+	}
+
+	// Cancel from the progress callback while assets are being written
+	changeToken, err := cancelAPI.CreateToken()
+	if err != nil {
+		t.Fatalf("CreateToken() err = %q, want %q", err, error(nil))
+	}
+	defer cancelAPI.DisposeToken(changeToken)
+	currentIndex, err := CreateVersionIndexUtil(storageAPI, hashAPI, jobAPI, progress, &progressData{task: "Indexing", t: t}, "restored", GetZStdDefaultCompressionType(), 32768)
+	if err != nil {
+		t.Fatalf("CreateVersionIndexUtil() err = %q, want %q", err, error(nil))
+	}
+	defer currentIndex.Dispose()
+	versionDiff, err := CreateVersionDiff(currentIndex, vi)
+	if err != nil {
+		t.Fatalf("CreateVersionDiff() err = %q, want %q", err, error(nil))
+	}
+	defer versionDiff.Dispose()
+	changeProgress := &cancellingProgressData{after: 100 * time.Millisecond, cancel: func() { cancelAPI.Cancel(changeToken) }}
+	err = ChangeVersion(storageAPI, versionStorageAPI, hashAPI, jobAPI, cancellingProgress, changeProgress, cancelAPI, changeToken, Longtail_Stats{}, compressionRegistry, ci, currentIndex, vi, versionDiff, "content", "restored")
+	if err == nil || !strings.HasSuffix(err.Error(), expected) {
+		t.Errorf("ChangeVersion() cancelled err = %v, want it to end with %q", err, expected)
+	}
+	for path, data := range assets {
+		restored, err := ReadFromStorage(storageAPI, "restored", path)
+		if err == nil && !bytes.Equal(restored, data) {
+			t.Errorf("ChangeVersion() cancelled left partial asset `%s` with %d of %d bytes", path, len(restored), len(data))
+		}
+	}
+
+	// Retrying from a fresh index of the folder completes the version
+	partialIndex, err := CreateVersionIndexUtil(storageAPI, hashAPI, jobAPI, progress, &progressData{task: "Indexing", t: t}, "restored", GetZStdDefaultCompressionType(), 32768)
+	if err != nil {
+		t.Fatalf("CreateVersionIndexUtil() err = %q, want %q", err, error(nil))
+	}
+	defer partialIndex.Dispose()
+	retryDiff, err := CreateVersionDiff(partialIndex, vi)
+	if err != nil {
+		t.Fatalf("CreateVersionDiff() err = %q, want %q", err, error(nil))
+	}
+	defer retryDiff.Dispose()
+	err = ChangeVersion(storageAPI, storageAPI, hashAPI, jobAPI, progress, &progressData{task: "Updating version", t: t}, Longtail_CancelAPI{}, Longtail_CancelToken{}, Longtail_Stats{}, compressionRegistry, ci, partialIndex, vi, retryDiff, "content", "restored")
+	if err != nil {
+		t.Fatalf("ChangeVersion() err = %q, want %q", err, error(nil))
+	}
+	checkRestoredAssets(t, storageAPI, assets)
+}
+
+func TestWorkStealingCreateVersionIndex(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	storageAPI := CreateInMemStorageAPI()
+	defer storageAPI.Dispose()
+	hashAPI := CreateBlake3HashAPI()
+	defer hashAPI.Dispose()
+
+	for i := 0; i < 200; i++ {
+		WriteToStorage(storageAPI, "version", fmt.Sprintf("folder_%d/file_%d.txt", i%7, i), bytes.Repeat([]byte(fmt.Sprintf("file %d ", i)), 100+i*50))
+	}
+
+	bikeshedJobAPI := CreateBikeshedJobAPI(uint32(runtime.NumCPU()))
+	defer bikeshedJobAPI.Dispose()
+	expectedIndex, err := CreateVersionIndexUtil(storageAPI, hashAPI, bikeshedJobAPI, progress, &progressData{task: "Indexing", t: t}, "version", GetLizardDefaultCompressionType(), 4096)
+	if err != nil {
+		t.Fatalf("CreateVersionIndexUtil() err = %q, want %q", err, error(nil))
+	}
+	defer expectedIndex.Dispose()
+	expected, err := WriteVersionIndexToBuffer(expectedIndex)
+	if err != nil {
+		t.Fatalf("WriteVersionIndexToBuffer() err = %q, want %q", err, error(nil))
+	}
+
+	for _, workerCount := range []uint32{0, 1, uint32(runtime.NumCPU())} {
+		jobAPI := CreateWorkStealingJobAPI(workerCount)
+		vi, err := CreateVersionIndexUtil(storageAPI, hashAPI, jobAPI, progress, &progressData{task: "Indexing", t: t}, "version", GetLizardDefaultCompressionType(), 4096)
+		if err != nil {
+			t.Errorf("CreateVersionIndexUtil() with %d workers err = %q, want %q", workerCount, err, error(nil))
+			jobAPI.Dispose()
+			continue
+		}
+		buffer, err := WriteVersionIndexToBuffer(vi)
+		if err != nil {
+			t.Errorf("WriteVersionIndexToBuffer() err = %q, want %q", err, error(nil))
+		} else if !bytes.Equal(buffer, expected) {
+			t.Errorf("CreateVersionIndexUtil() with %d workers differs from the index built with the bikeshed job api", workerCount)
+		}
+		vi.Dispose()
+		jobAPI.Dispose()
+	}
+}
+
+func memStorageTestContent(writer int, index int) []byte {
+	return bytes.Repeat([]byte{byte(writer*31 + index)}, 512+index)
+}
+
+func TestInMemStorageConcurrentReadWrite(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	storageAPI := CreateInMemStorageAPI()
+	defer storageAPI.Dispose()
+
+	const writerCount = 8
+	const fileCount = 200
+	var lock sync.Mutex
+	written := make([][2]int, 0, writerCount*fileCount)
+	errs := make(chan error, writerCount)
+	var wg sync.WaitGroup
+	for w := 0; w < writerCount; w++ {
+		wg.Add(1)
+		go func(writer int) {
+			defer wg.Done()
+			for i := 0; i < fileCount; i++ {
+				err := WriteToStorage(storageAPI, "store", fmt.Sprintf("writer_%d/file_%d", writer, i), memStorageTestContent(writer, i))
+				if err != nil {
+					errs <- err
+					return
+				}
+				lock.Lock()
+				written = append(written, [2]int{writer, i})
+				other := written[(writer*7919+i*104729)%len(written)]
+				lock.Unlock()
+				data, err := ReadFromStorage(storageAPI, "store", fmt.Sprintf("writer_%d/file_%d", other[0], other[1]))
+				if err != nil {
+					errs <- err
+					return
+				}
+				if !bytes.Equal(data, memStorageTestContent(other[0], other[1])) {
+					errs <- fmt.Errorf("writer_%d/file_%d has unexpected content", other[0], other[1])
+					return
+				}
+			}
+		}(w)
+	}
+	wg.Wait()
+	close(errs)
+	for err := range errs {
+		t.Errorf("concurrent read and write err = %q, want %q", err, error(nil))
+	}
+
+	fileInfos, err := GetFilesRecursively(storageAPI, "store")
+	if err != nil {
+		t.Fatalf("GetFilesRecursively() err = %q, want %q", err, error(nil))
+	}
+	defer fileInfos.Dispose()
+	// Each writer folder is listed as well as its files
+	if ret := fileInfos.GetFileCount(); ret != writerCount*(fileCount+1) {
+		t.Errorf("GetFilesRecursively() file count = %d, want %d", ret, writerCount*(fileCount+1))
+	}
+}
+
+func cacheStorageTestContent(c byte) []byte {
+	return bytes.Repeat([]byte{c}, 1000)
+}
+
+func readCacheStorageTestFile(t *testing.T, storageAPI Longtail_StorageAPI, path string, want byte) {
+	data, err := ReadFromStorage(storageAPI, "remote", path)
+	if err != nil {
+		t.Errorf("ReadFromStorage(%s) err = %q, want %q", path, err, error(nil))
+		return
+	}
+	if !bytes.Equal(data, cacheStorageTestContent(want)) {
+		t.Errorf("ReadFromStorage(%s) = %q..., want %q...", path, data[:1], []byte{want})
+	}
+}
+
+func writeCacheStorageTestFile(t *testing.T, storageAPI Longtail_StorageAPI, path string, c byte) {
+	err := WriteToStorage(storageAPI, "remote", path, cacheStorageTestContent(c))
+	if err != nil {
+		t.Fatalf("WriteToStorage(%s) err = %q, want %q", path, err, error(nil))
+	}
+}
+
+func TestInMemStorageGrowFreesOldBuffers(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	memTrackerAPI := CreateMemTrackerAPI()
+	defer memTrackerAPI.Dispose()
+	SetMemTrackerAPI(memTrackerAPI)
+	defer ClearMemTrackerAPI()
+
+	storageAPI := CreateInMemStorageAPI()
+	defer storageAPI.Dispose()
+
+	const fileSize = 4 * 1024 * 1024
+	content := make([]byte, fileSize)
+	for i := range content {
+		content[i] = byte(i * 7919 >> 8)
+	}
+	err := WriteToStorage(storageAPI, "store", "growing.bin", []byte{})
+	if err != nil {
+		t.Fatalf("WriteToStorage() err = %q, want %q", err, error(nil))
+	}
+	before, _ := memTrackerAPI.GetTagStats(MemTagOther)
+
+	// Readers pick up whatever buffer is current while the file grows, each read must see a prefix of the content
+	var readers sync.WaitGroup
+	stop := make(chan struct{})
+	errs := make(chan error, 4)
+	for r := 0; r < 4; r++ {
+		readers.Add(1)
+		go func() {
+			defer readers.Done()
+			for {
+				select {
+				case <-stop:
+					return
+				default:
+				}
+				data, err := ReadFromStorage(storageAPI, "store", "growing.bin")
+				if err != nil {
+					errs <- err
+					return
+				}
+				if !bytes.Equal(data, content[:len(data)]) {
+					errs <- fmt.Errorf("read %d bytes that are not a prefix of the content", len(data))
+					return
+				}
+			}
+		}()
+	}
+	err = WriteToStorageInParts(storageAPI, "store", "growing.bin", content, 1024)
+	close(stop)
+	readers.Wait()
+	close(errs)
+	for err := range errs {
+		t.Errorf("ReadFromStorage() err = %q, want %q", err, error(nil))
+	}
+	if err != nil {
+		t.Fatalf("WriteToStorageInParts() err = %q, want %q", err, error(nil))
+	}
+
+	// The buffers grow by doubling, keeping the retired ones would hold on to about twice the file size
+	after, _ := memTrackerAPI.GetTagStats(MemTagOther)
+	if grown := after.CurrentBytes - before.CurrentBytes; grown > fileSize+fileSize/4 {
+		t.Errorf("GetTagStats() grew by %d bytes for a %d byte file, want at most %d", grown, fileSize, fileSize+fileSize/4)
+	}
+	data, err := ReadFromStorage(storageAPI, "store", "growing.bin")
+	if err != nil {
+		t.Errorf("ReadFromStorage() err = %q, want %q", err, error(nil))
+	} else if !bytes.Equal(data, content) {
+		t.Errorf("ReadFromStorage() got %d bytes that differ from the %d bytes written", len(data), len(content))
+	}
+}
+
+func TestCacheStorageMemoryTier(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	remoteStorageAPI := CreateInMemStorageAPI()
+	defer remoteStorageAPI.Dispose()
+	writeCacheStorageTestFile(t, remoteStorageAPI, "a", 'a')
+	writeCacheStorageTestFile(t, remoteStorageAPI, "b", 'b')
+	writeCacheStorageTestFile(t, remoteStorageAPI, "c", 'c')
+
+	// Room for two of the three files and no local tier
+	cacheStorageAPI := CreateCacheStorageAPI(remoteStorageAPI, Longtail_StorageAPI{}, "", 0, 2500)
+	defer cacheStorageAPI.Dispose()
+	readCacheStorageTestFile(t, cacheStorageAPI, "a", 'a')
+	readCacheStorageTestFile(t, cacheStorageAPI, "b", 'b')
+	readCacheStorageTestFile(t, cacheStorageAPI, "a", 'a')
+	// b is the least recently used and is evicted
+	readCacheStorageTestFile(t, cacheStorageAPI, "c", 'c')
+
+	// Change the remote behind the cache, cached files keep their content
+	writeCacheStorageTestFile(t, remoteStorageAPI, "a", 'A')
+	writeCacheStorageTestFile(t, remoteStorageAPI, "b", 'B')
+	writeCacheStorageTestFile(t, remoteStorageAPI, "c", 'C')
+	readCacheStorageTestFile(t, cacheStorageAPI, "c", 'c')
+	readCacheStorageTestFile(t, cacheStorageAPI, "a", 'a')
+	readCacheStorageTestFile(t, cacheStorageAPI, "b", 'B')
+
+	// A write through the cache goes to the remote and drops the cached copy
+	writeCacheStorageTestFile(t, cacheStorageAPI, "b", 'x')
+	readCacheStorageTestFile(t, remoteStorageAPI, "b", 'x')
+	readCacheStorageTestFile(t, cacheStorageAPI, "b", 'x')
+}
+
+func TestCacheStorageLocalTier(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	remoteStorageAPI := CreateInMemStorageAPI()
+	defer remoteStorageAPI.Dispose()
+	localStorageAPI := CreateInMemStorageAPI()
+	defer localStorageAPI.Dispose()
+	writeCacheStorageTestFile(t, remoteStorageAPI, "a", 'a')
+	writeCacheStorageTestFile(t, remoteStorageAPI, "b", 'b')
+	writeCacheStorageTestFile(t, remoteStorageAPI, "c", 'c')
+
+	getLocalFileCount := func() uint32 {
+		fileInfos, err := GetFilesRecursively(localStorageAPI, "cache")
+		if err != nil {
+			t.Fatalf("GetFilesRecursively() err = %q, want %q", err, error(nil))
+		}
+		defer fileInfos.Dispose()
+		return fileInfos.GetFileCount()
+	}
+
+	// Room for two of the three files in the local tier and nothing in memory
+	cacheStorageAPI := CreateCacheStorageAPI(remoteStorageAPI, localStorageAPI, "cache", 2500, 0)
+	readCacheStorageTestFile(t, cacheStorageAPI, "a", 'a')
+	readCacheStorageTestFile(t, cacheStorageAPI, "b", 'b')
+	readCacheStorageTestFile(t, cacheStorageAPI, "a", 'a')
+	// b is the least recently used and its local file is removed
+	readCacheStorageTestFile(t, cacheStorageAPI, "c", 'c')
+	if ret := getLocalFileCount(); ret != 2 {
+		t.Errorf("local cache file count = %d, want %d", ret, 2)
+	}
+
+	writeCacheStorageTestFile(t, remoteStorageAPI, "a", 'A')
+	writeCacheStorageTestFile(t, remoteStorageAPI, "b", 'B')
+	writeCacheStorageTestFile(t, remoteStorageAPI, "c", 'C')
+	readCacheStorageTestFile(t, cacheStorageAPI, "c", 'c')
+	readCacheStorageTestFile(t, cacheStorageAPI, "a", 'a')
+	cacheStorageAPI.Dispose()
+
+	// A new cache picks up the files left in the local cache folder
+	cacheStorageAPI = CreateCacheStorageAPI(remoteStorageAPI, localStorageAPI, "cache", 2500, 0)
+	defer cacheStorageAPI.Dispose()
+	readCacheStorageTestFile(t, cacheStorageAPI, "a", 'a')
+	readCacheStorageTestFile(t, cacheStorageAPI, "c", 'c')
+
+	// A write through the cache removes the local copy
+	writeCacheStorageTestFile(t, cacheStorageAPI, "c", 'x')
+	if ret := getLocalFileCount(); ret != 1 {
+		t.Errorf("local cache file count = %d, want %d", ret, 1)
+	}
+	readCacheStorageTestFile(t, remoteStorageAPI, "c", 'x')
+	readCacheStorageTestFile(t, cacheStorageAPI, "c", 'x')
+	readCacheStorageTestFile(t, cacheStorageAPI, "a", 'a')
+}
+
+func TestCacheStorageLargeFiles(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	remoteStorageAPI := CreateInMemStorageAPI()
+	defer remoteStorageAPI.Dispose()
+	localStorageAPI := CreateInMemStorageAPI()
+	defer localStorageAPI.Dispose()
+	writeFile := func(storageAPI Longtail_StorageAPI, path string, c byte, size int) {
+		err := WriteToStorage(storageAPI, "remote", path, bytes.Repeat([]byte{c}, size))
+		if err != nil {
+			t.Fatalf("WriteToStorage(%s) err = %q, want %q", path, err, error(nil))
+		}
+	}
+	readFile := func(storageAPI Longtail_StorageAPI, path string, c byte, size int) {
+		data, err := ReadFromStorage(storageAPI, "remote", path)
+		if err != nil {
+			t.Errorf("ReadFromStorage(%s) err = %q, want %q", path, err, error(nil))
+			return
+		}
+		if !bytes.Equal(data, bytes.Repeat([]byte{c}, size)) {
+			t.Errorf("ReadFromStorage(%s) got %d bytes, want %d bytes of %q", path, len(data), size, []byte{c})
+		}
+	}
+	writeFile(remoteStorageAPI, "large", 'l', 2000)
+	writeFile(remoteStorageAPI, "huge", 'h', 3000)
+
+	// Files over the memory budget are read from the local copy, files over both budgets from the remote
+	cacheStorageAPI := CreateCacheStorageAPI(remoteStorageAPI, localStorageAPI, "cache", 2500, 1500)
+	defer cacheStorageAPI.Dispose()
+	readFile(cacheStorageAPI, "large", 'l', 2000)
+	readFile(cacheStorageAPI, "huge", 'h', 3000)
+	fileInfos, err := GetFilesRecursively(localStorageAPI, "cache")
+	if err != nil {
+		t.Fatalf("GetFilesRecursively() err = %q, want %q", err, error(nil))
+	}
+	if ret := fileInfos.GetFileCount(); ret != 1 {
+		t.Errorf("local cache file count = %d, want %d", ret, 1)
+	}
+	fileInfos.Dispose()
+
+	writeFile(remoteStorageAPI, "large", 'L', 2000)
+	writeFile(remoteStorageAPI, "huge", 'H', 3000)
+	readFile(cacheStorageAPI, "large", 'l', 2000)
+	readFile(cacheStorageAPI, "huge", 'H', 3000)
+}
+
+func TestCacheStorageConcurrentWrite(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	backingStorageAPI := CreateInMemStorageAPI()
+	defer backingStorageAPI.Dispose()
+	// Slow reads so the write lands while the readers are still reading the old content
+	remoteStorageAPI := CreateShapedStorageAPI(backingStorageAPI, 0, 200000, 0, 0)
+	defer remoteStorageAPI.Dispose()
+	localStorageAPI := CreateInMemStorageAPI()
+	defer localStorageAPI.Dispose()
+	cacheStorageAPI := CreateCacheStorageAPI(remoteStorageAPI, localStorageAPI, "cache", 1024*1024, 1024*1024)
+	defer cacheStorageAPI.Dispose()
+	writeCacheStorageTestFile(t, cacheStorageAPI, "a", 0)
+
+	// Readers that started before a write must not put the old content back in the cache when they are done
+	var wg sync.WaitGroup
+	stop := make(chan struct{})
+	for r := 0; r < 4; r++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for {
+				select {
+				case <-stop:
+					return
+				default:
+					_, _ = ReadFromStorage(cacheStorageAPI, "remote", "a")
+				}
+			}
+		}()
+	}
+	for i := 1; i < 30; i++ {
+		writeCacheStorageTestFile(t, cacheStorageAPI, "a", byte(i))
+		time.Sleep(30 * time.Millisecond)
+		readCacheStorageTestFile(t, cacheStorageAPI, "a", byte(i))
+	}
+	close(stop)
+	wg.Wait()
+}
+
+func checkShapedStorageDuration(t *testing.T, name string, elapsed time.Duration, lower time.Duration) {
+	// The upper bound is generous so a busy machine does not fail the test, it still catches a limit applied many times over
+	upper := lower*4 + 2*time.Second
+	if elapsed < lower || elapsed > upper {
+		t.Errorf("%s took %v, want between %v and %v", name, elapsed, lower, upper)
+	}
+}
+
+type chromeTrace struct {
+	TraceEvents []struct {
+		Name string `json:"name"`
+		Tid  uint64 `json:"tid"`
+	} `json:"traceEvents"`
+}
+
+func TestChromeTraceManyThreads(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	traceAPI := CreateChromeTraceAPI(1024)
+	defer traceAPI.Dispose()
+
+	// More threads than there are trace slots are alive at once, each traces before and after all have started
+	threadCount := 320
+	var started sync.WaitGroup
+	var done sync.WaitGroup
+	started.Add(threadCount)
+	done.Add(threadCount)
+	for i := 0; i < threadCount; i++ {
+		go func() {
+			// Never unlocked, the thread exits with the goroutine
+			runtime.LockOSThread()
+			traceAPI.TraceScope()
+			started.Done()
+			started.Wait()
+			traceAPI.TraceScope()
+			done.Done()
+		}()
+	}
+	done.Wait()
+
+	// Threads that come and go one at a time
+	for i := 0; i < threadCount; i++ {
+		var exited sync.WaitGroup
+		exited.Add(1)
+		go func() {
+			runtime.LockOSThread()
+			traceAPI.TraceScope()
+			exited.Done()
+		}()
+		exited.Wait()
+	}
+
+	storageAPI := CreateInMemStorageAPI()
+	defer storageAPI.Dispose()
+	err := WriteChromeTrace(traceAPI, storageAPI, "trace.json")
+	if err != nil {
+		t.Errorf("WriteChromeTrace() err = %q, want %q", err, error(nil))
+		return
+	}
+	data, err := ReadFromStorage(storageAPI, "", "trace.json")
+	if err != nil {
+		t.Errorf("ReadFromStorage() err = %q, want %q", err, error(nil))
+		return
+	}
+	var trace chromeTrace
+	err = json.Unmarshal(data, &trace)
+	if err != nil {
+		t.Errorf("json.Unmarshal() err = %q, want %q", err, error(nil))
+		return
+	}
+	if len(trace.TraceEvents) != threadCount*3 {
+		t.Errorf("WriteChromeTrace() event count = %d, want %d", len(trace.TraceEvents), threadCount*3)
+	}
+	tids := make(map[uint64]bool)
+	for _, event := range trace.TraceEvents {
+		tids[event.Tid] = true
+	}
+	if len(tids) < threadCount {
+		t.Errorf("WriteChromeTrace() thread count = %d, want at least %d", len(tids), threadCount)
+	}
+}
+
+func TestShapedStorageTiming(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	backingStorageAPI := CreateInMemStorageAPI()
+	defer backingStorageAPI.Dispose()
+	data := bytes.Repeat([]byte{7}, 1024*1024)
+	for i := 0; i < 4; i++ {
+		err := WriteToStorage(backingStorageAPI, "store", fmt.Sprintf("file_%d", i), data)
+		if err != nil {
+			t.Fatalf("WriteToStorage() err = %q, want %q", err, error(nil))
+		}
+	}
+
+	readAll := func(storageAPI Longtail_StorageAPI, count int) {
+		var wg sync.WaitGroup
+		for i := 0; i < count; i++ {
+			wg.Add(1)
+			go func(i int) {
+				defer wg.Done()
+				readData, err := ReadFromStorage(storageAPI, "store", fmt.Sprintf("file_%d", i))
+				if err != nil {
+					t.Errorf("ReadFromStorage() err = %q, want %q", err, error(nil))
+				} else if !bytes.Equal(readData, data) {
+					t.Errorf("ReadFromStorage() returned unexpected content")
+				}
+			}(i)
+		}
+		wg.Wait()
+	}
+
+	// Getting the size and reading each take at least one call with latency
+	latencyStorageAPI := CreateShapedStorageAPI(backingStorageAPI, 50000, 0, 0, 0)
+	start := time.Now()
+	for i := 0; i < 4; i++ {
+		readAll(latencyStorageAPI, 1)
+	}
+	checkShapedStorageDuration(t, "latency", time.Since(start), 4*2*50*time.Millisecond)
+	latencyStorageAPI.Dispose()
+
+	// The read bandwidth is shared by all callers, 4 MB at 8 MB/s
+	readStorageAPI := CreateShapedStorageAPI(backingStorageAPI, 0, 8*1024*1024, 0, 0)
+	start = time.Now()
+	readAll(readStorageAPI, 4)
+	checkShapedStorageDuration(t, "read bandwidth", time.Since(start), 500*time.Millisecond)
+	readStorageAPI.Dispose()
+
+	// The write bandwidth is shared by all callers, 4 MB at 8 MB/s
+	writeStorageAPI := CreateShapedStorageAPI(backingStorageAPI, 0, 0, 8*1024*1024, 0)
+	start = time.Now()
+	var wg sync.WaitGroup
+	for i := 0; i < 4; i++ {
+		wg.Add(1)
+		go func(i int) {
+			defer wg.Done()
+			err := WriteToStorage(writeStorageAPI, "written", fmt.Sprintf("file_%d", i), data)
+			if err != nil {
+				t.Errorf("WriteToStorage() err = %q, want %q", err, error(nil))
+			}
+		}(i)
+	}
+	wg.Wait()
+	checkShapedStorageDuration(t, "write bandwidth", time.Since(start), 500*time.Millisecond)
+	writeStorageAPI.Dispose()
+
+	// With one call at a time the latency of concurrent readers adds up
+	serialStorageAPI := CreateShapedStorageAPI(backingStorageAPI, 50000, 0, 0, 1)
+	start = time.Now()
+	readAll(serialStorageAPI, 4)
+	checkShapedStorageDuration(t, "max concurrency", time.Since(start), 4*2*50*time.Millisecond)
+	serialStorageAPI.Dispose()
+}
+
+func TestWriteContentReadsEachAssetOncePerBlock(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	hashAPI := CreateBlake3HashAPI()
+	defer hashAPI.Dispose()
+	jobAPI := CreateBikeshedJobAPI(uint32(runtime.NumCPU()))
+	defer jobAPI.Dispose()
+	compressionRegistry := CreateDefaultCompressionRegistry()
+	defer compressionRegistry.Dispose()
+	storageAPI := CreateInMemStorageAPI()
+	defer storageAPI.Dispose()
+
+	// Random data does not repeat, every chunk of the asset ends up in a block
+	data := make([]byte, 1024*1024)
+	rand.New(rand.NewSource(26)).Read(data)
+	err := WriteToStorage(storageAPI, "version", "asset.bin", data)
+	if err != nil {
+		t.Fatalf("WriteToStorage() err = %q, want %q", err, error(nil))
+	}
+	vi, err := CreateVersionIndexUtil(storageAPI, hashAPI, jobAPI, progress, &progressData{task: "Indexing", t: t}, "version", GetNoCompressionType(), 4096)
+	if err != nil {
+		t.Fatalf("CreateVersionIndexUtil() err = %q, want %q", err, error(nil))
+	}
+	defer vi.Dispose()
+	emptyIndex, err := CreateContentIndex(hashAPI, 0, nil, nil, nil, 65536, 4096)
+	if err != nil {
+		t.Fatalf("CreateContentIndex() err = %q, want %q", err, error(nil))
+	}
+	defer emptyIndex.Dispose()
+	ci, err := CreateMissingContent(hashAPI, emptyIndex, vi, 65536, 4096)
+	if err != nil {
+		t.Fatalf("CreateMissingContent() err = %q, want %q", err, error(nil))
+	}
+	defer ci.Dispose()
+
+	stats := CreateStats()
+	defer stats.Dispose()
+	err = WriteContent(storageAPI, storageAPI, compressionRegistry, jobAPI, progress, &progressData{task: "Writing content", t: t}, Longtail_CancelAPI{}, Longtail_CancelToken{}, stats, ci, vi, "version", "content")
+	if err != nil {
+		t.Fatalf("WriteContent() err = %q, want %q", err, error(nil))
+	}
+
+	// Each block opens the asset once for all of its chunks and writes one block file
+	chunkCount := uint64(vi.GetChunkCount())
+	blockCount := ci.GetBlockCount()
+	if chunkCount <= 2*blockCount {
+		t.Fatalf("CreateMissingContent() got %d chunks in %d blocks, want more than two chunks per block", chunkCount, blockCount)
+	}
+	if stats.GetFilesOpened() != 2*blockCount {
+		t.Errorf("WriteContent() opened %d files, want %d for %d blocks of %d chunks", stats.GetFilesOpened(), 2*blockCount, blockCount, chunkCount)
+	}
+	if stats.GetBytesRead() != uint64(len(data)) {
+		t.Errorf("WriteContent() read %d bytes, want %d", stats.GetBytesRead(), len(data))
+	}
+
+	err = WriteVersion(storageAPI, storageAPI, compressionRegistry, jobAPI, progress, &progressData{task: "Writing version", t: t}, Longtail_Stats{}, ci, vi, "content", "restored")
+	if err != nil {
+		t.Fatalf("WriteVersion() err = %q, want %q", err, error(nil))
+	}
+	checkRestoredAssets(t, storageAPI, map[string][]byte{"asset.bin": data})
+}
+
+func TestAdaptiveCompressionStoresIncompressibleBlocksRaw(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	hashAPI := CreateBlake3HashAPI()
+	defer hashAPI.Dispose()
+	jobAPI := CreateBikeshedJobAPI(uint32(runtime.NumCPU()))
+	defer jobAPI.Dispose()
+	compressionRegistry := CreateDefaultCompressionRegistry()
+	defer compressionRegistry.Dispose()
+
+	randomData := make([]byte, 1024*1024)
+	rand.New(rand.NewSource(30)).Read(randomData)
+	repeatingData := bytes.Repeat([]byte("a larger file that compresses well since it repeats itself "), 16384)
+
+	for _, raw := range []bool{true, false} {
+		data := repeatingData
+		if raw {
+			data = randomData
+		}
+		storageAPI := CreateInMemStorageAPI()
+		err := WriteToStorage(storageAPI, "version", "asset.bin", data)
+		if err != nil {
+			t.Fatalf("WriteToStorage() err = %q, want %q", err, error(nil))
+		}
+		err = writeAndRestoreVersion(t, storageAPI, hashAPI, jobAPI, compressionRegistry, compressionRegistry, GetAdaptiveCompressionType(GetZStdDefaultCompressionType()))
+		if err != nil {
+			t.Fatalf("writeAndRestoreVersion() err = %q, want %q", err, error(nil))
+		}
+		checkRestoredAssets(t, storageAPI, map[string][]byte{"asset.bin": data})
+
+		// A block stored raw starts with the chunk data as it is in the asset, a compressed block with its sizes
+		blocks, err := GetFilesRecursively(storageAPI, "content")
+		if err != nil {
+			t.Fatalf("GetFilesRecursively() err = %q, want %q", err, error(nil))
+		}
+		blockCount := 0
+		blockSize := uint64(0)
+		for i := uint32(0); i < blocks.GetFileCount(); i++ {
+			path := GetPath(blocks.GetPaths(), i)
+			if strings.HasSuffix(path, "/") {
+				continue
+			}
+			blockCount++
+			block, err := ReadFromStorage(storageAPI, "content", path)
+			if err != nil {
+				t.Fatalf("ReadFromStorage(%s) err = %q, want %q", path, err, error(nil))
+			}
+			blockSize += uint64(len(block))
+			if len(block) < 64 {
+				t.Errorf("ReadFromStorage(%s) got %d bytes, want at least 64", path, len(block))
+			} else if isRaw := bytes.Contains(data, block[:64]); isRaw != raw {
+				t.Errorf("WriteContent() block `%s` stored raw = %t, want %t", path, isRaw, raw)
+			}
+		}
+		if blockCount == 0 {
+			t.Errorf("WriteContent() wrote no blocks")
+		}
+		if !raw && blockSize*2 > uint64(len(data)) {
+			t.Errorf("WriteContent() wrote %d bytes of blocks for %d bytes of compressible data", blockSize, len(data))
+		}
+		blocks.Dispose()
+		storageAPI.Dispose()
+	}
+}
+
+func TestHashContextInPlace(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	memTrackerAPI := CreateMemTrackerAPI()
+	defer memTrackerAPI.Dispose()
+	SetMemTrackerAPI(memTrackerAPI)
+	defer ClearMemTrackerAPI()
+
+	hashAPIs := map[string]Longtail_HashAPI{
+		"blake2":   CreateBlake2HashAPI(),
+		"blake3":   CreateBlake3HashAPI(),
+		"meow":     CreateMeowHashAPI(),
+		"xxhash64": CreateXXHash64HashAPI(),
+	}
+	data := bytes.Repeat([]byte("0123456789abcdefghijklmnopqrstuvwxyz"), 1000)
+	for name, hashAPI := range hashAPIs {
+		contextSize := hashAPI.GetContextSize()
+		if contextSize == 0 {
+			t.Errorf("%s: GetContextSize() = %d, want more than 0", name, contextSize)
+		}
+		whole, err := hashAPI.HashBuffer(data)
+		if err != nil {
+			t.Errorf("%s: HashBuffer() err = %q, want %q", name, err, error(nil))
+		}
+
+		// Offset the memory so the context has to be aligned inside it
+		contextMemory := make([]byte, contextSize+16+1)[1:]
+		before, _ := memTrackerAPI.GetTagStats(MemTagOther)
+		for _, partSize := range []uint32{1, 7, 64, 4096, uint32(len(data))} {
+			if hash, err := hashAPI.HashInPlace(contextMemory, data, partSize); err != nil {
+				t.Errorf("%s: HashInPlace(%d) err = %q, want %q", name, partSize, err, error(nil))
+			} else if hash != whole {
+				t.Errorf("%s: HashInPlace(%d) = 0x%016x, want 0x%016x", name, partSize, hash, whole)
+			}
+		}
+		after, _ := memTrackerAPI.GetTagStats(MemTagOther)
+		if after.TotalCount != before.TotalCount {
+			t.Errorf("%s: HashInPlace() made %d allocations, want 0", name, after.TotalCount-before.TotalCount)
+		}
+
+		// A context from BeginContext hashes the same but is allocated
+		if hash, err := hashAPI.HashInParts(data, 64); err != nil {
+			t.Errorf("%s: HashInParts() err = %q, want %q", name, err, error(nil))
+		} else if hash != whole {
+			t.Errorf("%s: HashInParts() = 0x%016x, want 0x%016x", name, hash, whole)
+		}
+		allocated, _ := memTrackerAPI.GetTagStats(MemTagOther)
+		if allocated.TotalCount == after.TotalCount {
+			t.Errorf("%s: HashInParts() made no allocations, want at least 1", name)
+		}
+		hashAPI.Dispose()
+	}
+}
+
+func waitForSleepingJobsToStart(t *testing.T, jobs Longtail_SleepingJobs, count int) {
+	deadline := time.Now().Add(5 * time.Second)
+	for jobs.GetStartedCount() < count {
+		if time.Now().After(deadline) {
+			t.Fatalf("GetStartedCount() = %d after 5s, want %d", jobs.GetStartedCount(), count)
+		}
+		time.Sleep(time.Millisecond)
+	}
+}
+
+func TestWaitForAllJobsProgressInterval(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	// Progress is reported at most once per interval while waiting plus once when the group is done. The
+	// workers run all the jobs so the waiting thread has nothing to do but report progress
+	jobAPI := CreateBikeshedJobAPIWithProgressInterval(2, 50)
+	jobs, err := StartSleepingJobs(jobAPI, 2, 2, JobChannelCPU, 300000)
+	if err != nil {
+		t.Fatalf("StartSleepingJobs() err = %q, want %q", err, error(nil))
+	}
+	waitForSleepingJobsToStart(t, jobs, 2)
+	start := time.Now()
+	err = jobs.Wait()
+	elapsed := time.Since(start)
+	if err != nil {
+		t.Errorf("Wait() err = %q, want %q", err, error(nil))
+	}
+	if done := jobs.GetDoneCount(); done != 2 {
+		t.Errorf("Wait() returned after %d jobs, want %d", done, 2)
+	}
+	maxProgressCount := int(elapsed/(50*time.Millisecond)) + 2
+	if progressCount := jobs.GetProgressCount(); progressCount < 2 || progressCount > maxProgressCount {
+		t.Errorf("Wait() reported progress %d times in %s, want 2 to %d", progressCount, elapsed, maxProgressCount)
+	}
+	jobs.Dispose()
+	jobAPI.Dispose()
+
+	// The wait ends when the last job completes, not when the next progress report is due
+	jobAPI = CreateBikeshedJobAPIWithProgressInterval(2, 10000)
+	defer jobAPI.Dispose()
+	jobs, err = StartSleepingJobs(jobAPI, 1, 1, JobChannelCPU, 100000)
+	if err != nil {
+		t.Fatalf("StartSleepingJobs() err = %q, want %q", err, error(nil))
+	}
+	defer jobs.Dispose()
+	start = time.Now()
+	err = jobs.Wait()
+	elapsed = time.Since(start)
+	if err != nil {
+		t.Errorf("Wait() err = %q, want %q", err, error(nil))
+	}
+	if elapsed > 2*time.Second {
+		t.Errorf("Wait() took %s for a 100ms job, want less than %s", elapsed, 2*time.Second)
+	}
+	if progressCount := jobs.GetProgressCount(); progressCount > 2 {
+		t.Errorf("Wait() reported progress %d times, want at most 2", progressCount)
+	}
+}
+
+func TestJobGroupsWaitIndependently(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	jobAPI := CreateBikeshedJobAPI(2)
+	defer jobAPI.Dispose()
+
+	// A slow group is running on a worker while another group is started and waited for
+	slowJobs, err := StartSleepingJobs(jobAPI, 1, 1, JobChannelCPU, 2000000)
+	if err != nil {
+		t.Fatalf("StartSleepingJobs() err = %q, want %q", err, error(nil))
+	}
+	defer slowJobs.Dispose()
+	waitForSleepingJobsToStart(t, slowJobs, 1)
+
+	fastJobs, err := StartSleepingJobs(jobAPI, 16, 4, JobChannelCPU, 1000)
+	if err != nil {
+		t.Fatalf("StartSleepingJobs() err = %q, want %q", err, error(nil))
+	}
+	defer fastJobs.Dispose()
+	start := time.Now()
+	err = fastJobs.Wait()
+	elapsed := time.Since(start)
+	if err != nil {
+		t.Errorf("Wait() err = %q, want %q", err, error(nil))
+	}
+	if done := fastJobs.GetDoneCount(); done != 16 {
+		t.Errorf("Wait() returned after %d jobs, want %d", done, 16)
+	}
+	if done := slowJobs.GetDoneCount(); done != 0 || elapsed > time.Second {
+		t.Errorf("Wait() took %s and waited for %d jobs of another group, want less than %s and 0 jobs", elapsed, done, time.Second)
+	}
+
+	err = slowJobs.Wait()
+	if err != nil {
+		t.Errorf("Wait() err = %q, want %q", err, error(nil))
+	}
+	if done := slowJobs.GetDoneCount(); done != 1 {
+		t.Errorf("Wait() returned after %d jobs, want %d", done, 1)
+	}
+}
+
+func waitForSleepingJobsToFinish(t *testing.T, jobs Longtail_SleepingJobs, count int) {
+	deadline := time.Now().Add(5 * time.Second)
+	for jobs.GetDoneCount() < count {
+		if time.Now().After(deadline) {
+			t.Fatalf("GetDoneCount() = %d after 5s, want %d", jobs.GetDoneCount(), count)
+		}
+		time.Sleep(time.Millisecond)
+	}
+}
+
+func TestJobChannelsRunOnTheirWorkers(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	// The jobs are left to the workers, nobody waits for the groups until they are done
+	jobAPI := CreateBikeshedJobAPIWithIOWorkers(1, 4, GetBikeshedDefaultProgressIntervalMS())
+	defer jobAPI.Dispose()
+
+	ioJobs, err := StartSleepingJobs(jobAPI, 8, 8, JobChannelIO, 50000)
+	if err != nil {
+		t.Fatalf("StartSleepingJobs() err = %q, want %q", err, error(nil))
+	}
+	defer ioJobs.Dispose()
+	waitForSleepingJobsToFinish(t, ioJobs, 8)
+	if running := ioJobs.GetMaxRunningCount(); running < 2 || running > 4 {
+		t.Errorf("GetMaxRunningCount() = %d for IO jobs, want 2 to 4 for the IO workers", running)
+	}
+
+	// The IO workers leave the CPU jobs to the single CPU worker
+	cpuJobs, err := StartSleepingJobs(jobAPI, 8, 8, JobChannelCPU, 10000)
+	if err != nil {
+		t.Fatalf("StartSleepingJobs() err = %q, want %q", err, error(nil))
+	}
+	defer cpuJobs.Dispose()
+	waitForSleepingJobsToFinish(t, cpuJobs, 8)
+	if running := cpuJobs.GetMaxRunningCount(); running != 1 {
+		t.Errorf("GetMaxRunningCount() = %d for CPU jobs, want 1 for the CPU worker", running)
+	}
+
+	err = ioJobs.Wait()
+	if err != nil {
+		t.Errorf("Wait() err = %q, want %q", err, error(nil))
+	}
+	err = cpuJobs.Wait()
+	if err != nil {
+		t.Errorf("Wait() err = %q, want %q", err, error(nil))
+	}
+}
+
+func TestBikeshedGrowsPastInitialTaskCapacity(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	jobAPI := CreateBikeshedJobAPIWithTaskCapacity(2, 0, GetBikeshedDefaultProgressIntervalMS(), 64)
+	defer jobAPI.Dispose()
+
+	// Groups that are alive at the same time need more tasks than the first segment holds
+	jobCounts := []uint32{48, 48, 48, 48, 5000}
+	groups := make([]Longtail_SleepingJobs, 0, len(jobCounts))
+	for _, jobCount := range jobCounts {
+		jobs, err := StartSleepingJobs(jobAPI, jobCount, 100, JobChannelCPU, 100)
+		if err != nil {
+			t.Fatalf("StartSleepingJobs(%d) err = %q, want %q", jobCount, err, error(nil))
+		}
+		defer jobs.Dispose()
+		groups = append(groups, jobs)
+	}
+	for i, jobs := range groups {
+		err := jobs.Wait()
+		if err != nil {
+			t.Errorf("Wait() err = %q, want %q", err, error(nil))
+		}
+		if done := jobs.GetDoneCount(); done != int(jobCounts[i]) {
+			t.Errorf("Wait() returned after %d jobs, want %d", done, jobCounts[i])
+		}
+	}
+
+	// The segments are reused once the groups are done
+	jobs, err := StartSleepingJobs(jobAPI, 5000, 5000, JobChannelCPU, 0)
+	if err != nil {
+		t.Fatalf("StartSleepingJobs(%d) err = %q, want %q", 5000, err, error(nil))
+	}
+	defer jobs.Dispose()
+	err = jobs.Wait()
+	if err != nil {
+		t.Errorf("Wait() err = %q, want %q", err, error(nil))
+	}
+	if done := jobs.GetDoneCount(); done != 5000 {
+		t.Errorf("Wait() returned after %d jobs, want %d", done, 5000)
+	}
+}
+
+func TestCreateJobsDoesNotAllocate(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+
+	memTrackerAPI := CreateMemTrackerAPI()
+	defer memTrackerAPI.Dispose()
+	SetMemTrackerAPI(memTrackerAPI)
+	defer ClearMemTrackerAPI()
+
+	jobAPI := CreateBikeshedJobAPI(2)
+	defer jobAPI.Dispose()
+
+	// Creates the jobs one at a time, only reserving the group may allocate
+	startJobs := func(jobCount uint32) uint64 {
+		before, _ := memTrackerAPI.GetTagStats(MemTagJobs)
+		jobs, err := StartSleepingJobs(jobAPI, jobCount, 1, JobChannelCPU, 0)
+		if err != nil {
+			t.Fatalf("StartSleepingJobs(%d) err = %q, want %q", jobCount, err, error(nil))
+		}
+		after, _ := memTrackerAPI.GetTagStats(MemTagJobs)
+		err = jobs.Wait()
+		if err != nil {
+			t.Errorf("Wait() err = %q, want %q", err, error(nil))
+		}
+		jobs.Dispose()
+		return after.TotalCount - before.TotalCount
+	}
+
+	// The first group creates the task segment
+	startJobs(1024)
+	few := startJobs(16)
+	many := startJobs(1024)
+	if many != few {
+		t.Errorf("StartSleepingJobs() made %d job allocations for 1024 jobs and %d for 16 jobs, want the same", many, few)
+	}
+	if few > 1 {
+		t.Errorf("StartSleepingJobs() made %d job allocations, want at most 1 for the group", few)
+	}
+}
+
+func TestStatsRoundTrip(t *testing.T) {
+	l := SetLogger(logger, &loggerData{t: t})
+	defer ClearLogger(l)
+	SetLogLevel(3)
+	SetPlatformClocks()
+
+	hashAPI := CreateBlake3HashAPI()
+	defer hashAPI.Dispose()
+	jobAPI := CreateBikeshedJobAPI(uint32(runtime.NumCPU()))
+	defer jobAPI.Dispose()
+	compressionRegistry := CreateDefaultCompressionRegistry()
+	defer compressionRegistry.Dispose()
+	storageAPI := CreateInMemStorageAPI()
+	defer storageAPI.Dispose()
+
+	assets := map[string][]byte{"random.bin": make([]byte, 1024*1024)}
+	rand.New(rand.NewSource(45)).Read(assets["random.bin"])
+	for path, data := range roundTripAssets {
+		assets[path] = data
+	}
+	assetSize := uint64(0)
+	fileCount := uint64(0)
+	for path, data := range assets {
+		WriteToStorage(storageAPI, "version", path, data)
+		assetSize += uint64(len(data))
+		fileCount++
+	}
+
+	fileInfos, err := GetFilesRecursively(storageAPI, "version")
+	if err != nil {
+		t.Fatalf("GetFilesRecursively() err = %q, want %q", err, error(nil))
+	}
+	defer fileInfos.Dispose()
+	compressionTypes := make([]uint32, fileInfos.GetFileCount())
+	for i := range compressionTypes {
+		compressionTypes[i] = GetZStdDefaultCompressionType()
+	}
+	indexStats := CreateStats()
+	defer indexStats.Dispose()
+	vi, err := CreateVersionIndex(storageAPI, hashAPI, jobAPI, progress, &progressData{task: "Indexing", t: t}, Longtail_CancelAPI{}, Longtail_CancelToken{}, indexStats, "version", fileInfos.GetPaths(), fileInfos.GetFileSizes(), compressionTypes, 32768)
+	if err != nil {
+		t.Fatalf("CreateVersionIndex() err = %q, want %q", err, error(nil))
+	}
+	defer vi.Dispose()
+	emptyIndex, err := CreateContentIndex(hashAPI, 0, nil, nil, nil, 32768*12, 4096)
+	if err != nil {
+		t.Fatalf("CreateContentIndex() err = %q, want %q", err, error(nil))
+	}
+	defer emptyIndex.Dispose()
+	ci, err := CreateMissingContent(hashAPI, emptyIndex, vi, 32768*12, 4096)
+	if err != nil {
+		t.Fatalf("CreateMissingContent() err = %q, want %q", err, error(nil))
+	}
+	defer ci.Dispose()
+	writeStats := CreateStats()
+	defer writeStats.Dispose()
+	err = WriteContent(storageAPI, storageAPI, compressionRegistry, jobAPI, progress, &progressData{task: "Writing content", t: t}, Longtail_CancelAPI{}, Longtail_CancelToken{}, writeStats, ci, vi, "version", "content")
+	if err != nil {
+		t.Fatalf("WriteContent() err = %q, want %q", err, error(nil))
+	}
+	scanStats := CreateStats()
+	defer scanStats.Dispose()
+	readCI, err := ReadContent(storageAPI, hashAPI, jobAPI, progress, &progressData{task: "Reading content", t: t}, scanStats, "content")
+	if err != nil {
+		t.Fatalf("ReadContent() err = %q, want %q", err, error(nil))
+	}
+	defer readCI.Dispose()
+	versionStats := CreateStats()
+	defer versionStats.Dispose()
+	err = WriteVersion(storageAPI, storageAPI, compressionRegistry, jobAPI, progress, &progressData{task: "Writing version", t: t}, versionStats, readCI, vi, "content", "restored")
+	if err != nil {
+		t.Fatalf("WriteVersion() err = %q, want %q", err, error(nil))
+	}
+	checkRestoredAssets(t, storageAPI, assets)
+
+	blockCount := ci.GetBlockCount()
+	checkStat := func(call string, name string, value uint64, ok bool, want string) {
+		if !ok {
+			t.Errorf("%s() %s = %d, want %s", call, name, value, want)
+		}
+	}
+	checkPhases := func(call string, stats Longtail_Stats, phase int) {
+		for p := 0; p < StatsPhaseCount; p++ {
+			wallTime := stats.GetPhaseWallTimeUS(p)
+			if p == phase {
+				checkStat(call, fmt.Sprintf("phase %d wall time", p), wallTime, wallTime > 0, "more than 0")
+			} else {
+				checkStat(call, fmt.Sprintf("phase %d wall time", p), wallTime, wallTime == 0, "0")
+			}
+		}
+	}
+
+	// Every asset is opened, read and hashed once
+	checkStat("CreateVersionIndex", "bytes read", indexStats.GetBytesRead(), indexStats.GetBytesRead() == assetSize, fmt.Sprintf("%d", assetSize))
+	checkStat("CreateVersionIndex", "bytes hashed", indexStats.GetBytesHashed(), indexStats.GetBytesHashed() == assetSize, fmt.Sprintf("%d", assetSize))
+	checkStat("CreateVersionIndex", "files opened", indexStats.GetFilesOpened(), indexStats.GetFilesOpened() == fileCount, fmt.Sprintf("%d", fileCount))
+	checkStat("CreateVersionIndex", "jobs run", indexStats.GetJobsRun(), indexStats.GetJobsRun() > 0, "more than 0")
+	checkPhases("CreateVersionIndex", indexStats, StatsPhaseHashAssets)
+
+	// All chunks read for the blocks are compressed, each block is written once
+	checkStat("WriteContent", "bytes compressed", writeStats.GetBytesCompressed(), writeStats.GetBytesCompressed() == writeStats.GetBytesRead(), fmt.Sprintf("the %d bytes read", writeStats.GetBytesRead()))
+	checkStat("WriteContent", "bytes read", writeStats.GetBytesRead(), writeStats.GetBytesRead() > 0 && writeStats.GetBytesRead() <= assetSize, fmt.Sprintf("1 to %d", assetSize))
+	checkStat("WriteContent", "bytes written", writeStats.GetBytesWritten(), writeStats.GetBytesWritten() > 0 && writeStats.GetBytesWritten() < writeStats.GetBytesRead(), fmt.Sprintf("1 to %d", writeStats.GetBytesRead()))
+	checkStat("WriteContent", "files opened", writeStats.GetFilesOpened(), writeStats.GetFilesOpened() >= 2*blockCount, fmt.Sprintf("at least %d", 2*blockCount))
+	checkStat("WriteContent", "jobs run", writeStats.GetJobsRun(), writeStats.GetJobsRun() > 0, "more than 0")
+	checkPhases("WriteContent", writeStats, StatsPhaseWriteBlocks)
+
+	// Each block index is read once
+	checkStat("ReadContent", "blocks read", scanStats.GetBlocksRead(), scanStats.GetBlocksRead() == blockCount, fmt.Sprintf("%d", blockCount))
+	checkStat("ReadContent", "files opened", scanStats.GetFilesOpened(), scanStats.GetFilesOpened() == blockCount, fmt.Sprintf("%d", blockCount))
+	checkStat("ReadContent", "bytes read", scanStats.GetBytesRead(), scanStats.GetBytesRead() > 0, "more than 0")
+	checkStat("ReadContent", "jobs run", scanStats.GetJobsRun(), scanStats.GetJobsRun() > 0, "more than 0")
+
+	// Every block is decompressed at least once and every asset is written in full
+	checkStat("WriteVersion", "bytes written", versionStats.GetBytesWritten(), versionStats.GetBytesWritten() == assetSize, fmt.Sprintf("%d", assetSize))
+	checkStat("WriteVersion", "bytes decompressed", versionStats.GetBytesDecompressed(), versionStats.GetBytesDecompressed() >= writeStats.GetBytesCompressed(), fmt.Sprintf("at least %d", writeStats.GetBytesCompressed()))
+	checkStat("WriteVersion", "blocks read", versionStats.GetBlocksRead(), versionStats.GetBlocksRead() >= blockCount, fmt.Sprintf("at least %d", blockCount))
+	checkStat("WriteVersion", "bytes hashed", versionStats.GetBytesHashed(), versionStats.GetBytesHashed() == 0, "0")
+	checkStat("WriteVersion", "jobs run", versionStats.GetJobsRun(), versionStats.GetJobsRun() > 0, "more than 0")
+	checkPhases("WriteVersion", versionStats, StatsPhaseWriteAssets)
+}
@@ -11,16 +11,24 @@ echo Building %LIB_TARGET%
 if not exist obj mkdir obj
 if not exist "%LIB_TARGET_FOLDER%" mkdir "%LIB_TARGET_FOLDER%"
 pushd obj
+set ATOMICCANCEL_SRC=..\lib\atomiccancel\*.c
 set BIKESHED_SRC=..\lib\bikeshed\*.c
 set BLAKE2_SRC=..\lib\blake2\*.c ..\lib\blake2\ext\*.c
 set BLAKE3_SRC=..\lib\blake3\*.c ..\lib\blake3\ext\*.c
+set CACHESTORAGE_SRC=..\lib\cachestorage\*.c
+set CHROMETRACE_SRC=..\lib\chrometrace\*.c
 set FILESTORAGE_SRC=..\lib\filestorage\*.c
 set MEMSTORAGE_SRC=..\lib\memstorage\*.c
+set MEMTRACKER_SRC=..\lib\memtracker\*.c
 set MEOWHASH_SRC=..\lib\meowhash\*.c
+set POOLALLOCATOR_SRC=..\lib\poolallocator\*.c
+set SHAPEDSTORAGE_SRC=..\lib\shapedstorage\*.c
+set XXHASH64_SRC=..\lib\xxhash64\*.c
+set WORKSTEALING_SRC=..\lib\workstealing\*.c
 set LIZARD_SRC=..\lib\lizard\*.c ..\lib\lizard\ext\*.c ..\lib\lizard\ext\entropy\*.c ..\lib\lizard\ext\xxhash\*.c
 set BROTLI_SRC=..\lib\brotli\*.c ..\lib\brotli\ext\common\*.c ..\lib\brotli\ext\dec\*.c ..\lib\brotli\ext\enc\*.c ..\lib\brotli\ext\fuzz\*.c
 set ZLIB_SRC=..\lib\zstd\*.c ..\lib\zstd\ext\common\*.c ..\lib\zstd\ext\compress\*.c ..\lib\zstd\ext\decompress\*.c
 del /Q *.o
-gcc -c -std=gnu99 -g -m64 -O3 -pthread -msse4.1 -maes -Isrc -DWINVER=0x0A00 -D_WIN32_WINNT=0x0A00 ..\src\*.c ..\src\ext\*.c ..\lib\*.c %BIKESHED_SRC% %BLAKE2_SRC% %BLAKE3_SRC% %FILESTORAGE_SRC% %MEMSTORAGE_SRC% %MEOWHASH_SRC% %LIZARD_SRC% %BROTLI_SRC% %ZLIB_SRC%
+gcc -c -std=gnu99 -g -m64 -O3 -pthread -msse4.1 -maes -Isrc -DZSTD_MULTITHREAD -DWINVER=0x0A00 -D_WIN32_WINNT=0x0A00 ..\src\*.c ..\src\ext\*.c ..\lib\*.c %ATOMICCANCEL_SRC% %BIKESHED_SRC% %BLAKE2_SRC% %BLAKE3_SRC% %CACHESTORAGE_SRC% %CHROMETRACE_SRC% %FILESTORAGE_SRC% %MEMSTORAGE_SRC% %MEMTRACKER_SRC% %MEOWHASH_SRC% %POOLALLOCATOR_SRC% %SHAPEDSTORAGE_SRC% %XXHASH64_SRC% %WORKSTEALING_SRC% %LIZARD_SRC% %BROTLI_SRC% %ZLIB_SRC%
 popd
 ar rc %LIB_TARGET% obj/*.o
@@ -25,16 +25,24 @@ echo Building $LIB_TARGET_FOLDER
 mkdir -p obj
 mkdir -p $LIB_TARGET_FOLDER
 pushd obj >>/dev/null
+ATOMICCANCEL_SRC="../lib/atomiccancel/*.c"
 BIKESHED_SRC="../lib/bikeshed/*.c"
 BLAKE2_SRC="../lib/blake2/*.c ../lib/blake2/ext/*.c"
 BLAKE3_SRC="../lib/blake3/*.c ../lib/blake3/ext/*.c"
+CACHESTORAGE_SRC="../lib/cachestorage/*.c"
+CHROMETRACE_SRC="../lib/chrometrace/*.c"
 FILESTORAGE_SRC="../lib/filestorage/*.c"
 MEMSTORAGE_SRC="../lib/memstorage/*.c"
+MEMTRACKER_SRC="../lib/memtracker/*.c"
 MEOWHASH_SRC="../lib/meowhash/*.c"
+POOLALLOCATOR_SRC="../lib/poolallocator/*.c"
+SHAPEDSTORAGE_SRC="../lib/shapedstorage/*.c"
+XXHASH64_SRC="../lib/xxhash64/*.c"
+WORKSTEALING_SRC="../lib/workstealing/*.c"
 LIZARD_SRC="../lib/lizard/*.c ../lib/lizard/ext/*.c ../lib/lizard/ext/entropy/*.c ../lib/lizard/ext/xxhash/*.c"
 BROTLI_SRC="../lib/brotli/*.c ../lib/brotli/ext/common/*.c ../lib/brotli/ext/dec/*.c ../lib/brotli/ext/enc/*.c ../lib/brotli/ext/fuzz/*.c"
 ZLIB_SRC="../lib/zstd/*.c ../lib/zstd/ext/common/*.c ../lib/zstd/ext/compress/*.c ../lib/zstd/ext/decompress/*.c"
 rm *.o
-gcc -c -std=gnu99 -m64 -O3 -pthread -msse4.1 -maes -Isrc ../src/*.c ../src/ext/*.c ../lib/*.c $BIKESHED_SRC $BLAKE2_SRC $BLAKE3_SRC $FILESTORAGE_SRC $MEMSTORAGE_SRC $MEOWHASH_SRC $LIZARD_SRC $BROTLI_SRC $ZLIB_SRC
+gcc -c -std=gnu99 -m64 -O3 -pthread -msse4.1 -maes -Isrc -DZSTD_MULTITHREAD ../src/*.c ../src/ext/*.c ../lib/*.c $ATOMICCANCEL_SRC $BIKESHED_SRC $BLAKE2_SRC $BLAKE3_SRC $CACHESTORAGE_SRC $CHROMETRACE_SRC $FILESTORAGE_SRC $MEMSTORAGE_SRC $MEMTRACKER_SRC $MEOWHASH_SRC $POOLALLOCATOR_SRC $SHAPEDSTORAGE_SRC $XXHASH64_SRC $WORKSTEALING_SRC $LIZARD_SRC $BROTLI_SRC $ZLIB_SRC
 popd
 ar rc $LIB_TARGET obj/*.o
@@ -0,0 +1,85 @@
+#include "longtail_atomiccancel.h"
+
+#include "../../src/longtail.h"
+#include "../longtail_platform.h"
+
+#include <errno.h>
+
+struct AtomicCancelAPI
+{
+    struct Longtail_CancelAPI m_AtomicCancelAPI;
+};
+
+struct AtomicCancelToken
+{
+    int32_t volatile m_IsCancelled;
+};
+
+static int AtomicCancel_CreateToken(struct Longtail_CancelAPI* cancel_api, Longtail_CancelAPI_HCancelToken* out_token)
+{
+    LONGTAIL_FATAL_ASSERT(cancel_api != 0, return EINVAL)
+    LONGTAIL_FATAL_ASSERT(out_token != 0, return EINVAL)
+    struct AtomicCancelToken* token = (struct AtomicCancelToken*)Longtail_Alloc(sizeof(struct AtomicCancelToken));
+    if (!token)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "AtomicCancel_CreateToken(%p) failed with %d", cancel_api, ENOMEM)
+        return ENOMEM;
+    }
+    token->m_IsCancelled = 0;
+    *out_token = (Longtail_CancelAPI_HCancelToken)token;
+    return 0;
+}
+
+static int AtomicCancel_Cancel(struct Longtail_CancelAPI* cancel_api, Longtail_CancelAPI_HCancelToken token)
+{
+    LONGTAIL_FATAL_ASSERT(cancel_api != 0, return EINVAL)
+    LONGTAIL_FATAL_ASSERT(token != 0, return EINVAL)
+    struct AtomicCancelToken* atomic_token = (struct AtomicCancelToken*)token;
+    if (atomic_token->m_IsCancelled == 0)
+    {
+        Longtail_AtomicAdd32(&atomic_token->m_IsCancelled, 1);
+    }
+    return 0;
+}
+
+static int AtomicCancel_DisposeToken(struct Longtail_CancelAPI* cancel_api, Longtail_CancelAPI_HCancelToken token)
+{
+    LONGTAIL_FATAL_ASSERT(cancel_api != 0, return EINVAL)
+    LONGTAIL_FATAL_ASSERT(token != 0, return EINVAL)
+    Longtail_Free(token);
+    return 0;
+}
+
+static int AtomicCancel_IsCancelled(struct Longtail_CancelAPI* cancel_api, Longtail_CancelAPI_HCancelToken token)
+{
+    LONGTAIL_FATAL_ASSERT(cancel_api != 0, return EINVAL)
+    LONGTAIL_FATAL_ASSERT(token != 0, return EINVAL)
+    struct AtomicCancelToken* atomic_token = (struct AtomicCancelToken*)token;
+    return atomic_token->m_IsCancelled ? ECANCELED : 0;
+}
+
+static void AtomicCancel_Dispose(struct Longtail_API* cancel_api)
+{
+    Longtail_Free(cancel_api);
+}
+
+static void AtomicCancel_Init(struct AtomicCancelAPI* cancel_api)
+{
+    cancel_api->m_AtomicCancelAPI.m_API.Dispose = AtomicCancel_Dispose;
+    cancel_api->m_AtomicCancelAPI.CreateToken = AtomicCancel_CreateToken;
+    cancel_api->m_AtomicCancelAPI.Cancel = AtomicCancel_Cancel;
+    cancel_api->m_AtomicCancelAPI.DisposeToken = AtomicCancel_DisposeToken;
+    cancel_api->m_AtomicCancelAPI.IsCancelled = AtomicCancel_IsCancelled;
+}
+
+struct Longtail_CancelAPI* Longtail_CreateAtomicCancelAPI()
+{
+    struct AtomicCancelAPI* cancel_api = (struct AtomicCancelAPI*)Longtail_Alloc(sizeof(struct AtomicCancelAPI));
+    if (!cancel_api)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_CreateAtomicCancelAPI() failed with %d", ENOMEM)
+        return 0;
+    }
+    AtomicCancel_Init(cancel_api);
+    return &cancel_api->m_AtomicCancelAPI;
+}
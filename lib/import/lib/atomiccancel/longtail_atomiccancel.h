@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Cancel API where each token is a single atomic flag
+extern struct Longtail_CancelAPI* Longtail_CreateAtomicCancelAPI();
+
+#ifdef __cplusplus
+}
+#endif
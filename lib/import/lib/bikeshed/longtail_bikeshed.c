@@ -8,14 +8,29 @@
 
 #include <errno.h>
 
+// Each segment has its own shed, a new segment of at least twice the size is created when a job group does not fit.
+// A job group larger than BIKESHED_MAX_SEGMENT_TASK_COUNT gets a segment of its own sized to fit it, up to the
+// number of tasks and dependencies a single shed can index
+#define BIKESHED_MAX_SEGMENT_COUNT 16u
+#define BIKESHED_MAX_SEGMENT_TASK_COUNT 1048576u
+#define BIKESHED_MAX_SHED_TASK_COUNT 8388607u
+#define BIKESHED_MAX_SHED_DEPENDENCY_COUNT 8388607u
+#define BIKESHED_DEPENDENCIES_PER_TASK 7u
+
 struct ReadyCallback
 {
     struct Bikeshed_ReadyCallback cb;
     HLongtail_Sema m_Semaphore;
+    HLongtail_Sema m_IOSemaphore;
 };
 
 static void ReadyCallback_Dispose(struct ReadyCallback* ready_callback)
 {
+    if (ready_callback->m_IOSemaphore)
+    {
+        Longtail_DeleteSema(ready_callback->m_IOSemaphore);
+        Longtail_Free(ready_callback->m_IOSemaphore);
+    }
     Longtail_DeleteSema(ready_callback->m_Semaphore);
 	Longtail_Free(ready_callback->m_Semaphore);
 }
@@ -23,35 +38,59 @@ static void ReadyCallback_Dispose(struct ReadyCallback* ready_callback)
 static void ReadyCallback_Ready(struct Bikeshed_ReadyCallback* ready_callback, uint8_t channel, uint32_t ready_count)
 {
     struct ReadyCallback* cb = (struct ReadyCallback*)ready_callback;
+    // Without IO workers the CPU workers pick up the IO jobs
+    if (channel == LONGTAIL_JOB_CHANNEL_IO && cb->m_IOSemaphore)
+    {
+        Longtail_PostSema(cb->m_IOSemaphore, ready_count);
+        return;
+    }
     Longtail_PostSema(cb->m_Semaphore, ready_count);
 }
 
 static void ReadyCallback_Wait(struct ReadyCallback* cb)
 {
-    Longtail_WaitSema(cb->m_Semaphore);
+    Longtail_WaitSema(cb->m_Semaphore, LONGTAIL_TIMEOUT_INFINITE);
 }
 
-static int ReadyCallback_Init(struct ReadyCallback* ready_callback)
+static int ReadyCallback_Init(struct ReadyCallback* ready_callback, int has_io_workers)
 {
     ready_callback->cb.SignalReady = ReadyCallback_Ready;
-    return Longtail_CreateSema(Longtail_Alloc(Longtail_GetSemaSize()), 0, &ready_callback->m_Semaphore);
+    ready_callback->m_IOSemaphore = 0;
+    int err = Longtail_CreateSema(Longtail_Alloc(Longtail_GetSemaSize()), 0, &ready_callback->m_Semaphore);
+    if (err || !has_io_workers)
+    {
+        return err;
+    }
+    err = Longtail_CreateSema(Longtail_Alloc(Longtail_GetSemaSize()), 0, &ready_callback->m_IOSemaphore);
+    if (err)
+    {
+        Longtail_DeleteSema(ready_callback->m_Semaphore);
+        Longtail_Free(ready_callback->m_Semaphore);
+    }
+    return err;
 }
 
+struct BikeshedJobAPI;
+static int Bikeshed_ExecuteChannels(struct BikeshedJobAPI* job_api, uint8_t first_channel, uint8_t channel_count);
 
 struct ThreadWorker
 {
     int32_t volatile*   stop;
-    Bikeshed            shed;
+    struct BikeshedJobAPI* job_api;
     HLongtail_Sema        semaphore;
     HLongtail_Thread      thread;
+    uint8_t             first_channel;
+    uint8_t             channel_count;
 };
 
 static void ThreadWorker_Init(struct ThreadWorker* thread_worker)
 {
     thread_worker->stop = 0;
-    thread_worker->shed = 0;
+    thread_worker->job_api = 0;
     thread_worker->semaphore = 0;
     thread_worker->thread = 0;
+    thread_worker->first_channel = 0;
+    thread_worker->channel_count = 0;
 }
 
 static int32_t ThreadWorker_Execute(void* context)
@@ -60,19 +99,21 @@ static int32_t ThreadWorker_Execute(void* context)
 
     while (*thread_worker->stop == 0)
     {
-        if (!Bikeshed_ExecuteOne(thread_worker->shed, 0))
+        if (!Bikeshed_ExecuteChannels(thread_worker->job_api, thread_worker->first_channel, thread_worker->channel_count))
         {
-            Longtail_WaitSema(thread_worker->semaphore);
+            Longtail_WaitSema(thread_worker->semaphore, LONGTAIL_TIMEOUT_INFINITE);
         }
     }
     return 0;
 }
 
-static int ThreadWorker_CreateThread(struct ThreadWorker* thread_worker, Bikeshed in_shed, HLongtail_Sema in_semaphore, int32_t volatile* in_stop)
+static int ThreadWorker_CreateThread(struct ThreadWorker* thread_worker, struct BikeshedJobAPI* in_job_api, HLongtail_Sema in_semaphore, uint8_t in_first_channel, uint8_t in_channel_count, int32_t volatile* in_stop)
 {
-    thread_worker->shed               = in_shed;
+    thread_worker->job_api            = in_job_api;
     thread_worker->stop               = in_stop;
     thread_worker->semaphore          = in_semaphore;
+    thread_worker->first_channel      = in_first_channel;
+    thread_worker->channel_count      = in_channel_count;
     return Longtail_CreateThread(Longtail_Alloc(Longtail_GetThreadSize()), ThreadWorker_Execute, 0, thread_worker, &thread_worker->thread);
 }
 
@@ -94,108 +135,291 @@ static void ThreadWorker_Dispose(struct ThreadWorker* thread_worker)
 
 struct JobWrapper
 {
-    struct BikeshedJobAPI* m_JobAPI;
+    struct BikeshedJobGroup* m_JobGroup;
     Longtail_JobAPI_JobFunc m_JobFunc;
     void* m_Context;
 };
 
+// Each ReserveJobs call gets its own group so independent pipelines can share the workers
+struct BikeshedJobGroup
+{
+    struct BikeshedJobAPI* m_JobAPI;
+    struct Longtail_CancelAPI* m_CancelAPI;
+    Longtail_CancelAPI_HCancelToken m_CancelToken;
+    struct JobWrapper* m_ReservedJobs;
+    BikeShed_TaskFunc* m_ReservedTaskFuncs;
+    void** m_ReservedTaskContexts;
+    Bikeshed_TaskID* m_ReservedTasksIDs;
+    uint32_t m_ReservedJobCount;
+    uint32_t m_SegmentIndex;
+    int32_t volatile m_TaskIDOffset;
+    int32_t volatile m_SubmittedJobCount;
+    int32_t volatile m_PendingJobCount;
+    int32_t volatile m_JobsCompleted;
+    HLongtail_Sema m_JobsDoneSema;
+};
+
+struct BikeshedSegment
+{
+    Bikeshed m_Shed;
+    uint32_t m_TaskCapacity;
+    uint32_t m_ReservedTaskCount;
+};
+
 struct BikeshedJobAPI
 {
     struct Longtail_JobAPI m_BikeshedAPI;
 
     struct ReadyCallback m_ReadyCallback;
-    Bikeshed m_Shed;
+    struct BikeshedSegment m_Segments[BIKESHED_MAX_SEGMENT_COUNT];
+    int32_t volatile m_SegmentCount;
+    uint32_t m_InitialTaskCapacity;
+    HLongtail_SpinLock m_SegmentLock;
     uint32_t m_WorkerCount;
+    uint32_t m_IOWorkerCount;
     struct ThreadWorker* m_Workers;
     int32_t volatile m_Stop;
-    struct JobWrapper* m_ReservedJobs;
-    Bikeshed_TaskID* m_ReservedTasksIDs;
-    uint32_t m_ReservedJobCount;
-    int32_t volatile m_SubmittedJobCount;
-    int32_t volatile m_PendingJobCount;
-    int32_t volatile m_JobsCompleted;
+    int32_t volatile m_IdleWaiterCount;
+    uint64_t m_ProgressIntervalUS;
 };
 
 static enum Bikeshed_TaskResult Bikeshed_Job(Bikeshed shed, Bikeshed_TaskID task_id, uint8_t channel, void* context)
 {
     struct JobWrapper* wrapper = (struct JobWrapper*)context;
-    wrapper->m_JobFunc(wrapper->m_Context);
-    LONGTAIL_FATAL_ASSERT(wrapper->m_JobAPI->m_PendingJobCount > 0, return BIKESHED_TASK_RESULT_COMPLETE)
-    Longtail_AtomicAdd32(&wrapper->m_JobAPI->m_PendingJobCount, -1);
-    Longtail_AtomicAdd32(&wrapper->m_JobAPI->m_JobsCompleted, 1);
+    struct BikeshedJobGroup* job_group = wrapper->m_JobGroup;
+    int is_cancelled = job_group->m_CancelAPI && job_group->m_CancelAPI->IsCancelled(job_group->m_CancelAPI, job_group->m_CancelToken) == ECANCELED;
+    LONGTAIL_TRACE_BEGIN(job, channel == LONGTAIL_JOB_CHANNEL_IO ? "IOJob" : "CPUJob")
+    wrapper->m_JobFunc(wrapper->m_Context, is_cancelled);
+    LONGTAIL_TRACE_END(job)
+    LONGTAIL_FATAL_ASSERT(job_group->m_PendingJobCount > 0, return BIKESHED_TASK_RESULT_COMPLETE)
+    Longtail_AtomicAdd32(&job_group->m_JobsCompleted, 1);
+    struct BikeshedJobAPI* bikeshed_job_api = job_group->m_JobAPI;
+    if (Longtail_AtomicAdd32(&job_group->m_PendingJobCount, -1) == 0)
+    {
+        // Only the job that completes the group gets here, after WaitForAllJobs released its reference. The post must
+        // be the last access to job_group, WaitForAllJobs frees it as soon as it has taken the post
+        Longtail_PostSema(job_group->m_JobsDoneSema, 1);
+        int32_t idle_waiter_count = bikeshed_job_api->m_WorkerCount == 0 ? Longtail_AtomicAdd32(&bikeshed_job_api->m_IdleWaiterCount, 0) : 0;
+        if (idle_waiter_count > 0)
+        {
+            // We can't tell which of the idle waiters owns this group, wake all of them
+            Longtail_PostSema(bikeshed_job_api->m_ReadyCallback.m_Semaphore, (unsigned int)idle_waiter_count);
+        }
+    }
     return BIKESHED_TASK_RESULT_COMPLETE;
 }
 
-static uint32_t Bikeshed_GetWorkerCount(struct Longtail_JobAPI* job_api)
+// Runs one ready task from the channels [first_channel, first_channel + channel_count), in priority order
+static int Bikeshed_ExecuteChannels(struct BikeshedJobAPI* job_api, uint8_t first_channel, uint8_t channel_count)
 {
-    struct BikeshedJobAPI* bikeshed_job_api = (struct BikeshedJobAPI*)job_api;
-    return bikeshed_job_api->m_WorkerCount;
+    int32_t segment_count = job_api->m_SegmentCount;
+    for (uint8_t channel = first_channel; channel < first_channel + channel_count; ++channel)
+    {
+        for (int32_t s = 0; s < segment_count; ++s)
+        {
+            if (Bikeshed_ExecuteOne(job_api->m_Segments[s].m_Shed, channel))
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
 }
 
-static int Bikeshed_ReserveJobs(struct Longtail_JobAPI* job_api, uint32_t job_count)
+static int Bikeshed_CreateSegment(struct BikeshedJobAPI* job_api, uint32_t task_capacity, struct BikeshedSegment* out_segment)
 {
-    struct BikeshedJobAPI* bikeshed_job_api = (struct BikeshedJobAPI*)job_api;
-    if (bikeshed_job_api->m_PendingJobCount)
+    uint64_t dependency_capacity = (uint64_t)task_capacity * BIKESHED_DEPENDENCIES_PER_TASK;
+    dependency_capacity = dependency_capacity < BIKESHED_MAX_SHED_DEPENDENCY_COUNT ? dependency_capacity : BIKESHED_MAX_SHED_DEPENDENCY_COUNT;
+    void* shed_mem = Longtail_AllocTagged(LONGTAIL_MEMTAG_JOBS, BIKESHED_SIZE(task_capacity, (uint32_t)dependency_capacity, LONGTAIL_JOB_CHANNEL_COUNT));
+    if (!shed_mem)
+    {
+        return ENOMEM;
+    }
+    out_segment->m_Shed = Bikeshed_Create(shed_mem, task_capacity, (uint32_t)dependency_capacity, LONGTAIL_JOB_CHANNEL_COUNT, &job_api->m_ReadyCallback.cb);
+    out_segment->m_TaskCapacity = task_capacity;
+    out_segment->m_ReservedTaskCount = 0;
+    return 0;
+}
+
+// Finds a segment with room for task_count tasks, adding a new segment if none of the existing ones has room
+static int Bikeshed_ReserveSegment(struct BikeshedJobAPI* job_api, uint32_t task_count, uint32_t* out_segment_index)
+{
+    if (task_count > BIKESHED_MAX_SHED_TASK_COUNT)
     {
-        return EBUSY;
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Bikeshed_ReserveSegment(%p, %u) failed with %d", job_api, task_count, ENOMEM)
+        return ENOMEM;
     }
-    if (bikeshed_job_api->m_SubmittedJobCount)
+    while (1)
     {
-        return EBUSY;
+        Longtail_LockSpinLock(job_api->m_SegmentLock);
+        uint32_t segment_count = (uint32_t)job_api->m_SegmentCount;
+        int has_large_enough_segment = 0;
+        for (uint32_t s = 0; s < segment_count; ++s)
+        {
+            struct BikeshedSegment* segment = &job_api->m_Segments[s];
+            has_large_enough_segment |= segment->m_TaskCapacity >= task_count;
+            if (segment->m_TaskCapacity - segment->m_ReservedTaskCount >= task_count)
+            {
+                segment->m_ReservedTaskCount += task_count;
+                Longtail_UnlockSpinLock(job_api->m_SegmentLock);
+                *out_segment_index = s;
+                return 0;
+            }
+        }
+        if (segment_count < BIKESHED_MAX_SEGMENT_COUNT)
+        {
+            uint32_t task_capacity = segment_count == 0 ? job_api->m_InitialTaskCapacity : job_api->m_Segments[segment_count - 1].m_TaskCapacity * 2u;
+            while (task_capacity < task_count)
+            {
+                task_capacity *= 2u;
+            }
+            if (task_capacity > BIKESHED_MAX_SEGMENT_TASK_COUNT)
+            {
+                // Oversized groups get a segment that fits exactly, it is reused by later groups that fit in it
+                task_capacity = task_count > BIKESHED_MAX_SEGMENT_TASK_COUNT ? task_count : BIKESHED_MAX_SEGMENT_TASK_COUNT;
+            }
+            struct BikeshedSegment* segment = &job_api->m_Segments[segment_count];
+            int err = Bikeshed_CreateSegment(job_api, task_capacity, segment);
+            if (err)
+            {
+                Longtail_UnlockSpinLock(job_api->m_SegmentLock);
+                LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Bikeshed_ReserveSegment(%p, %u) failed with %d", job_api, task_count, err)
+                return err;
+            }
+            segment->m_ReservedTaskCount = task_count;
+            // Publish the segment to the workers once it is fully set up
+            Longtail_AtomicAdd32(&job_api->m_SegmentCount, 1);
+            Longtail_UnlockSpinLock(job_api->m_SegmentLock);
+            *out_segment_index = segment_count;
+            return 0;
+        }
+        Longtail_UnlockSpinLock(job_api->m_SegmentLock);
+        if (!has_large_enough_segment)
+        {
+            // No segment will ever have room for the group, waiting for one to be released would never finish
+            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Bikeshed_ReserveSegment(%p, %u) failed with %d", job_api, task_count, ENOMEM)
+            return ENOMEM;
+        }
+        // Every segment is in use, help out until a job group releases its reservation
+        Bikeshed_ExecuteChannels(job_api, 0, LONGTAIL_JOB_CHANNEL_COUNT);
     }
-    if (bikeshed_job_api->m_ReservedJobs)
+}
+
+static void Bikeshed_ReleaseSegment(struct BikeshedJobAPI* job_api, uint32_t segment_index, uint32_t task_count)
+{
+    Longtail_LockSpinLock(job_api->m_SegmentLock);
+    job_api->m_Segments[segment_index].m_ReservedTaskCount -= task_count;
+    Longtail_UnlockSpinLock(job_api->m_SegmentLock);
+}
+
+static uint32_t Bikeshed_GetWorkerCount(struct Longtail_JobAPI* job_api)
+{
+    struct BikeshedJobAPI* bikeshed_job_api = (struct BikeshedJobAPI*)job_api;
+    return bikeshed_job_api->m_WorkerCount;
+}
+
+static int Bikeshed_ReserveJobs(struct Longtail_JobAPI* job_api, uint32_t job_count, struct Longtail_CancelAPI* optional_cancel_api, Longtail_CancelAPI_HCancelToken optional_cancel_token, Longtail_JobAPI_Group* out_job_group)
+{
+    struct BikeshedJobAPI* bikeshed_job_api = (struct BikeshedJobAPI*)job_api;
+    // Each CreateJobs batch of task ids is preceded by the segment index so the jobs can be mapped to their shed
+    size_t job_group_size = sizeof(struct BikeshedJobGroup) +
+        sizeof(struct JobWrapper) * job_count +
+        sizeof(BikeShed_TaskFunc) * job_count +
+        sizeof(void*) * job_count +
+        Longtail_GetSemaSize() +
+        sizeof(Bikeshed_TaskID) * (job_count * 2u + 1u);
+    struct BikeshedJobGroup* job_group = (struct BikeshedJobGroup*)Longtail_AllocTagged(LONGTAIL_MEMTAG_JOBS, job_group_size);
+    if (!job_group)
     {
-        return EBUSY;
+        return ENOMEM;
     }
-    if (bikeshed_job_api->m_ReservedJobCount)
+    int err = Bikeshed_ReserveSegment(bikeshed_job_api, job_count, &job_group->m_SegmentIndex);
+    if (err)
     {
-        return EBUSY;
+        Longtail_Free(job_group);
+        return err;
     }
-    bikeshed_job_api->m_ReservedJobs = (struct JobWrapper*)Longtail_Alloc(sizeof(struct JobWrapper) * job_count);
-    bikeshed_job_api->m_ReservedTasksIDs = (Bikeshed_TaskID*)Longtail_Alloc(sizeof(Bikeshed_TaskID) * job_count);
-    if (bikeshed_job_api->m_ReservedJobs && bikeshed_job_api->m_ReservedTasksIDs)
+    char* p = (char*)&job_group[1];
+    job_group->m_JobAPI = (struct BikeshedJobAPI*)job_api;
+    job_group->m_CancelAPI = optional_cancel_api;
+    job_group->m_CancelToken = optional_cancel_token;
+    job_group->m_ReservedJobs = (struct JobWrapper*)p;
+    p += sizeof(struct JobWrapper) * job_count;
+    job_group->m_ReservedTaskFuncs = (BikeShed_TaskFunc*)p;
+    p += sizeof(BikeShed_TaskFunc) * job_count;
+    job_group->m_ReservedTaskContexts = (void**)p;
+    p += sizeof(void*) * job_count;
+    void* sema_mem = p;
+    p += Longtail_GetSemaSize();
+    job_group->m_ReservedTasksIDs = (Bikeshed_TaskID*)p;
+    job_group->m_ReservedJobCount = job_count;
+    job_group->m_ReservedTasksIDs[0] = job_group->m_SegmentIndex;
+    job_group->m_TaskIDOffset = 0;
+    job_group->m_SubmittedJobCount = 0;
+    // The group holds a reference of its own until WaitForAllJobs so the pending count can not reach zero
+    // while jobs are still being created
+    job_group->m_PendingJobCount = 1;
+    job_group->m_JobsCompleted = 0;
+    err = Longtail_CreateSema(sema_mem, 0, &job_group->m_JobsDoneSema);
+    if (err)
     {
-        bikeshed_job_api->m_ReservedJobCount = job_count;
-        return 0;
+        Bikeshed_ReleaseSegment(bikeshed_job_api, job_group->m_SegmentIndex, job_count);
+        Longtail_Free(job_group);
+        return err;
     }
-	Longtail_Free(bikeshed_job_api->m_ReservedTasksIDs);
-	Longtail_Free(bikeshed_job_api->m_ReservedJobs);
-    return ENOMEM;
+    *out_job_group = (Longtail_JobAPI_Group)job_group;
+    return 0;
 }
 
-static int Bikeshed_CreateJobs(struct Longtail_JobAPI* job_api, uint32_t job_count, Longtail_JobAPI_JobFunc job_funcs[], void* job_contexts[], Longtail_JobAPI_Jobs* out_jobs)
+static int Bikeshed_CreateJobs(struct Longtail_JobAPI* job_api, Longtail_JobAPI_Group job_group, uint32_t job_channel, uint32_t job_count, Longtail_JobAPI_JobFunc job_funcs[], void* job_contexts[], Longtail_JobAPI_Jobs* out_jobs)
 {
     struct BikeshedJobAPI* bikeshed_job_api = (struct BikeshedJobAPI*)job_api;
-    int32_t new_job_count = Longtail_AtomicAdd32(&bikeshed_job_api->m_SubmittedJobCount, (int32_t)job_count);
-    if (new_job_count > (int32_t)bikeshed_job_api->m_ReservedJobCount)
+    struct BikeshedJobGroup* bikeshed_job_group = (struct BikeshedJobGroup*)job_group;
+    LONGTAIL_FATAL_ASSERT(job_channel < LONGTAIL_JOB_CHANNEL_COUNT, return EINVAL)
+    int32_t new_job_count = Longtail_AtomicAdd32(&bikeshed_job_group->m_SubmittedJobCount, (int32_t)job_count);
+    if (new_job_count > (int32_t)bikeshed_job_group->m_ReservedJobCount)
     {
-        Longtail_AtomicAdd32(&bikeshed_job_api->m_SubmittedJobCount, -((int32_t)job_count));
+        Longtail_AtomicAdd32(&bikeshed_job_group->m_SubmittedJobCount, -((int32_t)job_count));
         return ENOMEM;
     }
     uint32_t job_range_start = (uint32_t)(new_job_count - job_count);
-
-    BikeShed_TaskFunc* func = (BikeShed_TaskFunc*)Longtail_Alloc(sizeof(BikeShed_TaskFunc) * job_count);
-    void** ctx = (void**)Longtail_Alloc(sizeof(void*) * job_count);
-    Bikeshed_TaskID* task_ids = &bikeshed_job_api->m_ReservedTasksIDs[job_range_start];
+    if (job_count == 0)
+    {
+        *out_jobs = &bikeshed_job_group->m_ReservedTasksIDs[1];
+        return 0;
+    }
+    int32_t task_id_end = Longtail_AtomicAdd32(&bikeshed_job_group->m_TaskIDOffset, (int32_t)(job_count + 1));
+    Bikeshed_TaskID* batch = &bikeshed_job_group->m_ReservedTasksIDs[task_id_end - (int32_t)(job_count + 1)];
+    batch[0] = bikeshed_job_group->m_SegmentIndex;
+    Bikeshed shed = bikeshed_job_api->m_Segments[bikeshed_job_group->m_SegmentIndex].m_Shed;
+
+    // The task descriptors are built in the group storage so submitting jobs does not allocate
+    BikeShed_TaskFunc* func = &bikeshed_job_group->m_ReservedTaskFuncs[job_range_start];
+    void** ctx = &bikeshed_job_group->m_ReservedTaskContexts[job_range_start];
+    Bikeshed_TaskID* task_ids = &batch[1];
     for (uint32_t i = 0; i < job_count; ++i)
     {
-        struct JobWrapper* job_wrapper = &bikeshed_job_api->m_ReservedJobs[job_range_start + i];
-        job_wrapper->m_JobAPI = bikeshed_job_api;
+        struct JobWrapper* job_wrapper = &bikeshed_job_group->m_ReservedJobs[job_range_start + i];
+        job_wrapper->m_JobGroup = bikeshed_job_group;
         job_wrapper->m_Context = job_contexts[i];
         job_wrapper->m_JobFunc = job_funcs[i];
         func[i] = Bikeshed_Job;
         ctx[i] = job_wrapper;
     }
 
-    while (!Bikeshed_CreateTasks(bikeshed_job_api->m_Shed, job_count, func, ctx, task_ids))
+    // The segment reservation leaves room for the group, but a finished task is only returned to the
+    // shed after its job function has returned so a completed group might still hold on to a few slots
+    while (!Bikeshed_CreateTasks(shed, job_count, func, ctx, task_ids))
+    {
+        Bikeshed_ExecuteChannels(bikeshed_job_api, 0, LONGTAIL_JOB_CHANNEL_COUNT);
+    }
+    if (job_channel != 0)
     {
-        Bikeshed_ExecuteOne(bikeshed_job_api->m_Shed, 0);
+        Bikeshed_SetTasksChannel(shed, job_count, task_ids, (uint8_t)job_channel);
     }
 
-    Longtail_AtomicAdd32(&bikeshed_job_api->m_PendingJobCount, (int)job_count);
+    Longtail_AtomicAdd32(&bikeshed_job_group->m_PendingJobCount, (int)job_count);
 
-	Longtail_Free(ctx);
-	Longtail_Free(func);
     *out_jobs = task_ids;
     return 0;
 }
@@ -203,9 +427,12 @@ static int Bikeshed_CreateJobs(struct Longtail_JobAPI* job_api, uint32_t job_cou
 static int Bikeshed_AddDependecies(struct Longtail_JobAPI* job_api, uint32_t job_count, Longtail_JobAPI_Jobs jobs, uint32_t dependency_job_count, Longtail_JobAPI_Jobs dependency_jobs)
 {
     struct BikeshedJobAPI* bikeshed_job_api = (struct BikeshedJobAPI*)job_api;
-    while (!Bikeshed_AddDependencies(bikeshed_job_api->m_Shed, job_count, (Bikeshed_TaskID*)jobs, dependency_job_count, (Bikeshed_TaskID*)dependency_jobs))
+    Bikeshed_TaskID segment_index = ((Bikeshed_TaskID*)jobs)[-1];
+    LONGTAIL_FATAL_ASSERT(segment_index == ((Bikeshed_TaskID*)dependency_jobs)[-1], return EINVAL)
+    Bikeshed shed = bikeshed_job_api->m_Segments[segment_index].m_Shed;
+    while (!Bikeshed_AddDependencies(shed, job_count, (Bikeshed_TaskID*)jobs, dependency_job_count, (Bikeshed_TaskID*)dependency_jobs))
     {
-        Bikeshed_ExecuteOne(bikeshed_job_api->m_Shed, 0);
+        Bikeshed_ExecuteChannels(bikeshed_job_api, 0, LONGTAIL_JOB_CHANNEL_COUNT);
     }
     return 0;
 }
@@ -213,64 +440,107 @@ static int Bikeshed_AddDependecies(struct Longtail_JobAPI* job_api, uint32_t job
 static int Bikeshed_ReadyJobs(struct Longtail_JobAPI* job_api, uint32_t job_count, Longtail_JobAPI_Jobs jobs)
 {
     struct BikeshedJobAPI* bikeshed_job_api = (struct BikeshedJobAPI*)job_api;
-    Bikeshed_ReadyTasks(bikeshed_job_api->m_Shed, job_count, (Bikeshed_TaskID*)jobs);
+    Bikeshed_TaskID segment_index = ((Bikeshed_TaskID*)jobs)[-1];
+    Bikeshed_ReadyTasks(bikeshed_job_api->m_Segments[segment_index].m_Shed, job_count, (Bikeshed_TaskID*)jobs);
     return 0;
 }
 
-static int Bikeshed_WaitForAllJobs(struct Longtail_JobAPI* job_api, void* context, Longtail_JobAPI_ProgressFunc process_func)
+static int Bikeshed_WaitForAllJobs(struct Longtail_JobAPI* job_api, Longtail_JobAPI_Group job_group, void* context, Longtail_JobAPI_ProgressFunc process_func)
 {
     struct BikeshedJobAPI* bikeshed_job_api = (struct BikeshedJobAPI*)job_api;
-    int32_t old_pending_count = 0;
-    while (bikeshed_job_api->m_PendingJobCount > 0)
+    struct BikeshedJobGroup* bikeshed_job_group = (struct BikeshedJobGroup*)job_group;
+    uint64_t progress_interval_us = bikeshed_job_api->m_ProgressIntervalUS;
+    uint64_t next_progress_time_us = 0;
+    LONGTAIL_TRACE_BEGIN(wait, "WaitForAllJobs")
+    // If releasing our reference completes the group no job touches it anymore, otherwise the job
+    // that completes it posts m_JobsDoneSema exactly once
+    int last_job_posts = Longtail_AtomicAdd32(&bikeshed_job_group->m_PendingJobCount, -1) != 0;
+    int jobs_done_taken = 0;
+    while (bikeshed_job_group->m_PendingJobCount > 0)
     {
         if (process_func)
         {
-            process_func(context, (uint32_t)bikeshed_job_api->m_ReservedJobCount, (uint32_t)bikeshed_job_api->m_JobsCompleted);
+            uint64_t now_us = Longtail_GetTimeUS();
+            if (now_us >= next_progress_time_us)
+            {
+                process_func(context, (uint32_t)bikeshed_job_group->m_ReservedJobCount, (uint32_t)bikeshed_job_group->m_JobsCompleted);
+                next_progress_time_us = now_us + progress_interval_us;
+            }
+        }
+        if (Bikeshed_ExecuteChannels(bikeshed_job_api, 0, LONGTAIL_JOB_CHANNEL_COUNT))
+        {
+            continue;
         }
-        if (Bikeshed_ExecuteOne(bikeshed_job_api->m_Shed, 0))
+        uint64_t timeout_us = (process_func && progress_interval_us) ? progress_interval_us : LONGTAIL_TIMEOUT_INFINITE;
+        if (bikeshed_job_api->m_WorkerCount == 0)
         {
+            // Without workers the waiting threads run the CPU jobs, sleep until a job is ready or a group completes
+            Longtail_AtomicAdd32(&bikeshed_job_api->m_IdleWaiterCount, 1);
+            if (bikeshed_job_group->m_PendingJobCount > 0)
+            {
+                Longtail_WaitSema(bikeshed_job_api->m_ReadyCallback.m_Semaphore, timeout_us);
+            }
+            Longtail_AtomicAdd32(&bikeshed_job_api->m_IdleWaiterCount, -1);
             continue;
         }
-        if (old_pending_count != bikeshed_job_api->m_PendingJobCount)
+        // Nothing we can run, sleep until the last pending job completes or it is time to report progress
+        if (Longtail_WaitSema(bikeshed_job_group->m_JobsDoneSema, timeout_us) == 0)
         {
-            old_pending_count = bikeshed_job_api->m_PendingJobCount;
+            jobs_done_taken = 1;
+            break;
         }
-        Longtail_Sleep(1000);
     }
+    if (last_job_posts && !jobs_done_taken)
+    {
+        // The last job may still be on its way to the post, block until it is done with the group
+        Longtail_WaitSema(bikeshed_job_group->m_JobsDoneSema, LONGTAIL_TIMEOUT_INFINITE);
+    }
+    LONGTAIL_TRACE_END(wait)
     if (process_func)
     {
-        process_func(context, (uint32_t)bikeshed_job_api->m_SubmittedJobCount, (uint32_t)bikeshed_job_api->m_SubmittedJobCount);
+        process_func(context, (uint32_t)bikeshed_job_group->m_SubmittedJobCount, (uint32_t)bikeshed_job_group->m_SubmittedJobCount);
     }
-    bikeshed_job_api->m_SubmittedJobCount = 0;
-	Longtail_Free(bikeshed_job_api->m_ReservedTasksIDs);
-    bikeshed_job_api->m_ReservedTasksIDs = 0;
-	Longtail_Free(bikeshed_job_api->m_ReservedJobs);
-    bikeshed_job_api->m_ReservedJobs = 0;
-    bikeshed_job_api->m_JobsCompleted = 0;
-    bikeshed_job_api->m_ReservedJobCount = 0;
-    return 0;
+    int err = 0;
+    if (bikeshed_job_group->m_CancelAPI)
+    {
+        err = bikeshed_job_group->m_CancelAPI->IsCancelled(bikeshed_job_group->m_CancelAPI, bikeshed_job_group->m_CancelToken);
+    }
+    Bikeshed_ReleaseSegment(bikeshed_job_api, bikeshed_job_group->m_SegmentIndex, bikeshed_job_group->m_ReservedJobCount);
+    Longtail_DeleteSema(bikeshed_job_group->m_JobsDoneSema);
+    Longtail_Free(bikeshed_job_group);
+    return err;
 }
 
 static void Bikeshed_Dispose(struct Longtail_API* job_api)
 {
     struct BikeshedJobAPI* bikeshed_job_api = (struct BikeshedJobAPI*)job_api;
     Longtail_AtomicAdd32(&bikeshed_job_api->m_Stop, 1);
-    ReadyCallback_Ready(&bikeshed_job_api->m_ReadyCallback.cb, 0, bikeshed_job_api->m_WorkerCount);
-    for (uint32_t i = 0; i < bikeshed_job_api->m_WorkerCount; ++i)
+    uint32_t thread_count = bikeshed_job_api->m_WorkerCount + bikeshed_job_api->m_IOWorkerCount;
+    ReadyCallback_Ready(&bikeshed_job_api->m_ReadyCallback.cb, LONGTAIL_JOB_CHANNEL_CPU, bikeshed_job_api->m_WorkerCount);
+    if (bikeshed_job_api->m_IOWorkerCount > 0)
+    {
+        ReadyCallback_Ready(&bikeshed_job_api->m_ReadyCallback.cb, LONGTAIL_JOB_CHANNEL_IO, bikeshed_job_api->m_IOWorkerCount);
+    }
+    for (uint32_t i = 0; i < thread_count; ++i)
     {
         ThreadWorker_JoinThread(&bikeshed_job_api->m_Workers[i]);
     }
-    for (uint32_t i = 0; i < bikeshed_job_api->m_WorkerCount; ++i)
+    for (uint32_t i = 0; i < thread_count; ++i)
     {
         ThreadWorker_Dispose(&bikeshed_job_api->m_Workers[i]);
     }
 	Longtail_Free(bikeshed_job_api->m_Workers);
-	Longtail_Free(bikeshed_job_api->m_Shed);
+    for (int32_t s = 0; s < bikeshed_job_api->m_SegmentCount; ++s)
+    {
+        Longtail_Free(bikeshed_job_api->m_Segments[s].m_Shed);
+    }
+    Longtail_DeleteSpinLock(bikeshed_job_api->m_SegmentLock);
+    Longtail_Free(bikeshed_job_api->m_SegmentLock);
 	ReadyCallback_Dispose(&bikeshed_job_api->m_ReadyCallback);
     Longtail_Free(bikeshed_job_api);
 }
 
-static int Bikeshed_Init(struct BikeshedJobAPI* job_api, uint32_t worker_count)
+static int Bikeshed_Init(struct BikeshedJobAPI* job_api, uint32_t worker_count, uint32_t io_worker_count, uint32_t progress_interval_ms, uint32_t initial_task_capacity)
 {
     job_api->m_BikeshedAPI.m_API.Dispose = Bikeshed_Dispose;
     job_api->m_BikeshedAPI.GetWorkerCount = Bikeshed_GetWorkerCount;
@@ -279,34 +549,57 @@ static int Bikeshed_Init(struct BikeshedJobAPI* job_api, uint32_t worker_count)
     job_api->m_BikeshedAPI.AddDependecies = Bikeshed_AddDependecies;
     job_api->m_BikeshedAPI.ReadyJobs = Bikeshed_ReadyJobs;
     job_api->m_BikeshedAPI.WaitForAllJobs = Bikeshed_WaitForAllJobs;
-    job_api->m_Shed = 0;
+    job_api->m_SegmentCount = 0;
+    job_api->m_InitialTaskCapacity = initial_task_capacity == 0 ? 1u : initial_task_capacity;
+    job_api->m_SegmentLock = 0;
     job_api->m_WorkerCount = worker_count;
+    job_api->m_IOWorkerCount = io_worker_count;
     job_api->m_Workers = 0;
     job_api->m_Stop = 0;
-    job_api->m_ReservedJobs = 0;
-    job_api->m_ReservedTasksIDs = 0;
-    job_api->m_ReservedJobCount = 0;
-    job_api->m_SubmittedJobCount = 0;
-    job_api->m_PendingJobCount = 0;
-    job_api->m_JobsCompleted = 0;
-
-	int err = ReadyCallback_Init(&job_api->m_ReadyCallback);
+    job_api->m_IdleWaiterCount = 0;
+    job_api->m_ProgressIntervalUS = (uint64_t)progress_interval_ms * 1000u;
+
+	int err = ReadyCallback_Init(&job_api->m_ReadyCallback, io_worker_count > 0);
+    if (err)
+    {
+        return err;
+    }
+
+    void* spin_lock_mem = Longtail_Alloc(Longtail_GetSpinLockSize());
+    if (!spin_lock_mem)
+    {
+        ReadyCallback_Dispose(&job_api->m_ReadyCallback);
+        return ENOMEM;
+    }
+    err = Longtail_CreateSpinLock(spin_lock_mem, &job_api->m_SegmentLock);
     if (err)
     {
+        Longtail_Free(spin_lock_mem);
+        ReadyCallback_Dispose(&job_api->m_ReadyCallback);
         return err;
     }
 
-    job_api->m_Shed = Bikeshed_Create(Longtail_Alloc(BIKESHED_SIZE(1048576, 7340032, 1)), 1048576, 7340032, 1, &job_api->m_ReadyCallback.cb);
-    job_api->m_Workers = (struct ThreadWorker*)Longtail_Alloc(sizeof(struct ThreadWorker) * job_api->m_WorkerCount);
+    uint32_t thread_count = worker_count + io_worker_count;
+    job_api->m_Workers = (struct ThreadWorker*)Longtail_Alloc(sizeof(struct ThreadWorker) * thread_count);
     if (!job_api->m_Workers)
     {
+        Longtail_DeleteSpinLock(job_api->m_SegmentLock);
+        Longtail_Free(job_api->m_SegmentLock);
         ReadyCallback_Dispose(&job_api->m_ReadyCallback);
         return ENOMEM;
     }
-    for (uint32_t i = 0; i < job_api->m_WorkerCount; ++i)
+    for (uint32_t i = 0; i < thread_count; ++i)
     {
         ThreadWorker_Init(&job_api->m_Workers[i]);
-        err = ThreadWorker_CreateThread(&job_api->m_Workers[i], job_api->m_Shed, job_api->m_ReadyCallback.m_Semaphore, &job_api->m_Stop);
+        // CPU workers run the IO jobs too unless there are dedicated IO workers
+        if (i < worker_count)
+        {
+            err = ThreadWorker_CreateThread(&job_api->m_Workers[i], job_api, job_api->m_ReadyCallback.m_Semaphore, LONGTAIL_JOB_CHANNEL_CPU, io_worker_count > 0 ? 1 : LONGTAIL_JOB_CHANNEL_COUNT, &job_api->m_Stop);
+        }
+        else
+        {
+            err = ThreadWorker_CreateThread(&job_api->m_Workers[i], job_api, job_api->m_ReadyCallback.m_IOSemaphore, LONGTAIL_JOB_CHANNEL_IO, 1, &job_api->m_Stop);
+        }
         if (err)
         {
             while(i-- > 0)
@@ -314,16 +607,33 @@ static int Bikeshed_Init(struct BikeshedJobAPI* job_api, uint32_t worker_count)
                 ThreadWorker_DisposeThread(&job_api->m_Workers[i]);
             }
             Longtail_Free(job_api->m_Workers);
+            Longtail_DeleteSpinLock(job_api->m_SegmentLock);
+            Longtail_Free(job_api->m_SegmentLock);
             ReadyCallback_Dispose(&job_api->m_ReadyCallback);
-            return err;
+                return err;
         }
     }
     return 0;
 }
 
-struct Longtail_JobAPI* Longtail_CreateBikeshedJobAPI(uint32_t worker_count)
+struct Longtail_JobAPI* Longtail_CreateBikeshedJobAPIWithTaskCapacity(uint32_t worker_count, uint32_t io_worker_count, uint32_t progress_interval_ms, uint32_t initial_task_capacity)
 {
     struct BikeshedJobAPI* job_api = (struct BikeshedJobAPI*)Longtail_Alloc(sizeof(struct BikeshedJobAPI));
-    Bikeshed_Init(job_api, worker_count);
+    Bikeshed_Init(job_api, worker_count, io_worker_count, progress_interval_ms, initial_task_capacity);
     return &job_api->m_BikeshedAPI;
 }
+
+struct Longtail_JobAPI* Longtail_CreateBikeshedJobAPIWithIOWorkers(uint32_t worker_count, uint32_t io_worker_count, uint32_t progress_interval_ms)
+{
+    return Longtail_CreateBikeshedJobAPIWithTaskCapacity(worker_count, io_worker_count, progress_interval_ms, LONGTAIL_BIKESHED_DEFAULT_TASK_CAPACITY);
+}
+
+struct Longtail_JobAPI* Longtail_CreateBikeshedJobAPIWithProgressInterval(uint32_t worker_count, uint32_t progress_interval_ms)
+{
+    return Longtail_CreateBikeshedJobAPIWithIOWorkers(worker_count, 0, progress_interval_ms);
+}
+
+struct Longtail_JobAPI* Longtail_CreateBikeshedJobAPI(uint32_t worker_count)
+{
+    return Longtail_CreateBikeshedJobAPIWithProgressInterval(worker_count, LONGTAIL_BIKESHED_DEFAULT_PROGRESS_INTERVAL_MS);
+}
@@ -6,8 +6,23 @@
 extern "C" {
 #endif
 
+#define LONGTAIL_BIKESHED_DEFAULT_PROGRESS_INTERVAL_MS 100u
+#define LONGTAIL_BIKESHED_DEFAULT_TASK_CAPACITY 16384u
+
 extern struct Longtail_JobAPI* Longtail_CreateBikeshedJobAPI(uint32_t worker_count);
 
+// progress_interval_ms is the minimum time between progress callbacks from WaitForAllJobs
+extern struct Longtail_JobAPI* Longtail_CreateBikeshedJobAPIWithProgressInterval(uint32_t worker_count, uint32_t progress_interval_ms);
+
+// worker_count workers run jobs on the CPU channel, io_worker_count additional workers run jobs on the IO channel.
+// With io_worker_count set to zero the CPU workers also run the IO jobs.
+extern struct Longtail_JobAPI* Longtail_CreateBikeshedJobAPIWithIOWorkers(uint32_t worker_count, uint32_t io_worker_count, uint32_t progress_interval_ms);
+
+// Tasks are allocated in segments, the first one holds initial_task_capacity tasks and every new segment is twice
+// the size of the previous one, up to 1048576 tasks. A job group larger than that gets a segment of its own, a single
+// job group can hold at most 8388607 jobs.
+extern struct Longtail_JobAPI* Longtail_CreateBikeshedJobAPIWithTaskCapacity(uint32_t worker_count, uint32_t io_worker_count, uint32_t progress_interval_ms, uint32_t initial_task_capacity);
+
 #ifdef __cplusplus
 }
 #endif
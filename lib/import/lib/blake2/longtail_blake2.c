@@ -15,16 +15,44 @@ static uint32_t Blake2Hash_GetIdentifier(struct Longtail_HashAPI* hash_api)
     return LONGTAIL_BLAKE2_HASH_TYPE;
 }
 
+static uint32_t Blake2Hash_GetContextSize(struct Longtail_HashAPI* hash_api)
+{
+    return (uint32_t)sizeof(blake2s_state);
+}
+
+static int Blake2Hash_BeginContextInPlace(struct Longtail_HashAPI* hash_api, void* context_memory, Longtail_HashAPI_HContext* out_context)
+{
+    blake2s_state* state = (blake2s_state*)context_memory;
+    int err = blake2s_init( state, sizeof(uint64_t));
+    if (err)
+    {
+        return err;
+    }
+    *out_context = (Longtail_HashAPI_HContext)state;
+    return 0;
+}
+
+static uint64_t Blake2Hash_EndContextInPlace(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext context)
+{
+    blake2s_state* state = (blake2s_state*)context;
+    uint64_t hash;
+    int err = blake2s_final(state, &hash, sizeof(uint64_t));
+    if (err)
+    {
+        return 0;
+    }
+    return hash;
+}
+
 static int Blake2Hash_BeginContext(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext* out_context)
 {
     blake2s_state* state = (blake2s_state*)Longtail_Alloc(sizeof(blake2s_state));
-    int err = blake2s_init( state, sizeof(uint64_t));
+    int err = Blake2Hash_BeginContextInPlace(hash_api, state, out_context);
     if (err)
     {
         Longtail_Free(state);
         return err;
     }
-    *out_context = (Longtail_HashAPI_HContext)state;
     return 0;
 }
 
@@ -36,14 +64,8 @@ static void Blake2Hash_Hash(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_
 
 static uint64_t Blake2Hash_EndContext(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext context)
 {
-    blake2s_state* state = (blake2s_state*)context;
-    uint64_t hash;
-    int err = blake2s_final(state, &hash, sizeof(uint64_t));
-    if (err)
-    {
-        return 0;
-    }
-	Longtail_Free(state);
+    uint64_t hash = Blake2Hash_EndContextInPlace(hash_api, context);
+    Longtail_Free(context);
     return hash;
 }
 
@@ -65,6 +87,9 @@ static void Blake2Hash_Init(struct Blake2HashAPI* hash_api)
     hash_api->m_Blake2HashAPI.Hash = Blake2Hash_Hash;
     hash_api->m_Blake2HashAPI.EndContext = Blake2Hash_EndContext;
     hash_api->m_Blake2HashAPI.HashBuffer = Blake2Hash_HashBuffer;
+    hash_api->m_Blake2HashAPI.GetContextSize = Blake2Hash_GetContextSize;
+    hash_api->m_Blake2HashAPI.BeginContextInPlace = Blake2Hash_BeginContextInPlace;
+    hash_api->m_Blake2HashAPI.EndContextInPlace = Blake2Hash_EndContextInPlace;
 }
 
 struct Longtail_HashAPI* Longtail_CreateBlake2HashAPI()
@@ -15,14 +15,33 @@ static uint32_t Blake3Hash_GetIdentifier(struct Longtail_HashAPI* hash_api)
     return LONGTAIL_BLAKE3_HASH_TYPE;
 }
 
-static int Blake3Hash_BeginContext(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext* out_context)
+static uint32_t Blake3Hash_GetContextSize(struct Longtail_HashAPI* hash_api)
 {
-    blake3_hasher* hasher = (blake3_hasher*)Longtail_Alloc(sizeof(blake3_hasher));
+    return (uint32_t)sizeof(blake3_hasher);
+}
+
+static int Blake3Hash_BeginContextInPlace(struct Longtail_HashAPI* hash_api, void* context_memory, Longtail_HashAPI_HContext* out_context)
+{
+    blake3_hasher* hasher = (blake3_hasher*)context_memory;
     blake3_hasher_init(hasher);
     *out_context = (Longtail_HashAPI_HContext)hasher;
     return 0;
 }
 
+static uint64_t Blake3Hash_EndContextInPlace(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext context)
+{
+    blake3_hasher* hasher = (blake3_hasher*)context;
+    uint64_t hash;
+    blake3_hasher_finalize(hasher, (uint8_t*)&hash, sizeof(uint64_t));
+    return hash;
+}
+
+static int Blake3Hash_BeginContext(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext* out_context)
+{
+    blake3_hasher* hasher = (blake3_hasher*)Longtail_Alloc(sizeof(blake3_hasher));
+    return Blake3Hash_BeginContextInPlace(hash_api, hasher, out_context);
+}
+
 static void Blake3Hash_Hash(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext context, uint32_t length, const void* data)
 {
     blake3_hasher* hasher = (blake3_hasher*)context;
@@ -31,10 +50,8 @@ static void Blake3Hash_Hash(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_
 
 static uint64_t Blake3Hash_EndContext(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext context)
 {
-    blake3_hasher* hasher = (blake3_hasher*)context;
-    uint64_t hash;
-    blake3_hasher_finalize(hasher, (uint8_t*)&hash, sizeof(uint64_t));
-	Longtail_Free(hasher);
+    uint64_t hash = Blake3Hash_EndContextInPlace(hash_api, context);
+    Longtail_Free(context);
     return hash;
 }
 
@@ -60,6 +77,9 @@ static void Blake3Hash_Init(struct Blake3HashAPI* hash_api)
     hash_api->m_Blake3HashAPI.Hash = Blake3Hash_Hash;
     hash_api->m_Blake3HashAPI.EndContext = Blake3Hash_EndContext;
     hash_api->m_Blake3HashAPI.HashBuffer = Blake3Hash_HashBuffer;
+    hash_api->m_Blake3HashAPI.GetContextSize = Blake3Hash_GetContextSize;
+    hash_api->m_Blake3HashAPI.BeginContextInPlace = Blake3Hash_BeginContextInPlace;
+    hash_api->m_Blake3HashAPI.EndContextInPlace = Blake3Hash_EndContextInPlace;
 }
 
 struct Longtail_HashAPI* Longtail_CreateBlake3HashAPI()
@@ -1,5 +1,7 @@
 #include "longtail_brotli.h"
 
+#include "../longtail_platform.h"
+
 #define FSE_STATIC_LINKING_ONLY
 #include "ext/include/brotli/decode.h"
 #include "ext/include/brotli/encode.h"
@@ -27,25 +29,193 @@ Longtail_CompressionAPI_HSettings LONGTAIL_BROTLI_TEXT_MIN_QUALITY          = (L
 Longtail_CompressionAPI_HSettings LONGTAIL_BROTLI_TEXT_DEFAULT_QUALITY      = (Longtail_CompressionAPI_HSettings)&LONGTAIL_BROTLI_TEXT_DEFAULT_QUALITY_SETTINGS;
 Longtail_CompressionAPI_HSettings LONGTAIL_BROTLI_TEXT_MAX_QUALITY          = (Longtail_CompressionAPI_HSettings)&LONGTAIL_BROTLI_TEXT_MAX_QUALITY_SETTINGS;
 
+#define LONGTAIL_BROTLI_MAX_CACHED_ALLOCATIONS    16
+#define LONGTAIL_BROTLI_MAX_POOLED_CONTEXTS       64
+#define LONGTAIL_BROTLI_ALLOCATION_HEADER_SIZE    16
+
+// Brotli encoder/decoder instances can not be reset, so a context instead keeps the memory
+// the instances allocate and hands it back to the next instance created with the context
+struct BrotliContext
+{
+    uint32_t m_AllocationCount;
+    size_t m_AllocationSizes[LONGTAIL_BROTLI_MAX_CACHED_ALLOCATIONS];
+    void* m_Allocations[LONGTAIL_BROTLI_MAX_CACHED_ALLOCATIONS];
+};
+
+static void* BrotliContext_Alloc(void* opaque, size_t size)
+{
+    struct BrotliContext* context = (struct BrotliContext*)opaque;
+    for (uint32_t i = 0; i < context->m_AllocationCount; ++i)
+    {
+        if (context->m_AllocationSizes[i] == size)
+        {
+            void* p = context->m_Allocations[i];
+            --context->m_AllocationCount;
+            context->m_AllocationSizes[i] = context->m_AllocationSizes[context->m_AllocationCount];
+            context->m_Allocations[i] = context->m_Allocations[context->m_AllocationCount];
+            return p;
+        }
+    }
+    char* mem = (char*)Longtail_Alloc(LONGTAIL_BROTLI_ALLOCATION_HEADER_SIZE + size);
+    if (!mem)
+    {
+        return 0;
+    }
+    *(size_t*)(void*)mem = size;
+    return &mem[LONGTAIL_BROTLI_ALLOCATION_HEADER_SIZE];
+}
+
+static void BrotliContext_Free(void* opaque, void* address)
+{
+    if (!address)
+    {
+        return;
+    }
+    struct BrotliContext* context = (struct BrotliContext*)opaque;
+    char* mem = &((char*)address)[-LONGTAIL_BROTLI_ALLOCATION_HEADER_SIZE];
+    if (context->m_AllocationCount < LONGTAIL_BROTLI_MAX_CACHED_ALLOCATIONS)
+    {
+        context->m_AllocationSizes[context->m_AllocationCount] = *(size_t*)(void*)mem;
+        context->m_Allocations[context->m_AllocationCount] = address;
+        ++context->m_AllocationCount;
+        return;
+    }
+    Longtail_Free(mem);
+}
+
+static void BrotliContext_Dispose(struct BrotliContext* context)
+{
+    while (context->m_AllocationCount)
+    {
+        --context->m_AllocationCount;
+        Longtail_Free(&((char*)context->m_Allocations[context->m_AllocationCount])[-LONGTAIL_BROTLI_ALLOCATION_HEADER_SIZE]);
+    }
+    Longtail_Free(context);
+}
+
 struct BrotliCompressionAPI
 {
     struct Longtail_CompressionAPI m_BrotliCompressionAPI;
+    HLongtail_SpinLock m_SpinLock;
+    uint32_t m_ContextCount;
+    struct BrotliContext* m_Contexts[LONGTAIL_BROTLI_MAX_POOLED_CONTEXTS];
 };
 
 void BrotliCompressionAPI_Dispose(struct Longtail_API* compression_api)
 {
+    struct BrotliCompressionAPI* brotli_compression_api = (struct BrotliCompressionAPI*)compression_api;
+    while (brotli_compression_api->m_ContextCount)
+    {
+        BrotliContext_Dispose(brotli_compression_api->m_Contexts[--brotli_compression_api->m_ContextCount]);
+    }
+    Longtail_DeleteSpinLock(brotli_compression_api->m_SpinLock);
     Longtail_Free(compression_api);
 }
 
+static int BrotliCompressionAPI_CreateContext(struct BrotliCompressionAPI* brotli_compression_api, struct BrotliContext** out_context)
+{
+    struct BrotliContext* context = 0;
+    Longtail_LockSpinLock(brotli_compression_api->m_SpinLock);
+    if (brotli_compression_api->m_ContextCount)
+    {
+        context = brotli_compression_api->m_Contexts[--brotli_compression_api->m_ContextCount];
+    }
+    Longtail_UnlockSpinLock(brotli_compression_api->m_SpinLock);
+    if (!context)
+    {
+        context = (struct BrotliContext*)Longtail_Alloc(sizeof(struct BrotliContext));
+        if (!context)
+        {
+            return ENOMEM;
+        }
+        context->m_AllocationCount = 0;
+    }
+    *out_context = context;
+    return 0;
+}
+
+static void BrotliCompressionAPI_DeleteContext(struct BrotliCompressionAPI* brotli_compression_api, struct BrotliContext* context)
+{
+    Longtail_LockSpinLock(brotli_compression_api->m_SpinLock);
+    if (brotli_compression_api->m_ContextCount < LONGTAIL_BROTLI_MAX_POOLED_CONTEXTS)
+    {
+        brotli_compression_api->m_Contexts[brotli_compression_api->m_ContextCount++] = context;
+        context = 0;
+    }
+    Longtail_UnlockSpinLock(brotli_compression_api->m_SpinLock);
+    if (context)
+    {
+        BrotliContext_Dispose(context);
+    }
+}
+
 size_t BrotliCompressionAPI_GetMaxCompressedSize(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HSettings settings, size_t size)
 {
     return BrotliEncoderMaxCompressedSize((size_t)size);
 }
 
-int BrotliCompressionAPI_Compress(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HSettings settings, const char* uncompressed, char* compressed, size_t uncompressed_size, size_t max_compressed_size, size_t* out_compressed_size)
+static int BrotliCompressionAPI_CreateCompressionContext(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HSettings settings, Longtail_CompressionAPI_HCompressionContext* out_context)
+{
+    return BrotliCompressionAPI_CreateContext((struct BrotliCompressionAPI*)compression_api, (struct BrotliContext**)out_context);
+}
+
+static void BrotliCompressionAPI_DeleteCompressionContext(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HCompressionContext context)
+{
+    BrotliCompressionAPI_DeleteContext((struct BrotliCompressionAPI*)compression_api, (struct BrotliContext*)context);
+}
+
+static int BrotliCompressionAPI_CreateDecompressionContext(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HDecompressionContext* out_context)
+{
+    return BrotliCompressionAPI_CreateContext((struct BrotliCompressionAPI*)compression_api, (struct BrotliContext**)out_context);
+}
+
+static void BrotliCompressionAPI_DeleteDecompressionContext(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HDecompressionContext context)
+{
+    BrotliCompressionAPI_DeleteContext((struct BrotliCompressionAPI*)compression_api, (struct BrotliContext*)context);
+}
+
+static int BrotliCompressionAPI_CompressWithContext(struct BrotliContext* context, struct BrotliSettings* brotli_settings, const char* uncompressed, char* compressed, size_t uncompressed_size, size_t max_compressed_size, size_t* out_compressed_size)
+{
+    BrotliEncoderState* state = BrotliEncoderCreateInstance(BrotliContext_Alloc, BrotliContext_Free, context);
+    if (!state)
+    {
+        return ENOMEM;
+    }
+    BrotliEncoderSetParameter(state, BROTLI_PARAM_QUALITY, (uint32_t)brotli_settings->m_Quality);
+    BrotliEncoderSetParameter(state, BROTLI_PARAM_LGWIN, (uint32_t)brotli_settings->m_WindowBits);
+    BrotliEncoderSetParameter(state, BROTLI_PARAM_MODE, (uint32_t)brotli_settings->m_Mode);
+    BrotliEncoderSetParameter(state, BROTLI_PARAM_SIZE_HINT, (uint32_t)uncompressed_size);
+    size_t available_in = uncompressed_size;
+    const uint8_t* next_in = (const uint8_t*)uncompressed;
+    size_t available_out = max_compressed_size;
+    uint8_t* next_out = (uint8_t*)compressed;
+    BROTLI_BOOL result = BrotliEncoderCompressStream(state, BROTLI_OPERATION_FINISH, &available_in, &next_in, &available_out, &next_out, 0);
+    if (!BrotliEncoderIsFinished(state))
+    {
+        result = BROTLI_FALSE;
+    }
+    BrotliEncoderDestroyInstance(state);
+    if (result == BROTLI_FALSE)
+    {
+        return EINVAL;
+    }
+    *out_compressed_size = max_compressed_size - available_out;
+    return 0;
+}
+
+int BrotliCompressionAPI_Compress(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HCompressionContext context, Longtail_CompressionAPI_HSettings settings, const char* uncompressed, char* compressed, size_t uncompressed_size, size_t max_compressed_size, size_t* out_compressed_size)
 {
     struct BrotliSettings* brotli_settings = (struct BrotliSettings*)settings;
 
+    // Empty input and quality 10 take special paths inside BrotliEncoderCompress
+    if (context && uncompressed_size > 0 && brotli_settings->m_Quality != 10)
+    {
+        if (0 == BrotliCompressionAPI_CompressWithContext((struct BrotliContext*)context, brotli_settings, uncompressed, compressed, uncompressed_size, max_compressed_size, out_compressed_size))
+        {
+            return 0;
+        }
+    }
+
     *out_compressed_size = max_compressed_size;
     if (BROTLI_FALSE == BrotliEncoderCompress(brotli_settings->m_Quality, brotli_settings->m_WindowBits, brotli_settings->m_Mode, uncompressed_size, (const uint8_t*)uncompressed, out_compressed_size, (uint8_t*)compressed))
     {
@@ -54,14 +224,33 @@ int BrotliCompressionAPI_Compress(struct Longtail_CompressionAPI* compression_ap
     return 0;
 }
 
-int BrotliCompressionAPI_Decompress(struct Longtail_CompressionAPI* compression_api, const char* compressed, char* uncompressed, size_t compressed_size, size_t max_uncompressed_size, size_t* out_uncompressed_size)
+int BrotliCompressionAPI_Decompress(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HDecompressionContext context, const char* compressed, char* uncompressed, size_t compressed_size, size_t max_uncompressed_size, size_t* out_uncompressed_size)
 {
-    *out_uncompressed_size = max_uncompressed_size;
-    BrotliDecoderResult result = BrotliDecoderDecompress(
-        compressed_size,
-        (const uint8_t*)compressed,
-        out_uncompressed_size,
-        (uint8_t*)uncompressed);
+    BrotliDecoderResult result;
+    if (context)
+    {
+        BrotliDecoderState* state = BrotliDecoderCreateInstance(BrotliContext_Alloc, BrotliContext_Free, context);
+        if (!state)
+        {
+            return ENOMEM;
+        }
+        size_t available_in = compressed_size;
+        const uint8_t* next_in = (const uint8_t*)compressed;
+        size_t available_out = max_uncompressed_size;
+        uint8_t* next_out = (uint8_t*)uncompressed;
+        result = BrotliDecoderDecompressStream(state, &available_in, &next_in, &available_out, &next_out, 0);
+        BrotliDecoderDestroyInstance(state);
+        *out_uncompressed_size = max_uncompressed_size - available_out;
+    }
+    else
+    {
+        *out_uncompressed_size = max_uncompressed_size;
+        result = BrotliDecoderDecompress(
+            compressed_size,
+            (const uint8_t*)compressed,
+            out_uncompressed_size,
+            (uint8_t*)uncompressed);
+    }
     switch (result)
     {
         case BROTLI_DECODER_RESULT_ERROR:
@@ -73,18 +262,30 @@ int BrotliCompressionAPI_Decompress(struct Longtail_CompressionAPI* compression_
     }
 }
 
-static void BrotliCompressionAPI_Init(struct BrotliCompressionAPI* compression_api)
+static int BrotliCompressionAPI_Init(struct BrotliCompressionAPI* compression_api)
 {
     compression_api->m_BrotliCompressionAPI.m_API.Dispose = BrotliCompressionAPI_Dispose;
     compression_api->m_BrotliCompressionAPI.GetMaxCompressedSize = BrotliCompressionAPI_GetMaxCompressedSize;
+    compression_api->m_BrotliCompressionAPI.CreateCompressionContext = BrotliCompressionAPI_CreateCompressionContext;
+    compression_api->m_BrotliCompressionAPI.DeleteCompressionContext = BrotliCompressionAPI_DeleteCompressionContext;
+    compression_api->m_BrotliCompressionAPI.CreateDecompressionContext = BrotliCompressionAPI_CreateDecompressionContext;
+    compression_api->m_BrotliCompressionAPI.DeleteDecompressionContext = BrotliCompressionAPI_DeleteDecompressionContext;
+    compression_api->m_BrotliCompressionAPI.SetCompressionWorkerCount = 0;
     compression_api->m_BrotliCompressionAPI.Compress = BrotliCompressionAPI_Compress;
     compression_api->m_BrotliCompressionAPI.Decompress = BrotliCompressionAPI_Decompress;
+    compression_api->m_ContextCount = 0;
+    return Longtail_CreateSpinLock(&compression_api[1], &compression_api->m_SpinLock);
 }
 
 struct Longtail_CompressionAPI* Longtail_CreateBrotliCompressionAPI()
 {
-    struct BrotliCompressionAPI* compression_api = (struct BrotliCompressionAPI*)Longtail_Alloc(sizeof(struct BrotliCompressionAPI));
-    BrotliCompressionAPI_Init(compression_api);
+    struct BrotliCompressionAPI* compression_api = (struct BrotliCompressionAPI*)Longtail_Alloc(sizeof(struct BrotliCompressionAPI) + Longtail_GetSpinLockSize());
+    int err = BrotliCompressionAPI_Init(compression_api);
+    if (err)
+    {
+        Longtail_Free(compression_api);
+        return 0;
+    }
     return &compression_api->m_BrotliCompressionAPI;
 }
 
@@ -0,0 +1,905 @@
+#include "longtail_cachestorage.h"
+
+#include "../../src/longtail.h"
+#include "../longtail_platform.h"
+
+#define STBDS_REALLOC(context,ptr,size) Longtail_STBRealloc(context,ptr,size)
+#define STBDS_FREE(context,ptr)         Longtail_STBFree(context,ptr)
+#include "../../src/ext/stb_ds.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint64_t Prime = 0x00000100000001B3ull;
+static const uint64_t Seed  = 0xCBF29CE484222325ull;
+
+static uint64_t fnv1a(const void* data, size_t numBytes)
+{
+    uint64_t hash = Seed;
+    const unsigned char* ptr = (const unsigned char*)data;
+    while (numBytes--)
+    {
+        hash = ((*ptr++) ^ hash) * Prime;
+    }
+    return hash;
+}
+
+// Memory tier entries hold the file content after the struct and are refcounted so a file that is evicted
+// while it is open stays valid until it is closed, local cache entries only track the size of the file on disk.
+// m_Generation is the generation of the path when the content was read, see CacheStorageAPI_IsCurrent
+struct CacheEntry
+{
+    TLongtail_Atomic32 m_RefCount;
+    uint64_t m_PathHash;
+    uint32_t m_Generation;
+    uint64_t m_Size;
+    struct CacheEntry* m_Newer;
+    struct CacheEntry* m_Older;
+};
+
+struct CacheLookup
+{
+    uint64_t key;
+    struct CacheEntry* value;
+};
+
+struct CacheGeneration
+{
+    uint64_t key;
+    uint32_t value;
+};
+
+// Entries are linked from most to least recently used, the tier owns one reference to each entry
+struct CacheTier
+{
+    struct CacheLookup* m_PathHashToEntry;
+    struct CacheEntry* m_Newest;
+    struct CacheEntry* m_Oldest;
+    uint64_t m_Size;
+    uint64_t m_MaxSize;
+};
+
+struct CacheStorageFile
+{
+    struct CacheEntry* m_Entry;                 // Files read from the memory tier
+    struct Longtail_StorageAPI* m_StorageAPI;   // Files streamed from the local cache or remote storage and files opened for writing
+    Longtail_StorageAPI_HOpenFile m_File;
+    uint64_t m_PathHash;
+    int m_IsWriteFile;
+};
+
+struct CacheStorageAPI
+{
+    struct Longtail_StorageAPI m_CacheStorageAPI;
+    struct Longtail_StorageAPI* m_RemoteAPI;
+    struct Longtail_StorageAPI* m_LocalAPI;
+    char* m_LocalCachePath;
+    HLongtail_SpinLock m_SpinLock;
+    struct CacheTier m_MemoryTier;
+    struct CacheTier m_LocalTier;
+    struct CacheGeneration* m_PathHashToGeneration;
+    TLongtail_Atomic32 m_TempFileCounter;
+    TLongtail_Atomic32 m_MemoryHitCount;
+    TLongtail_Atomic32 m_LocalHitCount;
+    TLongtail_Atomic32 m_RemoteReadCount;
+};
+
+static uint8_t* CacheEntry_GetData(struct CacheEntry* entry)
+{
+    return (uint8_t*)&entry[1];
+}
+
+static struct CacheEntry* CacheEntry_Create(uint64_t path_hash, uint32_t generation, uint64_t size, int with_data)
+{
+    size_t entry_size = sizeof(struct CacheEntry) + (with_data ? (size_t)size : 0u);
+    struct CacheEntry* entry = (struct CacheEntry*)Longtail_AllocTagged(with_data ? LONGTAIL_MEMTAG_BLOCK_DATA : LONGTAIL_MEMTAG_LOOKUP, entry_size);
+    if (!entry)
+    {
+        return 0;
+    }
+    entry->m_RefCount = 1;
+    entry->m_PathHash = path_hash;
+    entry->m_Generation = generation;
+    entry->m_Size = size;
+    entry->m_Newer = 0;
+    entry->m_Older = 0;
+    return entry;
+}
+
+static void CacheEntry_Release(struct CacheEntry* entry)
+{
+    if (Longtail_AtomicAdd32(&entry->m_RefCount, -1) != 0)
+    {
+        return;
+    }
+    Longtail_Free(entry);
+}
+
+static void CacheEntry_ReleaseAll(struct CacheEntry** entries)
+{
+    for (ptrdiff_t i = 0; i < arrlen(entries); ++i)
+    {
+        CacheEntry_Release(entries[i]);
+    }
+    arrfree(entries);
+}
+
+// The CacheTier functions must be called with the spin lock held
+
+static void CacheTier_Unlink(struct CacheTier* tier, struct CacheEntry* entry)
+{
+    if (entry->m_Newer)
+    {
+        entry->m_Newer->m_Older = entry->m_Older;
+    }
+    else
+    {
+        tier->m_Newest = entry->m_Older;
+    }
+    if (entry->m_Older)
+    {
+        entry->m_Older->m_Newer = entry->m_Newer;
+    }
+    else
+    {
+        tier->m_Oldest = entry->m_Newer;
+    }
+    entry->m_Newer = 0;
+    entry->m_Older = 0;
+}
+
+static void CacheTier_LinkNewest(struct CacheTier* tier, struct CacheEntry* entry)
+{
+    entry->m_Newer = 0;
+    entry->m_Older = tier->m_Newest;
+    if (tier->m_Newest)
+    {
+        tier->m_Newest->m_Newer = entry;
+    }
+    else
+    {
+        tier->m_Oldest = entry;
+    }
+    tier->m_Newest = entry;
+}
+
+// Returns the entry for `path_hash` and marks it as the most recently used
+static struct CacheEntry* CacheTier_Touch(struct CacheTier* tier, uint64_t path_hash)
+{
+    intptr_t it = hmgeti(tier->m_PathHashToEntry, path_hash);
+    if (it == -1)
+    {
+        return 0;
+    }
+    struct CacheEntry* entry = tier->m_PathHashToEntry[it].value;
+    if (tier->m_Newest != entry)
+    {
+        CacheTier_Unlink(tier, entry);
+        CacheTier_LinkNewest(tier, entry);
+    }
+    return entry;
+}
+
+// Takes over the callers reference to `entry` if it is inserted, returns 0 if the path is already in the tier
+static int CacheTier_Insert(struct CacheTier* tier, struct CacheEntry* entry)
+{
+    if (hmgeti(tier->m_PathHashToEntry, entry->m_PathHash) != -1)
+    {
+        return 0;
+    }
+    hmput(tier->m_PathHashToEntry, entry->m_PathHash, entry);
+    CacheTier_LinkNewest(tier, entry);
+    tier->m_Size += entry->m_Size;
+    return 1;
+}
+
+// Hands the tiers reference to the removed entry over to the caller
+static struct CacheEntry* CacheTier_Remove(struct CacheTier* tier, uint64_t path_hash)
+{
+    intptr_t it = hmgeti(tier->m_PathHashToEntry, path_hash);
+    if (it == -1)
+    {
+        return 0;
+    }
+    struct CacheEntry* entry = tier->m_PathHashToEntry[it].value;
+    (void)hmdel(tier->m_PathHashToEntry, path_hash);
+    CacheTier_Unlink(tier, entry);
+    tier->m_Size -= entry->m_Size;
+    return entry;
+}
+
+// Removes the least recently used entries until the tier is within budget, the caller gets the removed entries
+static struct CacheEntry** CacheTier_EvictOverBudget(struct CacheTier* tier)
+{
+    struct CacheEntry** evicted = 0;
+    while (tier->m_Size > tier->m_MaxSize && tier->m_Oldest)
+    {
+        arrpush(evicted, CacheTier_Remove(tier, tier->m_Oldest->m_PathHash));
+    }
+    return evicted;
+}
+
+static void CacheTier_Dispose(struct CacheTier* tier)
+{
+    struct CacheEntry* entry = tier->m_Newest;
+    while (entry)
+    {
+        struct CacheEntry* older = entry->m_Older;
+        CacheEntry_Release(entry);
+        entry = older;
+    }
+    hmfree(tier->m_PathHashToEntry);
+}
+
+static char* CacheStorageAPI_GetLocalPath(struct CacheStorageAPI* api, uint64_t path_hash)
+{
+    char file_name[32];
+    sprintf(file_name, "0x%016" PRIx64, path_hash);
+    return api->m_LocalAPI->ConcatPath(api->m_LocalAPI, api->m_LocalCachePath, file_name);
+}
+
+static void CacheStorageAPI_RemoveLocalFiles(struct CacheStorageAPI* api, struct CacheEntry** entries)
+{
+    for (ptrdiff_t i = 0; i < arrlen(entries); ++i)
+    {
+        char* local_path = CacheStorageAPI_GetLocalPath(api, entries[i]->m_PathHash);
+        (void)api->m_LocalAPI->RemoveFile(api->m_LocalAPI, local_path);
+        Longtail_Free(local_path);
+    }
+    CacheEntry_ReleaseAll(entries);
+}
+
+// A path starts at generation zero and is bumped each time it is invalidated. Content read from a path is only
+// cached if the path is still at the generation it had when the read started, otherwise a reader that raced a
+// writer could cache the content it read from before the write. Generations of written paths are kept for the
+// lifetime of the storage. Must be called with the spin lock held.
+static uint32_t CacheStorageAPI_GetGeneration(struct CacheStorageAPI* api, uint64_t path_hash)
+{
+    intptr_t it = hmgeti(api->m_PathHashToGeneration, path_hash);
+    return it == -1 ? 0u : api->m_PathHashToGeneration[it].value;
+}
+
+static int CacheStorageAPI_IsCurrent(struct CacheStorageAPI* api, const struct CacheEntry* entry)
+{
+    return CacheStorageAPI_GetGeneration(api, entry->m_PathHash) == entry->m_Generation;
+}
+
+// Drops any cached copy of the path, used before and after the path is changed in the remote storage
+static void CacheStorageAPI_Invalidate(struct CacheStorageAPI* api, uint64_t path_hash)
+{
+    Longtail_LockSpinLock(api->m_SpinLock);
+    hmput(api->m_PathHashToGeneration, path_hash, CacheStorageAPI_GetGeneration(api, path_hash) + 1u);
+    struct CacheEntry* memory_entry = CacheTier_Remove(&api->m_MemoryTier, path_hash);
+    struct CacheEntry* local_entry = CacheTier_Remove(&api->m_LocalTier, path_hash);
+    Longtail_UnlockSpinLock(api->m_SpinLock);
+    if (memory_entry)
+    {
+        CacheEntry_Release(memory_entry);
+    }
+    if (local_entry)
+    {
+        struct CacheEntry** entries = 0;
+        arrpush(entries, local_entry);
+        CacheStorageAPI_RemoveLocalFiles(api, entries);
+    }
+}
+
+static int CacheStorageAPI_OpenSource(struct Longtail_StorageAPI* storage_api, const char* path, Longtail_StorageAPI_HOpenFile* out_file, uint64_t* out_size)
+{
+    Longtail_StorageAPI_HOpenFile f;
+    int err = storage_api->OpenReadFile(storage_api, path, &f);
+    if (err)
+    {
+        return err;
+    }
+    err = storage_api->GetSize(storage_api, f, out_size);
+    if (err)
+    {
+        storage_api->CloseFile(storage_api, f);
+        return err;
+    }
+    *out_file = f;
+    return 0;
+}
+
+static int CacheStorageAPI_ReadEntry(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f, uint64_t path_hash, uint32_t generation, uint64_t size, struct CacheEntry** out_entry)
+{
+    struct CacheEntry* entry = CacheEntry_Create(path_hash, generation, size, 1);
+    if (!entry)
+    {
+        return ENOMEM;
+    }
+    if (size > 0)
+    {
+        int err = storage_api->Read(storage_api, f, 0, size, CacheEntry_GetData(entry));
+        if (err)
+        {
+            CacheEntry_Release(entry);
+            return err;
+        }
+    }
+    *out_entry = entry;
+    return 0;
+}
+
+#define CACHE_STORAGE_COPY_BUFFER_SIZE  (1024u * 1024u)
+
+// Stores `size` bytes from `data`, or copied from `source_file` in `source_api` if `data` is zero, in the local cache.
+// The file is written under a temporary name and then renamed so a partially written file is never taken for a cached one.
+// Returns 1 if the path is in the local cache afterwards
+static int CacheStorageAPI_StoreLocal(struct CacheStorageAPI* api, uint64_t path_hash, uint32_t generation, uint64_t size, const uint8_t* data, struct Longtail_StorageAPI* source_api, Longtail_StorageAPI_HOpenFile source_file)
+{
+    struct Longtail_StorageAPI* local_api = api->m_LocalAPI;
+    if (!local_api || size > api->m_LocalTier.m_MaxSize)
+    {
+        return 0;
+    }
+    uint8_t* copy_buffer = 0;
+    if (!data && size > 0)
+    {
+        copy_buffer = (uint8_t*)Longtail_AllocTagged(LONGTAIL_MEMTAG_BLOCK_DATA, (size_t)(size < CACHE_STORAGE_COPY_BUFFER_SIZE ? size : CACHE_STORAGE_COPY_BUFFER_SIZE));
+        if (!copy_buffer)
+        {
+            return 0;
+        }
+    }
+    char tmp_file_name[64];
+    sprintf(tmp_file_name, "0x%016" PRIx64 ".%d.tmp", path_hash, (int)Longtail_AtomicAdd32(&api->m_TempFileCounter, 1));
+    char* tmp_path = local_api->ConcatPath(local_api, api->m_LocalCachePath, tmp_file_name);
+    char* local_path = CacheStorageAPI_GetLocalPath(api, path_hash);
+
+    Longtail_StorageAPI_HOpenFile f;
+    int err = local_api->OpenWriteFile(local_api, tmp_path, size, &f);
+    if (!err)
+    {
+        if (data)
+        {
+            if (size > 0)
+            {
+                err = local_api->Write(local_api, f, 0, size, data);
+            }
+        }
+        else
+        {
+            uint64_t offset = 0;
+            while (!err && offset < size)
+            {
+                uint64_t length = (size - offset) < CACHE_STORAGE_COPY_BUFFER_SIZE ? (size - offset) : CACHE_STORAGE_COPY_BUFFER_SIZE;
+                err = source_api->Read(source_api, source_file, offset, length, copy_buffer);
+                err = err ? err : local_api->Write(local_api, f, offset, length, copy_buffer);
+                offset += length;
+            }
+        }
+        local_api->CloseFile(local_api, f);
+        err = err ? err : local_api->RenameFile(local_api, tmp_path, local_path);
+        if (err)
+        {
+            (void)local_api->RemoveFile(local_api, tmp_path);
+            // Someone else stored the same file first
+            if (local_api->IsFile(local_api, local_path))
+            {
+                err = 0;
+            }
+        }
+    }
+    Longtail_Free(copy_buffer);
+    Longtail_Free(tmp_path);
+    if (err)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_WARNING, "CacheStorageAPI_StoreLocal: Storing `%s` failed with %d", local_path, err)
+        Longtail_Free(local_path);
+        return 0;
+    }
+
+    struct CacheEntry* local_entry = CacheEntry_Create(path_hash, generation, size, 0);
+    if (!local_entry)
+    {
+        Longtail_Free(local_path);
+        return 0;
+    }
+    Longtail_LockSpinLock(api->m_SpinLock);
+    int is_current = CacheStorageAPI_IsCurrent(api, local_entry);
+    int inserted = is_current && CacheTier_Insert(&api->m_LocalTier, local_entry);
+    struct CacheEntry** evicted = CacheTier_EvictOverBudget(&api->m_LocalTier);
+    int is_cached = hmgeti(api->m_LocalTier.m_PathHashToEntry, path_hash) != -1;
+    Longtail_UnlockSpinLock(api->m_SpinLock);
+    if (!inserted)
+    {
+        CacheEntry_Release(local_entry);
+    }
+    if (!is_current && !is_cached)
+    {
+        // The path was written while we read it, don't leave the old content behind
+        (void)local_api->RemoveFile(local_api, local_path);
+    }
+    Longtail_Free(local_path);
+    CacheStorageAPI_RemoveLocalFiles(api, evicted);
+    return is_current && is_cached;
+}
+
+static void CacheStorageAPI_StoreMemory(struct CacheStorageAPI* api, struct CacheEntry* entry)
+{
+    if (entry->m_Size > api->m_MemoryTier.m_MaxSize)
+    {
+        return;
+    }
+    Longtail_AtomicAdd32(&entry->m_RefCount, 1);
+    Longtail_LockSpinLock(api->m_SpinLock);
+    int inserted = CacheStorageAPI_IsCurrent(api, entry) && CacheTier_Insert(&api->m_MemoryTier, entry);
+    struct CacheEntry** evicted = CacheTier_EvictOverBudget(&api->m_MemoryTier);
+    Longtail_UnlockSpinLock(api->m_SpinLock);
+    if (!inserted)
+    {
+        CacheEntry_Release(entry);
+    }
+    CacheEntry_ReleaseAll(evicted);
+}
+
+// Picks up the files left in the cache folder by earlier runs and removes interrupted writes
+static int CacheStorageAPI_ScanLocalCache(struct CacheStorageAPI* api)
+{
+    struct Longtail_StorageAPI* local_api = api->m_LocalAPI;
+    if (!local_api->IsDir(local_api, api->m_LocalCachePath))
+    {
+        int err = local_api->CreateDir(local_api, api->m_LocalCachePath);
+        if (err)
+        {
+            return err;
+        }
+    }
+    char** tmp_paths = 0;
+    Longtail_StorageAPI_HIterator it;
+    int err = local_api->StartFind(local_api, api->m_LocalCachePath, &it);
+    if (!err)
+    {
+        do
+        {
+            const char* file_name = local_api->GetFileName(local_api, it);
+            if (file_name)
+            {
+                size_t length = strlen(file_name);
+                char* end = 0;
+                if (length > 4 && strcmp(&file_name[length - 4], ".tmp") == 0)
+                {
+                    arrpush(tmp_paths, local_api->ConcatPath(local_api, api->m_LocalCachePath, file_name));
+                }
+                else if (length == 18 && file_name[0] == '0' && file_name[1] == 'x')
+                {
+                    uint64_t path_hash = (uint64_t)strtoull(&file_name[2], &end, 16);
+                    if (end == &file_name[length])
+                    {
+                        struct CacheEntry* entry = CacheEntry_Create(path_hash, 0, local_api->GetEntrySize(local_api, it), 0);
+                        if (!entry)
+                        {
+                            err = ENOMEM;
+                            break;
+                        }
+                        if (!CacheTier_Insert(&api->m_LocalTier, entry))
+                        {
+                            CacheEntry_Release(entry);
+                        }
+                    }
+                }
+            }
+            err = local_api->FindNext(local_api, it);
+        } while (err == 0);
+        local_api->CloseFind(local_api, it);
+    }
+    for (ptrdiff_t i = 0; i < arrlen(tmp_paths); ++i)
+    {
+        (void)local_api->RemoveFile(local_api, tmp_paths[i]);
+        Longtail_Free(tmp_paths[i]);
+    }
+    arrfree(tmp_paths);
+    if (err != ENOENT)
+    {
+        return err;
+    }
+    CacheStorageAPI_RemoveLocalFiles(api, CacheTier_EvictOverBudget(&api->m_LocalTier));
+    return 0;
+}
+
+static void CacheStorageAPI_Dispose(struct Longtail_API* storage_api)
+{
+    struct CacheStorageAPI* api = (struct CacheStorageAPI*)storage_api;
+    LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_INFO, "CacheStorageAPI_Dispose: %d memory hits, %d local cache hits, %d remote reads",
+        (int)api->m_MemoryHitCount, (int)api->m_LocalHitCount, (int)api->m_RemoteReadCount)
+    CacheTier_Dispose(&api->m_LocalTier);
+    CacheTier_Dispose(&api->m_MemoryTier);
+    hmfree(api->m_PathHashToGeneration);
+    Longtail_DeleteSpinLock(api->m_SpinLock);
+    Longtail_Free(api->m_LocalCachePath);
+    Longtail_Free(storage_api);
+}
+
+static int CacheStorageAPI_OpenReadFile(struct Longtail_StorageAPI* storage_api, const char* path, Longtail_StorageAPI_HOpenFile* out_open_file)
+{
+    struct CacheStorageAPI* api = (struct CacheStorageAPI*)storage_api;
+    uint64_t path_hash = fnv1a(path, strlen(path));
+    struct CacheStorageFile* file = (struct CacheStorageFile*)Longtail_Alloc(sizeof(struct CacheStorageFile));
+    if (!file)
+    {
+        return ENOMEM;
+    }
+    file->m_Entry = 0;
+    file->m_StorageAPI = 0;
+    file->m_File = 0;
+    file->m_PathHash = path_hash;
+    file->m_IsWriteFile = 0;
+
+    Longtail_LockSpinLock(api->m_SpinLock);
+    struct CacheEntry* entry = CacheTier_Touch(&api->m_MemoryTier, path_hash);
+    if (entry)
+    {
+        Longtail_AtomicAdd32(&entry->m_RefCount, 1);
+    }
+    int is_local = !entry && CacheTier_Touch(&api->m_LocalTier, path_hash) != 0;
+    uint32_t generation = CacheStorageAPI_GetGeneration(api, path_hash);
+    Longtail_UnlockSpinLock(api->m_SpinLock);
+
+    if (entry)
+    {
+        Longtail_AtomicAdd32(&api->m_MemoryHitCount, 1);
+        file->m_Entry = entry;
+        *out_open_file = (Longtail_StorageAPI_HOpenFile)file;
+        return 0;
+    }
+
+    struct Longtail_StorageAPI* source_api = 0;
+    Longtail_StorageAPI_HOpenFile source_file = 0;
+    uint64_t size = 0;
+    if (is_local)
+    {
+        char* local_path = CacheStorageAPI_GetLocalPath(api, path_hash);
+        int err = CacheStorageAPI_OpenSource(api->m_LocalAPI, local_path, &source_file, &size);
+        if (err)
+        {
+            // The cached file was removed under us, forget it and fetch it again
+            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_WARNING, "CacheStorageAPI_OpenReadFile: Reading `%s` cached as `%s` failed with %d", path, local_path, err)
+            Longtail_LockSpinLock(api->m_SpinLock);
+            struct CacheEntry* stale_entry = CacheTier_Remove(&api->m_LocalTier, path_hash);
+            Longtail_UnlockSpinLock(api->m_SpinLock);
+            if (stale_entry)
+            {
+                CacheEntry_Release(stale_entry);
+            }
+        }
+        else
+        {
+            source_api = api->m_LocalAPI;
+            Longtail_AtomicAdd32(&api->m_LocalHitCount, 1);
+        }
+        Longtail_Free(local_path);
+    }
+    int is_remote = !source_api;
+    if (is_remote)
+    {
+        int err = CacheStorageAPI_OpenSource(api->m_RemoteAPI, path, &source_file, &size);
+        if (err)
+        {
+            Longtail_Free(file);
+            return err;
+        }
+        source_api = api->m_RemoteAPI;
+        Longtail_AtomicAdd32(&api->m_RemoteReadCount, 1);
+    }
+
+    if (size <= api->m_MemoryTier.m_MaxSize)
+    {
+        int err = CacheStorageAPI_ReadEntry(source_api, source_file, path_hash, generation, size, &entry);
+        source_api->CloseFile(source_api, source_file);
+        if (err)
+        {
+            Longtail_Free(file);
+            return err;
+        }
+        if (is_remote)
+        {
+            (void)CacheStorageAPI_StoreLocal(api, path_hash, generation, size, CacheEntry_GetData(entry), 0, 0);
+        }
+        CacheStorageAPI_StoreMemory(api, entry);
+        file->m_Entry = entry;
+        *out_open_file = (Longtail_StorageAPI_HOpenFile)file;
+        return 0;
+    }
+
+    // Too large for the memory tier, reads are passed on to the open file instead. A remote file that fits the
+    // local cache is copied there first and read from the copy
+    if (is_remote && CacheStorageAPI_StoreLocal(api, path_hash, generation, size, 0, source_api, source_file))
+    {
+        char* local_path = CacheStorageAPI_GetLocalPath(api, path_hash);
+        Longtail_StorageAPI_HOpenFile local_file;
+        if (api->m_LocalAPI->OpenReadFile(api->m_LocalAPI, local_path, &local_file) == 0)
+        {
+            source_api->CloseFile(source_api, source_file);
+            source_api = api->m_LocalAPI;
+            source_file = local_file;
+        }
+        Longtail_Free(local_path);
+    }
+    file->m_StorageAPI = source_api;
+    file->m_File = source_file;
+    *out_open_file = (Longtail_StorageAPI_HOpenFile)file;
+    return 0;
+}
+
+static int CacheStorageAPI_GetSize(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f, uint64_t* out_size)
+{
+    struct CacheStorageFile* file = (struct CacheStorageFile*)f;
+    if (!file->m_Entry)
+    {
+        return file->m_StorageAPI->GetSize(file->m_StorageAPI, file->m_File, out_size);
+    }
+    *out_size = file->m_Entry->m_Size;
+    return 0;
+}
+
+static int CacheStorageAPI_Read(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f, uint64_t offset, uint64_t length, void* output)
+{
+    struct CacheStorageFile* file = (struct CacheStorageFile*)f;
+    if (!file->m_Entry)
+    {
+        return file->m_StorageAPI->Read(file->m_StorageAPI, file->m_File, offset, length, output);
+    }
+    if (offset + length > file->m_Entry->m_Size)
+    {
+        return EIO;
+    }
+    if (length > 0)
+    {
+        memcpy(output, &CacheEntry_GetData(file->m_Entry)[offset], (size_t)length);
+    }
+    return 0;
+}
+
+static int CacheStorageAPI_OpenWriteFile(struct Longtail_StorageAPI* storage_api, const char* path, uint64_t initial_size, Longtail_StorageAPI_HOpenFile* out_open_file)
+{
+    struct CacheStorageAPI* api = (struct CacheStorageAPI*)storage_api;
+    uint64_t path_hash = fnv1a(path, strlen(path));
+    struct CacheStorageFile* file = (struct CacheStorageFile*)Longtail_Alloc(sizeof(struct CacheStorageFile));
+    if (!file)
+    {
+        return ENOMEM;
+    }
+    CacheStorageAPI_Invalidate(api, path_hash);
+    Longtail_StorageAPI_HOpenFile remote_file;
+    int err = api->m_RemoteAPI->OpenWriteFile(api->m_RemoteAPI, path, initial_size, &remote_file);
+    if (err)
+    {
+        Longtail_Free(file);
+        return err;
+    }
+    file->m_Entry = 0;
+    file->m_StorageAPI = api->m_RemoteAPI;
+    file->m_File = remote_file;
+    file->m_PathHash = path_hash;
+    file->m_IsWriteFile = 1;
+    *out_open_file = (Longtail_StorageAPI_HOpenFile)file;
+    return 0;
+}
+
+static int CacheStorageAPI_Write(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f, uint64_t offset, uint64_t length, const void* input)
+{
+    struct CacheStorageFile* file = (struct CacheStorageFile*)f;
+    if (!file->m_IsWriteFile)
+    {
+        return EINVAL;
+    }
+    return file->m_StorageAPI->Write(file->m_StorageAPI, file->m_File, offset, length, input);
+}
+
+static int CacheStorageAPI_SetSize(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f, uint64_t length)
+{
+    struct CacheStorageFile* file = (struct CacheStorageFile*)f;
+    if (!file->m_IsWriteFile)
+    {
+        return EINVAL;
+    }
+    return file->m_StorageAPI->SetSize(file->m_StorageAPI, file->m_File, length);
+}
+
+static void CacheStorageAPI_CloseFile(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f)
+{
+    struct CacheStorageAPI* api = (struct CacheStorageAPI*)storage_api;
+    struct CacheStorageFile* file = (struct CacheStorageFile*)f;
+    if (file->m_Entry)
+    {
+        CacheEntry_Release(file->m_Entry);
+    }
+    else
+    {
+        file->m_StorageAPI->CloseFile(file->m_StorageAPI, file->m_File);
+        if (file->m_IsWriteFile)
+        {
+            // A reader may have cached the file while it was being written
+            CacheStorageAPI_Invalidate(api, file->m_PathHash);
+        }
+    }
+    Longtail_Free(file);
+}
+
+static int CacheStorageAPI_CreateDir(struct Longtail_StorageAPI* storage_api, const char* path)
+{
+    struct CacheStorageAPI* api = (struct CacheStorageAPI*)storage_api;
+    return api->m_RemoteAPI->CreateDir(api->m_RemoteAPI, path);
+}
+
+static int CacheStorageAPI_RenameFile(struct Longtail_StorageAPI* storage_api, const char* source_path, const char* target_path)
+{
+    struct CacheStorageAPI* api = (struct CacheStorageAPI*)storage_api;
+    int err = api->m_RemoteAPI->RenameFile(api->m_RemoteAPI, source_path, target_path);
+    CacheStorageAPI_Invalidate(api, fnv1a(source_path, strlen(source_path)));
+    CacheStorageAPI_Invalidate(api, fnv1a(target_path, strlen(target_path)));
+    return err;
+}
+
+static char* CacheStorageAPI_ConcatPath(struct Longtail_StorageAPI* storage_api, const char* root_path, const char* sub_path)
+{
+    struct CacheStorageAPI* api = (struct CacheStorageAPI*)storage_api;
+    return api->m_RemoteAPI->ConcatPath(api->m_RemoteAPI, root_path, sub_path);
+}
+
+static int CacheStorageAPI_IsDir(struct Longtail_StorageAPI* storage_api, const char* path)
+{
+    struct CacheStorageAPI* api = (struct CacheStorageAPI*)storage_api;
+    return api->m_RemoteAPI->IsDir(api->m_RemoteAPI, path);
+}
+
+// A cached file is known to exist without asking the remote storage
+static int CacheStorageAPI_IsFile(struct Longtail_StorageAPI* storage_api, const char* path)
+{
+    struct CacheStorageAPI* api = (struct CacheStorageAPI*)storage_api;
+    uint64_t path_hash = fnv1a(path, strlen(path));
+    Longtail_LockSpinLock(api->m_SpinLock);
+    int is_cached = hmgeti(api->m_MemoryTier.m_PathHashToEntry, path_hash) != -1 ||
+        hmgeti(api->m_LocalTier.m_PathHashToEntry, path_hash) != -1;
+    Longtail_UnlockSpinLock(api->m_SpinLock);
+    if (is_cached)
+    {
+        return 1;
+    }
+    return api->m_RemoteAPI->IsFile(api->m_RemoteAPI, path);
+}
+
+static int CacheStorageAPI_RemoveDir(struct Longtail_StorageAPI* storage_api, const char* path)
+{
+    struct CacheStorageAPI* api = (struct CacheStorageAPI*)storage_api;
+    return api->m_RemoteAPI->RemoveDir(api->m_RemoteAPI, path);
+}
+
+static int CacheStorageAPI_RemoveFile(struct Longtail_StorageAPI* storage_api, const char* path)
+{
+    struct CacheStorageAPI* api = (struct CacheStorageAPI*)storage_api;
+    CacheStorageAPI_Invalidate(api, fnv1a(path, strlen(path)));
+    return api->m_RemoteAPI->RemoveFile(api->m_RemoteAPI, path);
+}
+
+static int CacheStorageAPI_StartFind(struct Longtail_StorageAPI* storage_api, const char* path, Longtail_StorageAPI_HIterator* out_iterator)
+{
+    struct CacheStorageAPI* api = (struct CacheStorageAPI*)storage_api;
+    return api->m_RemoteAPI->StartFind(api->m_RemoteAPI, path, out_iterator);
+}
+
+static int CacheStorageAPI_FindNext(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HIterator iterator)
+{
+    struct CacheStorageAPI* api = (struct CacheStorageAPI*)storage_api;
+    return api->m_RemoteAPI->FindNext(api->m_RemoteAPI, iterator);
+}
+
+static void CacheStorageAPI_CloseFind(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HIterator iterator)
+{
+    struct CacheStorageAPI* api = (struct CacheStorageAPI*)storage_api;
+    api->m_RemoteAPI->CloseFind(api->m_RemoteAPI, iterator);
+}
+
+static const char* CacheStorageAPI_GetFileName(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HIterator iterator)
+{
+    struct CacheStorageAPI* api = (struct CacheStorageAPI*)storage_api;
+    return api->m_RemoteAPI->GetFileName(api->m_RemoteAPI, iterator);
+}
+
+static const char* CacheStorageAPI_GetDirectoryName(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HIterator iterator)
+{
+    struct CacheStorageAPI* api = (struct CacheStorageAPI*)storage_api;
+    return api->m_RemoteAPI->GetDirectoryName(api->m_RemoteAPI, iterator);
+}
+
+static uint64_t CacheStorageAPI_GetEntrySize(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HIterator iterator)
+{
+    struct CacheStorageAPI* api = (struct CacheStorageAPI*)storage_api;
+    return api->m_RemoteAPI->GetEntrySize(api->m_RemoteAPI, iterator);
+}
+
+static int CacheStorageAPI_Init(
+    struct CacheStorageAPI* storage_api,
+    struct Longtail_StorageAPI* remote_api,
+    struct Longtail_StorageAPI* local_api,
+    const char* local_cache_path,
+    uint64_t max_local_cache_size,
+    uint64_t max_memory_cache_size)
+{
+    storage_api->m_CacheStorageAPI.m_API.Dispose = CacheStorageAPI_Dispose;
+    storage_api->m_CacheStorageAPI.OpenReadFile = CacheStorageAPI_OpenReadFile;
+    storage_api->m_CacheStorageAPI.GetSize = CacheStorageAPI_GetSize;
+    storage_api->m_CacheStorageAPI.Read = CacheStorageAPI_Read;
+    storage_api->m_CacheStorageAPI.OpenWriteFile = CacheStorageAPI_OpenWriteFile;
+    storage_api->m_CacheStorageAPI.Write = CacheStorageAPI_Write;
+    storage_api->m_CacheStorageAPI.SetSize = CacheStorageAPI_SetSize;
+    storage_api->m_CacheStorageAPI.CloseFile = CacheStorageAPI_CloseFile;
+    storage_api->m_CacheStorageAPI.CreateDir = CacheStorageAPI_CreateDir;
+    storage_api->m_CacheStorageAPI.RenameFile = CacheStorageAPI_RenameFile;
+    storage_api->m_CacheStorageAPI.ConcatPath = CacheStorageAPI_ConcatPath;
+    storage_api->m_CacheStorageAPI.IsDir = CacheStorageAPI_IsDir;
+    storage_api->m_CacheStorageAPI.IsFile = CacheStorageAPI_IsFile;
+    storage_api->m_CacheStorageAPI.RemoveDir = CacheStorageAPI_RemoveDir;
+    storage_api->m_CacheStorageAPI.RemoveFile = CacheStorageAPI_RemoveFile;
+    storage_api->m_CacheStorageAPI.StartFind = CacheStorageAPI_StartFind;
+    storage_api->m_CacheStorageAPI.FindNext = CacheStorageAPI_FindNext;
+    storage_api->m_CacheStorageAPI.CloseFind = CacheStorageAPI_CloseFind;
+    storage_api->m_CacheStorageAPI.GetFileName = CacheStorageAPI_GetFileName;
+    storage_api->m_CacheStorageAPI.GetDirectoryName = CacheStorageAPI_GetDirectoryName;
+    storage_api->m_CacheStorageAPI.GetEntrySize = CacheStorageAPI_GetEntrySize;
+
+    storage_api->m_RemoteAPI = remote_api;
+    storage_api->m_LocalAPI = local_api;
+    storage_api->m_LocalCachePath = local_api ? Longtail_Strdup(local_cache_path) : 0;
+    memset(&storage_api->m_MemoryTier, 0, sizeof(struct CacheTier));
+    storage_api->m_MemoryTier.m_MaxSize = max_memory_cache_size;
+    memset(&storage_api->m_LocalTier, 0, sizeof(struct CacheTier));
+    storage_api->m_LocalTier.m_MaxSize = max_local_cache_size;
+    storage_api->m_PathHashToGeneration = 0;
+    storage_api->m_TempFileCounter = 0;
+    storage_api->m_MemoryHitCount = 0;
+    storage_api->m_LocalHitCount = 0;
+    storage_api->m_RemoteReadCount = 0;
+
+    int err = Longtail_CreateSpinLock(&storage_api[1], &storage_api->m_SpinLock);
+    if (err)
+    {
+        Longtail_Free(storage_api->m_LocalCachePath);
+        return err;
+    }
+    if (local_api)
+    {
+        err = CacheStorageAPI_ScanLocalCache(storage_api);
+        if (err)
+        {
+            CacheTier_Dispose(&storage_api->m_LocalTier);
+            Longtail_DeleteSpinLock(storage_api->m_SpinLock);
+            Longtail_Free(storage_api->m_LocalCachePath);
+            return err;
+        }
+    }
+    return 0;
+}
+
+struct Longtail_StorageAPI* Longtail_CreateCacheStorageAPI(
+    struct Longtail_StorageAPI* remote_api,
+    struct Longtail_StorageAPI* local_api,
+    const char* local_cache_path,
+    uint64_t max_local_cache_size,
+    uint64_t max_memory_cache_size)
+{
+    LONGTAIL_FATAL_ASSERT(remote_api != 0, return 0)
+    LONGTAIL_FATAL_ASSERT(local_api == 0 || local_cache_path != 0, return 0)
+    size_t api_size = sizeof(struct CacheStorageAPI) + Longtail_GetSpinLockSize();
+    struct CacheStorageAPI* storage_api = (struct CacheStorageAPI*)Longtail_Alloc(api_size);
+    if (!storage_api)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_CreateCacheStorageAPI(%p, %p, %s, %" PRIu64 ", %" PRIu64 ") failed with %d",
+            remote_api, local_api, local_cache_path ? local_cache_path : "", max_local_cache_size, max_memory_cache_size, ENOMEM)
+        return 0;
+    }
+    int err = CacheStorageAPI_Init(storage_api, remote_api, local_api, local_cache_path, max_local_cache_size, max_memory_cache_size);
+    if (err)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_CreateCacheStorageAPI(%p, %p, %s, %" PRIu64 ", %" PRIu64 ") failed with %d",
+            remote_api, local_api, local_cache_path ? local_cache_path : "", max_local_cache_size, max_memory_cache_size, err)
+        Longtail_Free(storage_api);
+        return 0;
+    }
+    return &storage_api->m_CacheStorageAPI;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct Longtail_StorageAPI;
+
+// Read-through cache in front of `remote_api`, meant for content that is never changed in place such as content blocks.
+// A file opened for reading is served from memory if it is there, else from the local cache folder `local_cache_path`
+// in `local_api`, else it is fetched from `remote_api` and kept in both. The memory tier holds at most
+// `max_memory_cache_size` bytes and the local cache at most `max_local_cache_size` bytes, least recently used files
+// are evicted first. Files larger than `max_memory_cache_size` are never held in memory, reads of them go to the open
+// local copy or remote file. Files already in `local_cache_path` are picked up on creation.
+// Writes, renames and removes go straight to `remote_api` and drop any cached copy of the paths they touch, all other
+// calls are passed through. `local_api` may be zero for a memory only cache.
+// `remote_api` and `local_api` are not owned and must outlive the returned storage.
+extern struct Longtail_StorageAPI* Longtail_CreateCacheStorageAPI(
+    struct Longtail_StorageAPI* remote_api,
+    struct Longtail_StorageAPI* local_api,
+    const char* local_cache_path,
+    uint64_t max_local_cache_size,
+    uint64_t max_memory_cache_size);
+
+#ifdef __cplusplus
+}
+#endif
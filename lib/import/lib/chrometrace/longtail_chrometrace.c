@@ -0,0 +1,332 @@
+#include "longtail_chrometrace.h"
+
+#include "../../src/longtail.h"
+#include "../longtail_platform.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CHROMETRACE_MAX_THREAD_COUNT 256u
+
+#define CHROMETRACE_THREAD_FREE  0
+#define CHROMETRACE_THREAD_READY 1
+#define CHROMETRACE_THREAD_BUSY  2
+
+struct ChromeTraceEvent
+{
+    const char* m_Name;
+    uint64_t m_BeginUS;
+    uint64_t m_DurationUS;
+    uint32_t m_Generation;
+};
+
+// A slot is locked (BUSY) while its owner adds an event, while Write copies it and while it changes owner.
+// Slots are never freed, once all are taken the one that has been idle the longest is handed to the new thread.
+// m_Generation counts the owners so events from different threads in the same slot keep separate tids.
+struct ChromeTraceThread
+{
+    TLongtail_Atomic32 m_State;
+    uint32_t m_Generation;
+    uint64_t m_ThreadId;
+    uint64_t volatile m_LastEventUS;
+    struct ChromeTraceEvent* m_Events;
+    uint64_t m_EventCount;
+};
+
+struct ChromeTraceAPI
+{
+    struct Longtail_TraceAPI m_ChromeTraceAPI;
+    uint32_t m_EventsPerThread;
+    uint32_t m_Serial;
+    uint64_t m_StartUS;
+    TLongtail_Atomic32 m_DroppedEventCount;
+    struct ChromeTraceThread m_Threads[CHROMETRACE_MAX_THREAD_COUNT];
+};
+
+// The serial tells a cached slot of a disposed api apart from one of a new api that got the same address
+static TLongtail_Atomic32 ChromeTrace_NextSerial = 0;
+
+struct ChromeTraceThreadCache
+{
+    struct ChromeTraceAPI* m_API;
+    uint32_t m_Serial;
+    struct ChromeTraceThread* m_Thread;
+};
+
+static LONGTAIL_THREAD_LOCAL struct ChromeTraceThreadCache ChromeTrace_ThreadCache;
+
+// Returns 0 if the slot is free, it has no events to lock
+static int ChromeTrace_LockThread(struct ChromeTraceThread* thread)
+{
+    while (1)
+    {
+        int32_t state = Longtail_CompareAndSwap32(&thread->m_State, CHROMETRACE_THREAD_READY, CHROMETRACE_THREAD_BUSY);
+        if (state == CHROMETRACE_THREAD_READY)
+        {
+            return 1;
+        }
+        if (state == CHROMETRACE_THREAD_FREE)
+        {
+            return 0;
+        }
+    }
+}
+
+static void ChromeTrace_UnlockThread(struct ChromeTraceThread* thread)
+{
+    Longtail_AtomicAdd32(&thread->m_State, CHROMETRACE_THREAD_READY - CHROMETRACE_THREAD_BUSY);
+}
+
+// Finds the slot this thread already owns or claims a new one, the slot is returned locked
+static struct ChromeTraceThread* ChromeTrace_ClaimThread(struct ChromeTraceAPI* chrome_trace_api, uint64_t thread_id)
+{
+    uint32_t start = (uint32_t)((thread_id * 0x9E3779B97F4A7C15ull) >> 56);
+    for (uint32_t i = 0; i < CHROMETRACE_MAX_THREAD_COUNT; ++i)
+    {
+        struct ChromeTraceThread* thread = &chrome_trace_api->m_Threads[(start + i) % CHROMETRACE_MAX_THREAD_COUNT];
+        int32_t state = Longtail_CompareAndSwap32(&thread->m_State, CHROMETRACE_THREAD_FREE, CHROMETRACE_THREAD_BUSY);
+        if (state == CHROMETRACE_THREAD_FREE)
+        {
+            thread->m_Events = (struct ChromeTraceEvent*)Longtail_Alloc(sizeof(struct ChromeTraceEvent) * chrome_trace_api->m_EventsPerThread);
+            if (thread->m_Events == 0)
+            {
+                Longtail_AtomicAdd32(&thread->m_State, CHROMETRACE_THREAD_FREE - CHROMETRACE_THREAD_BUSY);
+                return 0;
+            }
+            thread->m_ThreadId = thread_id;
+            thread->m_Generation = 0;
+            thread->m_EventCount = 0;
+            return thread;
+        }
+        if (thread->m_ThreadId == thread_id && ChromeTrace_LockThread(thread))
+        {
+            if (thread->m_ThreadId == thread_id)
+            {
+                return thread;
+            }
+            ChromeTrace_UnlockThread(thread);
+        }
+    }
+
+    // All slots are taken, threads that have exited never release theirs so take over the one idle the longest
+    for (uint32_t attempt = 0; attempt < CHROMETRACE_MAX_THREAD_COUNT; ++attempt)
+    {
+        struct ChromeTraceThread* oldest = 0;
+        for (uint32_t t = 0; t < CHROMETRACE_MAX_THREAD_COUNT; ++t)
+        {
+            struct ChromeTraceThread* thread = &chrome_trace_api->m_Threads[t];
+            if (thread->m_State == CHROMETRACE_THREAD_READY && (oldest == 0 || thread->m_LastEventUS < oldest->m_LastEventUS))
+            {
+                oldest = thread;
+            }
+        }
+        if (oldest == 0)
+        {
+            return 0;
+        }
+        if (Longtail_CompareAndSwap32(&oldest->m_State, CHROMETRACE_THREAD_READY, CHROMETRACE_THREAD_BUSY) == CHROMETRACE_THREAD_READY)
+        {
+            oldest->m_ThreadId = thread_id;
+            oldest->m_Generation++;
+            return oldest;
+        }
+    }
+    return 0;
+}
+
+static uint64_t ChromeTrace_BeginScope(struct Longtail_TraceAPI* trace_api)
+{
+    return Longtail_GetTimeUS();
+}
+
+static void ChromeTrace_EndScope(struct Longtail_TraceAPI* trace_api, const char* name, uint64_t begin)
+{
+    uint64_t end = Longtail_GetTimeUS();
+    struct ChromeTraceAPI* chrome_trace_api = (struct ChromeTraceAPI*)trace_api;
+    uint64_t thread_id = Longtail_GetCurrentThreadId();
+    struct ChromeTraceThreadCache* cache = &ChromeTrace_ThreadCache;
+    struct ChromeTraceThread* thread = 0;
+    if (cache->m_API == chrome_trace_api && cache->m_Serial == chrome_trace_api->m_Serial)
+    {
+        thread = cache->m_Thread;
+        ChromeTrace_LockThread(thread);
+        if (thread->m_ThreadId != thread_id)
+        {
+            // Handed to another thread while this one was idle
+            ChromeTrace_UnlockThread(thread);
+            thread = 0;
+        }
+    }
+    if (thread == 0)
+    {
+        thread = ChromeTrace_ClaimThread(chrome_trace_api, thread_id);
+        if (thread == 0)
+        {
+            Longtail_AtomicAdd32(&chrome_trace_api->m_DroppedEventCount, 1);
+            return;
+        }
+        cache->m_API = chrome_trace_api;
+        cache->m_Serial = chrome_trace_api->m_Serial;
+        cache->m_Thread = thread;
+    }
+    struct ChromeTraceEvent* event = &thread->m_Events[thread->m_EventCount % chrome_trace_api->m_EventsPerThread];
+    event->m_Name = name;
+    event->m_BeginUS = begin;
+    event->m_DurationUS = end - begin;
+    event->m_Generation = thread->m_Generation;
+    thread->m_EventCount++;
+    thread->m_LastEventUS = end;
+    ChromeTrace_UnlockThread(thread);
+}
+
+static void ChromeTrace_Dispose(struct Longtail_API* trace_api)
+{
+    struct ChromeTraceAPI* chrome_trace_api = (struct ChromeTraceAPI*)trace_api;
+    for (uint32_t t = 0; t < CHROMETRACE_MAX_THREAD_COUNT; ++t)
+    {
+        Longtail_Free(chrome_trace_api->m_Threads[t].m_Events);
+    }
+    Longtail_Free(chrome_trace_api);
+}
+
+static void ChromeTrace_Init(struct ChromeTraceAPI* chrome_trace_api, uint32_t events_per_thread)
+{
+    chrome_trace_api->m_ChromeTraceAPI.m_API.Dispose = ChromeTrace_Dispose;
+    chrome_trace_api->m_ChromeTraceAPI.BeginScope = ChromeTrace_BeginScope;
+    chrome_trace_api->m_ChromeTraceAPI.EndScope = ChromeTrace_EndScope;
+    chrome_trace_api->m_EventsPerThread = events_per_thread;
+    chrome_trace_api->m_Serial = (uint32_t)Longtail_AtomicAdd32(&ChromeTrace_NextSerial, 1);
+    chrome_trace_api->m_StartUS = Longtail_GetTimeUS();
+    chrome_trace_api->m_DroppedEventCount = 0;
+    memset(chrome_trace_api->m_Threads, 0, sizeof(chrome_trace_api->m_Threads));
+}
+
+struct Longtail_TraceAPI* Longtail_CreateChromeTraceAPI(uint32_t events_per_thread)
+{
+    LONGTAIL_FATAL_ASSERT(events_per_thread != 0, return 0)
+    struct ChromeTraceAPI* chrome_trace_api = (struct ChromeTraceAPI*)Longtail_Alloc(sizeof(struct ChromeTraceAPI));
+    if (!chrome_trace_api)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_CreateChromeTraceAPI(%u) failed with %d", events_per_thread, ENOMEM)
+        return 0;
+    }
+    ChromeTrace_Init(chrome_trace_api, events_per_thread);
+    return &chrome_trace_api->m_ChromeTraceAPI;
+}
+
+// Longest event line, excluding the scope name
+#define CHROMETRACE_MAX_EVENT_LENGTH 128u
+
+int Longtail_ChromeTrace_Write(struct Longtail_TraceAPI* trace_api, struct Longtail_StorageAPI* storage_api, const char* path)
+{
+    LONGTAIL_FATAL_ASSERT(trace_api != 0, return EINVAL)
+    LONGTAIL_FATAL_ASSERT(storage_api != 0, return EINVAL)
+    LONGTAIL_FATAL_ASSERT(path != 0, return EINVAL)
+    struct ChromeTraceAPI* chrome_trace_api = (struct ChromeTraceAPI*)trace_api;
+
+    // Copy the events once and work from the copy so threads that are still tracing can not change what we size,
+    // each slot is locked while it is copied so its events and count are consistent
+    uint32_t thread_event_counts[CHROMETRACE_MAX_THREAD_COUNT];
+    uint64_t total_event_count = 0;
+    for (uint32_t t = 0; t < CHROMETRACE_MAX_THREAD_COUNT; ++t)
+    {
+        struct ChromeTraceThread* thread = &chrome_trace_api->m_Threads[t];
+        thread_event_counts[t] = 0;
+        if (Longtail_AtomicAdd32(&thread->m_State, 0) == CHROMETRACE_THREAD_FREE)
+        {
+            continue;
+        }
+        // Only threads counted here are copied, a thread that starts tracing later is left out
+        thread_event_counts[t] = 1;
+        total_event_count += chrome_trace_api->m_EventsPerThread;
+    }
+    struct ChromeTraceEvent* events = (struct ChromeTraceEvent*)Longtail_Alloc(sizeof(struct ChromeTraceEvent) * (total_event_count ? total_event_count : 1u));
+    if (!events)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_ChromeTrace_Write: Failed to allocate %" PRIu64 " events for `%s`, %d", total_event_count, path, ENOMEM)
+        return ENOMEM;
+    }
+    uint64_t snapshot_event_count = 0;
+    for (uint32_t t = 0; t < CHROMETRACE_MAX_THREAD_COUNT; ++t)
+    {
+        struct ChromeTraceThread* thread = &chrome_trace_api->m_Threads[t];
+        if (thread_event_counts[t] == 0)
+        {
+            continue;
+        }
+        thread_event_counts[t] = 0;
+        if (!ChromeTrace_LockThread(thread))
+        {
+            continue;
+        }
+        uint64_t event_count = thread->m_EventCount;
+        uint64_t first_event = event_count > chrome_trace_api->m_EventsPerThread ? event_count - chrome_trace_api->m_EventsPerThread : 0;
+        for (uint64_t e = first_event; e < event_count; ++e)
+        {
+            events[snapshot_event_count++] = thread->m_Events[e % chrome_trace_api->m_EventsPerThread];
+        }
+        ChromeTrace_UnlockThread(thread);
+        thread_event_counts[t] = (uint32_t)(event_count - first_event);
+    }
+
+    size_t max_size = 64;
+    for (uint64_t e = 0; e < snapshot_event_count; ++e)
+    {
+        max_size += CHROMETRACE_MAX_EVENT_LENGTH + strlen(events[e].m_Name);
+    }
+    char* buffer = (char*)Longtail_Alloc(max_size);
+    if (!buffer)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_ChromeTrace_Write: Failed to allocate %" PRIu64 " bytes for `%s`, %d", (uint64_t)max_size, path, ENOMEM)
+        Longtail_Free(events);
+        return ENOMEM;
+    }
+    size_t size = (size_t)snprintf(buffer, max_size, "{\"traceEvents\":[");
+    const char* separator = "\n";
+    const struct ChromeTraceEvent* event = events;
+    for (uint32_t t = 0; t < CHROMETRACE_MAX_THREAD_COUNT; ++t)
+    {
+        for (uint32_t e = 0; e < thread_event_counts[t] && size < max_size; ++e, ++event)
+        {
+            uint64_t begin = event->m_BeginUS > chrome_trace_api->m_StartUS ? event->m_BeginUS - chrome_trace_api->m_StartUS : 0;
+            size += (size_t)snprintf(&buffer[size], max_size - size, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%" PRIu64 ",\"ts\":%" PRIu64 ",\"dur\":%" PRIu64 "}", separator, event->m_Name, (uint64_t)event->m_Generation * CHROMETRACE_MAX_THREAD_COUNT + t, begin, event->m_DurationUS);
+            separator = ",\n";
+        }
+    }
+    Longtail_Free(events);
+    LONGTAIL_FATAL_ASSERT(size < max_size, Longtail_Free(buffer); return EINVAL)
+    size += (size_t)snprintf(&buffer[size], max_size - size, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    LONGTAIL_FATAL_ASSERT(size < max_size, Longtail_Free(buffer); return EINVAL)
+
+    int32_t dropped_event_count = Longtail_AtomicAdd32(&chrome_trace_api->m_DroppedEventCount, 0);
+    if (dropped_event_count > 0)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_WARNING, "Longtail_ChromeTrace_Write: Dropped %d events, out of memory", dropped_event_count)
+    }
+
+    int err = EnsureParentPathExists(storage_api, path);
+    if (err)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_ChromeTrace_Write: Failed to create parent folder for `%s`, %d", path, err)
+        Longtail_Free(buffer);
+        return err;
+    }
+    Longtail_StorageAPI_HOpenFile file_handle;
+    err = storage_api->OpenWriteFile(storage_api, path, 0, &file_handle);
+    if (err)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_ChromeTrace_Write: Failed to create `%s`, %d", path, err)
+        Longtail_Free(buffer);
+        return err;
+    }
+    err = storage_api->Write(storage_api, file_handle, 0, size, buffer);
+    if (err)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_ChromeTrace_Write: Failed to write to `%s`, %d", path, err)
+    }
+    storage_api->CloseFile(storage_api, file_handle);
+    Longtail_Free(buffer);
+    return err;
+}
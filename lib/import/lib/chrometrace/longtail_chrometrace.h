@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LONGTAIL_CHROMETRACE_DEFAULT_EVENTS_PER_THREAD 65536u
+
+struct Longtail_TraceAPI;
+struct Longtail_StorageAPI;
+
+// Each thread that ends a scope gets its own ring buffer of events_per_thread events, once full the
+// oldest events are overwritten. Up to 256 threads have a buffer at a time, after that a new thread takes over
+// the buffer of the thread that has been idle the longest and the events already in it are kept.
+extern struct Longtail_TraceAPI* Longtail_CreateChromeTraceAPI(uint32_t events_per_thread);
+
+// Writes the recorded scopes as Chrome trace event JSON, viewable in chrome://tracing or Perfetto.
+// Can be called while other threads are tracing, each thread's events are copied under a lock so scopes that end
+// during the write are either included whole or left out.
+extern int Longtail_ChromeTrace_Write(struct Longtail_TraceAPI* trace_api, struct Longtail_StorageAPI* storage_api, const char* path);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,5 +1,7 @@
 #include "longtail_lizard.h"
 
+#include "../longtail_platform.h"
+
 #define FSE_STATIC_LINKING_ONLY
 #include "ext/lizard_common.h"
 #include "ext/lizard_decompress.h"
@@ -15,13 +17,36 @@ Longtail_CompressionAPI_HSettings LONGTAIL_LIZARD_MIN_COMPRESSION      = (Longta
 Longtail_CompressionAPI_HSettings LONGTAIL_LIZARD_DEFAULT_COMPRESSION  = (Longtail_CompressionAPI_HSettings)&LizardCompressionAPI_DefaultCompressionSetting;
 Longtail_CompressionAPI_HSettings LONGTAIL_LIZARD_MAX_COMPRESSION      = (Longtail_CompressionAPI_HSettings)&LizardCompressionAPI_MaxCompressionSetting;
 
+// Levels 10-19 use LZ4 style coding without entropy coding. Level 17 keeps most of the ratio of the default level 44
+// while compressing and decompressing about twice as fast, the levels above it compress at a few MB/s for little gain
+static int LizardCompressionAPI_FastCompressionSetting      = 17;
+
+Longtail_CompressionAPI_HSettings LONGTAIL_LIZARD_FAST_COMPRESSION     = (Longtail_CompressionAPI_HSettings)&LizardCompressionAPI_FastCompressionSetting;
+
+#define LONGTAIL_LIZARD_MAX_POOLED_CONTEXTS 64
+
+// Compression state for Lizard_compress_extState, sized for the compression level it was last used with
+struct LizardCompressionContext
+{
+    size_t m_StateSize;
+};
+
 struct LizardCompressionAPI
 {
     struct Longtail_CompressionAPI m_LizardCompressionAPI;
+    HLongtail_SpinLock m_SpinLock;
+    uint32_t m_ContextCount;
+    struct LizardCompressionContext* m_Contexts[LONGTAIL_LIZARD_MAX_POOLED_CONTEXTS];
 };
 
 void LizardCompressionAPI_Dispose(struct Longtail_API* compression_api)
 {
+    struct LizardCompressionAPI* lizard_compression_api = (struct LizardCompressionAPI*)compression_api;
+    while (lizard_compression_api->m_ContextCount)
+    {
+        Longtail_Free(lizard_compression_api->m_Contexts[--lizard_compression_api->m_ContextCount]);
+    }
+    Longtail_DeleteSpinLock(lizard_compression_api->m_SpinLock);
     Longtail_Free(compression_api);
 }
 
@@ -30,10 +55,69 @@ static size_t LizardCompressionAPI_GetMaxCompressedSize(struct Longtail_Compress
     return (size_t)Lizard_compressBound((int)size);
 }
 
-int LizardCompressionAPI_Compress(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HSettings settings, const char* uncompressed, char* compressed, size_t uncompressed_size, size_t max_compressed_size, size_t* out_compressed_size)
+static int LizardCompressionAPI_CreateCompressionContext(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HSettings settings, Longtail_CompressionAPI_HCompressionContext* out_context)
+{
+    struct LizardCompressionAPI* lizard_compression_api = (struct LizardCompressionAPI*)compression_api;
+    size_t state_size = (size_t)Lizard_sizeofState(*(int*)settings);
+    struct LizardCompressionContext* context = 0;
+    Longtail_LockSpinLock(lizard_compression_api->m_SpinLock);
+    for (uint32_t i = 0; i < lizard_compression_api->m_ContextCount; ++i)
+    {
+        if (lizard_compression_api->m_Contexts[i]->m_StateSize >= state_size)
+        {
+            context = lizard_compression_api->m_Contexts[i];
+            lizard_compression_api->m_Contexts[i] = lizard_compression_api->m_Contexts[--lizard_compression_api->m_ContextCount];
+            break;
+        }
+    }
+    Longtail_UnlockSpinLock(lizard_compression_api->m_SpinLock);
+    if (!context)
+    {
+        context = (struct LizardCompressionContext*)Longtail_Alloc(sizeof(struct LizardCompressionContext) + state_size);
+        if (!context)
+        {
+            return ENOMEM;
+        }
+        context->m_StateSize = state_size;
+    }
+    *out_context = (Longtail_CompressionAPI_HCompressionContext)context;
+    return 0;
+}
+
+static void LizardCompressionAPI_DeleteCompressionContext(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HCompressionContext context)
+{
+    struct LizardCompressionAPI* lizard_compression_api = (struct LizardCompressionAPI*)compression_api;
+    struct LizardCompressionContext* lizard_context = (struct LizardCompressionContext*)context;
+    Longtail_LockSpinLock(lizard_compression_api->m_SpinLock);
+    if (lizard_compression_api->m_ContextCount < LONGTAIL_LIZARD_MAX_POOLED_CONTEXTS)
+    {
+        lizard_compression_api->m_Contexts[lizard_compression_api->m_ContextCount++] = lizard_context;
+        lizard_context = 0;
+    }
+    Longtail_UnlockSpinLock(lizard_compression_api->m_SpinLock);
+    if (lizard_context)
+    {
+        Longtail_Free(lizard_context);
+    }
+}
+
+static int LizardCompressionAPI_CreateDecompressionContext(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HDecompressionContext* out_context)
+{
+    // Lizard decompression is stateless
+    *out_context = 0;
+    return 0;
+}
+
+static void LizardCompressionAPI_DeleteDecompressionContext(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HDecompressionContext context)
+{
+}
+
+int LizardCompressionAPI_Compress(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HCompressionContext context, Longtail_CompressionAPI_HSettings settings, const char* uncompressed, char* compressed, size_t uncompressed_size, size_t max_compressed_size, size_t* out_compressed_size)
 {
     int compression_setting = *(int*)settings;
-    int compressed_size = Lizard_compress(uncompressed, compressed, (int)uncompressed_size, (int)max_compressed_size, compression_setting);
+    int compressed_size = context ?
+        Lizard_compress_extState(&((struct LizardCompressionContext*)context)[1], uncompressed, compressed, (int)uncompressed_size, (int)max_compressed_size, compression_setting) :
+        Lizard_compress(uncompressed, compressed, (int)uncompressed_size, (int)max_compressed_size, compression_setting);
     if (compressed_size == 0)
     {
         return ENOMEM;
@@ -42,7 +126,7 @@ int LizardCompressionAPI_Compress(struct Longtail_CompressionAPI* compression_ap
     return 0;
 }
 
-static int LizardCompressionAPI_Decompress(struct Longtail_CompressionAPI* compression_api, const char* compressed, char* uncompressed, size_t compressed_size, size_t max_uncompressed_size, size_t* out_uncompressed_size)
+static int LizardCompressionAPI_Decompress(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HDecompressionContext context, const char* compressed, char* uncompressed, size_t compressed_size, size_t max_uncompressed_size, size_t* out_uncompressed_size)
 {
     int result = Lizard_decompress_safe(compressed, uncompressed, (int)compressed_size, (int)max_uncompressed_size);
     if (result < 0)
@@ -53,17 +137,29 @@ static int LizardCompressionAPI_Decompress(struct Longtail_CompressionAPI* compr
     return 0;
 }
 
-static void LizardCompressionAPI_Init(struct LizardCompressionAPI* compression_api)
+static int LizardCompressionAPI_Init(struct LizardCompressionAPI* compression_api)
 {
     compression_api->m_LizardCompressionAPI.m_API.Dispose = LizardCompressionAPI_Dispose;
     compression_api->m_LizardCompressionAPI.GetMaxCompressedSize = LizardCompressionAPI_GetMaxCompressedSize;
+    compression_api->m_LizardCompressionAPI.CreateCompressionContext = LizardCompressionAPI_CreateCompressionContext;
+    compression_api->m_LizardCompressionAPI.DeleteCompressionContext = LizardCompressionAPI_DeleteCompressionContext;
+    compression_api->m_LizardCompressionAPI.CreateDecompressionContext = LizardCompressionAPI_CreateDecompressionContext;
+    compression_api->m_LizardCompressionAPI.DeleteDecompressionContext = LizardCompressionAPI_DeleteDecompressionContext;
+    compression_api->m_LizardCompressionAPI.SetCompressionWorkerCount = 0;
     compression_api->m_LizardCompressionAPI.Compress = LizardCompressionAPI_Compress;
     compression_api->m_LizardCompressionAPI.Decompress = LizardCompressionAPI_Decompress;
+    compression_api->m_ContextCount = 0;
+    return Longtail_CreateSpinLock(&compression_api[1], &compression_api->m_SpinLock);
 }
 
 struct Longtail_CompressionAPI* Longtail_CreateLizardCompressionAPI()
 {
-    struct LizardCompressionAPI* compression_api = (struct LizardCompressionAPI*)Longtail_Alloc(sizeof(struct LizardCompressionAPI));
-    LizardCompressionAPI_Init(compression_api);
+    struct LizardCompressionAPI* compression_api = (struct LizardCompressionAPI*)Longtail_Alloc(sizeof(struct LizardCompressionAPI) + Longtail_GetSpinLockSize());
+    int err = LizardCompressionAPI_Init(compression_api);
+    if (err)
+    {
+        Longtail_Free(compression_api);
+        return 0;
+    }
     return &compression_api->m_LizardCompressionAPI;
 }
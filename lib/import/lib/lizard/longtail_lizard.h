@@ -11,6 +11,10 @@ extern Longtail_CompressionAPI_HSettings LONGTAIL_LIZARD_MIN_COMPRESSION;
 extern Longtail_CompressionAPI_HSettings LONGTAIL_LIZARD_DEFAULT_COMPRESSION;
 extern Longtail_CompressionAPI_HSettings LONGTAIL_LIZARD_MAX_COMPRESSION;
 
+// Lizard level 17, LZ4 style coding without an entropy stage. Decompresses about twice as fast as the default level
+// at a slightly lower ratio
+extern Longtail_CompressionAPI_HSettings LONGTAIL_LIZARD_FAST_COMPRESSION;
+
 #ifdef __cplusplus
 }
 #endif
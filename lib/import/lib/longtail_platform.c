@@ -117,11 +117,58 @@ void Longtail_Sleep(uint64_t timeout_us)
     Sleep(wait_ms);
 }
 
+uint64_t Longtail_GetTimeUS()
+{
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    uint64_t seconds = (uint64_t)(counter.QuadPart / frequency.QuadPart);
+    uint64_t remainder = (uint64_t)(counter.QuadPart % frequency.QuadPart);
+    return seconds * 1000000u + (remainder * 1000000u) / (uint64_t)frequency.QuadPart;
+}
+
+uint64_t Longtail_GetProcessCPUTimeUS()
+{
+    FILETIME creation_time;
+    FILETIME exit_time;
+    FILETIME kernel_time;
+    FILETIME user_time;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time))
+    {
+        return 0;
+    }
+    uint64_t kernel = ((uint64_t)kernel_time.dwHighDateTime << 32) | kernel_time.dwLowDateTime;
+    uint64_t user = ((uint64_t)user_time.dwHighDateTime << 32) | user_time.dwLowDateTime;
+    // FILETIME is in 100 nanosecond units
+    return (kernel + user) / 10u;
+}
+
 int32_t Longtail_AtomicAdd32(TLongtail_Atomic32* value, int32_t amount)
 {
     return InterlockedAdd((LONG volatile*)value, amount);
 }
 
+int32_t Longtail_CompareAndSwap32(TLongtail_Atomic32* value, int32_t expected, int32_t desired)
+{
+    return (int32_t)InterlockedCompareExchange((LONG volatile*)value, desired, expected);
+}
+
+int64_t Longtail_AtomicAdd64(TLongtail_Atomic64* value, int64_t amount)
+{
+    return InterlockedAdd64((LONG64 volatile*)value, amount);
+}
+
+int64_t Longtail_CompareAndSwap64(TLongtail_Atomic64* value, int64_t expected, int64_t desired)
+{
+    return (int64_t)InterlockedCompareExchange64((LONG64 volatile*)value, desired, expected);
+}
+
+uint64_t Longtail_GetCurrentThreadId()
+{
+    return (uint64_t)GetCurrentThreadId();
+}
+
 struct Longtail_Thread
 {
     HANDLE              m_Handle;
@@ -218,9 +265,21 @@ int Longtail_PostSema(HLongtail_Sema semaphore, unsigned int count)
                     NULL);
 }
 
-int Longtail_WaitSema(HLongtail_Sema semaphore)
+int Longtail_WaitSema(HLongtail_Sema semaphore, uint64_t timeout_us)
 {
-    return WAIT_OBJECT_0 == WaitForSingleObject(semaphore->m_Handle, INFINITE);
+    DWORD wait_ms = (timeout_us == LONGTAIL_TIMEOUT_INFINITE) ? INFINITE : (DWORD)(timeout_us / 1000);
+    DWORD result  = WaitForSingleObject(semaphore->m_Handle, wait_ms);
+    switch (result)
+    {
+        case WAIT_OBJECT_0:
+        return 0;
+        case WAIT_TIMEOUT:
+        return ETIMEDOUT;
+        case WAIT_FAILED:
+        return Win32ErrorToErrno(GetLastError());
+        default:
+        return EINVAL;
+    }
 }
 
 void Longtail_DeleteSema(HLongtail_Sema semaphore)
@@ -612,11 +671,48 @@ void Longtail_Sleep(uint64_t timeout_us)
     usleep((useconds_t)timeout_us);
 }
 
+uint64_t Longtail_GetTimeUS()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+uint64_t Longtail_GetProcessCPUTimeUS()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts))
+    {
+        return 0;
+    }
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
 int32_t Longtail_AtomicAdd32(TLongtail_Atomic32* value, int32_t amount)
 {
     return __sync_fetch_and_add(value, amount) + amount;
 }
 
+int32_t Longtail_CompareAndSwap32(TLongtail_Atomic32* value, int32_t expected, int32_t desired)
+{
+    return __sync_val_compare_and_swap(value, expected, desired);
+}
+
+int64_t Longtail_AtomicAdd64(TLongtail_Atomic64* value, int64_t amount)
+{
+    return __sync_fetch_and_add(value, amount) + amount;
+}
+
+int64_t Longtail_CompareAndSwap64(TLongtail_Atomic64* value, int64_t expected, int64_t desired)
+{
+    return __sync_val_compare_and_swap(value, expected, desired);
+}
+
+uint64_t Longtail_GetCurrentThreadId()
+{
+    return (uint64_t)(uintptr_t)pthread_self();
+}
+
 struct Longtail_Thread
 {
     pthread_t           m_Handle;
@@ -820,9 +916,19 @@ int Longtail_PostSema(HLongtail_Sema semaphore, unsigned int count)
     return 0;
 }
 
-int Longtail_WaitSema(HLongtail_Sema semaphore)
+int Longtail_WaitSema(HLongtail_Sema semaphore, uint64_t timeout_us)
 {
-    kern_return_t ret = semaphore_wait(semaphore->m_Semaphore);
+    if (timeout_us == LONGTAIL_TIMEOUT_INFINITE)
+    {
+        kern_return_t ret = semaphore_wait(semaphore->m_Semaphore);
+        return (int)ret;
+    }
+    mach_timespec_t wait_time = {(unsigned int)(timeout_us / 1000000u), (clock_res_t)((timeout_us % 1000000u) * 1000u)};
+    kern_return_t ret = semaphore_timedwait(semaphore->m_Semaphore, wait_time);
+    if (ret == KERN_OPERATION_TIMED_OUT)
+    {
+        return ETIMEDOUT;
+    }
     return (int)ret;
 }
 
@@ -900,9 +1006,26 @@ int Longtail_PostSema(HLongtail_Sema semaphore, unsigned int count)
     return 0;
 }
 
-int Longtail_WaitSema(HLongtail_Sema semaphore)
+int Longtail_WaitSema(HLongtail_Sema semaphore, uint64_t timeout_us)
 {
-    return sem_wait(&semaphore->m_Semaphore);
+    if (timeout_us == LONGTAIL_TIMEOUT_INFINITE)
+    {
+        return sem_wait(&semaphore->m_Semaphore);
+    }
+    struct timespec ts;
+    int err = GetTimeSpec(&ts, timeout_us);
+    if (err != 0)
+    {
+        return err;
+    }
+    while (sem_timedwait(&semaphore->m_Semaphore, &ts) != 0)
+    {
+        if (errno != EINTR)
+        {
+            return errno;
+        }
+    }
+    return 0;
 }
 
 void Longtail_DeleteSema(HLongtail_Sema semaphore)
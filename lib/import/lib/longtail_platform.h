@@ -11,9 +11,26 @@ static const uint64_t LONGTAIL_TIMEOUT_INFINITE = ((uint64_t)-1);
 
 uint32_t    Longtail_GetCPUCount();
 void        Longtail_Sleep(uint64_t timeout_us);
+uint64_t    Longtail_GetTimeUS();
+uint64_t    Longtail_GetProcessCPUTimeUS();
 
 typedef int32_t volatile TLongtail_Atomic32;
 int32_t Longtail_AtomicAdd32(TLongtail_Atomic32* value, int32_t amount);
+// Returns the value of `value` before the exchange, the exchange is done if it was `expected`
+int32_t Longtail_CompareAndSwap32(TLongtail_Atomic32* value, int32_t expected, int32_t desired);
+
+typedef int64_t volatile TLongtail_Atomic64;
+int64_t Longtail_AtomicAdd64(TLongtail_Atomic64* value, int64_t amount);
+// Returns the value of `value` before the exchange, the exchange is done if it was `expected`
+int64_t Longtail_CompareAndSwap64(TLongtail_Atomic64* value, int64_t expected, int64_t desired);
+
+uint64_t Longtail_GetCurrentThreadId();
+
+#if defined(_MSC_VER)
+    #define LONGTAIL_THREAD_LOCAL __declspec(thread)
+#else
+    #define LONGTAIL_THREAD_LOCAL __thread
+#endif
 
 typedef struct Longtail_Thread* HLongtail_Thread;
 
@@ -28,7 +45,7 @@ typedef struct Longtail_Sema* HLongtail_Sema;
 size_t  Longtail_GetSemaSize();
 int     Longtail_CreateSema(void* mem, int initial_count, HLongtail_Sema* out_sema);
 int     Longtail_PostSema(HLongtail_Sema semaphore, unsigned int count);
-int     Longtail_WaitSema(HLongtail_Sema semaphore);
+int     Longtail_WaitSema(HLongtail_Sema semaphore, uint64_t timeout_us);
 void    Longtail_DeleteSema(HLongtail_Sema semaphore);
 
 typedef struct Longtail_SpinLock* HLongtail_SpinLock;
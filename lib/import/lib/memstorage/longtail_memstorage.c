@@ -2,16 +2,24 @@
 
 #include "../../src/longtail.h"
 #include "../longtail_platform.h"
+
+#define STBDS_REALLOC(context,ptr,size) Longtail_STBRealloc(context,ptr,size)
+#define STBDS_FREE(context,ptr)         Longtail_STBFree(context,ptr)
 #include "../../src/ext/stb_ds.h"
 
 #include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+
+// Paths are spread over the shards by hash so lookups for different paths rarely share a lock
+#define INMEMSTORAGE_SHARD_COUNT 64u
 
-static const uint32_t Prime = 0x01000193;
-static const uint32_t Seed  = 0x811C9DC5;
+static const uint64_t Prime = 0x00000100000001B3ull;
+static const uint64_t Seed  = 0xCBF29CE484222325ull;
 
-static uint32_t fnv1a(const void* data, uint32_t numBytes)
+static uint64_t fnv1a(const void* data, size_t numBytes)
 {
-    uint32_t hash = Seed;
+    uint64_t hash = Seed;
     const unsigned char* ptr = (const unsigned char*)data;
     while (numBytes--)
     {
@@ -20,120 +28,219 @@ static uint32_t fnv1a(const void* data, uint32_t numBytes)
     return hash;
 }
 
-struct PathEntry
+// A buffer is never moved, growing a file publishes a new buffer and retires the old one. Readers do not take a lock,
+// they count themselves in m_ReaderCount and retired buffers are freed once no reader is left that could hold one
+struct MemFileBuffer
 {
+    struct MemFileBuffer* m_NextRetired;
+    uint64_t m_Capacity;
+};
+
+struct MemFile
+{
+    TLongtail_Atomic32 m_RefCount;
+    int32_t m_IsDir;
+    uint64_t m_ParentHash;
     char* m_FileName;
-    uint32_t m_ParentHash;
-    uint8_t* m_Content;
+    HLongtail_SpinLock m_WriteLock;
+    TLongtail_Atomic64 m_Buffer;
+    TLongtail_Atomic64 m_Size;
+    TLongtail_Atomic32 m_ReaderCount;
+    struct MemFileBuffer* volatile m_Retired;
 };
 
 struct Lookup
 {
-    uint32_t key;
-    uint32_t value;
+    uint64_t key;
+    struct MemFile* value;
+};
+
+struct InMemStorageShard
+{
+    HLongtail_SpinLock m_SpinLock;
+    struct Lookup* m_PathHashToFile;
 };
 
 struct InMemStorageAPI
 {
     struct Longtail_StorageAPI m_InMemStorageAPI;
-    struct Lookup* m_PathHashToContent;
-    struct PathEntry* m_PathEntries;
-    HLongtail_SpinLock m_SpinLock;
+    struct InMemStorageShard m_Shards[INMEMSTORAGE_SHARD_COUNT];
 };
 
-static void InMemStorageAPI_Dispose(struct Longtail_API* storage_api)
+struct InMemFindEntry
 {
-    struct InMemStorageAPI* in_mem_storage_api = (struct InMemStorageAPI*)storage_api;
-    size_t c = (size_t)arrlen(in_mem_storage_api->m_PathEntries);
-    while(c--)
-    {
-        struct PathEntry* path_entry = &in_mem_storage_api->m_PathEntries[c];
-        Longtail_Free(path_entry->m_FileName);
-        path_entry->m_FileName = 0;
-        arrfree(path_entry->m_Content);
-        path_entry->m_Content = 0;
-    }
-    Longtail_DeleteSpinLock(in_mem_storage_api->m_SpinLock);
-    hmfree(in_mem_storage_api->m_PathHashToContent);
-    in_mem_storage_api->m_PathHashToContent = 0;
-    arrfree(in_mem_storage_api->m_PathEntries);
-    in_mem_storage_api->m_PathEntries = 0;
-    Longtail_Free(storage_api);
+    char* m_Name;
+    uint64_t m_Size;
+    int m_IsDir;
+};
+
+struct InMemFindIterator
+{
+    struct InMemFindEntry* m_Entries;
+    ptrdiff_t m_Index;
+};
+
+static struct MemFileBuffer* MemFile_GetBuffer(struct MemFile* file)
+{
+    return (struct MemFileBuffer*)(uintptr_t)file->m_Buffer;
 }
 
-static uint32_t InMemStorageAPI_GetPathHash(const char* path)
+static uint8_t* MemFileBuffer_GetData(struct MemFileBuffer* buffer)
 {
-    return fnv1a((void*)path, (uint32_t)strlen(path));
+    return (uint8_t*)&buffer[1];
 }
 
-static int InMemStorageAPI_OpenReadFile(struct Longtail_StorageAPI* storage_api, const char* path, Longtail_StorageAPI_HOpenFile* out_open_file)
+static struct MemFile* MemFile_Create(const char* file_name, uint64_t parent_hash, int is_dir)
 {
-    struct InMemStorageAPI* instance = (struct InMemStorageAPI*)storage_api;
-    Longtail_LockSpinLock(instance->m_SpinLock);
-    uint32_t path_hash = InMemStorageAPI_GetPathHash(path);
-    intptr_t it = hmgeti(instance->m_PathHashToContent, path_hash);
-    if (it != -1)
+    struct MemFile* file = (struct MemFile*)Longtail_Alloc(sizeof(struct MemFile) + Longtail_GetSpinLockSize());
+    if (!file)
+    {
+        return 0;
+    }
+    int err = Longtail_CreateSpinLock(&file[1], &file->m_WriteLock);
+    if (err)
     {
-        Longtail_UnlockSpinLock(instance->m_SpinLock);
-        *out_open_file = (Longtail_StorageAPI_HOpenFile)(uintptr_t)path_hash;
+        Longtail_Free(file);
         return 0;
     }
-    Longtail_UnlockSpinLock(instance->m_SpinLock);
-    return ENOENT;
+    file->m_RefCount = 1;
+    file->m_IsDir = is_dir;
+    file->m_ParentHash = parent_hash;
+    file->m_FileName = Longtail_Strdup(file_name);
+    file->m_Buffer = 0;
+    file->m_Size = 0;
+    file->m_ReaderCount = 0;
+    file->m_Retired = 0;
+    return file;
 }
 
-static int InMemStorageAPI_GetSize(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f, uint64_t* out_size)
+static void MemFile_AddRef(struct MemFile* file)
 {
-    struct InMemStorageAPI* instance = (struct InMemStorageAPI*)storage_api;
-    Longtail_LockSpinLock(instance->m_SpinLock);
-    uint32_t path_hash = (uint32_t)(uintptr_t)f;
-    intptr_t it = hmgeti(instance->m_PathHashToContent, path_hash);
-    if (it == -1) {
-        Longtail_UnlockSpinLock(instance->m_SpinLock);
-        return ENOENT;
+    Longtail_AtomicAdd32(&file->m_RefCount, 1);
+}
+
+static void MemFile_Release(struct MemFile* file)
+{
+    if (Longtail_AtomicAdd32(&file->m_RefCount, -1) != 0)
+    {
+        return;
+    }
+    struct MemFileBuffer* buffer = file->m_Retired;
+    while (buffer)
+    {
+        struct MemFileBuffer* next = buffer->m_NextRetired;
+        Longtail_Free(buffer);
+        buffer = next;
+    }
+    Longtail_Free(MemFile_GetBuffer(file));
+    Longtail_DeleteSpinLock(file->m_WriteLock);
+    Longtail_Free(file->m_FileName);
+    Longtail_Free(file);
+}
+
+// Caller holds m_WriteLock. A reader that starts after the check loads the current buffer which is never retired
+static void MemFile_FreeRetired(struct MemFile* file)
+{
+    if (Longtail_AtomicAdd32(&file->m_ReaderCount, 0) != 0)
+    {
+        return;
+    }
+    struct MemFileBuffer* buffer = file->m_Retired;
+    file->m_Retired = 0;
+    while (buffer)
+    {
+        struct MemFileBuffer* next = buffer->m_NextRetired;
+        Longtail_Free(buffer);
+        buffer = next;
+    }
+}
+
+static struct MemFileBuffer* MemFile_BeginRead(struct MemFile* file)
+{
+    Longtail_AtomicAdd32(&file->m_ReaderCount, 1);
+    return MemFile_GetBuffer(file);
+}
+
+static void MemFile_EndRead(struct MemFile* file)
+{
+    if (Longtail_AtomicAdd32(&file->m_ReaderCount, -1) == 0 && file->m_Retired)
+    {
+        Longtail_LockSpinLock(file->m_WriteLock);
+        MemFile_FreeRetired(file);
+        Longtail_UnlockSpinLock(file->m_WriteLock);
+    }
+}
+
+// Caller holds m_WriteLock
+static int MemFile_Reserve(struct MemFile* file, uint64_t size)
+{
+    struct MemFileBuffer* buffer = MemFile_GetBuffer(file);
+    if (buffer && buffer->m_Capacity >= size)
+    {
+        return 0;
+    }
+    uint64_t capacity = buffer ? buffer->m_Capacity * 2u : 16u;
+    if (capacity < size)
+    {
+        capacity = size;
+    }
+    struct MemFileBuffer* new_buffer = (struct MemFileBuffer*)Longtail_Alloc((size_t)(sizeof(struct MemFileBuffer) + capacity));
+    if (!new_buffer)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "MemFile_Reserve(%p, %" PRIu64 ") failed with %d", file, size, ENOMEM)
+        return ENOMEM;
+    }
+    new_buffer->m_NextRetired = 0;
+    new_buffer->m_Capacity = capacity;
+    if (buffer)
+    {
+        memcpy(MemFileBuffer_GetData(new_buffer), MemFileBuffer_GetData(buffer), (size_t)file->m_Size);
+    }
+    Longtail_CompareAndSwap64(&file->m_Buffer, (int64_t)(uintptr_t)buffer, (int64_t)(uintptr_t)new_buffer);
+    if (buffer)
+    {
+        buffer->m_NextRetired = file->m_Retired;
+        file->m_Retired = buffer;
+        MemFile_FreeRetired(file);
     }
-    struct PathEntry* path_entry = (struct PathEntry*)&instance->m_PathEntries[instance->m_PathHashToContent[it].value];
-    uint64_t size = (uint64_t)arrlen(path_entry->m_Content);
-    Longtail_UnlockSpinLock(instance->m_SpinLock);
-    *out_size = size;
     return 0;
 }
 
-static int InMemStorageAPI_Read(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f, uint64_t offset, uint64_t length, void* output)
+// Caller holds m_WriteLock
+static int MemFile_SetSize(struct MemFile* file, uint64_t size)
 {
-    struct InMemStorageAPI* instance = (struct InMemStorageAPI*)storage_api;
-    Longtail_LockSpinLock(instance->m_SpinLock);
-    uint32_t path_hash = (uint32_t)(uintptr_t)f;
-    intptr_t it = hmgeti(instance->m_PathHashToContent, path_hash);
-    if (it == -1) {
-        Longtail_UnlockSpinLock(instance->m_SpinLock);
-        return ENOENT;
+    int err = MemFile_Reserve(file, size);
+    if (err)
+    {
+        return err;
     }
-    struct PathEntry* path_entry = (struct PathEntry*)&instance->m_PathEntries[instance->m_PathHashToContent[it].value];
-    if ((ptrdiff_t)(offset + length) > arrlen(path_entry->m_Content))
+    uint64_t old_size = (uint64_t)file->m_Size;
+    if (size > old_size)
     {
-        Longtail_UnlockSpinLock(instance->m_SpinLock);
-        return EIO;
+        memset(&MemFileBuffer_GetData(MemFile_GetBuffer(file))[old_size], 0, (size_t)(size - old_size));
     }
-    memcpy(output, &path_entry->m_Content[offset], length);
-    Longtail_UnlockSpinLock(instance->m_SpinLock);
+    Longtail_AtomicAdd64(&file->m_Size, (int64_t)size - (int64_t)old_size);
     return 0;
 }
 
-static uint32_t InMemStorageAPI_GetParentPathHash(struct InMemStorageAPI* instance, const char* path)
+static struct InMemStorageShard* InMemStorageAPI_GetShard(struct InMemStorageAPI* instance, uint64_t path_hash)
+{
+    return &instance->m_Shards[path_hash % INMEMSTORAGE_SHARD_COUNT];
+}
+
+static uint64_t InMemStorageAPI_GetPathHash(const char* path)
+{
+    return fnv1a((void*)path, strlen(path));
+}
+
+static uint64_t InMemStorageAPI_GetParentPathHash(const char* path)
 {
     const char* dir_path_begin = strrchr(path, '/');
     if (!dir_path_begin)
     {
         return 0;
     }
-    size_t dir_length = (uintptr_t)dir_path_begin - (uintptr_t)path;
-    char* dir_path = (char*)Longtail_Alloc(dir_length + 1);
-    strncpy(dir_path, path, dir_length);
-    dir_path[dir_length] = '\0';
-    uint32_t hash = InMemStorageAPI_GetPathHash(dir_path);
-    Longtail_Free(dir_path);
-    return hash;
+    return fnv1a((void*)path, (size_t)(dir_path_begin - path));
 }
 
 static const char* InMemStorageAPI_GetFileNamePart(const char* path)
@@ -146,152 +253,259 @@ static const char* InMemStorageAPI_GetFileNamePart(const char* path)
     return &file_name[1];
 }
 
-static int InMemStorageAPI_OpenWriteFile(struct Longtail_StorageAPI* storage_api, const char* path, uint64_t initial_size, Longtail_StorageAPI_HOpenFile* out_open_file)
+// Returns the file with an added reference, or zero
+static struct MemFile* InMemStorageAPI_AcquireFile(struct InMemStorageAPI* instance, uint64_t path_hash)
 {
-    struct InMemStorageAPI* instance = (struct InMemStorageAPI*)storage_api;
-    Longtail_LockSpinLock(instance->m_SpinLock);
-    uint32_t parent_path_hash = InMemStorageAPI_GetParentPathHash(instance, path);
-    if (parent_path_hash != 0 && hmgeti(instance->m_PathHashToContent, parent_path_hash) == -1)
+    struct InMemStorageShard* shard = InMemStorageAPI_GetShard(instance, path_hash);
+    Longtail_LockSpinLock(shard->m_SpinLock);
+    intptr_t it = hmgeti(shard->m_PathHashToFile, path_hash);
+    struct MemFile* file = (it == -1) ? 0 : shard->m_PathHashToFile[it].value;
+    if (file)
     {
-        Longtail_UnlockSpinLock(instance->m_SpinLock);
-        return ENOENT;
+        MemFile_AddRef(file);
     }
-    uint32_t path_hash = InMemStorageAPI_GetPathHash(path);
-    struct PathEntry* path_entry = 0;
-    intptr_t it = hmgeti(instance->m_PathHashToContent, path_hash);
-    if (it != -1)
+    Longtail_UnlockSpinLock(shard->m_SpinLock);
+    return file;
+}
+
+static int InMemStorageAPI_ParentExists(struct InMemStorageAPI* instance, uint64_t parent_path_hash)
+{
+    if (parent_path_hash == 0)
     {
-        path_entry = &instance->m_PathEntries[instance->m_PathHashToContent[it].value];
+        return 1;
     }
-    else
+    struct InMemStorageShard* shard = InMemStorageAPI_GetShard(instance, parent_path_hash);
+    Longtail_LockSpinLock(shard->m_SpinLock);
+    int exists = hmgeti(shard->m_PathHashToFile, parent_path_hash) != -1;
+    Longtail_UnlockSpinLock(shard->m_SpinLock);
+    return exists;
+}
+
+// Takes over the reference to `file` and inserts it unless the path is already taken, returns the file now at the
+// path with an added reference
+static struct MemFile* InMemStorageAPI_InsertFile(struct InMemStorageAPI* instance, uint64_t path_hash, struct MemFile* file)
+{
+    struct InMemStorageShard* shard = InMemStorageAPI_GetShard(instance, path_hash);
+    Longtail_LockSpinLock(shard->m_SpinLock);
+    intptr_t it = hmgeti(shard->m_PathHashToFile, path_hash);
+    if (it != -1)
     {
-        ptrdiff_t entry_index = arrlen(instance->m_PathEntries);
-        arrsetlen(instance->m_PathEntries, (size_t)(entry_index + 1));
-        path_entry = &instance->m_PathEntries[entry_index];
-        path_entry->m_ParentHash = parent_path_hash;
-        path_entry->m_FileName = Longtail_Strdup(InMemStorageAPI_GetFileNamePart(path));
-        path_entry->m_Content = 0;
-        hmput(instance->m_PathHashToContent, path_hash, (uint32_t)entry_index);
-    }
-    arrsetcap(path_entry->m_Content, initial_size == 0 ? 16 : (uint32_t)initial_size);
-    arrsetlen(path_entry->m_Content, (uint32_t)initial_size);
-    Longtail_UnlockSpinLock(instance->m_SpinLock);
-    *out_open_file = (Longtail_StorageAPI_HOpenFile)(uintptr_t)path_hash;
-    return 0;
+        struct MemFile* existing_file = shard->m_PathHashToFile[it].value;
+        MemFile_AddRef(existing_file);
+        Longtail_UnlockSpinLock(shard->m_SpinLock);
+        MemFile_Release(file);
+        return existing_file;
+    }
+    MemFile_AddRef(file);
+    hmput(shard->m_PathHashToFile, path_hash, file);
+    Longtail_UnlockSpinLock(shard->m_SpinLock);
+    return file;
 }
 
-static int InMemStorageAPI_Write(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f, uint64_t offset, uint64_t length, const void* input)
+static void InMemStorageAPI_Dispose(struct Longtail_API* storage_api)
+{
+    struct InMemStorageAPI* in_mem_storage_api = (struct InMemStorageAPI*)storage_api;
+    for (uint32_t s = 0; s < INMEMSTORAGE_SHARD_COUNT; ++s)
+    {
+        struct InMemStorageShard* shard = &in_mem_storage_api->m_Shards[s];
+        size_t c = (size_t)hmlen(shard->m_PathHashToFile);
+        while(c--)
+        {
+            MemFile_Release(shard->m_PathHashToFile[c].value);
+        }
+        hmfree(shard->m_PathHashToFile);
+        shard->m_PathHashToFile = 0;
+        Longtail_DeleteSpinLock(shard->m_SpinLock);
+    }
+    Longtail_Free(storage_api);
+}
+
+static int InMemStorageAPI_OpenReadFile(struct Longtail_StorageAPI* storage_api, const char* path, Longtail_StorageAPI_HOpenFile* out_open_file)
 {
     struct InMemStorageAPI* instance = (struct InMemStorageAPI*)storage_api;
-    Longtail_LockSpinLock(instance->m_SpinLock);
-    uint32_t path_hash = (uint32_t)(uintptr_t)f;
-    intptr_t it = hmgeti(instance->m_PathHashToContent, path_hash);
-    if (it == -1)
+    struct MemFile* file = InMemStorageAPI_AcquireFile(instance, InMemStorageAPI_GetPathHash(path));
+    if (!file)
     {
-        Longtail_UnlockSpinLock(instance->m_SpinLock);
         return ENOENT;
     }
-    struct PathEntry* path_entry = &instance->m_PathEntries[instance->m_PathHashToContent[it].value];
-    ptrdiff_t size = arrlen(path_entry->m_Content);
-    if ((ptrdiff_t)offset > size)
+    *out_open_file = (Longtail_StorageAPI_HOpenFile)file;
+    return 0;
+}
+
+static int InMemStorageAPI_GetSize(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f, uint64_t* out_size)
+{
+    struct MemFile* file = (struct MemFile*)f;
+    *out_size = (uint64_t)file->m_Size;
+    return 0;
+}
+
+static int InMemStorageAPI_Read(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f, uint64_t offset, uint64_t length, void* output)
+{
+    struct MemFile* file = (struct MemFile*)f;
+    // The buffer is published before the size so a buffer read after the size holds at least `size` bytes
+    uint64_t size = (uint64_t)file->m_Size;
+    struct MemFileBuffer* buffer = MemFile_BeginRead(file);
+    if (offset + length > size || (buffer ? buffer->m_Capacity : 0u) < offset + length)
     {
-        Longtail_UnlockSpinLock(instance->m_SpinLock);
+        MemFile_EndRead(file);
         return EIO;
     }
-    if ((ptrdiff_t)(offset + length) > size)
+    if (length > 0)
     {
-        size = offset + length;
+        memcpy(output, &MemFileBuffer_GetData(buffer)[offset], (size_t)length);
     }
-    arrsetcap(path_entry->m_Content, size == 0 ? 16 : (uint32_t)size);
-    arrsetlen(path_entry->m_Content, (uint32_t)size);
-    memcpy(&(path_entry->m_Content)[offset], input, length);
-    Longtail_UnlockSpinLock(instance->m_SpinLock);
+    MemFile_EndRead(file);
     return 0;
 }
 
-static int InMemStorageAPI_SetSize(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f, uint64_t length)
+static int InMemStorageAPI_OpenWriteFile(struct Longtail_StorageAPI* storage_api, const char* path, uint64_t initial_size, Longtail_StorageAPI_HOpenFile* out_open_file)
 {
     struct InMemStorageAPI* instance = (struct InMemStorageAPI*)storage_api;
-    Longtail_LockSpinLock(instance->m_SpinLock);
-    uint32_t path_hash = (uint32_t)(uintptr_t)f;
-    intptr_t it = hmgeti(instance->m_PathHashToContent, path_hash);
-    if (it == -1)
+    uint64_t parent_path_hash = InMemStorageAPI_GetParentPathHash(path);
+    if (!InMemStorageAPI_ParentExists(instance, parent_path_hash))
     {
-        Longtail_UnlockSpinLock(instance->m_SpinLock);
         return ENOENT;
     }
-    struct PathEntry* path_entry = &instance->m_PathEntries[instance->m_PathHashToContent[it].value];
-    arrsetlen(path_entry->m_Content, (uint32_t)length);
-    Longtail_UnlockSpinLock(instance->m_SpinLock);
+    uint64_t path_hash = InMemStorageAPI_GetPathHash(path);
+    struct MemFile* file = InMemStorageAPI_AcquireFile(instance, path_hash);
+    if (!file)
+    {
+        struct MemFile* new_file = MemFile_Create(InMemStorageAPI_GetFileNamePart(path), parent_path_hash, 0);
+        if (!new_file)
+        {
+            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "InMemStorageAPI_OpenWriteFile(%p, %s, %" PRIu64 ", %p) failed with %d", storage_api, path, initial_size, out_open_file, ENOMEM)
+            return ENOMEM;
+        }
+        file = InMemStorageAPI_InsertFile(instance, path_hash, new_file);
+    }
+    if (file->m_IsDir)
+    {
+        // Not a file
+        MemFile_Release(file);
+        return EINVAL;
+    }
+    Longtail_LockSpinLock(file->m_WriteLock);
+    int err = MemFile_SetSize(file, initial_size);
+    Longtail_UnlockSpinLock(file->m_WriteLock);
+    if (err)
+    {
+        MemFile_Release(file);
+        return err;
+    }
+    *out_open_file = (Longtail_StorageAPI_HOpenFile)file;
     return 0;
 }
 
+static int InMemStorageAPI_Write(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f, uint64_t offset, uint64_t length, const void* input)
+{
+    struct MemFile* file = (struct MemFile*)f;
+    Longtail_LockSpinLock(file->m_WriteLock);
+    uint64_t size = (uint64_t)file->m_Size;
+    if (offset > size)
+    {
+        Longtail_UnlockSpinLock(file->m_WriteLock);
+        return EIO;
+    }
+    int err = MemFile_Reserve(file, offset + length);
+    if (err)
+    {
+        Longtail_UnlockSpinLock(file->m_WriteLock);
+        return err;
+    }
+    memcpy(&MemFileBuffer_GetData(MemFile_GetBuffer(file))[offset], input, (size_t)length);
+    if (offset + length > size)
+    {
+        Longtail_AtomicAdd64(&file->m_Size, (int64_t)(offset + length - size));
+    }
+    Longtail_UnlockSpinLock(file->m_WriteLock);
+    return 0;
+}
+
+static int InMemStorageAPI_SetSize(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f, uint64_t length)
+{
+    struct MemFile* file = (struct MemFile*)f;
+    Longtail_LockSpinLock(file->m_WriteLock);
+    int err = MemFile_SetSize(file, length);
+    Longtail_UnlockSpinLock(file->m_WriteLock);
+    return err;
+}
+
 static void InMemStorageAPI_CloseFile(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f)
 {
+    MemFile_Release((struct MemFile*)f);
 }
 
 static int InMemStorageAPI_CreateDir(struct Longtail_StorageAPI* storage_api, const char* path)
 {
     struct InMemStorageAPI* instance = (struct InMemStorageAPI*)storage_api;
-    Longtail_LockSpinLock(instance->m_SpinLock);
-    uint32_t parent_path_hash = InMemStorageAPI_GetParentPathHash(instance, path);
-    if (parent_path_hash != 0 && hmgeti(instance->m_PathHashToContent, parent_path_hash) == -1)
+    uint64_t parent_path_hash = InMemStorageAPI_GetParentPathHash(path);
+    if (!InMemStorageAPI_ParentExists(instance, parent_path_hash))
     {
-        Longtail_UnlockSpinLock(instance->m_SpinLock);
         return ENOENT;
     }
-    uint32_t path_hash = InMemStorageAPI_GetPathHash(path);
-    intptr_t source_path_ptr = hmgeti(instance->m_PathHashToContent, path_hash);
-    if (source_path_ptr != -1)
+    uint64_t path_hash = InMemStorageAPI_GetPathHash(path);
+    struct MemFile* file = InMemStorageAPI_AcquireFile(instance, path_hash);
+    if (!file)
     {
-        struct PathEntry* source_entry = &instance->m_PathEntries[instance->m_PathHashToContent[source_path_ptr].value];
-        if (source_entry->m_Content == 0)
+        struct MemFile* new_file = MemFile_Create(InMemStorageAPI_GetFileNamePart(path), parent_path_hash, 1);
+        if (!new_file)
         {
-            Longtail_UnlockSpinLock(instance->m_SpinLock);
-            return 0;
+            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "InMemStorageAPI_CreateDir(%p, %s) failed with %d", storage_api, path, ENOMEM)
+            return ENOMEM;
         }
-        Longtail_UnlockSpinLock(instance->m_SpinLock);
-        return EIO;
+        file = InMemStorageAPI_InsertFile(instance, path_hash, new_file);
     }
-
-    ptrdiff_t entry_index = arrlen(instance->m_PathEntries);
-    arrsetlen(instance->m_PathEntries, (size_t)(entry_index + 1));
-    struct PathEntry* path_entry = &instance->m_PathEntries[entry_index];
-    path_entry->m_ParentHash = parent_path_hash;
-    path_entry->m_FileName = Longtail_Strdup(InMemStorageAPI_GetFileNamePart(path));
-    path_entry->m_Content = 0;
-    hmput(instance->m_PathHashToContent, path_hash, (uint32_t)entry_index);
-    Longtail_UnlockSpinLock(instance->m_SpinLock);
-    return 0;
+    int err = file->m_IsDir ? 0 : EIO;
+    MemFile_Release(file);
+    return err;
 }
 
 static int InMemStorageAPI_RenameFile(struct Longtail_StorageAPI* storage_api, const char* source_path, const char* target_path)
 {
     struct InMemStorageAPI* instance = (struct InMemStorageAPI*)storage_api;
-    Longtail_LockSpinLock(instance->m_SpinLock);
-    uint32_t source_path_hash = InMemStorageAPI_GetPathHash(source_path);
-    intptr_t source_path_ptr = hmgeti(instance->m_PathHashToContent, source_path_hash);
-    if (source_path_ptr == -1)
+    uint64_t source_path_hash = InMemStorageAPI_GetPathHash(source_path);
+    uint64_t target_path_hash = InMemStorageAPI_GetPathHash(target_path);
+    char* target_file_name = Longtail_Strdup(InMemStorageAPI_GetFileNamePart(target_path));
+    struct InMemStorageShard* source_shard = InMemStorageAPI_GetShard(instance, source_path_hash);
+    struct InMemStorageShard* target_shard = InMemStorageAPI_GetShard(instance, target_path_hash);
+
+    // Lock in shard order so two renames in opposite directions can not deadlock
+    struct InMemStorageShard* first_shard = source_shard < target_shard ? source_shard : target_shard;
+    struct InMemStorageShard* second_shard = source_shard < target_shard ? target_shard : source_shard;
+    Longtail_LockSpinLock(first_shard->m_SpinLock);
+    if (second_shard != first_shard)
     {
-        Longtail_UnlockSpinLock(instance->m_SpinLock);
-        return ENOENT;
+        Longtail_LockSpinLock(second_shard->m_SpinLock);
     }
-    struct PathEntry* source_entry = &instance->m_PathEntries[instance->m_PathHashToContent[source_path_ptr].value];
 
-    uint32_t target_path_hash = InMemStorageAPI_GetPathHash(target_path);
-    intptr_t target_path_ptr = hmgeti(instance->m_PathHashToContent, target_path_hash);
-    if (target_path_ptr != -1)
+    int err = 0;
+    intptr_t source_it = hmgeti(source_shard->m_PathHashToFile, source_path_hash);
+    if (source_it == -1)
     {
-        Longtail_UnlockSpinLock(instance->m_SpinLock);
-        return EEXIST;
+        err = ENOENT;
     }
-    source_entry->m_ParentHash = InMemStorageAPI_GetParentPathHash(instance, target_path);
-    Longtail_Free(source_entry->m_FileName);
-    source_entry->m_FileName = Longtail_Strdup(InMemStorageAPI_GetFileNamePart(target_path));
-    hmput(instance->m_PathHashToContent, target_path_hash, instance->m_PathHashToContent[source_path_ptr].value);
-    hmdel(instance->m_PathHashToContent, source_path_hash);
-    Longtail_UnlockSpinLock(instance->m_SpinLock);
-    return 0;
+    else if (hmgeti(target_shard->m_PathHashToFile, target_path_hash) != -1)
+    {
+        err = EEXIST;
+    }
+    else
+    {
+        struct MemFile* file = source_shard->m_PathHashToFile[source_it].value;
+        (void)hmdel(source_shard->m_PathHashToFile, source_path_hash);
+        file->m_ParentHash = InMemStorageAPI_GetParentPathHash(target_path);
+        char* source_file_name = file->m_FileName;
+        file->m_FileName = target_file_name;
+        target_file_name = source_file_name;
+        hmput(target_shard->m_PathHashToFile, target_path_hash, file);
+    }
+
+    if (second_shard != first_shard)
+    {
+        Longtail_UnlockSpinLock(second_shard->m_SpinLock);
+    }
+    Longtail_UnlockSpinLock(first_shard->m_SpinLock);
+    Longtail_Free(target_file_name);
+    return err;
 }
 
 static char* InMemStorageAPI_ConcatPath(struct Longtail_StorageAPI* storage_api, const char* root_path, const char* sub_path)
@@ -311,167 +525,150 @@ static char* InMemStorageAPI_ConcatPath(struct Longtail_StorageAPI* storage_api,
 static int InMemStorageAPI_IsDir(struct Longtail_StorageAPI* storage_api, const char* path)
 {
     struct InMemStorageAPI* instance = (struct InMemStorageAPI*)storage_api;
-    Longtail_LockSpinLock(instance->m_SpinLock);
-    uint32_t source_path_hash = InMemStorageAPI_GetPathHash(path);
-    intptr_t source_path_ptr = hmgeti(instance->m_PathHashToContent, source_path_hash);
-    if (source_path_ptr == -1)
+    struct MemFile* file = InMemStorageAPI_AcquireFile(instance, InMemStorageAPI_GetPathHash(path));
+    if (!file)
     {
-        Longtail_UnlockSpinLock(instance->m_SpinLock);
         return 0;
     }
-    struct PathEntry* source_entry = &instance->m_PathEntries[instance->m_PathHashToContent[source_path_ptr].value];
-    Longtail_UnlockSpinLock(instance->m_SpinLock);
-    return source_entry->m_Content == 0;
+    int is_dir = file->m_IsDir;
+    MemFile_Release(file);
+    return is_dir;
 }
+
 static int InMemStorageAPI_IsFile(struct Longtail_StorageAPI* storage_api, const char* path)
 {
     struct InMemStorageAPI* instance = (struct InMemStorageAPI*)storage_api;
-    Longtail_LockSpinLock(instance->m_SpinLock);
-    uint32_t path_hash = InMemStorageAPI_GetPathHash(path);
-    intptr_t source_path_ptr = hmgeti(instance->m_PathHashToContent, path_hash);
-    if (source_path_ptr == -1)
+    struct MemFile* file = InMemStorageAPI_AcquireFile(instance, InMemStorageAPI_GetPathHash(path));
+    if (!file)
     {
-        Longtail_UnlockSpinLock(instance->m_SpinLock);
         return 0;
     }
-    struct PathEntry* source_entry = &instance->m_PathEntries[instance->m_PathHashToContent[source_path_ptr].value];
-    Longtail_UnlockSpinLock(instance->m_SpinLock);
-    return source_entry->m_Content != 0;
+    int is_file = !file->m_IsDir;
+    MemFile_Release(file);
+    return is_file;
 }
 
-static int InMemStorageAPI_RemoveDir(struct Longtail_StorageAPI* storage_api, const char* path)
+static int InMemStorageAPI_RemoveEntry(struct InMemStorageAPI* instance, const char* path, int is_dir)
 {
-    struct InMemStorageAPI* instance = (struct InMemStorageAPI*)storage_api;
-    Longtail_LockSpinLock(instance->m_SpinLock);
-    uint32_t path_hash = InMemStorageAPI_GetPathHash(path);
-    intptr_t source_path_ptr = hmgeti(instance->m_PathHashToContent, path_hash);
-    if (source_path_ptr == -1)
+    uint64_t path_hash = InMemStorageAPI_GetPathHash(path);
+    struct InMemStorageShard* shard = InMemStorageAPI_GetShard(instance, path_hash);
+    Longtail_LockSpinLock(shard->m_SpinLock);
+    intptr_t it = hmgeti(shard->m_PathHashToFile, path_hash);
+    if (it == -1)
     {
-        Longtail_UnlockSpinLock(instance->m_SpinLock);
+        Longtail_UnlockSpinLock(shard->m_SpinLock);
         return ENOENT;
     }
-    struct PathEntry* path_entry = &instance->m_PathEntries[instance->m_PathHashToContent[source_path_ptr].value];
-    if (path_entry->m_Content)
+    struct MemFile* file = shard->m_PathHashToFile[it].value;
+    if (file->m_IsDir != is_dir)
     {
-        // Not a directory
-        Longtail_UnlockSpinLock(instance->m_SpinLock);
+        Longtail_UnlockSpinLock(shard->m_SpinLock);
         return EINVAL;
     }
-    Longtail_Free(path_entry->m_FileName);
-    path_entry->m_FileName = 0;
-    arrfree(path_entry->m_Content);
-    path_entry->m_Content = 0;
-    path_entry->m_ParentHash = 0;
-    hmdel(instance->m_PathHashToContent, path_hash);
-    Longtail_UnlockSpinLock(instance->m_SpinLock);
+    (void)hmdel(shard->m_PathHashToFile, path_hash);
+    Longtail_UnlockSpinLock(shard->m_SpinLock);
+    // Files that are still open are freed when they are closed
+    MemFile_Release(file);
     return 0;
 }
 
+static int InMemStorageAPI_RemoveDir(struct Longtail_StorageAPI* storage_api, const char* path)
+{
+    return InMemStorageAPI_RemoveEntry((struct InMemStorageAPI*)storage_api, path, 1);
+}
+
 static int InMemStorageAPI_RemoveFile(struct Longtail_StorageAPI* storage_api, const char* path)
 {
-    struct InMemStorageAPI* instance = (struct InMemStorageAPI*)storage_api;
-    Longtail_LockSpinLock(instance->m_SpinLock);
-    uint32_t path_hash = InMemStorageAPI_GetPathHash(path);
-    intptr_t source_path_ptr = hmgeti(instance->m_PathHashToContent, path_hash);
-    if (source_path_ptr == -1)
-    {
-        Longtail_UnlockSpinLock(instance->m_SpinLock);
-        return ENOENT;
-    }
-    struct PathEntry* path_entry = &instance->m_PathEntries[instance->m_PathHashToContent[source_path_ptr].value];
-    if (!path_entry->m_Content)
+    return InMemStorageAPI_RemoveEntry((struct InMemStorageAPI*)storage_api, path, 0);
+}
+
+static void InMemStorageAPI_FreeFindIterator(struct InMemFindIterator* find_iterator)
+{
+    size_t c = (size_t)arrlen(find_iterator->m_Entries);
+    while (c--)
     {
-        // Not a file
-        Longtail_UnlockSpinLock(instance->m_SpinLock);
-        return EINVAL;
+        Longtail_Free(find_iterator->m_Entries[c].m_Name);
     }
-    Longtail_Free(path_entry->m_FileName);
-    path_entry->m_FileName = 0;
-    arrfree(path_entry->m_Content);
-    path_entry->m_Content = 0;
-    path_entry->m_ParentHash = 0;
-    hmdel(instance->m_PathHashToContent, path_hash);
-    Longtail_UnlockSpinLock(instance->m_SpinLock);
-    return 0;
+    arrfree(find_iterator->m_Entries);
+    Longtail_Free(find_iterator);
 }
 
+// Takes a snapshot of the entries in `path` so no lock is held while the caller iterates
 static int InMemStorageAPI_StartFind(struct Longtail_StorageAPI* storage_api, const char* path, Longtail_StorageAPI_HIterator* out_iterator)
 {
     struct InMemStorageAPI* instance = (struct InMemStorageAPI*)storage_api;
-    Longtail_LockSpinLock(instance->m_SpinLock);
-    uint32_t path_hash = path[0] ? InMemStorageAPI_GetPathHash(path) : 0;
-    ptrdiff_t* i = (ptrdiff_t*)Longtail_Alloc(sizeof(ptrdiff_t));
-    *i = 0;
-    while (*i < arrlen(instance->m_PathEntries))
+    uint64_t path_hash = path[0] ? InMemStorageAPI_GetPathHash(path) : 0;
+    struct InMemFindIterator* find_iterator = (struct InMemFindIterator*)Longtail_Alloc(sizeof(struct InMemFindIterator));
+    if (!find_iterator)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "InMemStorageAPI_StartFind(%p, %s, %p) failed with %d", storage_api, path, out_iterator, ENOMEM)
+        return ENOMEM;
+    }
+    find_iterator->m_Entries = 0;
+    find_iterator->m_Index = 0;
+    for (uint32_t s = 0; s < INMEMSTORAGE_SHARD_COUNT; ++s)
     {
-        if (instance->m_PathEntries[*i].m_ParentHash == path_hash)
+        struct InMemStorageShard* shard = &instance->m_Shards[s];
+        Longtail_LockSpinLock(shard->m_SpinLock);
+        ptrdiff_t file_count = hmlen(shard->m_PathHashToFile);
+        for (ptrdiff_t i = 0; i < file_count; ++i)
         {
-            *out_iterator = (Longtail_StorageAPI_HIterator)i;
-            return 0;
+            struct MemFile* file = shard->m_PathHashToFile[i].value;
+            if (file->m_ParentHash != path_hash)
+            {
+                continue;
+            }
+            struct InMemFindEntry entry;
+            entry.m_Name = Longtail_Strdup(file->m_FileName);
+            entry.m_Size = file->m_IsDir ? 0u : (uint64_t)file->m_Size;
+            entry.m_IsDir = file->m_IsDir;
+            arrput(find_iterator->m_Entries, entry);
         }
-        *i += 1;
+        Longtail_UnlockSpinLock(shard->m_SpinLock);
+    }
+    if (arrlen(find_iterator->m_Entries) == 0)
+    {
+        InMemStorageAPI_FreeFindIterator(find_iterator);
+        return ENOENT;
     }
-    Longtail_Free(i);
-    Longtail_UnlockSpinLock(instance->m_SpinLock);
-    return ENOENT;
+    *out_iterator = (Longtail_StorageAPI_HIterator)find_iterator;
+    return 0;
 }
 
 static int InMemStorageAPI_FindNext(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HIterator iterator)
 {
-    struct InMemStorageAPI* instance = (struct InMemStorageAPI*)storage_api;
-    ptrdiff_t* i = (ptrdiff_t*)iterator;
-    uint32_t path_hash = instance->m_PathEntries[*i].m_ParentHash;
-    *i += 1;
-    while (*i < arrlen(instance->m_PathEntries))
+    struct InMemFindIterator* find_iterator = (struct InMemFindIterator*)iterator;
+    if (find_iterator->m_Index + 1 >= arrlen(find_iterator->m_Entries))
     {
-        if (instance->m_PathEntries[*i].m_ParentHash == path_hash)
-        {
-            return 0;
-        }
-        *i += 1;
+        return ENOENT;
     }
-    return ENOENT;
+    find_iterator->m_Index += 1;
+    return 0;
 }
+
 static void InMemStorageAPI_CloseFind(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HIterator iterator)
 {
-    struct InMemStorageAPI* instance = (struct InMemStorageAPI*)storage_api;
-    ptrdiff_t* i = (ptrdiff_t*)iterator;
-    Longtail_Free(i);
-    Longtail_UnlockSpinLock(instance->m_SpinLock);
+    InMemStorageAPI_FreeFindIterator((struct InMemFindIterator*)iterator);
 }
 
 static const char* InMemStorageAPI_GetFileName(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HIterator iterator)
 {
-    struct InMemStorageAPI* instance = (struct InMemStorageAPI*)storage_api;
-    ptrdiff_t* i = (ptrdiff_t*)iterator;
-    if (instance->m_PathEntries[*i].m_Content == 0)
-    {
-        return 0;
-    }
-    const char* file_name = instance->m_PathEntries[*i].m_FileName;
-    return file_name;
+    struct InMemFindIterator* find_iterator = (struct InMemFindIterator*)iterator;
+    struct InMemFindEntry* entry = &find_iterator->m_Entries[find_iterator->m_Index];
+    return entry->m_IsDir ? 0 : entry->m_Name;
 }
 
 static const char* InMemStorageAPI_GetDirectoryName(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HIterator iterator)
 {
-    struct InMemStorageAPI* instance = (struct InMemStorageAPI*)storage_api;
-    uint32_t* i = (uint32_t*)iterator;
-    if (instance->m_PathEntries[*i].m_Content != 0)
-    {
-        return 0;
-    }
-    return instance->m_PathEntries[*i].m_FileName;
+    struct InMemFindIterator* find_iterator = (struct InMemFindIterator*)iterator;
+    struct InMemFindEntry* entry = &find_iterator->m_Entries[find_iterator->m_Index];
+    return entry->m_IsDir ? entry->m_Name : 0;
 }
 
 static uint64_t InMemStorageAPI_GetEntrySize(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HIterator iterator)
 {
-    struct InMemStorageAPI* instance = (struct InMemStorageAPI*)storage_api;
-    uint32_t* i = (uint32_t*)iterator;
-    if (instance->m_PathEntries[*i].m_Content == 0)
-    {
-        return 0;
-    }
-    return (uint64_t)arrlen(instance->m_PathEntries[*i].m_Content);
+    struct InMemFindIterator* find_iterator = (struct InMemFindIterator*)iterator;
+    return find_iterator->m_Entries[find_iterator->m_Index].m_Size;
 }
 
 static int InMemStorageAPI_Init(struct InMemStorageAPI* storage_api)
@@ -498,14 +695,27 @@ static int InMemStorageAPI_Init(struct InMemStorageAPI* storage_api)
     storage_api->m_InMemStorageAPI.GetDirectoryName = InMemStorageAPI_GetDirectoryName;
     storage_api->m_InMemStorageAPI.GetEntrySize = InMemStorageAPI_GetEntrySize;
 
-    storage_api->m_PathHashToContent = 0;
-    storage_api->m_PathEntries = 0;
-    return Longtail_CreateSpinLock(&storage_api[1], &storage_api->m_SpinLock);
+    char* spin_lock_mem = (char*)&storage_api[1];
+    for (uint32_t s = 0; s < INMEMSTORAGE_SHARD_COUNT; ++s)
+    {
+        struct InMemStorageShard* shard = &storage_api->m_Shards[s];
+        shard->m_PathHashToFile = 0;
+        int err = Longtail_CreateSpinLock(&spin_lock_mem[Longtail_GetSpinLockSize() * s], &shard->m_SpinLock);
+        if (err)
+        {
+            while (s--)
+            {
+                Longtail_DeleteSpinLock(storage_api->m_Shards[s].m_SpinLock);
+            }
+            return err;
+        }
+    }
+    return 0;
 }
 
 struct Longtail_StorageAPI* Longtail_CreateInMemStorageAPI()
 {
-    struct InMemStorageAPI* storage_api = (struct InMemStorageAPI*)Longtail_Alloc(sizeof(struct InMemStorageAPI) + Longtail_GetSpinLockSize());
+    struct InMemStorageAPI* storage_api = (struct InMemStorageAPI*)Longtail_Alloc(sizeof(struct InMemStorageAPI) + Longtail_GetSpinLockSize() * INMEMSTORAGE_SHARD_COUNT);
     int err = InMemStorageAPI_Init(storage_api);
     if (err)
     {
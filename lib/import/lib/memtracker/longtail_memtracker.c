@@ -0,0 +1,115 @@
+#include "longtail_memtracker.h"
+
+#include "../../src/longtail.h"
+#include "../longtail_platform.h"
+
+#include <errno.h>
+#include <string.h>
+
+// Padded to a cache line so threads allocating with different tags do not contend
+struct MemTrackerTag
+{
+    TLongtail_Atomic64 m_CurrentBytes;
+    TLongtail_Atomic64 m_PeakBytes;
+    TLongtail_Atomic64 m_CurrentCount;
+    TLongtail_Atomic64 m_TotalCount;
+    int64_t m_Padding[4];
+};
+
+struct MemTrackerAPI
+{
+    struct Longtail_MemTrackerAPI m_MemTrackerAPI;
+    struct MemTrackerTag m_Tags[LONGTAIL_MEMTAG_COUNT];
+};
+
+static struct MemTrackerTag* MemTracker_GetTag(struct Longtail_MemTrackerAPI* mem_tracker_api, uint32_t tag)
+{
+    struct MemTrackerAPI* api = (struct MemTrackerAPI*)mem_tracker_api;
+    return &api->m_Tags[tag < LONGTAIL_MEMTAG_COUNT ? tag : LONGTAIL_MEMTAG_OTHER];
+}
+
+static void MemTracker_OnAlloc(struct Longtail_MemTrackerAPI* mem_tracker_api, uint32_t tag, size_t size)
+{
+    struct MemTrackerTag* t = MemTracker_GetTag(mem_tracker_api, tag);
+    int64_t current = Longtail_AtomicAdd64(&t->m_CurrentBytes, (int64_t)size);
+    int64_t peak = t->m_PeakBytes;
+    while (current > peak)
+    {
+        int64_t old_peak = Longtail_CompareAndSwap64(&t->m_PeakBytes, peak, current);
+        if (old_peak == peak)
+        {
+            break;
+        }
+        peak = old_peak;
+    }
+    Longtail_AtomicAdd64(&t->m_CurrentCount, 1);
+    Longtail_AtomicAdd64(&t->m_TotalCount, 1);
+}
+
+static void MemTracker_OnFree(struct Longtail_MemTrackerAPI* mem_tracker_api, uint32_t tag, size_t size)
+{
+    struct MemTrackerTag* t = MemTracker_GetTag(mem_tracker_api, tag);
+    Longtail_AtomicAdd64(&t->m_CurrentBytes, -(int64_t)size);
+    Longtail_AtomicAdd64(&t->m_CurrentCount, -1);
+}
+
+static int MemTracker_GetTagStats(struct Longtail_MemTrackerAPI* mem_tracker_api, uint32_t tag, struct Longtail_MemTagStats* out_stats)
+{
+    LONGTAIL_FATAL_ASSERT(mem_tracker_api != 0, return EINVAL)
+    LONGTAIL_FATAL_ASSERT(out_stats != 0, return EINVAL)
+    if (tag >= LONGTAIL_MEMTAG_COUNT)
+    {
+        return EINVAL;
+    }
+    struct MemTrackerTag* t = MemTracker_GetTag(mem_tracker_api, tag);
+    out_stats->m_CurrentBytes = (uint64_t)t->m_CurrentBytes;
+    out_stats->m_PeakBytes = (uint64_t)t->m_PeakBytes;
+    out_stats->m_CurrentCount = (uint64_t)t->m_CurrentCount;
+    out_stats->m_TotalCount = (uint64_t)t->m_TotalCount;
+    return 0;
+}
+
+static void MemTracker_ResetPeaks(struct Longtail_MemTrackerAPI* mem_tracker_api)
+{
+    for (uint32_t tag = 0; tag < LONGTAIL_MEMTAG_COUNT; ++tag)
+    {
+        struct MemTrackerTag* t = MemTracker_GetTag(mem_tracker_api, tag);
+        int64_t peak = t->m_PeakBytes;
+        for (;;)
+        {
+            int64_t old_peak = Longtail_CompareAndSwap64(&t->m_PeakBytes, peak, t->m_CurrentBytes);
+            if (old_peak == peak)
+            {
+                break;
+            }
+            peak = old_peak;
+        }
+    }
+}
+
+static void MemTracker_Dispose(struct Longtail_API* mem_tracker_api)
+{
+    Longtail_Free(mem_tracker_api);
+}
+
+static void MemTracker_Init(struct MemTrackerAPI* mem_tracker_api)
+{
+    mem_tracker_api->m_MemTrackerAPI.m_API.Dispose = MemTracker_Dispose;
+    mem_tracker_api->m_MemTrackerAPI.OnAlloc = MemTracker_OnAlloc;
+    mem_tracker_api->m_MemTrackerAPI.OnFree = MemTracker_OnFree;
+    mem_tracker_api->m_MemTrackerAPI.GetTagStats = MemTracker_GetTagStats;
+    mem_tracker_api->m_MemTrackerAPI.ResetPeaks = MemTracker_ResetPeaks;
+    memset(mem_tracker_api->m_Tags, 0, sizeof(mem_tracker_api->m_Tags));
+}
+
+struct Longtail_MemTrackerAPI* Longtail_CreateMemTrackerAPI()
+{
+    struct MemTrackerAPI* mem_tracker_api = (struct MemTrackerAPI*)Longtail_Alloc(sizeof(struct MemTrackerAPI));
+    if (!mem_tracker_api)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_CreateMemTrackerAPI() failed with %d", ENOMEM)
+        return 0;
+    }
+    MemTracker_Init(mem_tracker_api);
+    return &mem_tracker_api->m_MemTrackerAPI;
+}
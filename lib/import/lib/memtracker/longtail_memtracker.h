@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Memory tracker API that keeps per tag counters in atomics. Set it with Longtail_SetMemTrackerAPI before the allocations
+// it should account for and clear it again before disposing it.
+extern struct Longtail_MemTrackerAPI* Longtail_CreateMemTrackerAPI();
+
+#ifdef __cplusplus
+}
+#endif
@@ -16,14 +16,31 @@ static uint32_t MeowHash_GetIdentifier(struct Longtail_HashAPI* hash_api)
     return LONGTAIL_MEOW_HASH_TYPE;
 }
 
-static int MeowHash_BeginContext(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext* out_context)
+static uint32_t MeowHash_GetContextSize(struct Longtail_HashAPI* hash_api)
 {
-    meow_state* state = (meow_state*)Longtail_Alloc(sizeof(meow_state));
+    return (uint32_t)sizeof(meow_state);
+}
+
+static int MeowHash_BeginContextInPlace(struct Longtail_HashAPI* hash_api, void* context_memory, Longtail_HashAPI_HContext* out_context)
+{
+    meow_state* state = (meow_state*)context_memory;
     MeowBegin(state, MeowDefaultSeed);
     *out_context = (Longtail_HashAPI_HContext)state;
     return 0;
 }
 
+static uint64_t MeowHash_EndContextInPlace(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext context)
+{
+    meow_state* state = (meow_state*)context;
+    return (uint64_t)MeowU64From(MeowEnd(state, 0), 0);
+}
+
+static int MeowHash_BeginContext(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext* out_context)
+{
+    meow_state* state = (meow_state*)Longtail_Alloc(sizeof(meow_state));
+    return MeowHash_BeginContextInPlace(hash_api, state, out_context);
+}
+
 static void MeowHash_Hash(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext context, uint32_t length, const void* data)
 {
     meow_state* state = (meow_state*)context;
@@ -32,9 +49,8 @@ static void MeowHash_Hash(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HC
 
 static uint64_t MeowHash_EndContext(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext context)
 {
-    meow_state* state = (meow_state*)context;
-    uint64_t hash = (uint64_t)MeowU64From(MeowEnd(state, 0), 0);
-	Longtail_Free(state);
+    uint64_t hash = MeowHash_EndContextInPlace(hash_api, context);
+    Longtail_Free(context);
     return hash;
 }
 
@@ -60,6 +76,9 @@ static void MeowHash_Init(struct MeowHashAPI* hash_api)
     hash_api->m_MeowHashAPI.Hash = MeowHash_Hash;
     hash_api->m_MeowHashAPI.EndContext = MeowHash_EndContext;
     hash_api->m_MeowHashAPI.HashBuffer = MeowHash_HashBuffer;
+    hash_api->m_MeowHashAPI.GetContextSize = MeowHash_GetContextSize;
+    hash_api->m_MeowHashAPI.BeginContextInPlace = MeowHash_BeginContextInPlace;
+    hash_api->m_MeowHashAPI.EndContextInPlace = MeowHash_EndContextInPlace;
 }
 
 struct Longtail_HashAPI* Longtail_CreateMeowHashAPI()
@@ -0,0 +1,482 @@
+#include "longtail_poolallocator.h"
+
+#include "../../src/longtail.h"
+#include "../longtail_platform.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Sizes up to 128 bytes step by 16 bytes, above that each power of two is split in four steps
+#define POOLALLOCATOR_SMALL_SIZE_LIMIT  128u
+#define POOLALLOCATOR_MAX_POOLED_SIZE   32768u
+#define POOLALLOCATOR_SIZE_CLASS_COUNT  40u
+#define POOLALLOCATOR_LARGE_SIZE_CLASS  0xffffffffu
+
+#define POOLALLOCATOR_SHARD_COUNT       64u
+#define POOLALLOCATOR_MIN_SLAB_SIZE     65536u
+#define POOLALLOCATOR_MIN_SLAB_BLOCKS   8u
+// Empty slabs a shard keeps for reuse, slabs that become empty above this are returned to the system
+#define POOLALLOCATOR_MAX_EMPTY_SLAB_SIZE 262144u
+
+struct PoolSlab;
+
+// Keeps the memory handed out 16 byte aligned, same as malloc on 64-bit platforms
+struct PoolBlockHeader
+{
+    struct PoolSlab* m_Slab;
+    uint32_t m_SizeClass;
+    uint32_t m_Reserved;
+};
+
+struct PoolFreeBlock
+{
+    struct PoolFreeBlock* m_Next;
+};
+
+struct PoolShard;
+
+// Blocks are freed back to the slab they were carved from, the slab is linked in its shard as long as it has free blocks
+struct PoolSlab
+{
+    struct PoolSlab* m_Next;
+    struct PoolSlab* m_Prev;
+    struct PoolSlab* m_AllNext;
+    struct PoolSlab* m_AllPrev;
+    struct PoolShard* m_Shard;
+    struct PoolFreeBlock* m_FreeBlocks;
+    uint32_t m_SizeClass;
+    uint32_t m_SlabSize;
+    uint32_t m_UsedBlockCount;
+    uint32_t m_Reserved;
+};
+
+struct PoolShard
+{
+    HLongtail_SpinLock m_Lock;
+    struct PoolSlab* m_FreeSlabs[POOLALLOCATOR_SIZE_CLASS_COUNT];
+    struct PoolSlab* m_Slabs;
+    size_t m_EmptySlabSize;
+    size_t m_SlabSize;
+    uint64_t m_SlabCount;
+    uint64_t m_CreatedSlabCount;
+    uint64_t m_ReleasedSlabCount;
+};
+
+struct PoolAllocatorAPI
+{
+    struct Longtail_AllocatorAPI m_PoolAllocatorAPI;
+    struct PoolShard m_Shards[POOLALLOCATOR_SHARD_COUNT];
+};
+
+static uint32_t PoolAllocator_GetHighestBit(size_t value)
+{
+    uint32_t bit = 0;
+    while (value >>= 1)
+    {
+        ++bit;
+    }
+    return bit;
+}
+
+static uint32_t PoolAllocator_GetSizeClass(size_t size)
+{
+    if (size <= POOLALLOCATOR_SMALL_SIZE_LIMIT)
+    {
+        return size == 0 ? 0 : (uint32_t)((size - 1) / 16u);
+    }
+    uint32_t high_bit = PoolAllocator_GetHighestBit(size - 1);
+    uint32_t step = (uint32_t)((size - 1) >> (high_bit - 2));
+    return 8u + (high_bit - 7u) * 4u + (step - 4u);
+}
+
+static size_t PoolAllocator_GetSizeClassSize(uint32_t size_class)
+{
+    if (size_class < 8u)
+    {
+        return (size_class + 1u) * 16u;
+    }
+    uint32_t high_bit = 7u + (size_class - 8u) / 4u;
+    uint32_t step = 4u + (size_class - 8u) % 4u;
+    return (size_t)(step + 1u) << (high_bit - 2);
+}
+
+// Not a thread local cache, threads are spread over the shards by their id so they rarely share a lock
+static struct PoolShard* PoolAllocator_GetShard(struct PoolAllocatorAPI* pool_allocator_api)
+{
+    uint64_t thread_id = Longtail_GetCurrentThreadId();
+    uint32_t shard_index = (uint32_t)((thread_id * 0x9E3779B97F4A7C15ull) >> 58);
+    return &pool_allocator_api->m_Shards[shard_index];
+}
+
+static void PoolShard_LinkFreeSlab(struct PoolShard* shard, struct PoolSlab* slab)
+{
+    struct PoolSlab* head = shard->m_FreeSlabs[slab->m_SizeClass];
+    slab->m_Prev = 0;
+    slab->m_Next = head;
+    if (head)
+    {
+        head->m_Prev = slab;
+    }
+    shard->m_FreeSlabs[slab->m_SizeClass] = slab;
+}
+
+static void PoolShard_UnlinkFreeSlab(struct PoolShard* shard, struct PoolSlab* slab)
+{
+    if (slab->m_Prev)
+    {
+        slab->m_Prev->m_Next = slab->m_Next;
+    }
+    else
+    {
+        shard->m_FreeSlabs[slab->m_SizeClass] = slab->m_Next;
+    }
+    if (slab->m_Next)
+    {
+        slab->m_Next->m_Prev = slab->m_Prev;
+    }
+}
+
+static struct PoolSlab* PoolAllocator_CreateSlab(struct PoolShard* shard, uint32_t size_class)
+{
+    size_t block_size = sizeof(struct PoolBlockHeader) + PoolAllocator_GetSizeClassSize(size_class);
+    size_t block_count = POOLALLOCATOR_MIN_SLAB_SIZE / block_size;
+    if (block_count < POOLALLOCATOR_MIN_SLAB_BLOCKS)
+    {
+        block_count = POOLALLOCATOR_MIN_SLAB_BLOCKS;
+    }
+    size_t slab_size = sizeof(struct PoolSlab) + block_size * block_count;
+    struct PoolSlab* slab = (struct PoolSlab*)malloc(slab_size);
+    if (!slab)
+    {
+        return 0;
+    }
+    slab->m_Shard = shard;
+    slab->m_SizeClass = size_class;
+    slab->m_SlabSize = (uint32_t)slab_size;
+    slab->m_UsedBlockCount = 0;
+    char* slab_blocks = (char*)&slab[1];
+    struct PoolFreeBlock* first_free = 0;
+    for (size_t b = block_count; b-- > 0;)
+    {
+        struct PoolFreeBlock* free_block = (struct PoolFreeBlock*)&slab_blocks[b * block_size];
+        free_block->m_Next = first_free;
+        first_free = free_block;
+    }
+    slab->m_FreeBlocks = first_free;
+    return slab;
+}
+
+static void* PoolAllocator_Alloc(struct Longtail_AllocatorAPI* allocator_api, size_t s)
+{
+    struct PoolAllocatorAPI* pool_allocator_api = (struct PoolAllocatorAPI*)allocator_api;
+    if (s > POOLALLOCATOR_MAX_POOLED_SIZE)
+    {
+        struct PoolBlockHeader* header = (struct PoolBlockHeader*)malloc(sizeof(struct PoolBlockHeader) + s);
+        if (!header)
+        {
+            return 0;
+        }
+        header->m_Slab = 0;
+        header->m_SizeClass = POOLALLOCATOR_LARGE_SIZE_CLASS;
+        return &header[1];
+    }
+
+    uint32_t size_class = PoolAllocator_GetSizeClass(s);
+    struct PoolShard* shard = PoolAllocator_GetShard(pool_allocator_api);
+    Longtail_LockSpinLock(shard->m_Lock);
+    struct PoolSlab* slab = shard->m_FreeSlabs[size_class];
+    if (!slab)
+    {
+        Longtail_UnlockSpinLock(shard->m_Lock);
+        slab = PoolAllocator_CreateSlab(shard, size_class);
+        if (!slab)
+        {
+            return 0;
+        }
+        Longtail_LockSpinLock(shard->m_Lock);
+        slab->m_AllPrev = 0;
+        slab->m_AllNext = shard->m_Slabs;
+        if (shard->m_Slabs)
+        {
+            shard->m_Slabs->m_AllPrev = slab;
+        }
+        shard->m_Slabs = slab;
+        shard->m_SlabSize += slab->m_SlabSize;
+        shard->m_SlabCount++;
+        shard->m_CreatedSlabCount++;
+        PoolShard_LinkFreeSlab(shard, slab);
+        // Counted as empty so taking the first block below balances out
+        shard->m_EmptySlabSize += slab->m_SlabSize;
+    }
+    struct PoolFreeBlock* block = slab->m_FreeBlocks;
+    slab->m_FreeBlocks = block->m_Next;
+    if (slab->m_UsedBlockCount++ == 0)
+    {
+        shard->m_EmptySlabSize -= slab->m_SlabSize;
+    }
+    if (!slab->m_FreeBlocks)
+    {
+        PoolShard_UnlinkFreeSlab(shard, slab);
+    }
+    Longtail_UnlockSpinLock(shard->m_Lock);
+
+    struct PoolBlockHeader* header = (struct PoolBlockHeader*)block;
+    header->m_Slab = slab;
+    header->m_SizeClass = size_class;
+    return &header[1];
+}
+
+static void PoolAllocator_Free(struct Longtail_AllocatorAPI* allocator_api, void* p)
+{
+    if (p == 0)
+    {
+        return;
+    }
+    struct PoolBlockHeader* header = &((struct PoolBlockHeader*)p)[-1];
+    uint32_t size_class = header->m_SizeClass;
+    if (size_class == POOLALLOCATOR_LARGE_SIZE_CLASS)
+    {
+        free(header);
+        return;
+    }
+    LONGTAIL_FATAL_ASSERT(size_class < POOLALLOCATOR_SIZE_CLASS_COUNT, return)
+
+    struct PoolSlab* slab = header->m_Slab;
+    struct PoolShard* shard = slab->m_Shard;
+    struct PoolFreeBlock* block = (struct PoolFreeBlock*)header;
+    Longtail_LockSpinLock(shard->m_Lock);
+    if (!slab->m_FreeBlocks)
+    {
+        PoolShard_LinkFreeSlab(shard, slab);
+    }
+    block->m_Next = slab->m_FreeBlocks;
+    slab->m_FreeBlocks = block;
+    if (--slab->m_UsedBlockCount > 0)
+    {
+        Longtail_UnlockSpinLock(shard->m_Lock);
+        return;
+    }
+    if (shard->m_EmptySlabSize + slab->m_SlabSize <= POOLALLOCATOR_MAX_EMPTY_SLAB_SIZE)
+    {
+        shard->m_EmptySlabSize += slab->m_SlabSize;
+        Longtail_UnlockSpinLock(shard->m_Lock);
+        return;
+    }
+    PoolShard_UnlinkFreeSlab(shard, slab);
+    if (slab->m_AllPrev)
+    {
+        slab->m_AllPrev->m_AllNext = slab->m_AllNext;
+    }
+    else
+    {
+        shard->m_Slabs = slab->m_AllNext;
+    }
+    if (slab->m_AllNext)
+    {
+        slab->m_AllNext->m_AllPrev = slab->m_AllPrev;
+    }
+    shard->m_SlabSize -= slab->m_SlabSize;
+    shard->m_SlabCount--;
+    shard->m_ReleasedSlabCount++;
+    Longtail_UnlockSpinLock(shard->m_Lock);
+    free(slab);
+}
+
+static void PoolAllocator_Dispose(struct Longtail_API* allocator_api)
+{
+    struct PoolAllocatorAPI* pool_allocator_api = (struct PoolAllocatorAPI*)allocator_api;
+    for (uint32_t s = 0; s < POOLALLOCATOR_SHARD_COUNT; ++s)
+    {
+        struct PoolShard* shard = &pool_allocator_api->m_Shards[s];
+        struct PoolSlab* slab = shard->m_Slabs;
+        while (slab)
+        {
+            struct PoolSlab* next_slab = slab->m_AllNext;
+            free(slab);
+            slab = next_slab;
+        }
+        Longtail_DeleteSpinLock(shard->m_Lock);
+    }
+    free(pool_allocator_api);
+}
+
+static int PoolAllocator_Init(struct PoolAllocatorAPI* pool_allocator_api)
+{
+    pool_allocator_api->m_PoolAllocatorAPI.m_API.Dispose = PoolAllocator_Dispose;
+    pool_allocator_api->m_PoolAllocatorAPI.Alloc = PoolAllocator_Alloc;
+    pool_allocator_api->m_PoolAllocatorAPI.Free = PoolAllocator_Free;
+    char* spin_lock_mem = (char*)&pool_allocator_api[1];
+    for (uint32_t s = 0; s < POOLALLOCATOR_SHARD_COUNT; ++s)
+    {
+        struct PoolShard* shard = &pool_allocator_api->m_Shards[s];
+        memset(shard->m_FreeSlabs, 0, sizeof(shard->m_FreeSlabs));
+        shard->m_Slabs = 0;
+        shard->m_EmptySlabSize = 0;
+        shard->m_SlabSize = 0;
+        shard->m_SlabCount = 0;
+        shard->m_CreatedSlabCount = 0;
+        shard->m_ReleasedSlabCount = 0;
+        int err = Longtail_CreateSpinLock(&spin_lock_mem[Longtail_GetSpinLockSize() * s], &shard->m_Lock);
+        if (err)
+        {
+            while (s--)
+            {
+                Longtail_DeleteSpinLock(pool_allocator_api->m_Shards[s].m_Lock);
+            }
+            return err;
+        }
+    }
+    return 0;
+}
+
+struct Longtail_AllocatorAPI* Longtail_CreatePoolAllocatorAPI()
+{
+    // Not from Longtail_Alloc, a live allocation would keep Longtail_SetAllocatorAPI from installing the pool
+    size_t mem_size = sizeof(struct PoolAllocatorAPI) + Longtail_GetSpinLockSize() * POOLALLOCATOR_SHARD_COUNT;
+    struct PoolAllocatorAPI* pool_allocator_api = (struct PoolAllocatorAPI*)malloc(mem_size);
+    if (!pool_allocator_api)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_CreatePoolAllocatorAPI() failed with %d", ENOMEM)
+        return 0;
+    }
+    int err = PoolAllocator_Init(pool_allocator_api);
+    if (err)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_CreatePoolAllocatorAPI() failed with %d", err)
+        free(pool_allocator_api);
+        return 0;
+    }
+    return &pool_allocator_api->m_PoolAllocatorAPI;
+}
+
+int Longtail_PoolAllocator_GetStats(struct Longtail_AllocatorAPI* allocator_api, struct Longtail_PoolAllocatorStats* out_stats)
+{
+    LONGTAIL_FATAL_ASSERT(allocator_api != 0, return EINVAL)
+    LONGTAIL_FATAL_ASSERT(out_stats != 0, return EINVAL)
+    struct PoolAllocatorAPI* pool_allocator_api = (struct PoolAllocatorAPI*)allocator_api;
+    memset(out_stats, 0, sizeof(struct Longtail_PoolAllocatorStats));
+    for (uint32_t s = 0; s < POOLALLOCATOR_SHARD_COUNT; ++s)
+    {
+        struct PoolShard* shard = &pool_allocator_api->m_Shards[s];
+        Longtail_LockSpinLock(shard->m_Lock);
+        out_stats->m_SlabCount += shard->m_SlabCount;
+        out_stats->m_SlabBytes += (uint64_t)shard->m_SlabSize;
+        out_stats->m_EmptySlabBytes += (uint64_t)shard->m_EmptySlabSize;
+        if ((uint64_t)shard->m_EmptySlabSize > out_stats->m_MaxShardEmptySlabBytes)
+        {
+            out_stats->m_MaxShardEmptySlabBytes = (uint64_t)shard->m_EmptySlabSize;
+        }
+        out_stats->m_CreatedSlabCount += shard->m_CreatedSlabCount;
+        out_stats->m_ReleasedSlabCount += shard->m_ReleasedSlabCount;
+        Longtail_UnlockSpinLock(shard->m_Lock);
+    }
+    return 0;
+}
+
+struct ArenaChunk
+{
+    struct ArenaChunk* m_Next;
+    uint64_t m_Reserved;
+};
+
+struct ArenaAllocatorAPI
+{
+    struct Longtail_AllocatorAPI m_ArenaAllocatorAPI;
+    HLongtail_SpinLock m_Lock;
+    uint32_t m_ChunkSize;
+    struct ArenaChunk* m_Chunks;
+    char* m_ChunkPtr;
+    size_t m_ChunkLeft;
+};
+
+static void* ArenaAllocator_Alloc(struct Longtail_AllocatorAPI* allocator_api, size_t s)
+{
+    struct ArenaAllocatorAPI* arena_allocator_api = (struct ArenaAllocatorAPI*)allocator_api;
+    size_t aligned_size = (s + 15u) & ~(size_t)15u;
+    if (aligned_size > arena_allocator_api->m_ChunkSize / 4u)
+    {
+        // Big allocations get a chunk of their own so they don't waste the rest of the current chunk
+        struct ArenaChunk* chunk = (struct ArenaChunk*)malloc(sizeof(struct ArenaChunk) + aligned_size);
+        if (!chunk)
+        {
+            return 0;
+        }
+        Longtail_LockSpinLock(arena_allocator_api->m_Lock);
+        chunk->m_Next = arena_allocator_api->m_Chunks;
+        arena_allocator_api->m_Chunks = chunk;
+        Longtail_UnlockSpinLock(arena_allocator_api->m_Lock);
+        return &chunk[1];
+    }
+
+    Longtail_LockSpinLock(arena_allocator_api->m_Lock);
+    if (arena_allocator_api->m_ChunkLeft < aligned_size)
+    {
+        struct ArenaChunk* chunk = (struct ArenaChunk*)malloc(sizeof(struct ArenaChunk) + arena_allocator_api->m_ChunkSize);
+        if (!chunk)
+        {
+            Longtail_UnlockSpinLock(arena_allocator_api->m_Lock);
+            return 0;
+        }
+        chunk->m_Next = arena_allocator_api->m_Chunks;
+        arena_allocator_api->m_Chunks = chunk;
+        arena_allocator_api->m_ChunkPtr = (char*)&chunk[1];
+        arena_allocator_api->m_ChunkLeft = arena_allocator_api->m_ChunkSize;
+    }
+    void* p = arena_allocator_api->m_ChunkPtr;
+    arena_allocator_api->m_ChunkPtr += aligned_size;
+    arena_allocator_api->m_ChunkLeft -= aligned_size;
+    Longtail_UnlockSpinLock(arena_allocator_api->m_Lock);
+    return p;
+}
+
+static void ArenaAllocator_Free(struct Longtail_AllocatorAPI* allocator_api, void* p)
+{
+}
+
+static void ArenaAllocator_Dispose(struct Longtail_API* allocator_api)
+{
+    struct ArenaAllocatorAPI* arena_allocator_api = (struct ArenaAllocatorAPI*)allocator_api;
+    struct ArenaChunk* chunk = arena_allocator_api->m_Chunks;
+    while (chunk)
+    {
+        struct ArenaChunk* next_chunk = chunk->m_Next;
+        free(chunk);
+        chunk = next_chunk;
+    }
+    Longtail_DeleteSpinLock(arena_allocator_api->m_Lock);
+    free(arena_allocator_api);
+}
+
+static int ArenaAllocator_Init(struct ArenaAllocatorAPI* arena_allocator_api, uint32_t chunk_size)
+{
+    arena_allocator_api->m_ArenaAllocatorAPI.m_API.Dispose = ArenaAllocator_Dispose;
+    arena_allocator_api->m_ArenaAllocatorAPI.Alloc = ArenaAllocator_Alloc;
+    arena_allocator_api->m_ArenaAllocatorAPI.Free = ArenaAllocator_Free;
+    arena_allocator_api->m_ChunkSize = chunk_size;
+    arena_allocator_api->m_Chunks = 0;
+    arena_allocator_api->m_ChunkPtr = 0;
+    arena_allocator_api->m_ChunkLeft = 0;
+    return Longtail_CreateSpinLock(&arena_allocator_api[1], &arena_allocator_api->m_Lock);
+}
+
+struct Longtail_AllocatorAPI* Longtail_CreateArenaAllocatorAPI(uint32_t chunk_size)
+{
+    LONGTAIL_FATAL_ASSERT(chunk_size >= 64u, return 0)
+    // Not from Longtail_Alloc, a live allocation would keep Longtail_SetAllocatorAPI from installing the arena
+    size_t mem_size = sizeof(struct ArenaAllocatorAPI) + Longtail_GetSpinLockSize();
+    struct ArenaAllocatorAPI* arena_allocator_api = (struct ArenaAllocatorAPI*)malloc(mem_size);
+    if (!arena_allocator_api)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_CreateArenaAllocatorAPI(%u) failed with %d", chunk_size, ENOMEM)
+        return 0;
+    }
+    int err = ArenaAllocator_Init(arena_allocator_api, chunk_size);
+    if (err)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_CreateArenaAllocatorAPI(%u) failed with %d", chunk_size, err)
+        free(arena_allocator_api);
+        return 0;
+    }
+    return &arena_allocator_api->m_ArenaAllocatorAPI;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct Longtail_AllocatorAPI;
+
+// Serves allocations up to 32 KB from size class pools, larger allocations go straight to malloc.
+// There are no thread local caches, each thread allocates from one of 64 shards picked by its thread id so threads
+// rarely share a lock. Freed blocks go back to the slab they came from and a shard keeps up to 256 KB of empty slabs
+// for reuse, slabs that become empty beyond that are returned to the system.
+extern struct Longtail_AllocatorAPI* Longtail_CreatePoolAllocatorAPI();
+
+struct Longtail_PoolAllocatorStats
+{
+    uint64_t m_SlabCount;               // Slabs currently held, in use or kept empty for reuse
+    uint64_t m_SlabBytes;
+    uint64_t m_EmptySlabBytes;
+    uint64_t m_MaxShardEmptySlabBytes;  // Largest amount of empty slabs kept by a single shard
+    uint64_t m_CreatedSlabCount;        // Over the lifetime of the allocator
+    uint64_t m_ReleasedSlabCount;
+};
+
+// Only valid for an allocator created with Longtail_CreatePoolAllocatorAPI
+extern int Longtail_PoolAllocator_GetStats(struct Longtail_AllocatorAPI* allocator_api, struct Longtail_PoolAllocatorStats* out_stats);
+
+// Hands out memory from chunks of chunk_size bytes, Free does nothing and all memory is released when
+// the arena is disposed. Meant for temporary work where everything allocated dies at the same time.
+extern struct Longtail_AllocatorAPI* Longtail_CreateArenaAllocatorAPI(uint32_t chunk_size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,341 @@
+#include "longtail_shapedstorage.h"
+
+#include "../../src/longtail.h"
+#include "../longtail_platform.h"
+
+#include <errno.h>
+#include <inttypes.h>
+
+// Transfers in one direction are queued back to back on a link, each one finishes when the link
+// has had time to move its bytes at the configured rate
+struct ShapedStorageLink
+{
+    uint64_t m_BytesPerSecond;
+    uint64_t m_NextFreeUS;
+    HLongtail_SpinLock m_SpinLock;
+};
+
+struct ShapedStorageAPI
+{
+    struct Longtail_StorageAPI m_ShapedStorageAPI;
+    struct Longtail_StorageAPI* m_BackingAPI;
+    uint64_t m_LatencyUS;
+    struct ShapedStorageLink m_ReadLink;
+    struct ShapedStorageLink m_WriteLink;
+    HLongtail_Sema m_ConcurrencySema;
+};
+
+static void ShapedStorageAPI_Begin(struct ShapedStorageAPI* api)
+{
+    if (api->m_ConcurrencySema)
+    {
+        Longtail_WaitSema(api->m_ConcurrencySema, LONGTAIL_TIMEOUT_INFINITE);
+    }
+    if (api->m_LatencyUS)
+    {
+        Longtail_Sleep(api->m_LatencyUS);
+    }
+}
+
+static void ShapedStorageAPI_End(struct ShapedStorageAPI* api)
+{
+    if (api->m_ConcurrencySema)
+    {
+        Longtail_PostSema(api->m_ConcurrencySema, 1);
+    }
+}
+
+static void ShapedStorageAPI_Transfer(struct ShapedStorageLink* link, uint64_t length)
+{
+    if (link->m_BytesPerSecond == 0)
+    {
+        return;
+    }
+    uint64_t duration_us = (length * 1000000u) / link->m_BytesPerSecond;
+    Longtail_LockSpinLock(link->m_SpinLock);
+    uint64_t now = Longtail_GetTimeUS();
+    uint64_t start = link->m_NextFreeUS > now ? link->m_NextFreeUS : now;
+    uint64_t done = start + duration_us;
+    link->m_NextFreeUS = done;
+    Longtail_UnlockSpinLock(link->m_SpinLock);
+    if (done > now)
+    {
+        Longtail_Sleep(done - now);
+    }
+}
+
+static void ShapedStorageAPI_Dispose(struct Longtail_API* storage_api)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    if (api->m_ConcurrencySema)
+    {
+        Longtail_DeleteSema(api->m_ConcurrencySema);
+    }
+    Longtail_DeleteSpinLock(api->m_WriteLink.m_SpinLock);
+    Longtail_DeleteSpinLock(api->m_ReadLink.m_SpinLock);
+    Longtail_Free(storage_api);
+}
+
+static int ShapedStorageAPI_OpenReadFile(struct Longtail_StorageAPI* storage_api, const char* path, Longtail_StorageAPI_HOpenFile* out_open_file)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    ShapedStorageAPI_Begin(api);
+    int err = api->m_BackingAPI->OpenReadFile(api->m_BackingAPI, path, out_open_file);
+    ShapedStorageAPI_End(api);
+    return err;
+}
+
+static int ShapedStorageAPI_GetSize(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f, uint64_t* out_size)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    ShapedStorageAPI_Begin(api);
+    int err = api->m_BackingAPI->GetSize(api->m_BackingAPI, f, out_size);
+    ShapedStorageAPI_End(api);
+    return err;
+}
+
+static int ShapedStorageAPI_Read(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f, uint64_t offset, uint64_t length, void* output)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    ShapedStorageAPI_Begin(api);
+    int err = api->m_BackingAPI->Read(api->m_BackingAPI, f, offset, length, output);
+    if (!err)
+    {
+        ShapedStorageAPI_Transfer(&api->m_ReadLink, length);
+    }
+    ShapedStorageAPI_End(api);
+    return err;
+}
+
+static int ShapedStorageAPI_OpenWriteFile(struct Longtail_StorageAPI* storage_api, const char* path, uint64_t initial_size, Longtail_StorageAPI_HOpenFile* out_open_file)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    ShapedStorageAPI_Begin(api);
+    int err = api->m_BackingAPI->OpenWriteFile(api->m_BackingAPI, path, initial_size, out_open_file);
+    ShapedStorageAPI_End(api);
+    return err;
+}
+
+static int ShapedStorageAPI_Write(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f, uint64_t offset, uint64_t length, const void* input)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    ShapedStorageAPI_Begin(api);
+    ShapedStorageAPI_Transfer(&api->m_WriteLink, length);
+    int err = api->m_BackingAPI->Write(api->m_BackingAPI, f, offset, length, input);
+    ShapedStorageAPI_End(api);
+    return err;
+}
+
+static int ShapedStorageAPI_SetSize(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f, uint64_t length)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    ShapedStorageAPI_Begin(api);
+    int err = api->m_BackingAPI->SetSize(api->m_BackingAPI, f, length);
+    ShapedStorageAPI_End(api);
+    return err;
+}
+
+static void ShapedStorageAPI_CloseFile(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HOpenFile f)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    api->m_BackingAPI->CloseFile(api->m_BackingAPI, f);
+}
+
+static int ShapedStorageAPI_CreateDir(struct Longtail_StorageAPI* storage_api, const char* path)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    ShapedStorageAPI_Begin(api);
+    int err = api->m_BackingAPI->CreateDir(api->m_BackingAPI, path);
+    ShapedStorageAPI_End(api);
+    return err;
+}
+
+static int ShapedStorageAPI_RenameFile(struct Longtail_StorageAPI* storage_api, const char* source_path, const char* target_path)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    ShapedStorageAPI_Begin(api);
+    int err = api->m_BackingAPI->RenameFile(api->m_BackingAPI, source_path, target_path);
+    ShapedStorageAPI_End(api);
+    return err;
+}
+
+static char* ShapedStorageAPI_ConcatPath(struct Longtail_StorageAPI* storage_api, const char* root_path, const char* sub_path)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    return api->m_BackingAPI->ConcatPath(api->m_BackingAPI, root_path, sub_path);
+}
+
+static int ShapedStorageAPI_IsDir(struct Longtail_StorageAPI* storage_api, const char* path)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    ShapedStorageAPI_Begin(api);
+    int is_dir = api->m_BackingAPI->IsDir(api->m_BackingAPI, path);
+    ShapedStorageAPI_End(api);
+    return is_dir;
+}
+
+static int ShapedStorageAPI_IsFile(struct Longtail_StorageAPI* storage_api, const char* path)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    ShapedStorageAPI_Begin(api);
+    int is_file = api->m_BackingAPI->IsFile(api->m_BackingAPI, path);
+    ShapedStorageAPI_End(api);
+    return is_file;
+}
+
+static int ShapedStorageAPI_RemoveDir(struct Longtail_StorageAPI* storage_api, const char* path)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    ShapedStorageAPI_Begin(api);
+    int err = api->m_BackingAPI->RemoveDir(api->m_BackingAPI, path);
+    ShapedStorageAPI_End(api);
+    return err;
+}
+
+static int ShapedStorageAPI_RemoveFile(struct Longtail_StorageAPI* storage_api, const char* path)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    ShapedStorageAPI_Begin(api);
+    int err = api->m_BackingAPI->RemoveFile(api->m_BackingAPI, path);
+    ShapedStorageAPI_End(api);
+    return err;
+}
+
+// Listing a directory is one round trip, stepping through the result is not delayed
+static int ShapedStorageAPI_StartFind(struct Longtail_StorageAPI* storage_api, const char* path, Longtail_StorageAPI_HIterator* out_iterator)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    ShapedStorageAPI_Begin(api);
+    int err = api->m_BackingAPI->StartFind(api->m_BackingAPI, path, out_iterator);
+    ShapedStorageAPI_End(api);
+    return err;
+}
+
+static int ShapedStorageAPI_FindNext(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HIterator iterator)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    return api->m_BackingAPI->FindNext(api->m_BackingAPI, iterator);
+}
+
+static void ShapedStorageAPI_CloseFind(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HIterator iterator)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    api->m_BackingAPI->CloseFind(api->m_BackingAPI, iterator);
+}
+
+static const char* ShapedStorageAPI_GetFileName(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HIterator iterator)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    return api->m_BackingAPI->GetFileName(api->m_BackingAPI, iterator);
+}
+
+static const char* ShapedStorageAPI_GetDirectoryName(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HIterator iterator)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    return api->m_BackingAPI->GetDirectoryName(api->m_BackingAPI, iterator);
+}
+
+static uint64_t ShapedStorageAPI_GetEntrySize(struct Longtail_StorageAPI* storage_api, Longtail_StorageAPI_HIterator iterator)
+{
+    struct ShapedStorageAPI* api = (struct ShapedStorageAPI*)storage_api;
+    return api->m_BackingAPI->GetEntrySize(api->m_BackingAPI, iterator);
+}
+
+static int ShapedStorageAPI_Init(
+    struct ShapedStorageAPI* storage_api,
+    struct Longtail_StorageAPI* backing_api,
+    uint64_t latency_us,
+    uint64_t read_bytes_per_second,
+    uint64_t write_bytes_per_second,
+    uint32_t max_concurrency)
+{
+    storage_api->m_ShapedStorageAPI.m_API.Dispose = ShapedStorageAPI_Dispose;
+    storage_api->m_ShapedStorageAPI.OpenReadFile = ShapedStorageAPI_OpenReadFile;
+    storage_api->m_ShapedStorageAPI.GetSize = ShapedStorageAPI_GetSize;
+    storage_api->m_ShapedStorageAPI.Read = ShapedStorageAPI_Read;
+    storage_api->m_ShapedStorageAPI.OpenWriteFile = ShapedStorageAPI_OpenWriteFile;
+    storage_api->m_ShapedStorageAPI.Write = ShapedStorageAPI_Write;
+    storage_api->m_ShapedStorageAPI.SetSize = ShapedStorageAPI_SetSize;
+    storage_api->m_ShapedStorageAPI.CloseFile = ShapedStorageAPI_CloseFile;
+    storage_api->m_ShapedStorageAPI.CreateDir = ShapedStorageAPI_CreateDir;
+    storage_api->m_ShapedStorageAPI.RenameFile = ShapedStorageAPI_RenameFile;
+    storage_api->m_ShapedStorageAPI.ConcatPath = ShapedStorageAPI_ConcatPath;
+    storage_api->m_ShapedStorageAPI.IsDir = ShapedStorageAPI_IsDir;
+    storage_api->m_ShapedStorageAPI.IsFile = ShapedStorageAPI_IsFile;
+    storage_api->m_ShapedStorageAPI.RemoveDir = ShapedStorageAPI_RemoveDir;
+    storage_api->m_ShapedStorageAPI.RemoveFile = ShapedStorageAPI_RemoveFile;
+    storage_api->m_ShapedStorageAPI.StartFind = ShapedStorageAPI_StartFind;
+    storage_api->m_ShapedStorageAPI.FindNext = ShapedStorageAPI_FindNext;
+    storage_api->m_ShapedStorageAPI.CloseFind = ShapedStorageAPI_CloseFind;
+    storage_api->m_ShapedStorageAPI.GetFileName = ShapedStorageAPI_GetFileName;
+    storage_api->m_ShapedStorageAPI.GetDirectoryName = ShapedStorageAPI_GetDirectoryName;
+    storage_api->m_ShapedStorageAPI.GetEntrySize = ShapedStorageAPI_GetEntrySize;
+
+    storage_api->m_BackingAPI = backing_api;
+    storage_api->m_LatencyUS = latency_us;
+    storage_api->m_ReadLink.m_BytesPerSecond = read_bytes_per_second;
+    storage_api->m_ReadLink.m_NextFreeUS = 0;
+    storage_api->m_WriteLink.m_BytesPerSecond = write_bytes_per_second;
+    storage_api->m_WriteLink.m_NextFreeUS = 0;
+    storage_api->m_ConcurrencySema = 0;
+
+    // The semaphore goes first, it has the strictest alignment
+    char* p = (char*)&storage_api[1];
+    if (max_concurrency > 0)
+    {
+        int err = Longtail_CreateSema(p, (int)max_concurrency, &storage_api->m_ConcurrencySema);
+        if (err)
+        {
+            return err;
+        }
+    }
+    p += Longtail_GetSemaSize();
+    int err = Longtail_CreateSpinLock(p, &storage_api->m_ReadLink.m_SpinLock);
+    if (err)
+    {
+        if (storage_api->m_ConcurrencySema)
+        {
+            Longtail_DeleteSema(storage_api->m_ConcurrencySema);
+        }
+        return err;
+    }
+    p += Longtail_GetSpinLockSize();
+    err = Longtail_CreateSpinLock(p, &storage_api->m_WriteLink.m_SpinLock);
+    if (err)
+    {
+        Longtail_DeleteSpinLock(storage_api->m_ReadLink.m_SpinLock);
+        if (storage_api->m_ConcurrencySema)
+        {
+            Longtail_DeleteSema(storage_api->m_ConcurrencySema);
+        }
+        return err;
+    }
+    return 0;
+}
+
+struct Longtail_StorageAPI* Longtail_CreateShapedStorageAPI(
+    struct Longtail_StorageAPI* backing_api,
+    uint64_t latency_us,
+    uint64_t read_bytes_per_second,
+    uint64_t write_bytes_per_second,
+    uint32_t max_concurrency)
+{
+    LONGTAIL_FATAL_ASSERT(backing_api != 0, return 0)
+    size_t api_size = sizeof(struct ShapedStorageAPI) + Longtail_GetSemaSize() + Longtail_GetSpinLockSize() * 2u;
+    struct ShapedStorageAPI* storage_api = (struct ShapedStorageAPI*)Longtail_Alloc(api_size);
+    if (!storage_api)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_CreateShapedStorageAPI(%p, %" PRIu64 ", %" PRIu64 ", %" PRIu64 ", %u) failed with %d",
+            backing_api, latency_us, read_bytes_per_second, write_bytes_per_second, max_concurrency, ENOMEM)
+        return 0;
+    }
+    int err = ShapedStorageAPI_Init(storage_api, backing_api, latency_us, read_bytes_per_second, write_bytes_per_second, max_concurrency);
+    if (err)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_CreateShapedStorageAPI(%p, %" PRIu64 ", %" PRIu64 ", %" PRIu64 ", %u) failed with %d",
+            backing_api, latency_us, read_bytes_per_second, write_bytes_per_second, max_concurrency, err)
+        Longtail_Free(storage_api);
+        return 0;
+    }
+    return &storage_api->m_ShapedStorageAPI;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct Longtail_StorageAPI;
+
+// Wraps `backing_api` to behave like slow, remote storage for benchmarking. Each call that reaches the backing
+// storage waits `latency_us` and Read and Write are held back to `read_bytes_per_second` and `write_bytes_per_second`,
+// shared by all callers. At most `max_concurrency` calls run at once, further callers queue. Zero disables a limit.
+// `backing_api` is not owned and must outlive the returned storage.
+extern struct Longtail_StorageAPI* Longtail_CreateShapedStorageAPI(
+    struct Longtail_StorageAPI* backing_api,
+    uint64_t latency_us,
+    uint64_t read_bytes_per_second,
+    uint64_t write_bytes_per_second,
+    uint32_t max_concurrency);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,700 @@
+#include "longtail_workstealing.h"
+
+#include "../../src/longtail.h"
+#include "../longtail_platform.h"
+
+#include <errno.h>
+
+#define WORK_STEALING_PROGRESS_INTERVAL_US 100000u
+#define WORK_STEALING_DEPENDENCY_BLOCK_SIZE 64u
+#define WORK_STEALING_ANY_QUEUE 0xffffffffu
+
+struct WorkStealingJob;
+
+struct DependencyLink
+{
+    struct WorkStealingJob* m_Job;
+    struct DependencyLink* m_Next;
+};
+
+// Links are owned by the group of the dependent job, which can not complete before the link has been consumed
+struct DependencyLinkBlock
+{
+    struct DependencyLinkBlock* m_Next;
+    uint32_t m_UsedCount;
+    struct DependencyLink m_Links[WORK_STEALING_DEPENDENCY_BLOCK_SIZE];
+};
+
+// Marks the dependents list of a job that has completed, links can no longer be pushed to it
+static struct DependencyLink WorkStealing_CompletedLink;
+#define WORK_STEALING_COMPLETED ((int64_t)(uintptr_t)&WorkStealing_CompletedLink)
+
+struct WorkStealingJob
+{
+    struct WorkStealingJobGroup* m_JobGroup;
+    Longtail_JobAPI_JobFunc m_JobFunc;
+    void* m_Context;
+    // Lock free list of struct DependencyLink, swapped for WORK_STEALING_COMPLETED when the job completes
+    TLongtail_Atomic64 m_Dependents;
+    int32_t volatile m_UnresolvedDependencyCount;
+    // Intrusive links for the work queue the job is in, a job is queued at most once
+    struct WorkStealingJob* m_QueuePrev;
+    struct WorkStealingJob* m_QueueNext;
+};
+
+struct WorkStealingJobGroup
+{
+    struct Longtail_CancelAPI* m_CancelAPI;
+    Longtail_CancelAPI_HCancelToken m_CancelToken;
+    struct WorkStealingJob* m_ReservedJobs;
+    uint32_t m_ReservedJobCount;
+    int32_t volatile m_SubmittedJobCount;
+    int32_t volatile m_PendingJobCount;
+    int32_t volatile m_JobsCompleted;
+    struct DependencyLinkBlock* m_DependencyLinks;
+    HLongtail_SpinLock m_DependencyLinksLock;
+    HLongtail_Sema m_JobsDoneSema;
+};
+
+// The owning worker pushes and pops at the bottom, other threads steal from the top. The jobs are
+// linked through their own queue links so pushing never allocates.
+struct WorkQueue
+{
+    HLongtail_SpinLock m_Lock;
+    struct WorkStealingJob* m_Top;
+    struct WorkStealingJob* m_Bottom;
+};
+
+struct WorkStealingWorker
+{
+    struct WorkStealingJobAPI* m_JobAPI;
+    uint32_t m_QueueIndex;
+    // Set by the worker before it sleeps on m_WakeSema, cleared by whoever wakes it
+    int32_t volatile m_IsIdle;
+    HLongtail_Sema m_WakeSema;
+    HLongtail_Thread m_Thread;
+};
+
+struct WorkStealingJobAPI
+{
+    struct Longtail_JobAPI m_WorkStealingAPI;
+
+    uint32_t m_WorkerCount;
+    uint32_t m_QueueCount;
+    struct WorkQueue* m_Queues;
+    struct WorkStealingWorker* m_Workers;
+    int32_t volatile m_IdleWorkerCount;
+    // Without workers the threads in WaitForAllJobs run the jobs and sleep on m_IdleWaiterSema
+    HLongtail_Sema m_IdleWaiterSema;
+    int32_t volatile m_IdleWaiterCount;
+    int32_t volatile m_NextQueue;
+    int32_t volatile m_Stop;
+    uint64_t m_ProgressIntervalUS;
+};
+
+static int WorkQueue_Init(struct WorkQueue* queue, void* spin_lock_mem)
+{
+    queue->m_Top = 0;
+    queue->m_Bottom = 0;
+    return Longtail_CreateSpinLock(spin_lock_mem, &queue->m_Lock);
+}
+
+static void WorkQueue_Dispose(struct WorkQueue* queue)
+{
+    Longtail_DeleteSpinLock(queue->m_Lock);
+}
+
+static void WorkQueue_Push(struct WorkQueue* queue, uint32_t job_count, struct WorkStealingJob* jobs, uint32_t job_stride)
+{
+    Longtail_LockSpinLock(queue->m_Lock);
+    for (uint32_t i = 0; i < job_count; ++i)
+    {
+        struct WorkStealingJob* job = &jobs[i * job_stride];
+        job->m_QueuePrev = queue->m_Bottom;
+        job->m_QueueNext = 0;
+        if (queue->m_Bottom)
+        {
+            queue->m_Bottom->m_QueueNext = job;
+        }
+        else
+        {
+            queue->m_Top = job;
+        }
+        queue->m_Bottom = job;
+    }
+    Longtail_UnlockSpinLock(queue->m_Lock);
+}
+
+static struct WorkStealingJob* WorkQueue_PopBottom(struct WorkQueue* queue)
+{
+    Longtail_LockSpinLock(queue->m_Lock);
+    struct WorkStealingJob* job = queue->m_Bottom;
+    if (job)
+    {
+        queue->m_Bottom = job->m_QueuePrev;
+        if (queue->m_Bottom)
+        {
+            queue->m_Bottom->m_QueueNext = 0;
+        }
+        else
+        {
+            queue->m_Top = 0;
+        }
+    }
+    Longtail_UnlockSpinLock(queue->m_Lock);
+    return job;
+}
+
+static struct WorkStealingJob* WorkQueue_StealTop(struct WorkQueue* queue)
+{
+    Longtail_LockSpinLock(queue->m_Lock);
+    struct WorkStealingJob* job = queue->m_Top;
+    if (job)
+    {
+        queue->m_Top = job->m_QueueNext;
+        if (queue->m_Top)
+        {
+            queue->m_Top->m_QueuePrev = 0;
+        }
+        else
+        {
+            queue->m_Bottom = 0;
+        }
+    }
+    Longtail_UnlockSpinLock(queue->m_Lock);
+    return job;
+}
+
+static int WorkQueue_IsEmpty(struct WorkQueue* queue)
+{
+    Longtail_LockSpinLock(queue->m_Lock);
+    int is_empty = queue->m_Top == 0;
+    Longtail_UnlockSpinLock(queue->m_Lock);
+    return is_empty;
+}
+
+// Wakes up to job_count sleeping workers, starting with the owner of first_queue_index so the
+// worker whose queue got the jobs is the first to look for them
+static void WorkStealing_WakeWorkers(struct WorkStealingJobAPI* job_api, uint32_t first_queue_index, uint32_t job_count)
+{
+    if (job_api->m_WorkerCount == 0)
+    {
+        int32_t idle_waiter_count = Longtail_AtomicAdd32(&job_api->m_IdleWaiterCount, 0);
+        if (idle_waiter_count > 0)
+        {
+            Longtail_PostSema(job_api->m_IdleWaiterSema, job_count < (uint32_t)idle_waiter_count ? job_count : (uint32_t)idle_waiter_count);
+        }
+        return;
+    }
+    uint32_t worker_count = job_api->m_WorkerCount;
+    for (uint32_t i = 0; i < worker_count && job_count > 0; ++i)
+    {
+        if (Longtail_AtomicAdd32(&job_api->m_IdleWorkerCount, 0) == 0)
+        {
+            return;
+        }
+        struct WorkStealingWorker* worker = &job_api->m_Workers[(first_queue_index + i) % worker_count];
+        if (Longtail_CompareAndSwap32(&worker->m_IsIdle, 1, 0) == 1)
+        {
+            Longtail_AtomicAdd32(&job_api->m_IdleWorkerCount, -1);
+            Longtail_PostSema(worker->m_WakeSema, 1);
+            --job_count;
+        }
+    }
+}
+
+static uint32_t WorkStealing_PickQueue(struct WorkStealingJobAPI* job_api)
+{
+    return (uint32_t)Longtail_AtomicAdd32(&job_api->m_NextQueue, 1) % job_api->m_QueueCount;
+}
+
+static struct WorkStealingJob* WorkStealing_FindJob(struct WorkStealingJobAPI* job_api, uint32_t queue_index)
+{
+    uint32_t queue_count = job_api->m_QueueCount;
+    uint32_t start_index;
+    if (queue_index != WORK_STEALING_ANY_QUEUE)
+    {
+        struct WorkStealingJob* job = WorkQueue_PopBottom(&job_api->m_Queues[queue_index]);
+        if (job)
+        {
+            return job;
+        }
+        start_index = queue_index + 1;
+    }
+    else
+    {
+        start_index = WorkStealing_PickQueue(job_api);
+    }
+    for (uint32_t i = 0; i < queue_count; ++i)
+    {
+        uint32_t victim_index = (start_index + i) % queue_count;
+        if (victim_index == queue_index)
+        {
+            continue;
+        }
+        struct WorkStealingJob* job = WorkQueue_StealTop(&job_api->m_Queues[victim_index]);
+        if (job)
+        {
+            return job;
+        }
+    }
+    return 0;
+}
+
+static void WorkStealing_QueueJob(struct WorkStealingJobAPI* job_api, struct WorkStealingJob* job, uint32_t queue_index)
+{
+    // Keep unlocked work on the worker that completed its last dependency
+    uint32_t target_queue = queue_index != WORK_STEALING_ANY_QUEUE ? queue_index : WorkStealing_PickQueue(job_api);
+    WorkQueue_Push(&job_api->m_Queues[target_queue], 1, job, 1);
+    WorkStealing_WakeWorkers(job_api, target_queue, 1);
+}
+
+static void WorkStealing_ExecuteJob(struct WorkStealingJobAPI* job_api, struct WorkStealingJob* job, uint32_t queue_index)
+{
+    struct WorkStealingJobGroup* job_group = job->m_JobGroup;
+    int is_cancelled = job_group->m_CancelAPI && job_group->m_CancelAPI->IsCancelled(job_group->m_CancelAPI, job_group->m_CancelToken) == ECANCELED;
+    job->m_JobFunc(job->m_Context, is_cancelled);
+
+    // Close the list so AddDependecies stops adding to it and take the links it already has
+    int64_t dependents = job->m_Dependents;
+    int64_t current;
+    while ((current = Longtail_CompareAndSwap64(&job->m_Dependents, dependents, WORK_STEALING_COMPLETED)) != dependents)
+    {
+        dependents = current;
+    }
+
+    struct DependencyLink* link = (struct DependencyLink*)(uintptr_t)dependents;
+    while (link)
+    {
+        struct WorkStealingJob* dependent = link->m_Job;
+        // The link lives in the dependent job group, don't touch it after the dependent may have been scheduled
+        link = link->m_Next;
+        if (Longtail_AtomicAdd32(&dependent->m_UnresolvedDependencyCount, -1) == 0)
+        {
+            WorkStealing_QueueJob(job_api, dependent, queue_index);
+        }
+    }
+
+    LONGTAIL_FATAL_ASSERT(job_group->m_PendingJobCount > 0, return)
+    Longtail_AtomicAdd32(&job_group->m_JobsCompleted, 1);
+    if (Longtail_AtomicAdd32(&job_group->m_PendingJobCount, -1) == 0)
+    {
+        // Only the job that completes the group gets here, after WaitForAllJobs released its reference. The post must
+        // be the last access to job_group, WaitForAllJobs frees it as soon as it has taken the post
+        Longtail_PostSema(job_group->m_JobsDoneSema, 1);
+        if (job_api->m_WorkerCount == 0)
+        {
+            // The idle threads are all waiters, we can't tell which one owns this group so wake all of them
+            int32_t idle_waiter_count = Longtail_AtomicAdd32(&job_api->m_IdleWaiterCount, 0);
+            if (idle_waiter_count > 0)
+            {
+                Longtail_PostSema(job_api->m_IdleWaiterSema, (unsigned int)idle_waiter_count);
+            }
+        }
+    }
+}
+
+static int WorkStealing_HasQueuedJobs(struct WorkStealingJobAPI* job_api)
+{
+    for (uint32_t i = 0; i < job_api->m_QueueCount; ++i)
+    {
+        if (!WorkQueue_IsEmpty(&job_api->m_Queues[i]))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int32_t WorkStealingWorker_Execute(void* context)
+{
+    struct WorkStealingWorker* worker = (struct WorkStealingWorker*)context;
+    struct WorkStealingJobAPI* job_api = worker->m_JobAPI;
+
+    while (job_api->m_Stop == 0)
+    {
+        struct WorkStealingJob* job = WorkStealing_FindJob(job_api, worker->m_QueueIndex);
+        if (job)
+        {
+            WorkStealing_ExecuteJob(job_api, job, worker->m_QueueIndex);
+            continue;
+        }
+        // Register as idle before the final check so a concurrent push either sees us or we see its job
+        Longtail_AtomicAdd32(&worker->m_IsIdle, 1);
+        Longtail_AtomicAdd32(&job_api->m_IdleWorkerCount, 1);
+        if (job_api->m_Stop == 0 && !WorkStealing_HasQueuedJobs(job_api))
+        {
+            Longtail_WaitSema(worker->m_WakeSema, LONGTAIL_TIMEOUT_INFINITE);
+            continue;
+        }
+        if (Longtail_CompareAndSwap32(&worker->m_IsIdle, 1, 0) == 1)
+        {
+            Longtail_AtomicAdd32(&job_api->m_IdleWorkerCount, -1);
+            continue;
+        }
+        // Someone claimed us while we were checking, take the wake up they posted
+        Longtail_WaitSema(worker->m_WakeSema, LONGTAIL_TIMEOUT_INFINITE);
+    }
+    return 0;
+}
+
+static uint32_t WorkStealing_GetWorkerCount(struct Longtail_JobAPI* job_api)
+{
+    struct WorkStealingJobAPI* work_stealing_job_api = (struct WorkStealingJobAPI*)job_api;
+    return work_stealing_job_api->m_WorkerCount;
+}
+
+static int WorkStealing_ReserveJobs(struct Longtail_JobAPI* job_api, uint32_t job_count, struct Longtail_CancelAPI* optional_cancel_api, Longtail_CancelAPI_HCancelToken optional_cancel_token, Longtail_JobAPI_Group* out_job_group)
+{
+    size_t job_group_size = sizeof(struct WorkStealingJobGroup) +
+        sizeof(struct WorkStealingJob) * job_count +
+        Longtail_GetSpinLockSize() +
+        Longtail_GetSemaSize();
+    struct WorkStealingJobGroup* job_group = (struct WorkStealingJobGroup*)Longtail_AllocTagged(LONGTAIL_MEMTAG_JOBS, job_group_size);
+    if (!job_group)
+    {
+        return ENOMEM;
+    }
+    char* p = (char*)&job_group[1];
+    job_group->m_CancelAPI = optional_cancel_api;
+    job_group->m_CancelToken = optional_cancel_token;
+    job_group->m_ReservedJobs = (struct WorkStealingJob*)p;
+    p += sizeof(struct WorkStealingJob) * job_count;
+    job_group->m_ReservedJobCount = job_count;
+    job_group->m_SubmittedJobCount = 0;
+    // The group holds a reference of its own until WaitForAllJobs so the pending count can not reach zero
+    // while jobs are still being created
+    job_group->m_PendingJobCount = 1;
+    job_group->m_JobsCompleted = 0;
+    job_group->m_DependencyLinks = 0;
+    int err = Longtail_CreateSpinLock(p, &job_group->m_DependencyLinksLock);
+    if (err)
+    {
+        Longtail_Free(job_group);
+        return err;
+    }
+    p += Longtail_GetSpinLockSize();
+    err = Longtail_CreateSema(p, 0, &job_group->m_JobsDoneSema);
+    if (err)
+    {
+        Longtail_DeleteSpinLock(job_group->m_DependencyLinksLock);
+        Longtail_Free(job_group);
+        return err;
+    }
+    *out_job_group = (Longtail_JobAPI_Group)job_group;
+    return 0;
+}
+
+static int WorkStealing_CreateJobs(struct Longtail_JobAPI* job_api, Longtail_JobAPI_Group job_group, uint32_t job_channel, uint32_t job_count, Longtail_JobAPI_JobFunc job_funcs[], void* job_contexts[], Longtail_JobAPI_Jobs* out_jobs)
+{
+    struct WorkStealingJobGroup* work_stealing_job_group = (struct WorkStealingJobGroup*)job_group;
+    // All channels share the same workers, an idle worker steals whatever is queued
+    LONGTAIL_FATAL_ASSERT(job_channel < LONGTAIL_JOB_CHANNEL_COUNT, return EINVAL)
+    int32_t new_job_count = Longtail_AtomicAdd32(&work_stealing_job_group->m_SubmittedJobCount, (int32_t)job_count);
+    if (new_job_count > (int32_t)work_stealing_job_group->m_ReservedJobCount)
+    {
+        Longtail_AtomicAdd32(&work_stealing_job_group->m_SubmittedJobCount, -((int32_t)job_count));
+        return ENOMEM;
+    }
+    uint32_t job_range_start = (uint32_t)(new_job_count - job_count);
+
+    struct WorkStealingJob* jobs = &work_stealing_job_group->m_ReservedJobs[job_range_start];
+    for (uint32_t i = 0; i < job_count; ++i)
+    {
+        struct WorkStealingJob* job = &jobs[i];
+        job->m_JobGroup = work_stealing_job_group;
+        job->m_JobFunc = job_funcs[i];
+        job->m_Context = job_contexts[i];
+        job->m_Dependents = 0;
+        job->m_UnresolvedDependencyCount = 0;
+        job->m_QueuePrev = 0;
+        job->m_QueueNext = 0;
+    }
+
+    Longtail_AtomicAdd32(&work_stealing_job_group->m_PendingJobCount, (int)job_count);
+
+    *out_jobs = jobs;
+    return 0;
+}
+
+static struct DependencyLink* WorkStealing_AllocDependencyLink(struct WorkStealingJobGroup* job_group)
+{
+    Longtail_LockSpinLock(job_group->m_DependencyLinksLock);
+    struct DependencyLinkBlock* block = job_group->m_DependencyLinks;
+    if (!block || block->m_UsedCount == WORK_STEALING_DEPENDENCY_BLOCK_SIZE)
+    {
+        block = (struct DependencyLinkBlock*)Longtail_AllocTagged(LONGTAIL_MEMTAG_JOBS, sizeof(struct DependencyLinkBlock));
+        if (!block)
+        {
+            Longtail_UnlockSpinLock(job_group->m_DependencyLinksLock);
+            return 0;
+        }
+        block->m_Next = job_group->m_DependencyLinks;
+        block->m_UsedCount = 0;
+        job_group->m_DependencyLinks = block;
+    }
+    struct DependencyLink* link = &block->m_Links[block->m_UsedCount++];
+    Longtail_UnlockSpinLock(job_group->m_DependencyLinksLock);
+    return link;
+}
+
+static int WorkStealing_AddDependecies(struct Longtail_JobAPI* job_api, uint32_t job_count, Longtail_JobAPI_Jobs jobs, uint32_t dependency_job_count, Longtail_JobAPI_Jobs dependency_jobs)
+{
+    struct WorkStealingJobAPI* work_stealing_job_api = (struct WorkStealingJobAPI*)job_api;
+    struct WorkStealingJob* work_stealing_jobs = (struct WorkStealingJob*)jobs;
+    struct WorkStealingJob* work_stealing_dependency_jobs = (struct WorkStealingJob*)dependency_jobs;
+
+    for (uint32_t d = 0; d < dependency_job_count; ++d)
+    {
+        struct WorkStealingJob* dependency_job = &work_stealing_dependency_jobs[d];
+        for (uint32_t j = 0; j < job_count; ++j)
+        {
+            struct WorkStealingJob* job = &work_stealing_jobs[j];
+            struct DependencyLink* link = WorkStealing_AllocDependencyLink(job->m_JobGroup);
+            if (!link)
+            {
+                LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "WorkStealing_AddDependecies(%p, %u, %p, %u, %p) failed with %d", job_api, job_count, jobs, dependency_job_count, dependency_jobs, ENOMEM)
+                return ENOMEM;
+            }
+            link->m_Job = job;
+            // Count the dependency before it is visible to the dependency job so its completion can't take the count below zero
+            Longtail_AtomicAdd32(&job->m_UnresolvedDependencyCount, 1);
+            int64_t dependents = dependency_job->m_Dependents;
+            while (dependents != WORK_STEALING_COMPLETED)
+            {
+                link->m_Next = (struct DependencyLink*)(uintptr_t)dependents;
+                int64_t current = Longtail_CompareAndSwap64(&dependency_job->m_Dependents, dependents, (int64_t)(uintptr_t)link);
+                if (current == dependents)
+                {
+                    break;
+                }
+                dependents = current;
+            }
+            if (dependents == WORK_STEALING_COMPLETED)
+            {
+                // The dependency has already completed, if it was the last one the job is ready to run
+                if (Longtail_AtomicAdd32(&job->m_UnresolvedDependencyCount, -1) == 0)
+                {
+                    WorkStealing_QueueJob(work_stealing_job_api, job, WORK_STEALING_ANY_QUEUE);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static int WorkStealing_ReadyJobs(struct Longtail_JobAPI* job_api, uint32_t job_count, Longtail_JobAPI_Jobs jobs)
+{
+    struct WorkStealingJobAPI* work_stealing_job_api = (struct WorkStealingJobAPI*)job_api;
+    struct WorkStealingJob* work_stealing_jobs = (struct WorkStealingJob*)jobs;
+    uint32_t queue_count = work_stealing_job_api->m_QueueCount;
+
+    // Deal the jobs out over the worker queues so no single queue becomes the point of contention
+    uint32_t start_index = WorkStealing_PickQueue(work_stealing_job_api);
+    uint32_t spread_count = job_count < queue_count ? job_count : queue_count;
+    for (uint32_t q = 0; q < spread_count; ++q)
+    {
+        uint32_t queue_job_count = (job_count - q + queue_count - 1) / queue_count;
+        WorkQueue_Push(&work_stealing_job_api->m_Queues[(start_index + q) % queue_count], queue_job_count, &work_stealing_jobs[q], queue_count);
+    }
+    WorkStealing_WakeWorkers(work_stealing_job_api, start_index, job_count);
+    return 0;
+}
+
+static int WorkStealing_WaitForAllJobs(struct Longtail_JobAPI* job_api, Longtail_JobAPI_Group job_group, void* context, Longtail_JobAPI_ProgressFunc process_func)
+{
+    struct WorkStealingJobAPI* work_stealing_job_api = (struct WorkStealingJobAPI*)job_api;
+    struct WorkStealingJobGroup* work_stealing_job_group = (struct WorkStealingJobGroup*)job_group;
+    uint64_t progress_interval_us = work_stealing_job_api->m_ProgressIntervalUS;
+    uint64_t next_progress_time_us = 0;
+    // If releasing our reference completes the group no job touches it anymore, otherwise the job
+    // that completes it posts m_JobsDoneSema exactly once
+    int last_job_posts = Longtail_AtomicAdd32(&work_stealing_job_group->m_PendingJobCount, -1) != 0;
+    int jobs_done_taken = 0;
+    while (work_stealing_job_group->m_PendingJobCount > 0)
+    {
+        if (process_func)
+        {
+            uint64_t now_us = Longtail_GetTimeUS();
+            if (now_us >= next_progress_time_us)
+            {
+                process_func(context, (uint32_t)work_stealing_job_group->m_ReservedJobCount, (uint32_t)work_stealing_job_group->m_JobsCompleted);
+                next_progress_time_us = now_us + progress_interval_us;
+            }
+        }
+        struct WorkStealingJob* job = WorkStealing_FindJob(work_stealing_job_api, WORK_STEALING_ANY_QUEUE);
+        if (job)
+        {
+            WorkStealing_ExecuteJob(work_stealing_job_api, job, WORK_STEALING_ANY_QUEUE);
+            continue;
+        }
+        uint64_t timeout_us = (process_func && progress_interval_us) ? progress_interval_us : LONGTAIL_TIMEOUT_INFINITE;
+        if (work_stealing_job_api->m_WorkerCount == 0)
+        {
+            // Without workers the waiting threads run all jobs, sleep until a job is queued or a group completes
+            Longtail_AtomicAdd32(&work_stealing_job_api->m_IdleWaiterCount, 1);
+            if (work_stealing_job_group->m_PendingJobCount > 0 && !WorkStealing_HasQueuedJobs(work_stealing_job_api))
+            {
+                Longtail_WaitSema(work_stealing_job_api->m_IdleWaiterSema, timeout_us);
+            }
+            Longtail_AtomicAdd32(&work_stealing_job_api->m_IdleWaiterCount, -1);
+            continue;
+        }
+        // Nothing we can run, sleep until the last pending job completes or it is time to report progress
+        if (Longtail_WaitSema(work_stealing_job_group->m_JobsDoneSema, timeout_us) == 0)
+        {
+            jobs_done_taken = 1;
+            break;
+        }
+    }
+    if (last_job_posts && !jobs_done_taken)
+    {
+        // The last job may still be on its way to the post, block until it is done with the group
+        Longtail_WaitSema(work_stealing_job_group->m_JobsDoneSema, LONGTAIL_TIMEOUT_INFINITE);
+    }
+    if (process_func)
+    {
+        process_func(context, (uint32_t)work_stealing_job_group->m_SubmittedJobCount, (uint32_t)work_stealing_job_group->m_SubmittedJobCount);
+    }
+    struct DependencyLinkBlock* block = work_stealing_job_group->m_DependencyLinks;
+    while (block)
+    {
+        struct DependencyLinkBlock* next_block = block->m_Next;
+        Longtail_Free(block);
+        block = next_block;
+    }
+    int err = 0;
+    if (work_stealing_job_group->m_CancelAPI)
+    {
+        err = work_stealing_job_group->m_CancelAPI->IsCancelled(work_stealing_job_group->m_CancelAPI, work_stealing_job_group->m_CancelToken);
+    }
+    Longtail_DeleteSema(work_stealing_job_group->m_JobsDoneSema);
+    Longtail_DeleteSpinLock(work_stealing_job_group->m_DependencyLinksLock);
+    Longtail_Free(work_stealing_job_group);
+    return err;
+}
+
+static void WorkStealing_DisposeQueues(struct WorkStealingJobAPI* job_api, uint32_t queue_count)
+{
+    for (uint32_t i = 0; i < queue_count; ++i)
+    {
+        WorkQueue_Dispose(&job_api->m_Queues[i]);
+    }
+    Longtail_DeleteSema(job_api->m_IdleWaiterSema);
+}
+
+// Stops and joins the first worker_count workers and deletes their wake semaphores
+static void WorkStealing_StopWorkers(struct WorkStealingJobAPI* job_api, uint32_t worker_count)
+{
+    Longtail_AtomicAdd32(&job_api->m_Stop, 1);
+    for (uint32_t i = 0; i < worker_count; ++i)
+    {
+        Longtail_PostSema(job_api->m_Workers[i].m_WakeSema, 1);
+    }
+    for (uint32_t i = 0; i < worker_count; ++i)
+    {
+        Longtail_JoinThread(job_api->m_Workers[i].m_Thread, LONGTAIL_TIMEOUT_INFINITE);
+        Longtail_DeleteThread(job_api->m_Workers[i].m_Thread);
+        Longtail_DeleteSema(job_api->m_Workers[i].m_WakeSema);
+    }
+}
+
+static void WorkStealing_Dispose(struct Longtail_API* job_api)
+{
+    struct WorkStealingJobAPI* work_stealing_job_api = (struct WorkStealingJobAPI*)job_api;
+    WorkStealing_StopWorkers(work_stealing_job_api, work_stealing_job_api->m_WorkerCount);
+    WorkStealing_DisposeQueues(work_stealing_job_api, work_stealing_job_api->m_QueueCount);
+    Longtail_Free(work_stealing_job_api);
+}
+
+static int WorkStealing_Init(struct WorkStealingJobAPI* job_api, uint32_t worker_count, void* p)
+{
+    job_api->m_WorkStealingAPI.m_API.Dispose = WorkStealing_Dispose;
+    job_api->m_WorkStealingAPI.GetWorkerCount = WorkStealing_GetWorkerCount;
+    job_api->m_WorkStealingAPI.ReserveJobs = WorkStealing_ReserveJobs;
+    job_api->m_WorkStealingAPI.CreateJobs = WorkStealing_CreateJobs;
+    job_api->m_WorkStealingAPI.AddDependecies = WorkStealing_AddDependecies;
+    job_api->m_WorkStealingAPI.ReadyJobs = WorkStealing_ReadyJobs;
+    job_api->m_WorkStealingAPI.WaitForAllJobs = WorkStealing_WaitForAllJobs;
+    job_api->m_WorkerCount = worker_count;
+    // Without workers the thread calling WaitForAllJobs runs all the jobs from a single queue
+    job_api->m_QueueCount = worker_count > 0 ? worker_count : 1;
+    job_api->m_IdleWorkerCount = 0;
+    job_api->m_IdleWaiterCount = 0;
+    job_api->m_NextQueue = 0;
+    job_api->m_Stop = 0;
+    job_api->m_ProgressIntervalUS = WORK_STEALING_PROGRESS_INTERVAL_US;
+
+    char* mem = (char*)p;
+    job_api->m_Queues = (struct WorkQueue*)mem;
+    mem += sizeof(struct WorkQueue) * job_api->m_QueueCount;
+    job_api->m_Workers = (struct WorkStealingWorker*)mem;
+    mem += sizeof(struct WorkStealingWorker) * worker_count;
+
+    int err = Longtail_CreateSema(mem, 0, &job_api->m_IdleWaiterSema);
+    if (err)
+    {
+        return err;
+    }
+    mem += Longtail_GetSemaSize();
+    for (uint32_t q = 0; q < job_api->m_QueueCount; ++q)
+    {
+        err = WorkQueue_Init(&job_api->m_Queues[q], mem);
+        if (err)
+        {
+            WorkStealing_DisposeQueues(job_api, q);
+            return err;
+        }
+        mem += Longtail_GetSpinLockSize();
+    }
+    for (uint32_t i = 0; i < worker_count; ++i)
+    {
+        struct WorkStealingWorker* worker = &job_api->m_Workers[i];
+        worker->m_JobAPI = job_api;
+        worker->m_QueueIndex = i;
+        worker->m_IsIdle = 0;
+        err = Longtail_CreateSema(mem, 0, &worker->m_WakeSema);
+        if (err)
+        {
+            WorkStealing_StopWorkers(job_api, i);
+            WorkStealing_DisposeQueues(job_api, job_api->m_QueueCount);
+            return err;
+        }
+        mem += Longtail_GetSemaSize();
+        err = Longtail_CreateThread(mem, WorkStealingWorker_Execute, 0, worker, &worker->m_Thread);
+        if (err)
+        {
+            Longtail_DeleteSema(worker->m_WakeSema);
+            WorkStealing_StopWorkers(job_api, i);
+            WorkStealing_DisposeQueues(job_api, job_api->m_QueueCount);
+            return err;
+        }
+        mem += Longtail_GetThreadSize();
+    }
+    return 0;
+}
+
+struct Longtail_JobAPI* Longtail_CreateWorkStealingJobAPI(uint32_t worker_count)
+{
+    uint32_t queue_count = worker_count > 0 ? worker_count : 1;
+    size_t job_api_size = sizeof(struct WorkStealingJobAPI) +
+        sizeof(struct WorkQueue) * queue_count +
+        sizeof(struct WorkStealingWorker) * worker_count +
+        Longtail_GetSemaSize() +
+        Longtail_GetSpinLockSize() * queue_count +
+        (Longtail_GetSemaSize() + Longtail_GetThreadSize()) * worker_count;
+    struct WorkStealingJobAPI* job_api = (struct WorkStealingJobAPI*)Longtail_Alloc(job_api_size);
+    if (!job_api)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_CreateWorkStealingJobAPI(%u) failed with %d", worker_count, ENOMEM)
+        return 0;
+    }
+    int err = WorkStealing_Init(job_api, worker_count, &job_api[1]);
+    if (err)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_CreateWorkStealingJobAPI(%u) failed with %d", worker_count, err)
+        Longtail_Free(job_api);
+        return 0;
+    }
+    return &job_api->m_WorkStealingAPI;
+}
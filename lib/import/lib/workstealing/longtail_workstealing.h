@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Job API where every worker has its own job queue and steals from the other workers when it runs dry.
+// Jobs on all channels are run by the same workers.
+extern struct Longtail_JobAPI* Longtail_CreateWorkStealingJobAPI(uint32_t worker_count);
+
+#ifdef __cplusplus
+}
+#endif
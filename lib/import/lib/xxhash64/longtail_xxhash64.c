@@ -0,0 +1,94 @@
+#include "longtail_xxhash64.h"
+
+#include "../../src/longtail.h"
+
+#include <errno.h>
+
+#define XXH_PRIVATE_API
+#include "../lizard/ext/xxhash/xxhash.h"
+
+const uint32_t LONGTAIL_XXHASH64_HASH_TYPE = (((uint32_t)'x') << 24) + (((uint32_t)'x') << 16) + (((uint32_t)'6') << 8) + ((uint32_t)'4');
+
+struct XXHash64HashAPI
+{
+    struct Longtail_HashAPI m_XXHash64HashAPI;
+};
+
+static uint32_t XXHash64Hash_GetIdentifier(struct Longtail_HashAPI* hash_api)
+{
+    return LONGTAIL_XXHASH64_HASH_TYPE;
+}
+
+static uint32_t XXHash64Hash_GetContextSize(struct Longtail_HashAPI* hash_api)
+{
+    return (uint32_t)sizeof(XXH64_state_t);
+}
+
+static int XXHash64Hash_BeginContextInPlace(struct Longtail_HashAPI* hash_api, void* context_memory, Longtail_HashAPI_HContext* out_context)
+{
+    XXH64_state_t* state = (XXH64_state_t*)context_memory;
+    XXH64_reset(state, 0);
+    *out_context = (Longtail_HashAPI_HContext)state;
+    return 0;
+}
+
+static uint64_t XXHash64Hash_EndContextInPlace(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext context)
+{
+    XXH64_state_t* state = (XXH64_state_t*)context;
+    return (uint64_t)XXH64_digest(state);
+}
+
+static int XXHash64Hash_BeginContext(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext* out_context)
+{
+    XXH64_state_t* state = (XXH64_state_t*)Longtail_Alloc(sizeof(XXH64_state_t));
+    if (!state)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "XXHash64Hash_BeginContext(%p, %p) failed with %d", hash_api, out_context, ENOMEM)
+        return ENOMEM;
+    }
+    return XXHash64Hash_BeginContextInPlace(hash_api, state, out_context);
+}
+
+static void XXHash64Hash_Hash(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext context, uint32_t length, const void* data)
+{
+    XXH64_state_t* state = (XXH64_state_t*)context;
+    XXH64_update(state, data, (size_t)length);
+}
+
+static uint64_t XXHash64Hash_EndContext(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext context)
+{
+    uint64_t hash = XXHash64Hash_EndContextInPlace(hash_api, context);
+    Longtail_Free(context);
+    return hash;
+}
+
+static int XXHash64Hash_HashBuffer(struct Longtail_HashAPI* hash_api, uint32_t length, const void* data, uint64_t* out_hash)
+{
+    *out_hash = (uint64_t)XXH64(data, (size_t)length, 0);
+    return 0;
+}
+
+static void XXHash64Hash_Dispose(struct Longtail_API* hash_api)
+{
+    Longtail_Free(hash_api);
+}
+
+static void XXHash64Hash_Init(struct XXHash64HashAPI* hash_api)
+{
+    hash_api->m_XXHash64HashAPI.m_API.Dispose = XXHash64Hash_Dispose;
+    hash_api->m_XXHash64HashAPI.GetIdentifier = XXHash64Hash_GetIdentifier;
+    hash_api->m_XXHash64HashAPI.BeginContext = XXHash64Hash_BeginContext;
+    hash_api->m_XXHash64HashAPI.Hash = XXHash64Hash_Hash;
+    hash_api->m_XXHash64HashAPI.EndContext = XXHash64Hash_EndContext;
+    hash_api->m_XXHash64HashAPI.HashBuffer = XXHash64Hash_HashBuffer;
+    hash_api->m_XXHash64HashAPI.GetContextSize = XXHash64Hash_GetContextSize;
+    hash_api->m_XXHash64HashAPI.BeginContextInPlace = XXHash64Hash_BeginContextInPlace;
+    hash_api->m_XXHash64HashAPI.EndContextInPlace = XXHash64Hash_EndContextInPlace;
+}
+
+struct Longtail_HashAPI* Longtail_CreateXXHash64HashAPI()
+{
+    struct XXHash64HashAPI* xxhash64_hash = (struct XXHash64HashAPI*)Longtail_Alloc(sizeof(struct XXHash64HashAPI));
+    XXHash64Hash_Init(xxhash64_hash);
+    return &xxhash64_hash->m_XXHash64HashAPI;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern struct Longtail_HashAPI* Longtail_CreateXXHash64HashAPI();
+extern const uint32_t LONGTAIL_XXHASH64_HASH_TYPE;
+
+#ifdef __cplusplus
+}
+#endif
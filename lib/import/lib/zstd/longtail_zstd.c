@@ -1,9 +1,12 @@
 #include "longtail_zstd.h"
 
+#include "../longtail_platform.h"
+#define ZSTD_STATIC_LINKING_ONLY
 #include "ext/zstd.h"
 #include "ext/common/zstd_errors.h"
 
 #include <errno.h>
+#include <string.h>
 
 
 const uint32_t LONGTAIL_ZSTD_MIN_COMPRESSION_LEVEL      = 0;
@@ -14,25 +17,284 @@ Longtail_CompressionAPI_HSettings LONGTAIL_ZSTD_MIN_COMPRESSION        =(Longtai
 Longtail_CompressionAPI_HSettings LONGTAIL_ZSTD_DEFAULT_COMPRESSION    =(Longtail_CompressionAPI_HSettings)&LONGTAIL_ZSTD_DEFAULT_COMPRESSION_LEVEL;
 Longtail_CompressionAPI_HSettings LONGTAIL_ZSTD_MAX_COMPRESSION        =(Longtail_CompressionAPI_HSettings)&LONGTAIL_ZSTD_MAX_COMPRESSION_LEVEL;
 
+#define LONGTAIL_ZSTD_MAX_POOLED_CONTEXTS 64
+#define LONGTAIL_ZSTD_MAX_LEVEL 22
+#define LONGTAIL_ZSTD_DICTIONARY_ID_SIZE 4
+#define LONGTAIL_ZSTD_MIN_JOB_SIZE (512 * 1024)
+#define LONGTAIL_ZSTD_MIN_DICTIONARY_SAMPLE_SIZE 64
+
+// Deleted contexts are kept in a pool so each worker thread effectively keeps its own
+// ZSTD_CCtx/ZSTD_DCtx alive across blocks instead of setting one up per block
 struct ZStdCompressionAPI
 {
     struct Longtail_CompressionAPI m_ZStdCompressionAPI;
+    HLongtail_SpinLock m_SpinLock;
+    uint32_t m_CCtxCount;
+    uint32_t m_DCtxCount;
+    ZSTD_CCtx* m_CCtxs[LONGTAIL_ZSTD_MAX_POOLED_CONTEXTS];
+    ZSTD_DCtx* m_DCtxs[LONGTAIL_ZSTD_MAX_POOLED_CONTEXTS];
+
+    // Only set for instances created with Longtail_CreateZStdDictionaryCompressionAPI
+    // Compressed data is prefixed with m_DictionaryId so blocks compressed against
+    // another dictionary are rejected instead of decoded into garbage
+    const void* m_Dictionary;
+    size_t m_DictionarySize;
+    uint32_t m_DictionaryId;
+    ZSTD_DDict* m_DDict;
+    ZSTD_CDict* m_CDicts[LONGTAIL_ZSTD_MAX_LEVEL + 1];
 };
 
+static uint32_t fnv1a(const void* data, size_t numBytes)
+{
+    uint32_t hash = 0x811C9DC5;
+    const unsigned char* p = (const unsigned char*)data;
+    while (numBytes--)
+    {
+        hash = (*p++ ^ hash) * 0x01000193;
+    }
+    return hash;
+}
+
 void ZStdCompressionAPI_Dispose(struct Longtail_API* compression_api)
 {
+    struct ZStdCompressionAPI* zstd_compression_api = (struct ZStdCompressionAPI*)compression_api;
+    while (zstd_compression_api->m_CCtxCount)
+    {
+        ZSTD_freeCCtx(zstd_compression_api->m_CCtxs[--zstd_compression_api->m_CCtxCount]);
+    }
+    while (zstd_compression_api->m_DCtxCount)
+    {
+        ZSTD_freeDCtx(zstd_compression_api->m_DCtxs[--zstd_compression_api->m_DCtxCount]);
+    }
+    for (uint32_t l = 0; l <= LONGTAIL_ZSTD_MAX_LEVEL; ++l)
+    {
+        ZSTD_freeCDict(zstd_compression_api->m_CDicts[l]);
+    }
+    ZSTD_freeDDict(zstd_compression_api->m_DDict);
+    Longtail_DeleteSpinLock(zstd_compression_api->m_SpinLock);
     Longtail_Free(compression_api);
 }
 
 static size_t ZStdCompressionAPI_GetMaxCompressedSize(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HSettings settings, size_t size)
 {
-    return ZSTD_COMPRESSBOUND(size);
+    struct ZStdCompressionAPI* zstd_compression_api = (struct ZStdCompressionAPI*)compression_api;
+    return ZSTD_COMPRESSBOUND(size) + (zstd_compression_api->m_DDict ? LONGTAIL_ZSTD_DICTIONARY_ID_SIZE : 0);
+}
+
+static int ZStdCompressionAPI_CreateCompressionContext(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HSettings settings, Longtail_CompressionAPI_HCompressionContext* out_context)
+{
+    struct ZStdCompressionAPI* zstd_compression_api = (struct ZStdCompressionAPI*)compression_api;
+    ZSTD_CCtx* cctx = 0;
+    Longtail_LockSpinLock(zstd_compression_api->m_SpinLock);
+    if (zstd_compression_api->m_CCtxCount)
+    {
+        cctx = zstd_compression_api->m_CCtxs[--zstd_compression_api->m_CCtxCount];
+    }
+    Longtail_UnlockSpinLock(zstd_compression_api->m_SpinLock);
+    if (!cctx)
+    {
+        cctx = ZSTD_createCCtx();
+        if (!cctx)
+        {
+            return ENOMEM;
+        }
+    }
+    *out_context = (Longtail_CompressionAPI_HCompressionContext)cctx;
+    return 0;
+}
+
+static void ZStdCompressionAPI_DeleteCompressionContext(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HCompressionContext context)
+{
+    struct ZStdCompressionAPI* zstd_compression_api = (struct ZStdCompressionAPI*)compression_api;
+    ZSTD_CCtx* cctx = (ZSTD_CCtx*)context;
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, 0);
+    Longtail_LockSpinLock(zstd_compression_api->m_SpinLock);
+    if (zstd_compression_api->m_CCtxCount < LONGTAIL_ZSTD_MAX_POOLED_CONTEXTS)
+    {
+        zstd_compression_api->m_CCtxs[zstd_compression_api->m_CCtxCount++] = cctx;
+        cctx = 0;
+    }
+    Longtail_UnlockSpinLock(zstd_compression_api->m_SpinLock);
+    ZSTD_freeCCtx(cctx);
+}
+
+// Only has an effect if zstd is built with ZSTD_MULTITHREAD, otherwise fails with ENOTSUP
+static int ZStdCompressionAPI_SetCompressionWorkerCount(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HCompressionContext context, uint32_t worker_count)
+{
+    size_t result = ZSTD_CCtx_setParameter((ZSTD_CCtx*)context, ZSTD_c_nbWorkers, worker_count > 1 ? (int)worker_count : 0);
+    if (ZSTD_isError(result))
+    {
+        return ENOTSUP;
+    }
+    return 0;
+}
+
+static int ZStdCompressionAPI_CreateDecompressionContext(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HDecompressionContext* out_context)
+{
+    struct ZStdCompressionAPI* zstd_compression_api = (struct ZStdCompressionAPI*)compression_api;
+    ZSTD_DCtx* dctx = 0;
+    Longtail_LockSpinLock(zstd_compression_api->m_SpinLock);
+    if (zstd_compression_api->m_DCtxCount)
+    {
+        dctx = zstd_compression_api->m_DCtxs[--zstd_compression_api->m_DCtxCount];
+    }
+    Longtail_UnlockSpinLock(zstd_compression_api->m_SpinLock);
+    if (!dctx)
+    {
+        dctx = ZSTD_createDCtx();
+        if (!dctx)
+        {
+            return ENOMEM;
+        }
+    }
+    *out_context = (Longtail_CompressionAPI_HDecompressionContext)dctx;
+    return 0;
+}
+
+static void ZStdCompressionAPI_DeleteDecompressionContext(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HDecompressionContext context)
+{
+    struct ZStdCompressionAPI* zstd_compression_api = (struct ZStdCompressionAPI*)compression_api;
+    ZSTD_DCtx* dctx = (ZSTD_DCtx*)context;
+    Longtail_LockSpinLock(zstd_compression_api->m_SpinLock);
+    if (zstd_compression_api->m_DCtxCount < LONGTAIL_ZSTD_MAX_POOLED_CONTEXTS)
+    {
+        zstd_compression_api->m_DCtxs[zstd_compression_api->m_DCtxCount++] = dctx;
+        dctx = 0;
+    }
+    Longtail_UnlockSpinLock(zstd_compression_api->m_SpinLock);
+    ZSTD_freeDCtx(dctx);
+}
+
+static ZSTD_CDict* ZStdCompressionAPI_GetCDict(struct ZStdCompressionAPI* zstd_compression_api, int compression_level)
+{
+    uint32_t level = (compression_level <= 0) ? 0 : (compression_level > LONGTAIL_ZSTD_MAX_LEVEL) ? LONGTAIL_ZSTD_MAX_LEVEL : (uint32_t)compression_level;
+    Longtail_LockSpinLock(zstd_compression_api->m_SpinLock);
+    ZSTD_CDict* cdict = zstd_compression_api->m_CDicts[level];
+    Longtail_UnlockSpinLock(zstd_compression_api->m_SpinLock);
+    if (cdict)
+    {
+        return cdict;
+    }
+    cdict = ZSTD_createCDict(zstd_compression_api->m_Dictionary, zstd_compression_api->m_DictionarySize, compression_level);
+    if (!cdict)
+    {
+        return 0;
+    }
+    Longtail_LockSpinLock(zstd_compression_api->m_SpinLock);
+    if (zstd_compression_api->m_CDicts[level])
+    {
+        ZSTD_freeCDict(cdict);
+        cdict = zstd_compression_api->m_CDicts[level];
+    }
+    else
+    {
+        zstd_compression_api->m_CDicts[level] = cdict;
+    }
+    Longtail_UnlockSpinLock(zstd_compression_api->m_SpinLock);
+    return cdict;
 }
 
-int ZStdCompressionAPI_Compress(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HSettings settings, const char* uncompressed, char* compressed, size_t uncompressed_size, size_t max_compressed_size, size_t* out_compressed_size)
+static int ZStdCompressionAPI_CompressWithDictionary(struct ZStdCompressionAPI* zstd_compression_api, ZSTD_CCtx* cctx, int compression_level, const char* uncompressed, char* compressed, size_t uncompressed_size, size_t max_compressed_size, size_t* out_compressed_size)
 {
+    if (max_compressed_size < LONGTAIL_ZSTD_DICTIONARY_ID_SIZE)
+    {
+        return EINVAL;
+    }
+    ZSTD_CDict* cdict = ZStdCompressionAPI_GetCDict(zstd_compression_api, compression_level);
+    if (!cdict)
+    {
+        return ENOMEM;
+    }
+    memcpy(compressed, &zstd_compression_api->m_DictionaryId, LONGTAIL_ZSTD_DICTIONARY_ID_SIZE);
+    size_t size = ZSTD_compress_usingCDict(cctx, &compressed[LONGTAIL_ZSTD_DICTIONARY_ID_SIZE], max_compressed_size - LONGTAIL_ZSTD_DICTIONARY_ID_SIZE, uncompressed, uncompressed_size, cdict);
+    if (ZSTD_isError(size))
+    {
+        return EINVAL;
+    }
+    *out_compressed_size = LONGTAIL_ZSTD_DICTIONARY_ID_SIZE + size;
+    return 0;
+}
+
+static int ZStdCompressionAPI_DecompressWithDictionary(struct ZStdCompressionAPI* zstd_compression_api, ZSTD_DCtx* dctx, const char* compressed, char* uncompressed, size_t compressed_size, size_t max_uncompressed_size, size_t* out_uncompressed_size)
+{
+    uint32_t dictionary_id;
+    if (compressed_size < LONGTAIL_ZSTD_DICTIONARY_ID_SIZE)
+    {
+        return EBADF;
+    }
+    memcpy(&dictionary_id, compressed, LONGTAIL_ZSTD_DICTIONARY_ID_SIZE);
+    if (dictionary_id != zstd_compression_api->m_DictionaryId)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_WARNING, "ZStdCompressionAPI_DecompressWithDictionary: data compressed with dictionary %08x, expected %08x", dictionary_id, zstd_compression_api->m_DictionaryId)
+        return EBADF;
+    }
+    size_t size = ZSTD_decompress_usingDDict(dctx, uncompressed, max_uncompressed_size, &compressed[LONGTAIL_ZSTD_DICTIONARY_ID_SIZE], compressed_size - LONGTAIL_ZSTD_DICTIONARY_ID_SIZE, zstd_compression_api->m_DDict);
+    if (ZSTD_isError(size))
+    {
+        return EINVAL;
+    }
+    *out_uncompressed_size = size;
+    return 0;
+}
+
+// Splits the input in jobs so every worker gets a share, the default job size for the
+// higher compression levels is larger than a typical block
+static int ZStdCompressionAPI_CompressMultithreaded(ZSTD_CCtx* cctx, int worker_count, int compression_level, const char* uncompressed, char* compressed, size_t uncompressed_size, size_t max_compressed_size, size_t* out_compressed_size)
+{
+    size_t job_size = uncompressed_size / (size_t)worker_count;
+    if (job_size < LONGTAIL_ZSTD_MIN_JOB_SIZE)
+    {
+        job_size = LONGTAIL_ZSTD_MIN_JOB_SIZE;
+    }
+    size_t result = ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, compression_level);
+    if (!ZSTD_isError(result))
+    {
+        result = ZSTD_CCtx_setParameter(cctx, ZSTD_c_jobSize, (int)job_size);
+    }
+    if (ZSTD_isError(result))
+    {
+        return EINVAL;
+    }
+    size_t size = ZSTD_compress2(cctx, compressed, max_compressed_size, uncompressed, uncompressed_size);
+    if (ZSTD_isError(size))
+    {
+        return EINVAL;
+    }
+    *out_compressed_size = size;
+    return 0;
+}
+
+int ZStdCompressionAPI_Compress(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HCompressionContext context, Longtail_CompressionAPI_HSettings settings, const char* uncompressed, char* compressed, size_t uncompressed_size, size_t max_compressed_size, size_t* out_compressed_size)
+{
+    struct ZStdCompressionAPI* zstd_compression_api = (struct ZStdCompressionAPI*)compression_api;
     int compression_level = *(int*)settings;
-    size_t size = ZSTD_compress( compressed, max_compressed_size, uncompressed, uncompressed_size, compression_level);
+    if (zstd_compression_api->m_DDict)
+    {
+        if (context)
+        {
+            return ZStdCompressionAPI_CompressWithDictionary(zstd_compression_api, (ZSTD_CCtx*)context, compression_level, uncompressed, compressed, uncompressed_size, max_compressed_size, out_compressed_size);
+        }
+        int err = ZStdCompressionAPI_CreateCompressionContext(compression_api, settings, &context);
+        if (err)
+        {
+            return err;
+        }
+        err = ZStdCompressionAPI_CompressWithDictionary(zstd_compression_api, (ZSTD_CCtx*)context, compression_level, uncompressed, compressed, uncompressed_size, max_compressed_size, out_compressed_size);
+        ZStdCompressionAPI_DeleteCompressionContext(compression_api, context);
+        return err;
+    }
+    int worker_count = 0;
+    if (context)
+    {
+        ZSTD_CCtx_getParameter((ZSTD_CCtx*)context, ZSTD_c_nbWorkers, &worker_count);
+    }
+    if (worker_count > 0)
+    {
+        return ZStdCompressionAPI_CompressMultithreaded((ZSTD_CCtx*)context, worker_count, compression_level, uncompressed, compressed, uncompressed_size, max_compressed_size, out_compressed_size);
+    }
+    size_t size = context ?
+        ZSTD_compressCCtx((ZSTD_CCtx*)context, compressed, max_compressed_size, uncompressed, uncompressed_size, compression_level) :
+        ZSTD_compress( compressed, max_compressed_size, uncompressed, uncompressed_size, compression_level);
     if (ZSTD_isError(size))
     {
         return EINVAL;
@@ -42,9 +304,27 @@ int ZStdCompressionAPI_Compress(struct Longtail_CompressionAPI* compression_api,
 }
 
 
-int ZStdCompressionAPI_Decompress(struct Longtail_CompressionAPI* compression_api, const char* compressed, char* uncompressed, size_t compressed_size, size_t max_uncompressed_size, size_t* out_uncompressed_size)
+int ZStdCompressionAPI_Decompress(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HDecompressionContext context, const char* compressed, char* uncompressed, size_t compressed_size, size_t max_uncompressed_size, size_t* out_uncompressed_size)
 {
-    size_t size = ZSTD_decompress( uncompressed, max_uncompressed_size, compressed, compressed_size);
+    struct ZStdCompressionAPI* zstd_compression_api = (struct ZStdCompressionAPI*)compression_api;
+    if (zstd_compression_api->m_DDict)
+    {
+        if (context)
+        {
+            return ZStdCompressionAPI_DecompressWithDictionary(zstd_compression_api, (ZSTD_DCtx*)context, compressed, uncompressed, compressed_size, max_uncompressed_size, out_uncompressed_size);
+        }
+        int err = ZStdCompressionAPI_CreateDecompressionContext(compression_api, &context);
+        if (err)
+        {
+            return err;
+        }
+        err = ZStdCompressionAPI_DecompressWithDictionary(zstd_compression_api, (ZSTD_DCtx*)context, compressed, uncompressed, compressed_size, max_uncompressed_size, out_uncompressed_size);
+        ZStdCompressionAPI_DeleteDecompressionContext(compression_api, context);
+        return err;
+    }
+    size_t size = context ?
+        ZSTD_decompressDCtx((ZSTD_DCtx*)context, uncompressed, max_uncompressed_size, compressed, compressed_size) :
+        ZSTD_decompress( uncompressed, max_uncompressed_size, compressed, compressed_size);
     if (ZSTD_isError(size))
     {
         return EINVAL;
@@ -53,17 +333,133 @@ int ZStdCompressionAPI_Decompress(struct Longtail_CompressionAPI* compression_ap
     return 0;
 }
 
-static void ZStdCompressionAPI_Init(struct ZStdCompressionAPI* compression_api)
+static int ZStdCompressionAPI_Init(struct ZStdCompressionAPI* compression_api)
 {
     compression_api->m_ZStdCompressionAPI.m_API.Dispose = ZStdCompressionAPI_Dispose;
     compression_api->m_ZStdCompressionAPI.GetMaxCompressedSize = ZStdCompressionAPI_GetMaxCompressedSize;
+    compression_api->m_ZStdCompressionAPI.CreateCompressionContext = ZStdCompressionAPI_CreateCompressionContext;
+    compression_api->m_ZStdCompressionAPI.DeleteCompressionContext = ZStdCompressionAPI_DeleteCompressionContext;
+    compression_api->m_ZStdCompressionAPI.CreateDecompressionContext = ZStdCompressionAPI_CreateDecompressionContext;
+    compression_api->m_ZStdCompressionAPI.DeleteDecompressionContext = ZStdCompressionAPI_DeleteDecompressionContext;
+    compression_api->m_ZStdCompressionAPI.SetCompressionWorkerCount = ZStdCompressionAPI_SetCompressionWorkerCount;
     compression_api->m_ZStdCompressionAPI.Compress = ZStdCompressionAPI_Compress;
     compression_api->m_ZStdCompressionAPI.Decompress = ZStdCompressionAPI_Decompress;
+    compression_api->m_CCtxCount = 0;
+    compression_api->m_DCtxCount = 0;
+    compression_api->m_Dictionary = 0;
+    compression_api->m_DictionarySize = 0;
+    compression_api->m_DictionaryId = 0;
+    compression_api->m_DDict = 0;
+    for (uint32_t l = 0; l <= LONGTAIL_ZSTD_MAX_LEVEL; ++l)
+    {
+        compression_api->m_CDicts[l] = 0;
+    }
+    return Longtail_CreateSpinLock(&compression_api[1], &compression_api->m_SpinLock);
 }
 
 struct Longtail_CompressionAPI* Longtail_CreateZStdCompressionAPI()
 {
-    struct ZStdCompressionAPI* compression_api = (struct ZStdCompressionAPI*)Longtail_Alloc(sizeof(struct ZStdCompressionAPI));
-    ZStdCompressionAPI_Init(compression_api);
+    struct ZStdCompressionAPI* compression_api = (struct ZStdCompressionAPI*)Longtail_Alloc(sizeof(struct ZStdCompressionAPI) + Longtail_GetSpinLockSize());
+    int err = ZStdCompressionAPI_Init(compression_api);
+    if (err)
+    {
+        Longtail_Free(compression_api);
+        return 0;
+    }
     return &compression_api->m_ZStdCompressionAPI;
 }
+
+struct Longtail_CompressionAPI* Longtail_CreateZStdDictionaryCompressionAPI(const void* dictionary, size_t dictionary_size)
+{
+    LONGTAIL_FATAL_ASSERT(dictionary != 0, return 0)
+    LONGTAIL_FATAL_ASSERT(dictionary_size > 0, return 0)
+    size_t spin_lock_size = Longtail_GetSpinLockSize();
+    size_t api_size = sizeof(struct ZStdCompressionAPI) + spin_lock_size + dictionary_size;
+    struct ZStdCompressionAPI* compression_api = (struct ZStdCompressionAPI*)Longtail_Alloc(api_size);
+    int err = ZStdCompressionAPI_Init(compression_api);
+    if (err)
+    {
+        Longtail_Free(compression_api);
+        return 0;
+    }
+    void* dictionary_copy = &((char*)&compression_api[1])[spin_lock_size];
+    memcpy(dictionary_copy, dictionary, dictionary_size);
+    compression_api->m_Dictionary = dictionary_copy;
+    compression_api->m_DictionarySize = dictionary_size;
+    compression_api->m_DictionaryId = Longtail_GetZStdDictionaryId(dictionary, dictionary_size);
+    compression_api->m_DDict = ZSTD_createDDict(dictionary_copy, dictionary_size);
+    if (!compression_api->m_DDict)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_WARNING, "Longtail_CreateZStdDictionaryCompressionAPI: failed to load dictionary of size %u", (uint32_t)dictionary_size)
+        ZStdCompressionAPI_Dispose(&compression_api->m_ZStdCompressionAPI.m_API);
+        return 0;
+    }
+    return &compression_api->m_ZStdCompressionAPI;
+}
+
+uint32_t Longtail_GetZStdDictionaryId(const void* dictionary, size_t dictionary_size)
+{
+    return fnv1a(dictionary, dictionary_size);
+}
+
+int Longtail_TrainZStdDictionary(
+    const void* samples_buffer,
+    const size_t* sample_sizes,
+    uint32_t sample_count,
+    size_t max_dictionary_size,
+    void* out_dictionary_buffer,
+    size_t* out_dictionary_size)
+{
+    LONGTAIL_FATAL_ASSERT(samples_buffer != 0, return EINVAL)
+    LONGTAIL_FATAL_ASSERT(sample_sizes != 0, return EINVAL)
+    LONGTAIL_FATAL_ASSERT(out_dictionary_buffer != 0, return EINVAL)
+    LONGTAIL_FATAL_ASSERT(out_dictionary_size != 0, return EINVAL)
+    if (sample_count == 0 || max_dictionary_size < LONGTAIL_ZSTD_MIN_DICTIONARY_SAMPLE_SIZE)
+    {
+        return EINVAL;
+    }
+
+    // The zdict trainer is not part of our zstd import so we build a raw content
+    // dictionary, zstd uses it as history that every frame can reference.
+    // Spread the budget evenly over the samples, each sample contributes its head
+    // which is where the shared boilerplate of small structured files tends to be.
+    // With more samples than fit we take every n-th sample.
+    uint32_t max_sample_count = (uint32_t)(max_dictionary_size / LONGTAIL_ZSTD_MIN_DICTIONARY_SAMPLE_SIZE);
+    uint32_t stride = (sample_count + max_sample_count - 1) / max_sample_count;
+    uint32_t used_sample_count = (sample_count + stride - 1) / stride;
+    size_t sample_budget = max_dictionary_size / used_sample_count;
+
+    const char* sample_ptr = (const char*)samples_buffer;
+    char* dictionary_ptr = (char*)out_dictionary_buffer;
+    size_t dictionary_size = 0;
+    uint32_t last_sample_hash = 0;
+    for (uint32_t s = 0; s < sample_count; ++s)
+    {
+        const char* sample = sample_ptr;
+        size_t sample_size = sample_sizes[s];
+        sample_ptr += sample_size;
+        if ((s % stride) != 0 || sample_size == 0)
+        {
+            continue;
+        }
+        size_t size = sample_size < sample_budget ? sample_size : sample_budget;
+        if (size > max_dictionary_size - dictionary_size)
+        {
+            size = max_dictionary_size - dictionary_size;
+        }
+        uint32_t sample_hash = fnv1a(sample, size);
+        if (dictionary_size > 0 && sample_hash == last_sample_hash)
+        {
+            continue;
+        }
+        last_sample_hash = sample_hash;
+        memcpy(&dictionary_ptr[dictionary_size], sample, size);
+        dictionary_size += size;
+    }
+    if (dictionary_size < LONGTAIL_ZSTD_MIN_DICTIONARY_SAMPLE_SIZE)
+    {
+        return EINVAL;
+    }
+    *out_dictionary_size = dictionary_size;
+    return 0;
+}
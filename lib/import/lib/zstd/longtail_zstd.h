@@ -11,6 +11,23 @@ extern Longtail_CompressionAPI_HSettings LONGTAIL_ZSTD_MIN_COMPRESSION;
 extern Longtail_CompressionAPI_HSettings LONGTAIL_ZSTD_DEFAULT_COMPRESSION;
 extern Longtail_CompressionAPI_HSettings LONGTAIL_ZSTD_MAX_COMPRESSION;
 
+// Same compression settings as Longtail_CreateZStdCompressionAPI but all data is compressed against
+// `dictionary` which is copied. Compressed data is tagged with Longtail_GetZStdDictionaryId() of the
+// dictionary and decompressing data tagged with another id fails with EBADF
+extern struct Longtail_CompressionAPI* Longtail_CreateZStdDictionaryCompressionAPI(const void* dictionary, size_t dictionary_size);
+extern uint32_t Longtail_GetZStdDictionaryId(const void* dictionary, size_t dictionary_size);
+
+// Builds a dictionary of at most `max_dictionary_size` bytes from `sample_count` samples stored
+// back to back in `samples_buffer`, typically a selection of chunks from a content store.
+// Returns EINVAL if the samples are too few or too small to be useful
+extern int Longtail_TrainZStdDictionary(
+    const void* samples_buffer,
+    const size_t* sample_sizes,
+    uint32_t sample_count,
+    size_t max_dictionary_size,
+    void* out_dictionary_buffer,
+    size_t* out_dictionary_size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,2 +1,6 @@
+#include "../longtail.h"
+
+#define STBDS_REALLOC(context,ptr,size) Longtail_STBRealloc(context,ptr,size)
+#define STBDS_FREE(context,ptr)         Longtail_STBFree(context,ptr)
 #define STB_DS_IMPLEMENTATION
 #include "stb_ds.h"
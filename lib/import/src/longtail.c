@@ -4,9 +4,12 @@
 #define __USE_GNU
 #endif
 
+#define STBDS_REALLOC(context,ptr,size) Longtail_STBRealloc(context,ptr,size)
+#define STBDS_FREE(context,ptr)         Longtail_STBFree(context,ptr)
 #include "ext/stb_ds.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <inttypes.h>
 #include <stdarg.h>
 #include <errno.h>
@@ -45,6 +48,14 @@ void Longtail_NukeFree(void* p);
     #endif
 #endif
 
+// Evaluates to the value after the add
+#if defined(_WIN32)
+    #include <intrin.h>
+    #define ATOMICADD32(value, amount) (_InterlockedExchangeAdd((long volatile*)(value), (long)(amount)) + (amount))
+#else
+    #define ATOMICADD32(value, amount) (__sync_fetch_and_add((value), (amount)) + (amount))
+#endif
+
 Longtail_Assert Longtail_Assert_private = 0;
 
 void Longtail_SetAssert(Longtail_Assert assert_func)
@@ -73,16 +84,213 @@ void Longtail_SetAllocAndFree(Longtail_Alloc_Func alloc, Longtail_Free_Func Long
     Free_private = Longtail_Free;
 }
 
-void* Longtail_Alloc(size_t s)
+static struct Longtail_AllocatorAPI* Longtail_AllocatorAPI_private = 0;
+// Allocations that must go back to the allocator that is set, switching allocators while any are alive would free
+// them with the wrong one
+static int32_t volatile Longtail_LiveAllocationCount_private = 0;
+
+int Longtail_SetAllocatorAPI(struct Longtail_AllocatorAPI* allocator_api)
+{
+    int32_t live_allocation_count = ATOMICADD32(&Longtail_LiveAllocationCount_private, 0);
+    if (live_allocation_count != 0)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_SetAllocatorAPI(%p) failed with %d, %d allocations are still alive", allocator_api, EBUSY, live_allocation_count)
+        return EBUSY;
+    }
+    Longtail_AllocatorAPI_private = allocator_api;
+    return 0;
+}
+
+static struct Longtail_MemTrackerAPI* Longtail_MemTrackerAPI_private = 0;
+// Bumped each time a tracker is set so allocations reported to a previous tracker are not freed from the current one
+static int32_t volatile Longtail_MemTrackerGeneration_private = 0;
+
+void Longtail_SetMemTrackerAPI(struct Longtail_MemTrackerAPI* mem_tracker_api)
 {
+    if (mem_tracker_api)
+    {
+        (void)ATOMICADD32(&Longtail_MemTrackerGeneration_private, 1);
+    }
+    Longtail_MemTrackerAPI_private = mem_tracker_api;
+}
+
+struct Longtail_MemTrackerAPI* Longtail_GetMemTrackerAPI()
+{
+    return Longtail_MemTrackerAPI_private;
+}
+
+// Keeps the returned memory 16 byte aligned. Every allocation has the header, not only the tracked ones, so the tracker
+// can be set or cleared while allocations are alive without Longtail_Free misreading the memory in front of them
+struct MemTrackerHeader
+{
+    uint64_t m_Size;
+    uint32_t m_Tag;
+    uint32_t m_TrackerGeneration;
+};
+
+static void* Longtail_RawAlloc(size_t s)
+{
+    if (Longtail_AllocatorAPI_private)
+    {
+        return Longtail_AllocatorAPI_private->Alloc(Longtail_AllocatorAPI_private, s);
+    }
     return Longtail_Alloc_private ? Longtail_Alloc_private(s) : malloc(s);
 }
 
-void Longtail_Free(void* p)
+static void Longtail_RawFree(void* p)
 {
+    if (Longtail_AllocatorAPI_private)
+    {
+        Longtail_AllocatorAPI_private->Free(Longtail_AllocatorAPI_private, p);
+        return;
+    }
     Free_private ? Free_private(p) : free(p);
 }
 
+void* Longtail_AllocTagged(uint32_t tag, size_t s)
+{
+    struct MemTrackerHeader* header = (struct MemTrackerHeader*)Longtail_RawAlloc(sizeof(struct MemTrackerHeader) + s);
+    if (!header)
+    {
+        return 0;
+    }
+    (void)ATOMICADD32(&Longtail_LiveAllocationCount_private, 1);
+    struct Longtail_MemTrackerAPI* mem_tracker_api = Longtail_MemTrackerAPI_private;
+    header->m_Size = (uint64_t)s;
+    header->m_Tag = tag;
+    header->m_TrackerGeneration = mem_tracker_api ? (uint32_t)Longtail_MemTrackerGeneration_private : 0u;
+    if (mem_tracker_api)
+    {
+        mem_tracker_api->OnAlloc(mem_tracker_api, tag, s);
+    }
+    return &header[1];
+}
+
+void* Longtail_Alloc(size_t s)
+{
+    return Longtail_AllocTagged(LONGTAIL_MEMTAG_OTHER, s);
+}
+
+void Longtail_Free(void* p)
+{
+    if (!p)
+    {
+        return;
+    }
+    struct MemTrackerHeader* header = &((struct MemTrackerHeader*)p)[-1];
+    struct Longtail_MemTrackerAPI* mem_tracker_api = Longtail_MemTrackerAPI_private;
+    if (mem_tracker_api && header->m_TrackerGeneration == (uint32_t)Longtail_MemTrackerGeneration_private)
+    {
+        mem_tracker_api->OnFree(mem_tracker_api, header->m_Tag, (size_t)header->m_Size);
+    }
+    (void)ATOMICADD32(&Longtail_LiveAllocationCount_private, -1);
+    Longtail_RawFree(header);
+}
+
+// stb_ds does not pass the old size to realloc, it is taken from the header Longtail_AllocTagged keeps in front of each allocation
+void* Longtail_STBRealloc(void* context, void* old_p, size_t s)
+{
+    (void)context;
+    void* p = Longtail_AllocTagged(LONGTAIL_MEMTAG_LOOKUP, s);
+    if (!p)
+    {
+        return 0;
+    }
+    if (old_p)
+    {
+        uint64_t old_size = ((struct MemTrackerHeader*)old_p)[-1].m_Size;
+        memcpy(p, old_p, (size_t)(old_size < s ? old_size : s));
+        Longtail_Free(old_p);
+    }
+    return p;
+}
+
+void Longtail_STBFree(void* context, void* p)
+{
+    (void)context;
+    Longtail_Free(p);
+}
+
+struct ScopedArenaChunk
+{
+    struct ScopedArenaChunk* m_Next;
+    uint64_t m_Reserved;
+};
+
+// Bump allocator for the temporaries of a single call. It is owned by the calling thread and has no free,
+// everything is released at once by ScopedArena_Dispose.
+struct ScopedArena
+{
+    struct ScopedArenaChunk* m_Chunks;
+    char* m_Ptr;
+    size_t m_Left;
+    size_t m_ChunkSize;
+    uint32_t m_Tag;
+};
+
+static void ScopedArena_Init(struct ScopedArena* arena, uint32_t tag, size_t chunk_size)
+{
+    arena->m_Chunks = 0;
+    arena->m_Ptr = 0;
+    arena->m_Left = 0;
+    arena->m_ChunkSize = chunk_size;
+    arena->m_Tag = tag;
+}
+
+static size_t ScopedArena_GetAllocSize(size_t s)
+{
+    return (s + 15u) & ~(size_t)15u;
+}
+
+static void* ScopedArena_Alloc(struct ScopedArena* arena, size_t s)
+{
+    size_t aligned_size = ScopedArena_GetAllocSize(s);
+    if (!arena->m_Chunks || arena->m_Left < aligned_size)
+    {
+        size_t chunk_size = aligned_size > arena->m_ChunkSize ? aligned_size : arena->m_ChunkSize;
+        struct ScopedArenaChunk* chunk = (struct ScopedArenaChunk*)Longtail_AllocTagged(arena->m_Tag, sizeof(struct ScopedArenaChunk) + chunk_size);
+        if (!chunk)
+        {
+            return 0;
+        }
+        chunk->m_Next = arena->m_Chunks;
+        arena->m_Chunks = chunk;
+        arena->m_Ptr = (char*)&chunk[1];
+        arena->m_Left = chunk_size;
+    }
+    void* p = arena->m_Ptr;
+    arena->m_Ptr += aligned_size;
+    arena->m_Left -= aligned_size;
+    return p;
+}
+
+static void ScopedArena_Dispose(struct ScopedArena* arena)
+{
+    struct ScopedArenaChunk* chunk = arena->m_Chunks;
+    while (chunk)
+    {
+        struct ScopedArenaChunk* next_chunk = chunk->m_Next;
+        Longtail_Free(chunk);
+        chunk = next_chunk;
+    }
+    arena->m_Chunks = 0;
+    arena->m_Ptr = 0;
+    arena->m_Left = 0;
+}
+
+const char* Longtail_GetMemTagName(uint32_t tag)
+{
+    switch (tag)
+    {
+        case LONGTAIL_MEMTAG_OTHER: return "other";
+        case LONGTAIL_MEMTAG_INDEX: return "index";
+        case LONGTAIL_MEMTAG_BLOCK_DATA: return "block_data";
+        case LONGTAIL_MEMTAG_LOOKUP: return "lookup";
+        case LONGTAIL_MEMTAG_JOBS: return "jobs";
+        default: return "unknown";
+    }
+}
+
 #if !defined(LONGTAIL_LOG_LEVEL)
     #define LONGTAIL_LOG_LEVEL   0
 #endif
@@ -116,6 +324,122 @@ void Longtail_CallLogger(int level, const char* fmt, ...)
     Longtail_Log_private(Longtail_LogContext, level, buffer);
 }
 
+static struct Longtail_TraceAPI* Longtail_TraceAPI_private = 0;
+
+void Longtail_SetTraceAPI(struct Longtail_TraceAPI* trace_api)
+{
+    Longtail_TraceAPI_private = trace_api;
+}
+
+struct Longtail_TraceAPI* Longtail_GetTraceAPI()
+{
+    return Longtail_TraceAPI_private;
+}
+
+void Longtail_ResetMemTagPeaks()
+{
+    struct Longtail_MemTrackerAPI* mem_tracker_api = Longtail_MemTrackerAPI_private;
+    if (mem_tracker_api)
+    {
+        mem_tracker_api->ResetPeaks(mem_tracker_api);
+    }
+}
+
+void Longtail_LogMemTagStats(const char* context)
+{
+    struct Longtail_MemTrackerAPI* mem_tracker_api = Longtail_MemTrackerAPI_private;
+    if (!mem_tracker_api)
+    {
+        return;
+    }
+    for (uint32_t tag = 0; tag < LONGTAIL_MEMTAG_COUNT; ++tag)
+    {
+        struct Longtail_MemTagStats tag_stats;
+        if (mem_tracker_api->GetTagStats(mem_tracker_api, tag, &tag_stats))
+        {
+            continue;
+        }
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_INFO, "%s: memory `%s` current %" PRIu64 " bytes in %" PRIu64 " allocations, peak %" PRIu64 " bytes, %" PRIu64 " allocations in total",
+            context, Longtail_GetMemTagName(tag), tag_stats.m_CurrentBytes, tag_stats.m_CurrentCount, tag_stats.m_PeakBytes, tag_stats.m_TotalCount)
+    }
+}
+
+static Longtail_Clock_Func Longtail_WallClock_private = 0;
+static Longtail_Clock_Func Longtail_CPUClock_private = 0;
+
+void Longtail_SetClocks(Longtail_Clock_Func wall_clock, Longtail_Clock_Func cpu_clock)
+{
+    Longtail_WallClock_private = wall_clock;
+    Longtail_CPUClock_private = cpu_clock;
+}
+
+// Counters owned by a single job, summed into the Longtail_Stats of the call once all jobs are done
+struct JobStats
+{
+    uint64_t m_BytesRead;
+    uint64_t m_BytesWritten;
+    uint64_t m_BytesHashed;
+    uint64_t m_BytesCompressed;
+    uint64_t m_BytesDecompressed;
+    uint64_t m_FilesOpened;
+    uint64_t m_BlocksRead;
+    uint64_t m_JobsRun;
+};
+
+struct StatsPhase
+{
+    uint64_t m_WallStartUS;
+    uint64_t m_CPUStartUS;
+};
+
+static void Stats_BeginPhase(struct Longtail_Stats* optional_stats, struct StatsPhase* phase)
+{
+    if (optional_stats == 0)
+    {
+        return;
+    }
+    phase->m_WallStartUS = Longtail_WallClock_private ? Longtail_WallClock_private() : 0;
+    phase->m_CPUStartUS = Longtail_CPUClock_private ? Longtail_CPUClock_private() : 0;
+}
+
+static void Stats_EndPhase(struct Longtail_Stats* optional_stats, uint32_t phase_index, const struct StatsPhase* phase)
+{
+    if (optional_stats == 0)
+    {
+        return;
+    }
+    optional_stats->m_PhaseWallTimeUS[phase_index] += Longtail_WallClock_private ? Longtail_WallClock_private() - phase->m_WallStartUS : 0;
+    optional_stats->m_PhaseCPUTimeUS[phase_index] += Longtail_CPUClock_private ? Longtail_CPUClock_private() - phase->m_CPUStartUS : 0;
+}
+
+static void Stats_AddJobStats(struct Longtail_Stats* optional_stats, const struct JobStats* job_stats)
+{
+    if (optional_stats == 0)
+    {
+        return;
+    }
+    optional_stats->m_BytesRead += job_stats->m_BytesRead;
+    optional_stats->m_BytesWritten += job_stats->m_BytesWritten;
+    optional_stats->m_BytesHashed += job_stats->m_BytesHashed;
+    optional_stats->m_BytesCompressed += job_stats->m_BytesCompressed;
+    optional_stats->m_BytesDecompressed += job_stats->m_BytesDecompressed;
+    optional_stats->m_FilesOpened += job_stats->m_FilesOpened;
+    optional_stats->m_BlocksRead += job_stats->m_BlocksRead;
+    optional_stats->m_JobsRun += job_stats->m_JobsRun;
+}
+
+static void JobStats_Add(struct JobStats* job_stats, const struct JobStats* other)
+{
+    job_stats->m_BytesRead += other->m_BytesRead;
+    job_stats->m_BytesWritten += other->m_BytesWritten;
+    job_stats->m_BytesHashed += other->m_BytesHashed;
+    job_stats->m_BytesCompressed += other->m_BytesCompressed;
+    job_stats->m_BytesDecompressed += other->m_BytesDecompressed;
+    job_stats->m_FilesOpened += other->m_FilesOpened;
+    job_stats->m_BlocksRead += other->m_BlocksRead;
+    job_stats->m_JobsRun += other->m_JobsRun;
+}
+
 char* Longtail_Strdup(const char* path)
 {
     char* r = (char*)Longtail_Alloc(strlen(path) + 1);
@@ -314,7 +638,7 @@ static size_t GetPathsSize(uint32_t path_count, uint32_t path_data_size)
 
 static struct Longtail_Paths* CreatePaths(uint32_t path_count, uint32_t path_data_size)
 {
-    struct Longtail_Paths* paths = (struct Longtail_Paths*)Longtail_Alloc(GetPathsSize(path_count, path_data_size));
+    struct Longtail_Paths* paths = (struct Longtail_Paths*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, GetPathsSize(path_count, path_data_size));
     LONGTAIL_FATAL_ASSERT(paths != 0, return 0)
     char* p = (char*)&paths[1];
     paths->m_DataSize = 0;
@@ -474,7 +798,7 @@ int Longtail_GetFilesRecursively(struct Longtail_StorageAPI* storage_api, const
     }
 
     uint32_t asset_count = *context.m_Paths->m_PathCount;
-    struct Longtail_FileInfos* result = (struct Longtail_FileInfos*)Longtail_Alloc(
+    struct Longtail_FileInfos* result = (struct Longtail_FileInfos*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, 
         sizeof(struct Longtail_FileInfos) +
         sizeof(uint64_t) * asset_count +
         GetPathsSize(asset_count, context.m_Paths->m_DataSize));
@@ -543,6 +867,16 @@ static int StorageChunkFeederFunc(void* context, struct Longtail_Chunker* chunke
 #define AVG_CHUNKER_SIZE(max_chunk_size) ((max_chunk_size < ChunkerWindowSize) ? ChunkerWindowSize : max_chunk_size)
 #define MAX_CHUNKER_SIZE(max_chunk_size) (max_chunk_size * 4)
 
+// Number of max size chunks the chunker buffers, fewer and larger reads and less moving of buffered data
+#define CHUNKER_BUFFER_CHUNK_COUNT 8u
+// Hash contexts up to this size are kept on the stack of the hashing job
+#define MAX_STACK_HASH_CONTEXT_SIZE 2048u
+
+static int IsCancelled(struct Longtail_CancelAPI* optional_cancel_api, Longtail_CancelAPI_HCancelToken optional_cancel_token)
+{
+    return optional_cancel_api && optional_cancel_api->IsCancelled(optional_cancel_api, optional_cancel_token) == ECANCELED;
+}
+
 struct HashJob
 {
     struct Longtail_StorageAPI* m_StorageAPI;
@@ -560,17 +894,27 @@ struct HashJob
     uint32_t* m_ChunkCompressionTypes;
     uint32_t* m_ChunkSizes;
     uint32_t m_MaxChunkSize;
+    struct JobStats m_Stats;
     int m_Err;
 };
 
-static void DynamicChunking(void* context)
+static void DynamicChunking(void* context, int is_cancelled)
 {
     LONGTAIL_FATAL_ASSERT(context != 0, return)
+    LONGTAIL_TRACE_BEGIN(dynamic_chunking, "DynamicChunking")
     struct HashJob* hash_job = (struct HashJob*)context;
+    hash_job->m_Stats.m_JobsRun += 1;
+    if (is_cancelled)
+    {
+        hash_job->m_Err = ECANCELED;
+        LONGTAIL_TRACE_END(dynamic_chunking)
+        return;
+    }
 
     hash_job->m_Err = GetPathHash(hash_job->m_HashAPI, hash_job->m_Path, hash_job->m_PathHash);
     if (hash_job->m_Err)
     {
+        LONGTAIL_TRACE_END(dynamic_chunking)
         return;
     }
 
@@ -578,6 +922,7 @@ static void DynamicChunking(void* context)
     {
         hash_job->m_Err = 0;
         *hash_job->m_AssetChunkCount = 0;
+        LONGTAIL_TRACE_END(dynamic_chunking)
         return;
     }
     uint32_t chunk_count = 0;
@@ -592,6 +937,7 @@ static void DynamicChunking(void* context)
         Longtail_Free(path);
         path = 0;
         hash_job->m_Err = err;
+        LONGTAIL_TRACE_END(dynamic_chunking)
         return;
     }
 
@@ -603,7 +949,7 @@ static void DynamicChunking(void* context)
     }
     else if (hash_size <= ChunkerWindowSize || hash_job->m_MaxChunkSize <= ChunkerWindowSize)
     {
-        char* buffer = (char*)Longtail_Alloc((size_t)hash_size);
+        char* buffer = (char*)Longtail_AllocTagged(LONGTAIL_MEMTAG_BLOCK_DATA, (size_t)hash_size);
         LONGTAIL_FATAL_ASSERT(buffer, hash_job->m_Err = ENOMEM; return)
         err = storage_api->Read(storage_api, file_handle, 0, hash_size, buffer);
         if (err)
@@ -616,6 +962,7 @@ static void DynamicChunking(void* context)
             Longtail_Free(path);
             path = 0;
             hash_job->m_Err = err;
+            LONGTAIL_TRACE_END(dynamic_chunking)
             return;
         }
 
@@ -630,6 +977,7 @@ static void DynamicChunking(void* context)
             Longtail_Free(path);
             path = 0;
             hash_job->m_Err = err;
+            LONGTAIL_TRACE_END(dynamic_chunking)
             return;
         }
 
@@ -660,10 +1008,11 @@ static void DynamicChunking(void* context)
         struct Longtail_ChunkerParams chunker_params = { min_chunk_size, avg_chunk_size, max_chunk_size };
 
         struct Longtail_Chunker* chunker;
-        err = Longtail_CreateChunker(
+        err = Longtail_CreateChunkerWithBufferSize(
             &chunker_params,
             StorageChunkFeederFunc,
             &feeder_context,
+            max_chunk_size * CHUNKER_BUFFER_CHUNK_COUNT,
             &chunker);
 
         if (err)
@@ -674,11 +1023,18 @@ static void DynamicChunking(void* context)
             Longtail_Free(path);
             path = 0;
             hash_job->m_Err = err;
+            LONGTAIL_TRACE_END(dynamic_chunking)
             return;
         }
 
+        uint64_t hash_context_storage[(MAX_STACK_HASH_CONTEXT_SIZE + LONGTAIL_HASH_CONTEXT_ALIGNMENT) / sizeof(uint64_t)];
+        void* hash_context_memory = (void*)(((uintptr_t)hash_context_storage + (LONGTAIL_HASH_CONTEXT_ALIGNMENT - 1)) & ~(uintptr_t)(LONGTAIL_HASH_CONTEXT_ALIGNMENT - 1));
+        int hash_context_in_place = hash_job->m_HashAPI->GetContextSize(hash_job->m_HashAPI) <= MAX_STACK_HASH_CONTEXT_SIZE;
+
         Longtail_HashAPI_HContext asset_hash_context;
-        err = hash_job->m_HashAPI->BeginContext(hash_job->m_HashAPI, &asset_hash_context);
+        err = hash_context_in_place ?
+            hash_job->m_HashAPI->BeginContextInPlace(hash_job->m_HashAPI, hash_context_memory, &asset_hash_context) :
+            hash_job->m_HashAPI->BeginContext(hash_job->m_HashAPI, &asset_hash_context);
         if (err)
         {
             LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "DynamicChunking: Failed to create hash context for path `%s`", path)
@@ -687,6 +1043,7 @@ static void DynamicChunking(void* context)
             Longtail_Free(path);
             path = 0;
             hash_job->m_Err = err;
+            LONGTAIL_TRACE_END(dynamic_chunking)
             return;
         }
 
@@ -701,12 +1058,20 @@ static void DynamicChunking(void* context)
                 LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "DynamicChunking: Failed to create hash for chunk of `%s`", path)
                 Longtail_Free(chunker);
                 chunker = 0;
-                hash_job->m_HashAPI->EndContext(hash_job->m_HashAPI, asset_hash_context);
+                if (hash_context_in_place)
+                {
+                    hash_job->m_HashAPI->EndContextInPlace(hash_job->m_HashAPI, asset_hash_context);
+                }
+                else
+                {
+                    hash_job->m_HashAPI->EndContext(hash_job->m_HashAPI, asset_hash_context);
+                }
                 storage_api->CloseFile(storage_api, file_handle);
                 file_handle = 0;
                 Longtail_Free(path);
                 path = 0;
                 hash_job->m_Err = err;
+                LONGTAIL_TRACE_END(dynamic_chunking)
                 return;
             }
             hash_job->m_ChunkSizes[chunk_count] = r.len;
@@ -720,14 +1085,20 @@ static void DynamicChunking(void* context)
         }
         LONGTAIL_FATAL_ASSERT(remaining == 0, hash_job->m_Err = EINVAL; return)
 
-        content_hash = hash_job->m_HashAPI->EndContext(hash_job->m_HashAPI, asset_hash_context);
+        content_hash = hash_context_in_place ?
+            hash_job->m_HashAPI->EndContextInPlace(hash_job->m_HashAPI, asset_hash_context) :
+            hash_job->m_HashAPI->EndContext(hash_job->m_HashAPI, asset_hash_context);
         Longtail_Free(chunker);
         chunker = 0;
     }
 
     storage_api->CloseFile(storage_api, file_handle);
     file_handle = 0;
-    
+
+    hash_job->m_Stats.m_FilesOpened += 1;
+    hash_job->m_Stats.m_BytesRead += hash_size;
+    hash_job->m_Stats.m_BytesHashed += hash_size;
+
     LONGTAIL_FATAL_ASSERT(chunk_count <= hash_job->m_MaxChunkCount, hash_job->m_Err = EINVAL; return)
     *hash_job->m_AssetChunkCount = chunk_count;
 
@@ -735,6 +1106,7 @@ static void DynamicChunking(void* context)
     path = 0;
 
     hash_job->m_Err = 0;
+    LONGTAIL_TRACE_END(dynamic_chunking)
 }
 
 static int ChunkAssets(
@@ -743,6 +1115,9 @@ static int ChunkAssets(
     struct Longtail_JobAPI* job_api,
     Longtail_JobAPI_ProgressFunc job_progress_func,
     void* job_progress_context,
+    struct Longtail_CancelAPI* optional_cancel_api,
+    Longtail_CancelAPI_HCancelToken optional_cancel_token,
+    struct Longtail_Stats* optional_stats,
     const char* root_path,
     const struct Longtail_Paths* paths,
     TLongtail_Hash* path_hashes,
@@ -799,23 +1174,37 @@ static int ChunkAssets(
         }
     }
 
-    int err = job_api->ReserveJobs(job_api, job_count);
+    struct StatsPhase stats_phase;
+    Stats_BeginPhase(optional_stats, &stats_phase);
+
+    Longtail_JobAPI_Group job_group = 0;
+    int err = job_api->ReserveJobs(job_api, job_count, optional_cancel_api, optional_cancel_token, &job_group);
     if (err)
     {
         LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_WARNING, "ChunkAssets: Failed to reserve %" PRIu64 " jobs for folder `%s`, %d", paths->m_PathCount, root_path, err)
         return err;
     }
 
-    uint32_t* job_chunk_counts = (uint32_t*)Longtail_Alloc(sizeof(uint32_t) * job_count);
+    // The per job results only live until they are gathered below, they share one arena chunk sized up front
+    size_t temp_size =
+        ScopedArena_GetAllocSize(sizeof(uint32_t) * job_count) +
+        ScopedArena_GetAllocSize(sizeof(TLongtail_Hash) * max_chunk_count) +
+        ScopedArena_GetAllocSize(sizeof(uint32_t) * max_chunk_count) +
+        ScopedArena_GetAllocSize(sizeof(uint32_t) * max_chunk_count) +
+        ScopedArena_GetAllocSize(sizeof(struct HashJob) * job_count);
+    struct ScopedArena temp_arena;
+    ScopedArena_Init(&temp_arena, LONGTAIL_MEMTAG_INDEX, temp_size);
+
+    uint32_t* job_chunk_counts = (uint32_t*)ScopedArena_Alloc(&temp_arena, sizeof(uint32_t) * job_count);
     LONGTAIL_FATAL_ASSERT(job_chunk_counts, return ENOMEM)
-    TLongtail_Hash* hashes = (TLongtail_Hash*)Longtail_Alloc(sizeof(TLongtail_Hash) * max_chunk_count);
+    TLongtail_Hash* hashes = (TLongtail_Hash*)ScopedArena_Alloc(&temp_arena, sizeof(TLongtail_Hash) * max_chunk_count);
     LONGTAIL_FATAL_ASSERT(hashes, return ENOMEM)
-    uint32_t* sizes = (uint32_t*)Longtail_Alloc(sizeof(uint32_t) * max_chunk_count);
+    uint32_t* sizes = (uint32_t*)ScopedArena_Alloc(&temp_arena, sizeof(uint32_t) * max_chunk_count);
     LONGTAIL_FATAL_ASSERT(sizes, return ENOMEM)
-    uint32_t* compression_types = (uint32_t*)Longtail_Alloc(sizeof(uint32_t) * max_chunk_count);
+    uint32_t* compression_types = (uint32_t*)ScopedArena_Alloc(&temp_arena, sizeof(uint32_t) * max_chunk_count);
     LONGTAIL_FATAL_ASSERT(compression_types, return ENOMEM)
 
-    struct HashJob* hash_jobs = (struct HashJob*)Longtail_Alloc(sizeof(struct HashJob) * job_count);
+    struct HashJob* hash_jobs = (struct HashJob*)ScopedArena_Alloc(&temp_arena, sizeof(struct HashJob) * job_count);
     LONGTAIL_FATAL_ASSERT(hash_jobs, return ENOMEM)
 
     uint64_t jobs_started = 0;
@@ -850,13 +1239,14 @@ static int ChunkAssets(
             job->m_ChunkSizes = &sizes[chunks_offset];
             job->m_ChunkCompressionTypes = &compression_types[chunks_offset];
             job->m_MaxChunkSize = max_chunk_size;
+            memset(&job->m_Stats, 0, sizeof(job->m_Stats));
             job->m_Err = EINVAL;
 
             Longtail_JobAPI_JobFunc func[1] = {DynamicChunking};
             void* ctx[1] = {&hash_jobs[jobs_started]};
 
             Longtail_JobAPI_Jobs jobs;
-            err = job_api->CreateJobs(job_api, 1, func, ctx, &jobs);
+            err = job_api->CreateJobs(job_api, job_group, LONGTAIL_JOB_CHANNEL_CPU, 1, func, ctx, &jobs);
             LONGTAIL_FATAL_ASSERT(!err, return err)
             err = job_api->ReadyJobs(job_api, 1, jobs);
             LONGTAIL_FATAL_ASSERT(!err, return err)
@@ -867,16 +1257,31 @@ static int ChunkAssets(
         }
     }
 
-    err = job_api->WaitForAllJobs(job_api, job_progress_context, job_progress_func);
-    LONGTAIL_FATAL_ASSERT(!err, return err)
+    err = job_api->WaitForAllJobs(job_api, job_group, job_progress_context, job_progress_func);
+    LONGTAIL_FATAL_ASSERT(!err || err == ECANCELED, return err)
+    if (err == ECANCELED)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_INFO, "ChunkAssets: Cancelled hashing folder `%s`", root_path)
+    }
+
+    Stats_EndPhase(optional_stats, LONGTAIL_STATS_PHASE_HASH_ASSETS, &stats_phase);
+    if (optional_stats)
+    {
+        for (uint32_t i = 0; i < jobs_started; ++i)
+        {
+            Stats_AddJobStats(optional_stats, &hash_jobs[i].m_Stats);
+        }
+    }
 
-    err = 0;
-    for (uint32_t i = 0; i < jobs_started; ++i)
+    if (!err)
     {
-        if (hash_jobs[i].m_Err)
+        for (uint32_t i = 0; i < jobs_started; ++i)
         {
-            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_WARNING, "ChunkAssets: Failed to hash `%s`, %d", hash_jobs[i].m_Path, hash_jobs[i].m_Err)
-            err = err ? err : hash_jobs[i].m_Err;
+            if (hash_jobs[i].m_Err)
+            {
+                LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_WARNING, "ChunkAssets: Failed to hash `%s`, %d", hash_jobs[i].m_Path, hash_jobs[i].m_Err)
+                err = err ? err : hash_jobs[i].m_Err;
+            }
         }
     }
 
@@ -889,11 +1294,11 @@ static int ChunkAssets(
             built_chunk_count += *hash_jobs[i].m_AssetChunkCount;
         }
         *chunk_count = built_chunk_count;
-        *chunk_sizes = (uint32_t*)Longtail_Alloc(sizeof(uint32_t) * *chunk_count);
+        *chunk_sizes = (uint32_t*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof(uint32_t) * *chunk_count);
         LONGTAIL_FATAL_ASSERT(*chunk_sizes, return ENOMEM)
-        *chunk_hashes = (TLongtail_Hash*)Longtail_Alloc(sizeof(TLongtail_Hash) * *chunk_count);
+        *chunk_hashes = (TLongtail_Hash*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof(TLongtail_Hash) * *chunk_count);
         LONGTAIL_FATAL_ASSERT(*chunk_hashes, return ENOMEM)
-        *chunk_compression_types = (uint32_t*)Longtail_Alloc(sizeof(uint32_t) * *chunk_count);
+        *chunk_compression_types = (uint32_t*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof(uint32_t) * *chunk_count);
         LONGTAIL_FATAL_ASSERT(*chunk_compression_types, return ENOMEM)
 
         uint32_t chunk_offset = 0;
@@ -928,26 +1333,13 @@ static int ChunkAssets(
                 *chunk_hashes = 0;
                 Longtail_Free(*chunk_compression_types);
                 *chunk_compression_types = 0;
+                ScopedArena_Dispose(&temp_arena);
                 return err;
             }
         }
     }
 
-    Longtail_Free(compression_types);
-    compression_types = 0;
-
-    Longtail_Free(hashes);
-    hashes = 0;
-
-    Longtail_Free(sizes);
-    sizes = 0;
-
-    Longtail_Free(job_chunk_counts);
-    job_chunk_counts = 0;
-
-    Longtail_Free(hash_jobs);
-    hash_jobs = 0;
-
+    ScopedArena_Dispose(&temp_arena);
     return err;
 }
 
@@ -1137,6 +1529,9 @@ int Longtail_CreateVersionIndex(
     struct Longtail_JobAPI* job_api,
     Longtail_JobAPI_ProgressFunc job_progress_func,
     void* job_progress_context,
+    struct Longtail_CancelAPI* optional_cancel_api,
+    Longtail_CancelAPI_HCancelToken optional_cancel_token,
+    struct Longtail_Stats* optional_stats,
     const char* root_path,
     const struct Longtail_Paths* paths,
     const uint64_t* asset_sizes,
@@ -1153,18 +1548,18 @@ int Longtail_CreateVersionIndex(
     LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_DEBUG, "Longtail_CreateVersionIndex: From `%s` with %u assets", root_path, *paths->m_PathCount)
 
     uint32_t path_count = *paths->m_PathCount;
-    TLongtail_Hash* path_hashes = (TLongtail_Hash*)Longtail_Alloc(sizeof(TLongtail_Hash) * path_count);
+    TLongtail_Hash* path_hashes = (TLongtail_Hash*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof(TLongtail_Hash) * path_count);
     LONGTAIL_FATAL_ASSERT(path_hashes != 0, return ENOMEM)
-    TLongtail_Hash* content_hashes = (TLongtail_Hash*)Longtail_Alloc(sizeof(TLongtail_Hash) * path_count);
+    TLongtail_Hash* content_hashes = (TLongtail_Hash*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof(TLongtail_Hash) * path_count);
     LONGTAIL_FATAL_ASSERT(content_hashes != 0, return ENOMEM)
-    uint32_t* asset_chunk_counts = (uint32_t*)Longtail_Alloc(sizeof(uint32_t) * path_count);
+    uint32_t* asset_chunk_counts = (uint32_t*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof(uint32_t) * path_count);
     LONGTAIL_FATAL_ASSERT(asset_chunk_counts != 0, return ENOMEM)
 
     uint32_t assets_chunk_index_count = 0;
     uint32_t* asset_chunk_sizes = 0;
     uint32_t* asset_chunk_compression_types = 0;
     TLongtail_Hash* asset_chunk_hashes = 0;
-    uint32_t* asset_chunk_start_index = (uint32_t*)Longtail_Alloc(sizeof(uint32_t) * path_count);
+    uint32_t* asset_chunk_start_index = (uint32_t*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof(uint32_t) * path_count);
     LONGTAIL_FATAL_ASSERT(asset_chunk_start_index, return ENOMEM)
 
     int err = ChunkAssets(
@@ -1173,6 +1568,9 @@ int Longtail_CreateVersionIndex(
         job_api,
         job_progress_func,
         job_progress_context,
+        optional_cancel_api,
+        optional_cancel_token,
+        optional_stats,
         root_path,
         paths,
         path_hashes,
@@ -1196,6 +1594,8 @@ int Longtail_CreateVersionIndex(
         asset_chunk_hashes = 0;
         Longtail_Free(asset_chunk_sizes);
         asset_chunk_sizes = 0;
+        Longtail_Free(asset_chunk_counts);
+        asset_chunk_counts = 0;
         Longtail_Free(content_hashes);
         content_hashes = 0;
         Longtail_Free(path_hashes);
@@ -1203,13 +1603,13 @@ int Longtail_CreateVersionIndex(
         return err;
     }
 
-    uint32_t* asset_chunk_indexes = (uint32_t*)Longtail_Alloc(sizeof(uint32_t) * assets_chunk_index_count);
+    uint32_t* asset_chunk_indexes = (uint32_t*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof(uint32_t) * assets_chunk_index_count);
     LONGTAIL_FATAL_ASSERT(asset_chunk_indexes != 0, return ENOMEM)
-    TLongtail_Hash* compact_chunk_hashes = (TLongtail_Hash*)Longtail_Alloc(sizeof(TLongtail_Hash) * assets_chunk_index_count);
+    TLongtail_Hash* compact_chunk_hashes = (TLongtail_Hash*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof(TLongtail_Hash) * assets_chunk_index_count);
     LONGTAIL_FATAL_ASSERT(compact_chunk_hashes != 0, return ENOMEM)
-    uint32_t* compact_chunk_sizes =  (uint32_t*)Longtail_Alloc(sizeof(uint32_t) * assets_chunk_index_count);
+    uint32_t* compact_chunk_sizes =  (uint32_t*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof(uint32_t) * assets_chunk_index_count);
     LONGTAIL_FATAL_ASSERT(compact_chunk_sizes != 0, return ENOMEM)
-    uint32_t* compact_chunk_compression_types =  (uint32_t*)Longtail_Alloc(sizeof(uint32_t) * assets_chunk_index_count);
+    uint32_t* compact_chunk_compression_types =  (uint32_t*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof(uint32_t) * assets_chunk_index_count);
     LONGTAIL_FATAL_ASSERT(compact_chunk_compression_types != 0, return ENOMEM)
 
     uint32_t unique_chunk_count = 0;
@@ -1237,7 +1637,7 @@ int Longtail_CreateVersionIndex(
     chunk_hash_to_index = 0;
 
     size_t version_index_size = Longtail_GetVersionIndexSize(path_count, unique_chunk_count, assets_chunk_index_count, paths->m_DataSize);
-    void* version_index_mem = Longtail_Alloc(version_index_size);
+    void* version_index_mem = Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, version_index_size);
     LONGTAIL_FATAL_ASSERT(version_index_mem, return ENOMEM)
 
     struct Longtail_VersionIndex* version_index = Longtail_BuildVersionIndex(
@@ -1282,6 +1682,7 @@ int Longtail_CreateVersionIndex(
     path_hashes = 0;
 
     *out_version_index = version_index;
+    Longtail_LogMemTagStats("Longtail_CreateVersionIndex");
     return 0;
 }
 
@@ -1295,7 +1696,7 @@ int Longtail_WriteVersionIndexToBuffer(
     LONGTAIL_FATAL_ASSERT(out_size != 0, return EINVAL)
     LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_DEBUG, "Longtail_WriteVersionIndexToBuffer: %u assets", version_index->m_AssetCount)
     size_t index_data_size = GetVersionIndexDataSize(*version_index->m_AssetCount, *version_index->m_ChunkCount, *version_index->m_AssetChunkIndexCount, version_index->m_NameDataSize);
-    *out_buffer = Longtail_Alloc(index_data_size);
+    *out_buffer = Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, index_data_size);
     if (!(*out_buffer))
     {
         return ENOMEM;
@@ -1354,7 +1755,7 @@ int Longtail_ReadVersionIndexFromBuffer(
     LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_DEBUG, "Longtail_ReadVersionIndexFromBuffer: Buffer size %u", size)
 
     size_t version_index_size = sizeof(struct Longtail_VersionIndex) + size;
-    struct Longtail_VersionIndex* version_index = (struct Longtail_VersionIndex*)Longtail_Alloc(version_index_size);
+    struct Longtail_VersionIndex* version_index = (struct Longtail_VersionIndex*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, version_index_size);
     if (!version_index)
     {
         return ENOMEM;
@@ -1394,7 +1795,7 @@ int Longtail_ReadVersionIndex(
         return err;
     }
     size_t version_index_size = version_index_data_size + sizeof(struct Longtail_VersionIndex);
-    struct Longtail_VersionIndex* version_index = (struct Longtail_VersionIndex*)Longtail_Alloc(version_index_size);
+    struct Longtail_VersionIndex* version_index = (struct Longtail_VersionIndex*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, version_index_size);
     if (!version_index)
     {
         LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_ReadVersionIndex: Failed to allocate memory for `%s`", path)
@@ -1630,7 +2031,7 @@ int Longtail_CreateContentIndex(
     if (chunk_count == 0)
     {
         size_t content_index_size = GetContentIndexSize(0, 0);
-        struct Longtail_ContentIndex* content_index = (struct Longtail_ContentIndex*)Longtail_Alloc(content_index_size);
+        struct Longtail_ContentIndex* content_index = (struct Longtail_ContentIndex*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, content_index_size);
         LONGTAIL_FATAL_ASSERT(content_index, return ENOMEM)
 
         content_index->m_Version = (uint32_t*)(void*)&((char*)content_index)[sizeof(struct Longtail_ContentIndex)];
@@ -1645,14 +2046,14 @@ int Longtail_CreateContentIndex(
         *out_content_index = content_index;
         return 0;
     }
-    uint64_t* chunk_indexes = (uint64_t*)Longtail_Alloc((size_t)(sizeof(uint64_t) * chunk_count));
+    uint64_t* chunk_indexes = (uint64_t*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, (size_t)(sizeof(uint64_t) * chunk_count));
     LONGTAIL_FATAL_ASSERT(chunk_indexes, return ENOMEM)
     uint64_t unique_chunk_count = GetUniqueHashes(chunk_count, chunk_hashes, chunk_indexes);
 
-    struct BlockIndex** block_indexes = (struct BlockIndex**)Longtail_Alloc(sizeof(struct BlockIndex*) * unique_chunk_count);
+    struct BlockIndex** block_indexes = (struct BlockIndex**)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof(struct BlockIndex*) * unique_chunk_count);
     LONGTAIL_FATAL_ASSERT(block_indexes, return ENOMEM)
 
-    uint64_t* stored_chunk_indexes = (uint64_t*)Longtail_Alloc(sizeof(uint64_t) * max_chunks_per_block);
+    uint64_t* stored_chunk_indexes = (uint64_t*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof(uint64_t) * max_chunks_per_block);
     LONGTAIL_FATAL_ASSERT(stored_chunk_indexes, return ENOMEM)
 
     uint64_t i = 0;
@@ -1703,7 +2104,7 @@ int Longtail_CreateContentIndex(
         }
 
         int err = CreateBlockIndex(
-            Longtail_Alloc(GetBlockIndexSize(chunk_count_in_block)),
+            Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, GetBlockIndexSize(chunk_count_in_block)),
             hash_api,
             current_compression_type,
             chunk_count_in_block,
@@ -1724,7 +2125,7 @@ int Longtail_CreateContentIndex(
 
     // Build Content Index (from block list)
     size_t content_index_size = GetContentIndexSize(block_count, unique_chunk_count);
-    struct Longtail_ContentIndex* content_index = (struct Longtail_ContentIndex*)Longtail_Alloc(content_index_size);
+    struct Longtail_ContentIndex* content_index = (struct Longtail_ContentIndex*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, content_index_size);
     LONGTAIL_FATAL_ASSERT(content_index, return ENOMEM)
 
     content_index->m_Version = (uint32_t*)(void*)&((char*)content_index)[sizeof(struct Longtail_ContentIndex)];
@@ -1778,7 +2179,7 @@ int Longtail_WriteContentIndexToBuffer(
     LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_DEBUG, "Longtail_WriteContentIndexToBuffer: %" PRIu64 " blocks", *content_index->m_BlockCount)
 
     size_t index_data_size = GetContentIndexDataSize(*content_index->m_BlockCount, *content_index->m_ChunkCount);
-    *out_buffer = Longtail_Alloc(index_data_size);
+    *out_buffer = Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, index_data_size);
     if (!(*out_buffer))
     {
         return ENOMEM;
@@ -1836,7 +2237,7 @@ int Longtail_ReadContentIndexFromBuffer(
     LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_DEBUG, "Longtail_ReadContentIndexFromBuffer: Buffer size %u", size)
 
     size_t content_index_size = size + sizeof(struct Longtail_ContentIndex);
-    struct Longtail_ContentIndex* content_index = (struct Longtail_ContentIndex*)Longtail_Alloc(content_index_size);
+    struct Longtail_ContentIndex* content_index = (struct Longtail_ContentIndex*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, content_index_size);
     if (!content_index)
     {
         return ENOMEM;
@@ -1876,7 +2277,7 @@ int Longtail_ReadContentIndex(
         return err;
     }
     uint64_t content_index_size = sizeof(struct Longtail_ContentIndex) + content_index_data_size;
-    struct Longtail_ContentIndex* content_index = (struct Longtail_ContentIndex*)Longtail_Alloc((size_t)(content_index_size));
+    struct Longtail_ContentIndex* content_index = (struct Longtail_ContentIndex*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, (size_t)(content_index_size));
     if (!content_index)
     {
         LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_ReadContentIndex: Failed allocate memory for `%s`", path)
@@ -1959,6 +2360,26 @@ static int CreateAssetPartLookup(
     return 0;
 }
 
+// A compression context and output buffer for one compression type
+struct CompressionContextSlot
+{
+    uint32_t m_CompressionType;
+    uint32_t m_CompressionWorkerCount;
+    struct Longtail_CompressionAPI* m_CompressionAPI;
+    Longtail_CompressionAPI_HCompressionContext m_CompressionContext;
+    char* m_CompressedData;
+    size_t m_CompressedDataCapacity;
+};
+
+// Reusable buffers for one in-flight block in the WriteContent pipeline
+struct WriteBlockBuffer
+{
+    char* m_BlockData;
+    size_t m_BlockDataCapacity;
+    // stb_ds array with one context per compression type used by the blocks of the buffer
+    struct CompressionContextSlot* m_CompressionContexts;
+};
+
 struct WriteBlockJob
 {
     struct Longtail_StorageAPI* m_SourceStorageAPI;
@@ -1972,6 +2393,17 @@ struct WriteBlockJob
     struct ChunkHashToAssetPart* m_AssetPartLookup;
     uint64_t m_FirstChunkIndex;
     uint32_t m_ChunkCount;
+    struct WriteBlockBuffer* m_Buffer;
+    uint32_t m_BlockDataSize;
+    uint32_t m_CompressionType;
+    uint32_t m_CompressionWorkerCount;
+    uint32_t m_JobWorkerCount;
+    int32_t volatile* m_CompressingJobCount;
+    const char* m_WriteData;
+    uint32_t m_WriteSize;
+    struct Longtail_CancelAPI* m_CancelAPI;
+    Longtail_CancelAPI_HCancelToken m_CancelToken;
+    struct JobStats m_Stats;
     int m_Err;
 };
 
@@ -1999,8 +2431,15 @@ static int DecompressBlock(
     {
         return err;
     }
+    Longtail_CompressionAPI_HDecompressionContext decompression_context;
+    err = compression_api->CreateDecompressionContext(compression_api, &decompression_context);
+    if (err)
+    {
+        return err;
+    }
     size_t size;
-    err = compression_api->Decompress(compression_api, compressed_buffer, uncompressed_buffer, compressed_size, uncompressed_size, &size);
+    err = compression_api->Decompress(compression_api, decompression_context, compressed_buffer, uncompressed_buffer, compressed_size, uncompressed_size, &size);
+    compression_api->DeleteDecompressionContext(compression_api, decompression_context);
     if (err)
     {
         return err;
@@ -2012,15 +2451,17 @@ static int DecompressBlock(
     return 0;
 }
 
+// Reads the stored, possibly compressed, block. The data is decoded with DecodeBlockData so the
+// reading can run on an IO worker and the decompression on a CPU worker
 static int ReadBlockData(
     struct Longtail_StorageAPI* storage_api,
-    struct Longtail_CompressionRegistryAPI* compression_registry_api,
     const char* content_folder,
     TLongtail_Hash block_hash,
-    void** out_block_data)
+    struct JobStats* job_stats,
+    void** out_stored_block_data,
+    uint64_t* out_stored_block_size)
 {
     LONGTAIL_FATAL_ASSERT(storage_api != 0, return EINVAL)
-    LONGTAIL_FATAL_ASSERT(compression_registry_api != 0, return EINVAL)
     LONGTAIL_FATAL_ASSERT(content_folder != 0, return EINVAL)
 
     char file_name[MAX_BLOCK_NAME_LENGTH + 4];
@@ -2037,17 +2478,19 @@ static int ReadBlockData(
         block_path = 0;
         return err;
     }
+    job_stats->m_FilesOpened += 1;
     uint64_t compressed_block_size;
     err = storage_api->GetSize(storage_api, block_file, &compressed_block_size);
     if (err != 0)
     {
         LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "ReadBlockData: Failed to get size of block `%s`, %d", block_path, err)
+        storage_api->CloseFile(storage_api, block_file);
         Longtail_Free(block_path);
         block_path = 0;
         return err;
     }
 
-    char* compressed_block_content = (char*)Longtail_Alloc(compressed_block_size);
+    char* compressed_block_content = (char*)Longtail_AllocTagged(LONGTAIL_MEMTAG_BLOCK_DATA, compressed_block_size);
     LONGTAIL_FATAL_ASSERT(compressed_block_content, return ENOMEM)
     err = storage_api->Read(storage_api, block_file, 0, compressed_block_size, compressed_block_content);
     storage_api->CloseFile(storage_api, block_file);
@@ -2060,14 +2503,43 @@ static int ReadBlockData(
         compressed_block_content = 0;
         return err;
     }
+    job_stats->m_BytesRead += compressed_block_size;
+    job_stats->m_BlocksRead += 1;
+
+    Longtail_Free(block_path);
+    block_path = 0;
 
+    *out_stored_block_data = compressed_block_content;
+    *out_stored_block_size = compressed_block_size;
+    return 0;
+}
+
+// Validates and decompresses a block read with ReadBlockData, takes ownership of stored_block_data
+static int DecodeBlockData(
+    struct Longtail_CompressionRegistryAPI* compression_registry_api,
+    TLongtail_Hash block_hash,
+    void* stored_block_data,
+    uint64_t stored_block_size,
+    struct JobStats* job_stats,
+    void** out_block_data)
+{
+    LONGTAIL_FATAL_ASSERT(compression_registry_api != 0, return EINVAL)
+    LONGTAIL_FATAL_ASSERT(stored_block_data != 0, return EINVAL)
+
+    char* compressed_block_content = (char*)stored_block_data;
+    uint64_t compressed_block_size = stored_block_size;
+    if (compressed_block_size < sizeof(uint32_t))
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_WARNING, "DecodeBlockData: Malformed content block (size to small) 0x%" PRIx64, block_hash)
+        Longtail_Free(compressed_block_content);
+        compressed_block_content = 0;
+        return EBADF;
+    }
     uint32_t chunk_count = *(const uint32_t*)(void*)(&compressed_block_content[compressed_block_size - sizeof(uint32_t)]);
     size_t block_index_data_size = GetBlockIndexDataSize(chunk_count);
     if (compressed_block_size < block_index_data_size)
     {
-        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_WARNING, "ReadBlockData: Malformed content block (size to small) `%s`", block_path)
-        Longtail_Free(block_path);
-        block_path = 0;
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_WARNING, "DecodeBlockData: Malformed content block (size to small) 0x%" PRIx64, block_hash)
         Longtail_Free(compressed_block_content);
         compressed_block_content = 0;
         return EBADF;
@@ -2079,9 +2551,7 @@ static int ReadBlockData(
     TLongtail_Hash verify_block_hash = *block_hash_ptr;
     if (block_hash != verify_block_hash)
     {
-        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_WARNING, "ReadBlockData: Malformed content block (mismatching block hash) `%s`", block_path)
-        Longtail_Free(block_path);
-        block_path = 0;
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_WARNING, "DecodeBlockData: Malformed content block (mismatching block hash) 0x%" PRIx64, block_hash)
         Longtail_Free(block_data);
         block_data = 0;
         return EBADF;
@@ -2093,9 +2563,9 @@ static int ReadBlockData(
     {
         uint32_t uncompressed_size = ((uint32_t*)(void*)compressed_block_content)[0];
         uint32_t compressed_size = ((uint32_t*)(void*)compressed_block_content)[1];
-        block_data = (char*)Longtail_Alloc(uncompressed_size);
+        block_data = (char*)Longtail_AllocTagged(LONGTAIL_MEMTAG_BLOCK_DATA, uncompressed_size);
         LONGTAIL_FATAL_ASSERT(block_data, return ENOMEM)
-        err = DecompressBlock(
+        int err = DecompressBlock(
             compression_registry_api,
             compression_type,
             compressed_size,
@@ -2108,18 +2578,14 @@ static int ReadBlockData(
 
         if (err)
         {
-            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "ReadBlockData: Failed to decompress block `%s`, %d", block_path, err)
+            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "DecodeBlockData: Failed to decompress block 0x%" PRIx64 ", %d", block_hash, err)
             Longtail_Free(block_data);
             block_data = 0;
-            Longtail_Free(block_path);
-            block_path = 0;
             return EBADF;
         }
+        job_stats->m_BytesDecompressed += uncompressed_size;
     }
 
-    Longtail_Free(block_path);
-    block_path = 0;
-
     *out_block_data = block_data;
     return 0;
 }
@@ -2127,6 +2593,7 @@ static int ReadBlockData(
 static int ReadBlockIndex(
     struct Longtail_StorageAPI* storage_api,
     const char* full_block_path,
+    struct JobStats* job_stats,
     struct BlockIndex** out_block_index)
 {
     LONGTAIL_FATAL_ASSERT(storage_api != 0, return EINVAL)
@@ -2139,6 +2606,7 @@ static int ReadBlockIndex(
         LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "ReadBlock: Failed to open block `%s`, %d", full_block_path, err)
         return err;
     }
+    job_stats->m_FilesOpened += 1;
     uint64_t s;
     err = storage_api->GetSize(storage_api, f, &s);
     if (err)
@@ -2166,7 +2634,7 @@ static int ReadBlockIndex(
         return EBADF;
     }
 
-    void* block_index_mem = Longtail_Alloc(GetBlockIndexSize(chunk_count));
+    void* block_index_mem = Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, GetBlockIndexSize(chunk_count));
     LONGTAIL_FATAL_ASSERT(block_index_mem, return ENOMEM)
     struct BlockIndex* block_index = InitBlockIndex(block_index_mem, chunk_count);
 
@@ -2179,20 +2647,44 @@ static int ReadBlockIndex(
         block_index = 0;
         return err;
     }
+    job_stats->m_BytesRead += sizeof(uint32_t) + block_index_data_size;
+    job_stats->m_BlocksRead += 1;
 
     *out_block_index = block_index;
     return 0;
 }
 
 
-int CompressBlock(
+static int GrowBuffer(char** buffer, size_t* capacity, size_t size)
+{
+    if (*capacity >= size)
+    {
+        return 0;
+    }
+    char* new_buffer = (char*)Longtail_AllocTagged(LONGTAIL_MEMTAG_BLOCK_DATA, size);
+    if (!new_buffer)
+    {
+        return ENOMEM;
+    }
+    if (*buffer)
+    {
+        Longtail_Free(*buffer);
+    }
+    *buffer = new_buffer;
+    *capacity = size;
+    return 0;
+}
+
+static int CompressBlock(
     struct Longtail_CompressionRegistryAPI* compression_registry_api,
     uint32_t compression_type,
     size_t uncompressed_size,
     size_t* compressed_size,
     const char* uncompressed_buffer,
-    char** out_compressed_buffer,
-    size_t compressed_prefix_size)
+    struct WriteBlockBuffer* buffer,
+    size_t compressed_prefix_size,
+    uint32_t worker_count,
+    char** out_compressed_data)
 {
     struct Longtail_CompressionAPI* compression_api;
     Longtail_CompressionAPI_HSettings compression_settings;
@@ -2202,193 +2694,523 @@ int CompressBlock(
         return err;
     }
 
-    size_t max_compressed_size = compression_api->GetMaxCompressedSize(compression_api, compression_settings, uncompressed_size);
-    *out_compressed_buffer = (char*)Longtail_Alloc(compressed_prefix_size + max_compressed_size);
-    if (!(*out_compressed_buffer))
+    // Contexts are kept for the whole call so blocks, and candidates of best-of compression, that switch type reuse them.
+    // Each type compresses to its own output buffer so the outputs of all best-of candidates are kept
+    struct CompressionContextSlot* slot = 0;
+    for (ptrdiff_t i = 0; i < arrlen(buffer->m_CompressionContexts); ++i)
     {
-        return ENOMEM;
+        if (buffer->m_CompressionContexts[i].m_CompressionType == compression_type)
+        {
+            slot = &buffer->m_CompressionContexts[i];
+            break;
+        }
+    }
+    if (!slot)
+    {
+        struct CompressionContextSlot new_slot = { compression_type, 1u, compression_api, 0, 0, 0 };
+        err = compression_api->CreateCompressionContext(compression_api, compression_settings, &new_slot.m_CompressionContext);
+        if (err)
+        {
+            return err;
+        }
+        arrpush(buffer->m_CompressionContexts, new_slot);
+        slot = &arrlast(buffer->m_CompressionContexts);
+    }
+    if (compression_api->SetCompressionWorkerCount && slot->m_CompressionWorkerCount != worker_count)
+    {
+        // Not all builds of a codec support this, it is fine to fall back to single threaded compression
+        compression_api->SetCompressionWorkerCount(compression_api, slot->m_CompressionContext, worker_count);
+        slot->m_CompressionWorkerCount = worker_count;
     }
 
-    char* compressed_buffer = &(*out_compressed_buffer)[compressed_prefix_size];
-    err = compression_api->Compress(compression_api, compression_settings, uncompressed_buffer, compressed_buffer, uncompressed_size, max_compressed_size, compressed_size);
+    size_t max_compressed_size = compression_api->GetMaxCompressedSize(compression_api, compression_settings, uncompressed_size);
+    err = GrowBuffer(&slot->m_CompressedData, &slot->m_CompressedDataCapacity, compressed_prefix_size + max_compressed_size);
     if (err)
     {
-        Longtail_Free(*out_compressed_buffer);
         return err;
     }
-    return 0;
-}
-
 
+    *out_compressed_data = slot->m_CompressedData;
+    return compression_api->Compress(compression_api, slot->m_CompressionContext, compression_settings, uncompressed_buffer, &slot->m_CompressedData[compressed_prefix_size], uncompressed_size, max_compressed_size, compressed_size);
+}
 
-static void Longtail_WriteContentBlockJob(void* context)
+// Compresses with each candidate and picks the first one that is within max_size_overhead_percent
+// of the smallest, its output is returned without compressing it again
+static int CompressBlockBestOf(
+    struct Longtail_CompressionRegistryAPI* compression_registry_api,
+    uint32_t candidate_count,
+    const uint32_t* candidate_types,
+    uint32_t max_size_overhead_percent,
+    size_t uncompressed_size,
+    size_t* compressed_size,
+    const char* uncompressed_buffer,
+    struct WriteBlockBuffer* buffer,
+    size_t compressed_prefix_size,
+    uint32_t worker_count,
+    uint32_t* out_compression_type,
+    char** out_compressed_data)
 {
-    LONGTAIL_FATAL_ASSERT(context != 0, return)
+    LONGTAIL_FATAL_ASSERT(candidate_count <= LONGTAIL_MAX_COMPRESSION_CANDIDATES, return EINVAL)
+    size_t candidate_sizes[LONGTAIL_MAX_COMPRESSION_CANDIDATES];
+    char* candidate_datas[LONGTAIL_MAX_COMPRESSION_CANDIDATES];
+    int candidate_errs[LONGTAIL_MAX_COMPRESSION_CANDIDATES];
+    uint32_t best_candidate = candidate_count;
+    int err = EINVAL;
+    for (uint32_t c = 0; c < candidate_count; ++c)
+    {
+        candidate_errs[c] = CompressBlock(
+            compression_registry_api,
+            candidate_types[c],
+            uncompressed_size,
+            &candidate_sizes[c],
+            uncompressed_buffer,
+            buffer,
+            compressed_prefix_size,
+            worker_count,
+            &candidate_datas[c]);
+        if (candidate_errs[c])
+        {
+            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_WARNING, "CompressBlockBestOf: Failed to compress with compression type %u, %d", candidate_types[c], candidate_errs[c])
+            err = candidate_errs[c];
+            continue;
+        }
+        if (best_candidate == candidate_count || candidate_sizes[c] < candidate_sizes[best_candidate])
+        {
+            best_candidate = c;
+        }
+    }
+    if (best_candidate == candidate_count)
+    {
+        return err;
+    }
 
-    struct WriteBlockJob* job = (struct WriteBlockJob*)context;
-    struct Longtail_StorageAPI* source_storage_api = job->m_SourceStorageAPI;
-    struct Longtail_StorageAPI* target_storage_api = job->m_TargetStorageAPI;
-    struct Longtail_CompressionRegistryAPI* compression_registry_api = job->m_CompressionRegistryAPI;
+    uint32_t chosen_candidate = best_candidate;
+    for (uint32_t c = 0; c < best_candidate; ++c)
+    {
+        if (candidate_errs[c] == 0 && candidate_sizes[c] * 100u <= candidate_sizes[best_candidate] * (100u + max_size_overhead_percent))
+        {
+            chosen_candidate = c;
+            break;
+        }
+    }
+    *compressed_size = candidate_sizes[chosen_candidate];
+    *out_compression_type = candidate_types[chosen_candidate];
+    *out_compressed_data = candidate_datas[chosen_candidate];
+    return 0;
+}
 
-    const struct Longtail_ContentIndex* content_index = job->m_ContentIndex;
-    const char* content_folder = job->m_ContentFolder;
-    uint64_t first_chunk_index = job->m_FirstChunkIndex;
-    uint32_t chunk_count = job->m_ChunkCount;
-    uint64_t block_index = content_index->m_ChunkBlockIndexes[first_chunk_index];
-    TLongtail_Hash block_hash = content_index->m_BlockHashes[block_index];
+// Keeps the source asset of the previous chunk open and accumulates chunk
+// ranges that are adjacent in the asset so they can be fetched with one Read
+struct AssetReadCache
+{
+    struct Longtail_StorageAPI* m_StorageAPI;
+    const char* m_AssetPath;
+    char* m_FullPath;
+    Longtail_StorageAPI_HOpenFile m_FileHandle;
+    uint64_t m_FileSize;
+    uint64_t m_ReadOffset;
+    uint64_t m_ReadLength;
+    char* m_ReadPtr;
+    struct JobStats* m_Stats;
+};
 
-    char tmp_block_name[MAX_BLOCK_NAME_LENGTH + 4];
-    GetBlockName(job->m_BlockHash, tmp_block_name);
-    strcat(tmp_block_name, ".tmp");
+static int AssetReadCache_Flush(struct AssetReadCache* cache)
+{
+    if (cache->m_ReadLength == 0)
+    {
+        return 0;
+    }
+    int err = cache->m_StorageAPI->Read(cache->m_StorageAPI, cache->m_FileHandle, cache->m_ReadOffset, cache->m_ReadLength, cache->m_ReadPtr);
+    if (err)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "AssetReadCache_Flush: Failed to read from asset file `%s`, %d", cache->m_FullPath, err)
+        return err;
+    }
+    cache->m_Stats->m_BytesRead += cache->m_ReadLength;
+    cache->m_ReadPtr += cache->m_ReadLength;
+    cache->m_ReadOffset += cache->m_ReadLength;
+    cache->m_ReadLength = 0;
+    return 0;
+}
 
-    char* tmp_block_path = (char*)target_storage_api->ConcatPath(target_storage_api, content_folder, tmp_block_name);
+static void AssetReadCache_Close(struct AssetReadCache* cache)
+{
+    if (cache->m_FileHandle)
+    {
+        cache->m_StorageAPI->CloseFile(cache->m_StorageAPI, cache->m_FileHandle);
+        cache->m_FileHandle = 0;
+    }
+    if (cache->m_FullPath)
+    {
+        Longtail_Free(cache->m_FullPath);
+        cache->m_FullPath = 0;
+    }
+    cache->m_AssetPath = 0;
+}
 
-    uint32_t block_data_size = 0;
-    for (uint64_t chunk_index = first_chunk_index; chunk_index < first_chunk_index + chunk_count; ++chunk_index)
+static int AssetReadCache_Open(struct AssetReadCache* cache, const char* assets_folder, const char* asset_path)
+{
+    cache->m_FullPath = cache->m_StorageAPI->ConcatPath(cache->m_StorageAPI, assets_folder, asset_path);
+    int err = cache->m_StorageAPI->OpenReadFile(cache->m_StorageAPI, cache->m_FullPath, &cache->m_FileHandle);
+    if (err)
     {
-        LONGTAIL_FATAL_ASSERT(content_index->m_ChunkBlockIndexes[chunk_index] == block_index, job->m_Err = EINVAL; return)
-        uint32_t chunk_size = content_index->m_ChunkLengths[chunk_index];
-        block_data_size += chunk_size;
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "AssetReadCache_Open: Failed to open asset file `%s`, %d", cache->m_FullPath, err)
+        cache->m_FileHandle = 0;
+        return err;
+    }
+    cache->m_Stats->m_FilesOpened += 1;
+    err = cache->m_StorageAPI->GetSize(cache->m_StorageAPI, cache->m_FileHandle, &cache->m_FileSize);
+    if (err)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "AssetReadCache_Open: Failed to get size of asset file `%s`, %d", cache->m_FullPath, err)
+        return err;
     }
+    cache->m_AssetPath = asset_path;
+    return 0;
+}
 
-    char* block_data_buffer = (char*)Longtail_Alloc(block_data_size);
-    LONGTAIL_FATAL_ASSERT(block_data_buffer, job->m_Err = ENOMEM; return)
-    char* write_buffer = block_data_buffer;
-    char* write_ptr = write_buffer;
+static int ReadBlockChunks(
+    struct Longtail_StorageAPI* source_storage_api,
+    const char* assets_folder,
+    const char* content_folder,
+    const struct Longtail_ContentIndex* content_index,
+    struct ChunkHashToAssetPart* asset_part_lookup,
+    uint64_t first_chunk_index,
+    uint32_t chunk_count,
+    char* out_data,
+    struct JobStats* job_stats,
+    uint32_t* out_compression_type)
+{
+    uint64_t block_index = content_index->m_ChunkBlockIndexes[first_chunk_index];
+    TLongtail_Hash block_hash = content_index->m_BlockHashes[block_index];
+
+    struct AssetReadCache cache;
+    memset(&cache, 0, sizeof(cache));
+    cache.m_StorageAPI = source_storage_api;
+    cache.m_ReadPtr = out_data;
+    cache.m_Stats = job_stats;
 
     uint32_t compression_type = 0;
+    int err = 0;
     for (uint64_t chunk_index = first_chunk_index; chunk_index < first_chunk_index + chunk_count; ++chunk_index)
     {
         TLongtail_Hash chunk_hash = content_index->m_ChunkHashes[chunk_index];
         uint32_t chunk_size = content_index->m_ChunkLengths[chunk_index];
         intptr_t tmp;
-        intptr_t asset_part_index = hmgeti_ts(job->m_AssetPartLookup, chunk_hash, tmp);
+        intptr_t asset_part_index = hmgeti_ts(asset_part_lookup, chunk_hash, tmp);
         if (asset_part_index == -1)
         {
-            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_WriteContentBlockJob: Failed to get path for asset content 0x%" PRIx64 " in `%s`", chunk_hash, content_folder)
-            Longtail_Free(block_data_buffer);
-            block_data_buffer = 0;
-            Longtail_Free((char*)tmp_block_path);
-            tmp_block_path = 0;
-            job->m_Err = EINVAL;
-            return;
+            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "ReadBlockChunks: Failed to get path for asset content 0x%" PRIx64 " in `%s`", chunk_hash, content_folder)
+            err = EINVAL;
+            break;
         }
-        struct AssetPart* asset_part = &job->m_AssetPartLookup[asset_part_index].value;
+        struct AssetPart* asset_part = &asset_part_lookup[asset_part_index].value;
         const char* asset_path = asset_part->m_Path;
         if (IsDirPath(asset_path))
         {
-            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_WriteContentBlockJob: Directory should not have any chunks `%s`", asset_path)
-            Longtail_Free(block_data_buffer);
-            block_data_buffer = 0;
-            Longtail_Free((char*)tmp_block_path);
-            tmp_block_path = 0;
-            job->m_Err = EINVAL;
-            return;
+            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "ReadBlockChunks: Directory should not have any chunks `%s`", asset_path)
+            err = EINVAL;
+            break;
         }
 
-        char* full_path = source_storage_api->ConcatPath(source_storage_api, job->m_AssetsFolder, asset_path);
         uint64_t asset_content_offset = asset_part->m_Start;
         if (chunk_index != first_chunk_index && compression_type != asset_part->m_CompressionType)
         {
-            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_WARNING, "Longtail_WriteContentBlockJob: Warning: Inconsistend compression type for chunks inside block 0x%" PRIx64 " in `%s`, retaining %u", block_hash, content_folder, compression_type)
+            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_WARNING, "ReadBlockChunks: Warning: Inconsistend compression type for chunks inside block 0x%" PRIx64 " in `%s`, retaining %u", block_hash, content_folder, compression_type)
         }
         else
         {
             compression_type = asset_part->m_CompressionType;
         }
-        Longtail_StorageAPI_HOpenFile file_handle;
-        int err = source_storage_api->OpenReadFile(source_storage_api, full_path, &file_handle);
-        if (err)
+
+        // Asset paths point into the version index name data so equal paths share the same pointer
+        if (asset_path != cache.m_AssetPath)
         {
-            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_WriteContentBlockJob: Failed to open asset file `%s`, %d", full_path, err)
-            Longtail_Free(block_data_buffer);
-            block_data_buffer = 0;
-            Longtail_Free((char*)tmp_block_path);
-            tmp_block_path = 0;
-            job->m_Err = err;
-            return;
+            err = AssetReadCache_Flush(&cache);
+            if (err)
+            {
+                break;
+            }
+            AssetReadCache_Close(&cache);
+            err = AssetReadCache_Open(&cache, assets_folder, asset_path);
+            if (err)
+            {
+                break;
+            }
         }
-        uint64_t asset_file_size;
-        err = source_storage_api->GetSize(source_storage_api, file_handle, &asset_file_size);
-        if (err)
+        else if (asset_content_offset != cache.m_ReadOffset + cache.m_ReadLength)
         {
-            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_WriteContentBlockJob: Failed to get size of asset file `%s`, %d", full_path, err)
-            Longtail_Free(block_data_buffer);
-            block_data_buffer = 0;
-            Longtail_Free((char*)tmp_block_path);
-            tmp_block_path = 0;
-            job->m_Err = err;
-            return;
+            err = AssetReadCache_Flush(&cache);
+            if (err)
+            {
+                break;
+            }
         }
-        if (asset_file_size < (asset_content_offset + chunk_size))
+
+        if (cache.m_FileSize < (asset_content_offset + chunk_size))
         {
-            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_WriteContentBlockJob: Mismatching asset size in asset `%s`, size is %" PRIu64 ", but expecting at least %" PRIu64 "", full_path, asset_file_size, asset_content_offset + chunk_size)
-            Longtail_Free(block_data_buffer);
-            block_data_buffer = 0;
-            Longtail_Free((char*)tmp_block_path);
-            tmp_block_path = 0;
-            source_storage_api->CloseFile(source_storage_api, file_handle);
-            file_handle = 0;
-            job->m_Err = EBADF;
-            return;
+            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "ReadBlockChunks: Mismatching asset size in asset `%s`, size is %" PRIu64 ", but expecting at least %" PRIu64 "", cache.m_FullPath, cache.m_FileSize, asset_content_offset + chunk_size)
+            err = EBADF;
+            break;
         }
-        err = source_storage_api->Read(source_storage_api, file_handle, asset_content_offset, chunk_size, write_ptr);
-        if (err)
+        if (cache.m_ReadLength == 0)
         {
-            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_WriteContentBlockJob: Failed to read from asset file `%s`, %d", full_path, err)
-            Longtail_Free(block_data_buffer);
-            block_data_buffer = 0;
-            Longtail_Free((char*)tmp_block_path);
-            tmp_block_path = 0;
-            source_storage_api->CloseFile(source_storage_api, file_handle);
-            file_handle = 0;
-            job->m_Err = err;
-            return;
+            cache.m_ReadOffset = asset_content_offset;
         }
-        write_ptr += chunk_size;
+        cache.m_ReadLength += chunk_size;
+    }
 
-        source_storage_api->CloseFile(source_storage_api, file_handle);
-        Longtail_Free((char*)full_path);
-        full_path = 0;
+    if (!err)
+    {
+        err = AssetReadCache_Flush(&cache);
+    }
+    AssetReadCache_Close(&cache);
+    if (err)
+    {
+        return err;
+    }
+    *out_compression_type = compression_type;
+    return 0;
+}
+
+static void Longtail_ReadContentBlockJob(void* context, int is_cancelled)
+{
+    LONGTAIL_FATAL_ASSERT(context != 0, return)
+
+    struct WriteBlockJob* job = (struct WriteBlockJob*)context;
+    job->m_Stats.m_JobsRun += 1;
+    if (job->m_Err)
+    {
+        return;
+    }
+    if (is_cancelled)
+    {
+        job->m_Err = ECANCELED;
+        return;
+    }
+    const struct Longtail_ContentIndex* content_index = job->m_ContentIndex;
+    uint64_t first_chunk_index = job->m_FirstChunkIndex;
+    uint32_t chunk_count = job->m_ChunkCount;
+
+    uint32_t block_data_size = 0;
+    for (uint64_t chunk_index = first_chunk_index; chunk_index < first_chunk_index + chunk_count; ++chunk_index)
+    {
+        LONGTAIL_FATAL_ASSERT(content_index->m_ChunkBlockIndexes[chunk_index] == content_index->m_ChunkBlockIndexes[first_chunk_index], job->m_Err = EINVAL; return)
+        uint32_t chunk_size = content_index->m_ChunkLengths[chunk_index];
+        block_data_size += chunk_size;
+    }
+
+    struct WriteBlockBuffer* buffer = job->m_Buffer;
+    int err = GrowBuffer(&buffer->m_BlockData, &buffer->m_BlockDataCapacity, block_data_size);
+    if (err)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_ReadContentBlockJob: Failed to allocate %u bytes for block 0x%" PRIx64 ", %d", block_data_size, job->m_BlockHash, err)
+        job->m_Err = err;
+        return;
+    }
+
+    uint32_t compression_type = 0;
+    err = ReadBlockChunks(
+        job->m_SourceStorageAPI,
+        job->m_AssetsFolder,
+        job->m_ContentFolder,
+        content_index,
+        job->m_AssetPartLookup,
+        first_chunk_index,
+        chunk_count,
+        buffer->m_BlockData,
+        &job->m_Stats,
+        &compression_type);
+    if (err)
+    {
+        job->m_Err = err;
+        return;
+    }
+    job->m_BlockDataSize = block_data_size;
+    job->m_CompressionType = compression_type;
+    job->m_Err = 0;
+}
+
+#ifndef LONGTAIL_ADAPTIVE_COMPRESSION_MIN_GAIN_PERCENT
+    #define LONGTAIL_ADAPTIVE_COMPRESSION_MIN_GAIN_PERCENT  5u
+#endif
+
+// Smaller blocks are not worth splitting across threads
+#define LONGTAIL_MULTITHREADED_COMPRESSION_MIN_BLOCK_SIZE   (1024u * 1024u)
+
+#define LONGTAIL_ADAPTIVE_COMPRESSION_SAMPLE_COUNT  16u
+#define LONGTAIL_ADAPTIVE_COMPRESSION_SAMPLE_SIZE   1024u
+
+// Cheap estimate to skip compressing already compressed data (audio, images, video). Samples
+// a few windows of the block and checks if the byte histogram is as flat as random data, using
+// the chi-square statistic which is ~255 for uniformly distributed bytes
+static int IsIncompressibleBlock(const char* data, uint32_t size)
+{
+    const uint32_t sample_count = LONGTAIL_ADAPTIVE_COMPRESSION_SAMPLE_COUNT;
+    const uint32_t sample_size = LONGTAIL_ADAPTIVE_COMPRESSION_SAMPLE_SIZE;
+    if (size < sample_count * sample_size)
+    {
+        // Small enough to just try compressing it
+        return 0;
+    }
+    uint32_t histogram[256];
+    memset(histogram, 0, sizeof(histogram));
+    uint32_t sample_stride = (size - sample_size) / (sample_count - 1);
+    for (uint32_t s = 0; s < sample_count; ++s)
+    {
+        const unsigned char* sample = (const unsigned char*)&data[s * sample_stride];
+        for (uint32_t i = 0; i < sample_size; ++i)
+        {
+            ++histogram[sample[i]];
+        }
+    }
+    uint64_t n = sample_count * sample_size;
+    uint64_t sum_squares = 0;
+    for (uint32_t b = 0; b < 256; ++b)
+    {
+        sum_squares += (uint64_t)histogram[b] * histogram[b];
+    }
+    uint64_t chi_square = (sum_squares * 256u) / n - n;
+    return chi_square < 512u;
+}
+
+static void Longtail_CompressContentBlockJob(void* context, int is_cancelled)
+{
+    LONGTAIL_FATAL_ASSERT(context != 0, return)
+
+    struct WriteBlockJob* job = (struct WriteBlockJob*)context;
+    job->m_Stats.m_JobsRun += 1;
+    if (job->m_Err)
+    {
+        return;
+    }
+    if (is_cancelled)
+    {
+        job->m_Err = ECANCELED;
+        return;
+    }
+
+    struct WriteBlockBuffer* buffer = job->m_Buffer;
+    int adaptive = (job->m_CompressionType & LONGTAIL_ADAPTIVE_COMPRESSION_FLAG) != 0;
+    job->m_CompressionType &= ~LONGTAIL_ADAPTIVE_COMPRESSION_FLAG;
+    if (adaptive && IsIncompressibleBlock(buffer->m_BlockData, job->m_BlockDataSize))
+    {
+        job->m_CompressionType = 0;
+    }
+    if (job->m_CompressionType == 0)
+    {
+        job->m_WriteData = buffer->m_BlockData;
+        job->m_WriteSize = job->m_BlockDataSize;
+        return;
+    }
+
+    struct Longtail_CompressionRegistryAPI* compression_registry_api = job->m_CompressionRegistryAPI;
+    // Extra compression threads only go to job workers that are not compressing another block
+    int32_t compressing_job_count = ATOMICADD32(job->m_CompressingJobCount, 1);
+    uint32_t idle_worker_count = job->m_JobWorkerCount > (uint32_t)compressing_job_count ? job->m_JobWorkerCount - (uint32_t)compressing_job_count : 0u;
+    uint32_t worker_count = 1u;
+    if (job->m_BlockDataSize >= LONGTAIL_MULTITHREADED_COMPRESSION_MIN_BLOCK_SIZE && job->m_CompressionWorkerCount > 1u)
+    {
+        worker_count += (job->m_CompressionWorkerCount - 1u) < idle_worker_count ? (job->m_CompressionWorkerCount - 1u) : idle_worker_count;
+    }
+    uint32_t candidate_count;
+    const uint32_t* candidate_types;
+    uint32_t max_size_overhead_percent;
+    size_t compressed_size;
+    char* compressed_data;
+    int err;
+    if (compression_registry_api->GetCompressionCandidates &&
+        0 == compression_registry_api->GetCompressionCandidates(compression_registry_api, job->m_CompressionType, &candidate_count, &candidate_types, &max_size_overhead_percent))
+    {
+        err = CompressBlockBestOf(
+            compression_registry_api,
+            candidate_count,
+            candidate_types,
+            max_size_overhead_percent,
+            job->m_BlockDataSize,
+            &compressed_size,
+            buffer->m_BlockData,
+            buffer,
+            sizeof(uint32_t) + sizeof(uint32_t),
+            worker_count,
+            &job->m_CompressionType,
+            &compressed_data);
+    }
+    else
+    {
+        err = CompressBlock(
+            compression_registry_api,
+            job->m_CompressionType,
+            job->m_BlockDataSize,
+            &compressed_size,
+            buffer->m_BlockData,
+            buffer,
+            sizeof(uint32_t) + sizeof(uint32_t),
+            worker_count,
+            &compressed_data);
+    }
+    (void)ATOMICADD32(job->m_CompressingJobCount, -1);
+    if (err)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_CompressContentBlockJob: Failed to compress block 0x%" PRIx64 ", %d", job->m_BlockHash, err)
+        job->m_Err = err;
+        return;
+    }
+    job->m_Stats.m_BytesCompressed += job->m_BlockDataSize;
+    // Not worth paying for decompression on every download
+    if (adaptive && (sizeof(uint32_t) + sizeof(uint32_t) + compressed_size) * 100u > (uint64_t)job->m_BlockDataSize * (100u - LONGTAIL_ADAPTIVE_COMPRESSION_MIN_GAIN_PERCENT))
+    {
+        job->m_CompressionType = 0;
+        job->m_WriteData = buffer->m_BlockData;
+        job->m_WriteSize = job->m_BlockDataSize;
+        return;
+    }
+    ((uint32_t*)(void*)compressed_data)[0] = (uint32_t)job->m_BlockDataSize;
+    ((uint32_t*)(void*)compressed_data)[1] = (uint32_t)compressed_size;
+    job->m_WriteData = compressed_data;
+    job->m_WriteSize = (uint32_t)(sizeof(uint32_t) + sizeof(uint32_t) + compressed_size);
+}
+
+static void Longtail_WriteContentBlockJob(void* context, int is_cancelled)
+{
+    LONGTAIL_FATAL_ASSERT(context != 0, return)
+    LONGTAIL_TRACE_BEGIN(write_content_block, "WriteContentBlockJob")
+
+    struct WriteBlockJob* job = (struct WriteBlockJob*)context;
+    job->m_Stats.m_JobsRun += 1;
+    if (job->m_Err)
+    {
+        LONGTAIL_TRACE_END(write_content_block)
+        return;
+    }
+    if (is_cancelled)
+    {
+        job->m_Err = ECANCELED;
+        LONGTAIL_TRACE_END(write_content_block)
+        return;
     }
+    struct Longtail_StorageAPI* target_storage_api = job->m_TargetStorageAPI;
 
-    if (compression_type != 0)
-    {
-        size_t compressed_size;
-        char* compressed_buffer;
-        int err = CompressBlock(
-            compression_registry_api,
-            compression_type,
-            block_data_size,
-            &compressed_size,
-            write_buffer,
-            &compressed_buffer,
-            sizeof(uint32_t) + sizeof(uint32_t));
-        ((uint32_t*)(void*)compressed_buffer)[0] = (uint32_t)block_data_size;
-        ((uint32_t*)(void*)compressed_buffer)[1] = (uint32_t)compressed_size;
-        if (err)
-        {
-            Longtail_Free(block_data_buffer);
-            block_data_buffer = 0;
-            Longtail_Free((char*)tmp_block_path);
-            job->m_Err = err;
-            return;
-        }
+    const struct Longtail_ContentIndex* content_index = job->m_ContentIndex;
+    const char* content_folder = job->m_ContentFolder;
+    uint64_t first_chunk_index = job->m_FirstChunkIndex;
+    uint32_t chunk_count = job->m_ChunkCount;
+    uint64_t block_index = content_index->m_ChunkBlockIndexes[first_chunk_index];
+    TLongtail_Hash block_hash = content_index->m_BlockHashes[block_index];
 
-        Longtail_Free(block_data_buffer);
-        block_data_buffer = 0;
-        block_data_size = (uint32_t)(sizeof(uint32_t) + sizeof(uint32_t) + compressed_size);
-        block_data_buffer = compressed_buffer;
-    }
+    char tmp_block_name[MAX_BLOCK_NAME_LENGTH + 4];
+    GetBlockName(job->m_BlockHash, tmp_block_name);
+    strcat(tmp_block_name, ".tmp");
+
+    char* tmp_block_path = (char*)target_storage_api->ConcatPath(target_storage_api, content_folder, tmp_block_name);
 
     int err = EnsureParentPathExists(target_storage_api, tmp_block_path);
     if (err)
     {
         LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_WriteContentBlockJob: Failed to create parent path for `%s`, %d", tmp_block_path, err)
-        Longtail_Free(block_data_buffer);
-        block_data_buffer = 0;
         Longtail_Free((char*)tmp_block_path);
         job->m_Err = err;
+        LONGTAIL_TRACE_END(write_content_block)
         return;
     }
 
@@ -2397,30 +3219,25 @@ static void Longtail_WriteContentBlockJob(void* context)
     if (err)
     {
         LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_WriteContentBlockJob: Failed to create block file `%s`, %d", tmp_block_path, err)
-        Longtail_Free(block_data_buffer);
-        block_data_buffer = 0;
         Longtail_Free((char*)tmp_block_path);
         tmp_block_path = 0;
         job->m_Err = err;
+        LONGTAIL_TRACE_END(write_content_block)
         return;
     }
-    err = target_storage_api->Write(target_storage_api, block_file_handle, 0, block_data_size, block_data_buffer);
+    err = target_storage_api->Write(target_storage_api, block_file_handle, 0, job->m_WriteSize, job->m_WriteData);
     if (err)
     {
         LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_WriteContentBlockJob: Failed to write to block file `%s`, %d", tmp_block_path, err)
         target_storage_api->CloseFile(target_storage_api, block_file_handle);
         block_file_handle = 0;
-        Longtail_Free(block_data_buffer);
-        block_data_buffer = 0;
         Longtail_Free((char*)tmp_block_path);
         tmp_block_path = 0;
         job->m_Err = err;
+        LONGTAIL_TRACE_END(write_content_block)
         return;
     }
-    Longtail_Free(block_data_buffer);
-    block_data_buffer = 0;
-    uint32_t write_offset = block_data_size;
-
+    uint32_t write_offset = job->m_WriteSize;
     uint32_t aligned_size = (((write_offset + 15) / 16) * 16);
     uint32_t padding = aligned_size - write_offset;
     if (padding)
@@ -2434,17 +3251,18 @@ static void Longtail_WriteContentBlockJob(void* context)
             Longtail_Free((char*)tmp_block_path);
             tmp_block_path = 0;
             job->m_Err = err;
+            LONGTAIL_TRACE_END(write_content_block)
             return;
         }
         write_offset = aligned_size;
     }
-    struct BlockIndex* block_index_ptr = (struct BlockIndex*)Longtail_Alloc(GetBlockIndexSize(chunk_count));
+    struct BlockIndex* block_index_ptr = (struct BlockIndex*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, GetBlockIndexSize(chunk_count));
     LONGTAIL_FATAL_ASSERT(block_index_ptr, job->m_Err = ENOMEM; return)
     InitBlockIndex(block_index_ptr, chunk_count);
     memmove(block_index_ptr->m_ChunkHashes, &content_index->m_ChunkHashes[first_chunk_index], sizeof(TLongtail_Hash) * chunk_count);
     memmove(block_index_ptr->m_ChunkSizes, &content_index->m_ChunkLengths[first_chunk_index], sizeof(uint32_t) * chunk_count);
     *block_index_ptr->m_BlockHash = block_hash;
-    *block_index_ptr->m_ChunkCompressionType = compression_type;
+    *block_index_ptr->m_ChunkCompressionType = job->m_CompressionType;
     *block_index_ptr->m_ChunkCount = chunk_count;
     size_t block_index_data_size = GetBlockIndexDataSize(chunk_count);
     err = target_storage_api->Write(target_storage_api, block_file_handle, write_offset, block_index_data_size, &block_index_ptr[1]);
@@ -2458,12 +3276,25 @@ static void Longtail_WriteContentBlockJob(void* context)
         Longtail_Free((char*)tmp_block_path);
         tmp_block_path = 0;
         job->m_Err = err;
+        LONGTAIL_TRACE_END(write_content_block)
         return;
     }
     Longtail_Free(block_index_ptr);
     block_index_ptr = 0;
 
     target_storage_api->CloseFile(target_storage_api, block_file_handle);
+    job->m_Stats.m_FilesOpened += 1;
+    job->m_Stats.m_BytesWritten += write_offset + block_index_data_size;
+    if (IsCancelled(job->m_CancelAPI, job->m_CancelToken))
+    {
+        // Don't publish the block, the content folder should only hold blocks from completed writes
+        target_storage_api->RemoveFile(target_storage_api, tmp_block_path);
+        Longtail_Free((char*)tmp_block_path);
+        tmp_block_path = 0;
+        job->m_Err = ECANCELED;
+        LONGTAIL_TRACE_END(write_content_block)
+        return;
+    }
     err = target_storage_api->RenameFile(target_storage_api, tmp_block_path, job->m_BlockPath);
     if (err)
     {
@@ -2471,12 +3302,56 @@ static void Longtail_WriteContentBlockJob(void* context)
         Longtail_Free((char*)tmp_block_path);
         tmp_block_path = 0;
         job->m_Err = err;
+        LONGTAIL_TRACE_END(write_content_block)
         return;
     }
     Longtail_Free((char*)tmp_block_path);
     tmp_block_path = 0;
 
     job->m_Err = 0;
+    LONGTAIL_TRACE_END(write_content_block)
+}
+
+static void WriteContentStart(void* context, int is_cancelled)
+{
+    // Nothing to do here, releases the first block of each buffer
+}
+
+// Creates the read, compress and write jobs for a block, the read job waits for `after_job`. If setting up fails
+// the block is flagged as failed so its jobs skip their work, a job that could not be linked is returned in
+// `out_unlinked_job` as it has to be readied on its own
+static int WriteContent_CreateBlockJobs(
+    struct Longtail_JobAPI* job_api,
+    Longtail_JobAPI_Group job_group,
+    struct WriteBlockJob* job,
+    Longtail_JobAPI_Jobs after_job,
+    Longtail_JobAPI_Jobs* out_write_job,
+    Longtail_JobAPI_Jobs* out_unlinked_job)
+{
+    Longtail_JobAPI_JobFunc funcs[3] = { Longtail_ReadContentBlockJob, Longtail_CompressContentBlockJob, Longtail_WriteContentBlockJob };
+    void* ctxs[3] = { job, job, job };
+    uint32_t channels[3] = { LONGTAIL_JOB_CHANNEL_IO, LONGTAIL_JOB_CHANNEL_CPU, LONGTAIL_JOB_CHANNEL_IO };
+    Longtail_JobAPI_Jobs previous_job = after_job;
+    for (uint32_t stage = 0; stage < 3; ++stage)
+    {
+        Longtail_JobAPI_Jobs stage_job;
+        int err = job_api->CreateJobs(job_api, job_group, channels[stage], 1, &funcs[stage], &ctxs[stage], &stage_job);
+        if (err)
+        {
+            job->m_Err = err;
+            return err;
+        }
+        err = job_api->AddDependecies(job_api, 1, stage_job, 1, previous_job);
+        if (err)
+        {
+            job->m_Err = err;
+            *out_unlinked_job = stage_job;
+            return err;
+        }
+        previous_job = stage_job;
+    }
+    *out_write_job = previous_job;
+    return 0;
 }
 
 int Longtail_WriteContent(
@@ -2486,6 +3361,9 @@ int Longtail_WriteContent(
     struct Longtail_JobAPI* job_api,
     Longtail_JobAPI_ProgressFunc job_progress_func,
     void* job_progress_context,
+    struct Longtail_CancelAPI* optional_cancel_api,
+    Longtail_CancelAPI_HCancelToken optional_cancel_token,
+    struct Longtail_Stats* optional_stats,
     struct Longtail_ContentIndex* content_index,
     struct Longtail_VersionIndex* version_index,
     const char* assets_folder,
@@ -2513,22 +3391,23 @@ int Longtail_WriteContent(
         return 0;
     }
 
-    int err = job_api->ReserveJobs(job_api, (uint32_t)block_count);
-    if (err)
-    {
-        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_WriteContent: Failed to reserve jobs when writing to `%s`, %d", content_folder, err)
-        return err;
-    }
+    struct StatsPhase stats_phase;
+    Stats_BeginPhase(optional_stats, &stats_phase);
 
     struct ChunkHashToAssetPart* asset_part_lookup;
-    err = CreateAssetPartLookup(version_index, &asset_part_lookup);
+    int err = CreateAssetPartLookup(version_index, &asset_part_lookup);
     if (!asset_part_lookup)
     {
         return err;
     }
 
-    struct WriteBlockJob* write_block_jobs = (struct WriteBlockJob*)Longtail_Alloc((size_t)(sizeof(struct WriteBlockJob) * block_count));
-    LONGTAIL_FATAL_ASSERT(write_block_jobs, return ENOMEM)
+    struct WriteBlockJob* write_block_jobs = (struct WriteBlockJob*)Longtail_AllocTagged(LONGTAIL_MEMTAG_JOBS, (size_t)(sizeof(struct WriteBlockJob) * block_count));
+    if (!write_block_jobs)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_WriteContent: Failed to allocate jobs when writing to `%s`, %d", content_folder, ENOMEM)
+        hmfree(asset_part_lookup);
+        return ENOMEM;
+    }
     uint32_t block_start_chunk_index = 0;
     uint32_t job_count = 0;
     for (uint64_t block_index = 0; block_index < block_count; ++block_index)
@@ -2565,31 +3444,142 @@ int Longtail_WriteContent(
         job->m_AssetPartLookup = asset_part_lookup;
         job->m_FirstChunkIndex = block_start_chunk_index;
         job->m_ChunkCount = chunk_count;
-        job->m_Err = EINVAL;
+        job->m_Buffer = 0;
+        job->m_BlockDataSize = 0;
+        job->m_CompressionType = 0;
+        job->m_CompressionWorkerCount = 1;
+        job->m_JobWorkerCount = 1;
+        job->m_CompressingJobCount = 0;
+        job->m_WriteData = 0;
+        job->m_WriteSize = 0;
+        job->m_CancelAPI = optional_cancel_api;
+        job->m_CancelToken = optional_cancel_token;
+        memset(&job->m_Stats, 0, sizeof(job->m_Stats));
+        job->m_Err = 0;
 
-        Longtail_JobAPI_JobFunc func[1] = { Longtail_WriteContentBlockJob };
-        void* ctx[1] = { job };
+        block_start_chunk_index += chunk_count;
+    }
 
-        Longtail_JobAPI_Jobs jobs;
-        err = job_api->CreateJobs(job_api, 1, func, ctx, &jobs);
-        LONGTAIL_FATAL_ASSERT(!err, return err)
-        err = job_api->ReadyJobs(job_api, 1, jobs);
-        LONGTAIL_FATAL_ASSERT(!err, return err)
+    // Blocks are pushed through a read -> compress -> write pipeline. There is a bounded set of
+    // block buffers; the read stage of a block waits for the write stage of the block that used
+    // the same buffer before it so reads and compression overlap without unbounded memory use
+    const uint32_t worker_count = job_api->GetWorkerCount(job_api) + 1;
+    uint32_t buffer_count = worker_count * 2u;
+    if (buffer_count > job_count)
+    {
+        buffer_count = job_count;
+    }
+    struct WriteBlockBuffer* buffers = 0;
+    Longtail_JobAPI_Jobs* write_jobs = 0;
+    if (job_count > 0)
+    {
+        buffers = (struct WriteBlockBuffer*)Longtail_AllocTagged(LONGTAIL_MEMTAG_BLOCK_DATA, sizeof(struct WriteBlockBuffer) * buffer_count);
+        write_jobs = (Longtail_JobAPI_Jobs*)Longtail_AllocTagged(LONGTAIL_MEMTAG_JOBS, sizeof(Longtail_JobAPI_Jobs) * job_count);
+        if (!buffers || !write_jobs)
+        {
+            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_WriteContent: Failed to allocate block buffers when writing to `%s`, %d", content_folder, ENOMEM)
+            err = ENOMEM;
+        }
+        else
+        {
+            memset(buffers, 0, sizeof(struct WriteBlockBuffer) * buffer_count);
+        }
+    }
 
-        block_start_chunk_index += chunk_count;
+    // One extra job that the first block of each buffer waits for, so the whole graph is set up before any job runs
+    Longtail_JobAPI_Group job_group = 0;
+    int abandoned_job_is_running = 0;
+    int32_t volatile compressing_job_count = 0;
+    if (!err && job_count > 0)
+    {
+        err = job_api->ReserveJobs(job_api, job_count * 3u + 1u, optional_cancel_api, optional_cancel_token, &job_group);
+        if (err)
+        {
+            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_WriteContent: Failed to reserve jobs when writing to `%s`, %d", content_folder, err)
+        }
     }
 
-    err = job_api->WaitForAllJobs(job_api, job_progress_context, job_progress_func);
-    LONGTAIL_FATAL_ASSERT(!err, return err)
+    if (job_group)
+    {
+        Longtail_JobAPI_JobFunc start_func[1] = { WriteContentStart };
+        void* start_ctx[1] = { 0 };
+        Longtail_JobAPI_Jobs start_job = 0;
+        err = job_api->CreateJobs(job_api, job_group, LONGTAIL_JOB_CHANNEL_CPU, 1, start_func, start_ctx, &start_job);
+        Longtail_JobAPI_Jobs unlinked_job = 0;
+        for (uint32_t j = 0; !err && j < job_count; ++j)
+        {
+            struct WriteBlockJob* job = &write_block_jobs[j];
+            job->m_Buffer = &buffers[j % buffer_count];
+
+            // The last blocks of the call may use the workers that run out of blocks to compress
+            uint32_t blocks_left = job_count - j;
+            job->m_CompressionWorkerCount = blocks_left < worker_count ? worker_count / blocks_left : 1u;
+            job->m_JobWorkerCount = worker_count;
+            job->m_CompressingJobCount = &compressing_job_count;
+
+            err = WriteContent_CreateBlockJobs(job_api, job_group, job, j < buffer_count ? start_job : write_jobs[j - buffer_count], &write_jobs[j], &unlinked_job);
+        }
+        if (err)
+        {
+            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_WriteContent: Failed to create jobs when writing to `%s`, %d", content_folder, err)
+        }
+
+        // A job that could not be linked skips its work, it is readied first so that if readying fails no job has run
+        int ready_err = unlinked_job ? job_api->ReadyJobs(job_api, 1, unlinked_job) : 0;
+        if (!ready_err && start_job)
+        {
+            // Blocks that were set up before a failure still run, the group has to complete before the buffers are released
+            ready_err = job_api->ReadyJobs(job_api, 1, start_job);
+            abandoned_job_is_running = ready_err != 0 && unlinked_job != 0;
+        }
+        if (ready_err)
+        {
+            // The group will never complete, it is abandoned
+            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_WriteContent: Failed to start jobs when writing to `%s`, %d", content_folder, ready_err)
+            err = err ? err : ready_err;
+            job_group = 0;
+        }
+    }
+    if (job_group)
+    {
+        int wait_err = job_api->WaitForAllJobs(job_api, job_group, job_progress_context, job_progress_func);
+        err = err ? err : wait_err;
+    }
+    for (uint32_t j = 0; !err && j < job_count; ++j)
+    {
+        err = write_block_jobs[j].m_Err;
+    }
+
+    for (uint32_t b = 0; buffers && b < buffer_count; ++b)
+    {
+        Longtail_Free(buffers[b].m_BlockData);
+        buffers[b].m_BlockData = 0;
+        for (ptrdiff_t i = 0; i < arrlen(buffers[b].m_CompressionContexts); ++i)
+        {
+            struct CompressionContextSlot* slot = &buffers[b].m_CompressionContexts[i];
+            slot->m_CompressionAPI->DeleteCompressionContext(slot->m_CompressionAPI, slot->m_CompressionContext);
+            Longtail_Free(slot->m_CompressedData);
+            slot->m_CompressedData = 0;
+        }
+        arrfree(buffers[b].m_CompressionContexts);
+    }
+    Longtail_Free(buffers);
+    buffers = 0;
+    Longtail_Free(write_jobs);
+    write_jobs = 0;
 
-    err = 0;
+    if (err == ECANCELED)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_INFO, "Longtail_WriteContent: Cancelled writing content to `%s`", content_folder)
+    }
+    Stats_EndPhase(optional_stats, LONGTAIL_STATS_PHASE_WRITE_BLOCKS, &stats_phase);
     while (job_count--)
     {
         struct WriteBlockJob* job = &write_block_jobs[job_count];
-        if (job->m_Err)
+        Stats_AddJobStats(optional_stats, &job->m_Stats);
+        if (job->m_Err && job->m_Err != ECANCELED)
         {
             LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_WriteContent: Failed to write content to `%s`, %d", content_folder, job->m_Err)
-            err = err ? err : job->m_Err;
         }
         Longtail_Free((void*)job->m_BlockPath);
         job->m_BlockPath = 0;
@@ -2597,9 +3587,14 @@ int Longtail_WriteContent(
 
     hmfree(asset_part_lookup);
     asset_part_lookup = 0;
-    Longtail_Free(write_block_jobs);
+    // A skipping job only touches its block so the blocks are left allocated if it may still run
+    if (!abandoned_job_is_running)
+    {
+        Longtail_Free(write_block_jobs);
+    }
     write_block_jobs = 0;
 
+    Longtail_LogMemTagStats("Longtail_WriteContent");
     return err;
 }
 
@@ -2636,7 +3631,7 @@ static int CreateContentLookup(
     LONGTAIL_FATAL_ASSERT(chunk_count == 0 || chunk_hashes != 0, return EINVAL)
     LONGTAIL_FATAL_ASSERT(chunk_count == 0 || chunk_block_indexes != 0, return EINVAL)
 
-    struct ContentLookup* cl = (struct ContentLookup*)Longtail_Alloc(sizeof(struct ContentLookup));
+    struct ContentLookup* cl = (struct ContentLookup*)Longtail_AllocTagged(LONGTAIL_MEMTAG_LOOKUP, sizeof(struct ContentLookup));
     LONGTAIL_FATAL_ASSERT(cl, return ENOMEM)
     cl->m_BlockHashToBlockIndex = 0;
     cl->m_ChunkHashToChunkIndex = 0;
@@ -2664,29 +3659,102 @@ struct BlockDecompressorJob
     struct Longtail_CompressionRegistryAPI* m_CompressionRegistryAPI;
     const char* m_ContentFolder;
     TLongtail_Hash m_BlockHash;
+    // Holds the stored block between BlockReader and BlockDecompressor, then the decompressed block
     void* m_BlockData;
+    uint64_t m_StoredBlockSize;
+    struct JobStats m_Stats;
     int m_Err;
 };
 
-static void BlockDecompressor(void* context)
+// Runs on the IO channel and hands the stored block to BlockDecompressor which runs on the CPU channel
+static void BlockReader(void* context, int is_cancelled)
 {
     LONGTAIL_FATAL_ASSERT(context != 0, return)
+    LONGTAIL_TRACE_BEGIN(block_reader, "BlockReader")
 
     struct BlockDecompressorJob* job = (struct BlockDecompressorJob*)context;
+    job->m_Stats.m_JobsRun += 1;
+    if (is_cancelled)
+    {
+        job->m_Err = ECANCELED;
+        LONGTAIL_TRACE_END(block_reader)
+        return;
+    }
     job->m_Err = ReadBlockData(
         job->m_ContentStorageAPI,
-        job->m_CompressionRegistryAPI,
         job->m_ContentFolder,
         job->m_BlockHash,
-        &job->m_BlockData);
+        &job->m_Stats,
+        &job->m_BlockData,
+        &job->m_StoredBlockSize);
+    if (job->m_Err)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "BlockReader: Failed to read block 0x%" PRIx64 " from `%s`, %d", job->m_BlockHash, job->m_ContentFolder, job->m_Err)
+    }
+    LONGTAIL_TRACE_END(block_reader)
+}
+
+static void BlockDecompressor(void* context, int is_cancelled)
+{
+    LONGTAIL_FATAL_ASSERT(context != 0, return)
+    LONGTAIL_TRACE_BEGIN(block_decompressor, "BlockDecompressor")
+
+    struct BlockDecompressorJob* job = (struct BlockDecompressorJob*)context;
+    job->m_Stats.m_JobsRun += 1;
     if (job->m_Err)
     {
-        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "BlockDecompressor: Failed to read block 0x%" PRIx64 " from `%s`, %d", job->m_BlockHash, job->m_ContentFolder, job->m_Err)
+        LONGTAIL_TRACE_END(block_decompressor)
+        return;
+    }
+    void* stored_block_data = job->m_BlockData;
+    job->m_BlockData = 0;
+    if (is_cancelled)
+    {
+        Longtail_Free(stored_block_data);
+        job->m_Err = ECANCELED;
+        LONGTAIL_TRACE_END(block_decompressor)
         return;
     }
+    job->m_Err = DecodeBlockData(
+        job->m_CompressionRegistryAPI,
+        job->m_BlockHash,
+        stored_block_data,
+        job->m_StoredBlockSize,
+        &job->m_Stats,
+        &job->m_BlockData);
+    if (job->m_Err)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "BlockDecompressor: Failed to decode block 0x%" PRIx64 " from `%s`, %d", job->m_BlockHash, job->m_ContentFolder, job->m_Err)
+    }
+    LONGTAIL_TRACE_END(block_decompressor)
+}
+
+// Creates the read and decompress jobs for a block, the caller adds its dependency on *out_decompress_job
+// and readies *out_read_job
+static int CreateBlockDecompressorJobs(
+    struct Longtail_JobAPI* job_api,
+    Longtail_JobAPI_Group job_group,
+    struct BlockDecompressorJob* block_job,
+    Longtail_JobAPI_Jobs* out_read_job,
+    Longtail_JobAPI_Jobs* out_decompress_job)
+{
+    Longtail_JobAPI_JobFunc read_funcs[1] = { BlockReader };
+    Longtail_JobAPI_JobFunc decompress_funcs[1] = { BlockDecompressor };
+    void* ctxs[1] = { block_job };
+    int err = job_api->CreateJobs(job_api, job_group, LONGTAIL_JOB_CHANNEL_IO, 1, read_funcs, ctxs, out_read_job);
+    if (err)
+    {
+        return err;
+    }
+    err = job_api->CreateJobs(job_api, job_group, LONGTAIL_JOB_CHANNEL_CPU, 1, decompress_funcs, ctxs, out_decompress_job);
+    if (err)
+    {
+        return err;
+    }
+    return job_api->AddDependecies(job_api, 1, *out_decompress_job, 1, *out_read_job);
 }
 
-static void WriteReady(void* context)
+static void WriteReady(void* context, int is_cancelled)
 {
     // Nothing to do here, we are just a syncronization point
 }
@@ -2699,6 +3767,7 @@ struct WritePartialAssetFromBlocksJob
     struct Longtail_StorageAPI* m_VersionStorageAPI;
     struct Longtail_CompressionRegistryAPI* m_CompressionRegistryAPI;
     struct Longtail_JobAPI* m_JobAPI;
+    Longtail_JobAPI_Group m_JobGroup;
     const struct Longtail_ContentIndex* m_ContentIndex;
     const struct Longtail_VersionIndex* m_VersionIndex;
     const char* m_ContentFolder;
@@ -2714,10 +3783,13 @@ struct WritePartialAssetFromBlocksJob
 
     Longtail_StorageAPI_HOpenFile m_AssetOutputFile;
 
+    // Summed over all parts of the asset since the job is reused for each part
+    struct JobStats m_Stats;
+
     int m_Err;
 };
 
-void WritePartialAssetFromBlocks(void* context);
+void WritePartialAssetFromBlocks(void* context, int is_cancelled);
 
 // Returns the write sync task, or the write task if there is no need for decompression of block
 static int CreatePartialAssetWriteJob(
@@ -2725,6 +3797,7 @@ static int CreatePartialAssetWriteJob(
     struct Longtail_StorageAPI* version_storage_api,
     struct Longtail_CompressionRegistryAPI* compression_registry_api,
     struct Longtail_JobAPI* job_api,
+    Longtail_JobAPI_Group job_group,
     const struct Longtail_ContentIndex* content_index,
     const struct Longtail_VersionIndex* version_index,
     const char* content_folder,
@@ -2740,6 +3813,7 @@ static int CreatePartialAssetWriteJob(
     job->m_VersionStorageAPI = version_storage_api;
     job->m_CompressionRegistryAPI = compression_registry_api;
     job->m_JobAPI = job_api;
+    job->m_JobGroup = job_group;
     job->m_ContentIndex = content_index;
     job->m_VersionIndex = version_index;
     job->m_ContentFolder = content_folder;
@@ -2757,9 +3831,6 @@ static int CreatePartialAssetWriteJob(
     uint32_t chunk_index_end = chunk_index_start + version_index->m_AssetChunkCounts[asset_index];
     uint32_t chunk_index_offset = chunk_start_index_offset;
 
-    Longtail_JobAPI_JobFunc decompress_funcs[MAX_BLOCKS_PER_PARTIAL_ASSET_WRITE];
-    void* decompress_ctx[MAX_BLOCKS_PER_PARTIAL_ASSET_WRITE];
-
     const uint32_t worker_count = job_api->GetWorkerCount(job_api) + 1;
     const uint32_t max_parallell_decompress_jobs = worker_count < MAX_BLOCKS_PER_PARTIAL_ASSET_WRITE ? worker_count : MAX_BLOCKS_PER_PARTIAL_ASSET_WRITE;
 
@@ -2788,8 +3859,8 @@ static int CreatePartialAssetWriteJob(
             block_job->m_BlockHash = block_hash;
             block_job->m_Err = EINVAL;
             block_job->m_BlockData = 0;
-            decompress_funcs[job->m_BlockDecompressorJobCount] = BlockDecompressor;
-            decompress_ctx[job->m_BlockDecompressorJobCount] = block_job;
+            block_job->m_StoredBlockSize = 0;
+            memset(&block_job->m_Stats, 0, sizeof(block_job->m_Stats));
             ++job->m_BlockDecompressorJobCount;
         }
         ++job->m_AssetChunkCount;
@@ -2799,26 +3870,33 @@ static int CreatePartialAssetWriteJob(
     Longtail_JobAPI_JobFunc write_funcs[1] = { WritePartialAssetFromBlocks };
     void* write_ctx[1] = { job };
     Longtail_JobAPI_Jobs write_job;
-    int err = job_api->CreateJobs(job_api, 1, write_funcs, write_ctx, &write_job);
+    int err = job_api->CreateJobs(job_api, job_group, LONGTAIL_JOB_CHANNEL_IO, 1, write_funcs, write_ctx, &write_job);
     LONGTAIL_FATAL_ASSERT(!err, return err)
 
     if (job->m_BlockDecompressorJobCount > 0)
     {
-        Longtail_JobAPI_Jobs decompression_jobs;
-        err = job_api->CreateJobs(job_api, job->m_BlockDecompressorJobCount, decompress_funcs, decompress_ctx, &decompression_jobs);
-        LONGTAIL_FATAL_ASSERT(!err, return err)
+        Longtail_JobAPI_Jobs read_jobs[MAX_BLOCKS_PER_PARTIAL_ASSET_WRITE];
+        for (uint32_t d = 0; d < job->m_BlockDecompressorJobCount; ++d)
+        {
+            Longtail_JobAPI_Jobs decompression_job;
+            err = CreateBlockDecompressorJobs(job_api, job_group, &job->m_BlockDecompressorJobs[d], &read_jobs[d], &decompression_job);
+            LONGTAIL_FATAL_ASSERT(!err, return err)
+            err = job_api->AddDependecies(job_api, 1, write_job, 1, decompression_job);
+            LONGTAIL_FATAL_ASSERT(!err, return err)
+        }
         Longtail_JobAPI_JobFunc sync_write_funcs[1] = { WriteReady };
         void* sync_write_ctx[1] = { 0 };
         Longtail_JobAPI_Jobs write_sync_job;
-        err = job_api->CreateJobs(job_api, 1, sync_write_funcs, sync_write_ctx, &write_sync_job);
+        err = job_api->CreateJobs(job_api, job_group, LONGTAIL_JOB_CHANNEL_CPU, 1, sync_write_funcs, sync_write_ctx, &write_sync_job);
         LONGTAIL_FATAL_ASSERT(!err, return err)
 
         err = job_api->AddDependecies(job_api, 1, write_job, 1, write_sync_job);
         LONGTAIL_FATAL_ASSERT(!err, return err)
-        err = job_api->AddDependecies(job_api, 1, write_job, job->m_BlockDecompressorJobCount, decompression_jobs);
-        LONGTAIL_FATAL_ASSERT(!err, return err)
-        err = job_api->ReadyJobs(job_api, job->m_BlockDecompressorJobCount, decompression_jobs);
-        LONGTAIL_FATAL_ASSERT(!err, return err)
+        for (uint32_t d = 0; d < job->m_BlockDecompressorJobCount; ++d)
+        {
+            err = job_api->ReadyJobs(job_api, 1, read_jobs[d]);
+            LONGTAIL_FATAL_ASSERT(!err, return err)
+        }
 
         *out_jobs = write_sync_job;
         return 0;
@@ -2827,9 +3905,43 @@ static int CreatePartialAssetWriteJob(
     return 0;
 }
 
-void WritePartialAssetFromBlocks(void* context)
+void WritePartialAssetFromBlocks(void* context, int is_cancelled)
 {
+    LONGTAIL_TRACE_BEGIN(write_partial_asset, "WritePartialAssetFromBlocks")
     struct WritePartialAssetFromBlocksJob* job = (struct WritePartialAssetFromBlocksJob*)context;
+    job->m_Stats.m_JobsRun += 1;
+    for (uint32_t d = 0; d < job->m_BlockDecompressorJobCount; ++d)
+    {
+        JobStats_Add(&job->m_Stats, &job->m_BlockDecompressorJobs[d].m_Stats);
+    }
+
+    if (is_cancelled)
+    {
+        // Don't queue the next part of the asset, just release what this part holds
+        for (uint32_t d = 0; d < job->m_BlockDecompressorJobCount; ++d)
+        {
+            Longtail_Free(job->m_BlockDecompressorJobs[d].m_BlockData);
+            job->m_BlockDecompressorJobs[d].m_BlockData = 0;
+        }
+        if (job->m_AssetOutputFile)
+        {
+            // Earlier parts of the asset are already written, don't leave a partial asset behind
+            job->m_VersionStorageAPI->CloseFile(job->m_VersionStorageAPI, job->m_AssetOutputFile);
+            job->m_AssetOutputFile = 0;
+            const char* asset_path = &job->m_VersionIndex->m_NameData[job->m_VersionIndex->m_NameOffsets[job->m_AssetIndex]];
+            char* full_asset_path = job->m_VersionStorageAPI->ConcatPath(job->m_VersionStorageAPI, job->m_VersionFolder, asset_path);
+            int err = job->m_VersionStorageAPI->RemoveFile(job->m_VersionStorageAPI, full_asset_path);
+            if (err)
+            {
+                LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_WARNING, "WritePartialAssetFromBlocks: Failed to remove partially written asset `%s` in `%s`, %d", asset_path, job->m_VersionFolder, err)
+            }
+            Longtail_Free(full_asset_path);
+            full_asset_path = 0;
+        }
+        job->m_Err = ECANCELED;
+        LONGTAIL_TRACE_END(write_partial_asset)
+        return;
+    }
 
     // Need to fetch all the data we need from the context since we will reuse it
     job->m_Err = 0;
@@ -2854,6 +3966,7 @@ void WritePartialAssetFromBlocks(void* context)
         {
             Longtail_Free(block_datas[d]);
         }
+        LONGTAIL_TRACE_END(write_partial_asset)
         return;
     }
 
@@ -2870,6 +3983,7 @@ void WritePartialAssetFromBlocks(void* context)
             Longtail_Free(block_datas[d]);
         }
         job->m_Err = ENOENT;
+        LONGTAIL_TRACE_END(write_partial_asset)
         return;
     }
     if (!job->m_AssetOutputFile)
@@ -2886,6 +4000,7 @@ void WritePartialAssetFromBlocks(void* context)
                 Longtail_Free(block_datas[d]);
             }
             job->m_Err = err;
+            LONGTAIL_TRACE_END(write_partial_asset)
             return;
         }
         if (IsDirPath(full_asset_path))
@@ -2898,11 +4013,13 @@ void WritePartialAssetFromBlocks(void* context)
                 Longtail_Free(full_asset_path);
                 full_asset_path = 0;
                 job->m_Err = err;
+                LONGTAIL_TRACE_END(write_partial_asset)
                 return;
             }
             Longtail_Free(full_asset_path);
             full_asset_path = 0;
             job->m_Err = 0;
+            LONGTAIL_TRACE_END(write_partial_asset)
             return;
         }
 
@@ -2918,8 +4035,10 @@ void WritePartialAssetFromBlocks(void* context)
                 Longtail_Free(block_datas[d]);
             }
             job->m_Err = err;
+            LONGTAIL_TRACE_END(write_partial_asset)
             return;
         }
+        job->m_Stats.m_FilesOpened += 1;
         Longtail_Free(full_asset_path);
         full_asset_path = 0;
     }
@@ -2932,6 +4051,7 @@ void WritePartialAssetFromBlocks(void* context)
             job->m_VersionStorageAPI,
             job->m_CompressionRegistryAPI,
             job->m_JobAPI,
+            job->m_JobGroup,
             job->m_ContentIndex,
             job->m_VersionIndex,
             job->m_ContentFolder,
@@ -2951,6 +4071,7 @@ void WritePartialAssetFromBlocks(void* context)
                 Longtail_Free(block_datas[d]);
             }
             job->m_Err = err;
+            LONGTAIL_TRACE_END(write_partial_asset)
             return;
         }
         // Decompression of blocks will start immediately
@@ -2998,6 +4119,7 @@ void WritePartialAssetFromBlocks(void* context)
                 LONGTAIL_FATAL_ASSERT(!err, job->m_Err = EINVAL; return)
             }
             job->m_Err = EINVAL;
+            LONGTAIL_TRACE_END(write_partial_asset)
             return;
         }
         char* block_data = block_datas[decompressed_block_index];
@@ -3022,8 +4144,10 @@ void WritePartialAssetFromBlocks(void* context)
                 LONGTAIL_FATAL_ASSERT(!err, job->m_Err = err; return)
             }
             job->m_Err = err;
+            LONGTAIL_TRACE_END(write_partial_asset)
             return;
         }
+        job->m_Stats.m_BytesWritten += chunk_size;
         write_offset += chunk_size;
 
         ++chunk_index_offset;
@@ -3042,9 +4166,11 @@ void WritePartialAssetFromBlocks(void* context)
         {
             job->m_VersionStorageAPI->CloseFile(job->m_VersionStorageAPI, job->m_AssetOutputFile);
             job->m_Err = err;
+            LONGTAIL_TRACE_END(write_partial_asset)
             return;
         }
         job->m_Err = 0;
+        LONGTAIL_TRACE_END(write_partial_asset)
         return;
     }
 
@@ -3052,6 +4178,7 @@ void WritePartialAssetFromBlocks(void* context)
     job->m_AssetOutputFile = 0;
 
     job->m_Err = 0;
+    LONGTAIL_TRACE_END(write_partial_asset)
 }
 
 struct WriteAssetsFromBlockJob
@@ -3066,10 +4193,13 @@ struct WriteAssetsFromBlockJob
     uint32_t* m_AssetIndexes;
     uint32_t m_AssetCount;
     struct HashToIndexItem* m_ContentChunkLookup;
+    struct Longtail_CancelAPI* m_CancelAPI;
+    Longtail_CancelAPI_HCancelToken m_CancelToken;
+    struct JobStats m_Stats;
     int m_Err;
 };
 
-static void WriteAssetsFromBlock(void* context)
+static void WriteAssetsFromBlock(void* context, int is_cancelled)
 {
     LONGTAIL_FATAL_ASSERT(context != 0, return)
 
@@ -3083,6 +4213,15 @@ static void WriteAssetsFromBlock(void* context)
     uint32_t* asset_indexes = job->m_AssetIndexes;
     uint32_t asset_count = job->m_AssetCount;
     struct HashToIndexItem* content_chunk_lookup = job->m_ContentChunkLookup;
+    job->m_Stats.m_JobsRun += 1;
+
+    if (is_cancelled)
+    {
+        Longtail_Free(job->m_DecompressBlockJob.m_BlockData);
+        job->m_DecompressBlockJob.m_BlockData = 0;
+        job->m_Err = ECANCELED;
+        return;
+    }
 
     if (job->m_DecompressBlockJob.m_Err)
     {
@@ -3096,6 +4235,13 @@ static void WriteAssetsFromBlock(void* context)
 
     for (uint32_t i = 0; i < asset_count; ++i)
     {
+        if (IsCancelled(job->m_CancelAPI, job->m_CancelToken))
+        {
+            Longtail_Free(block_data);
+            block_data = 0;
+            job->m_Err = ECANCELED;
+            return;
+        }
         uint32_t asset_index = asset_indexes[i];
         const char* asset_path = &version_index->m_NameData[version_index->m_NameOffsets[asset_index]];
         char* full_asset_path = version_storage_api->ConcatPath(version_storage_api, version_folder, asset_path);
@@ -3123,6 +4269,7 @@ static void WriteAssetsFromBlock(void* context)
             job->m_Err = err;
             return;
         }
+        job->m_Stats.m_FilesOpened += 1;
 
         uint64_t asset_write_offset = 0;
         uint32_t asset_chunk_index_start = version_index->m_AssetChunkIndexStarts[asset_index];
@@ -3148,6 +4295,7 @@ static void WriteAssetsFromBlock(void* context)
                 job->m_Err = err;
                 return;
             }
+            job->m_Stats.m_BytesWritten += chunk_size;
             asset_write_offset += chunk_size;
         }
 
@@ -3321,6 +4469,9 @@ static int WriteAssets(
     struct Longtail_JobAPI* job_api,
     Longtail_JobAPI_ProgressFunc job_progress_func,
     void* job_progress_context,
+    struct Longtail_CancelAPI* optional_cancel_api,
+    Longtail_CancelAPI_HCancelToken optional_cancel_token,
+    struct Longtail_Stats* optional_stats,
     const struct Longtail_ContentIndex* content_index,
     const struct Longtail_VersionIndex* version_index,
     const char* content_path,
@@ -3386,11 +4537,15 @@ static int WriteAssets(
             }
             asset_job_count += 1;   // Write job
             asset_job_count += 1;   // Sync job
-            asset_job_count += decompress_job_count;
+            asset_job_count += decompress_job_count * 2u;   // Read and decompress jobs
         }
     }
 
-    int err = job_api->ReserveJobs(job_api, (awl->m_BlockJobCount * 2u) + asset_job_count);
+    struct StatsPhase stats_phase;
+    Stats_BeginPhase(optional_stats, &stats_phase);
+
+    Longtail_JobAPI_Group job_group = 0;
+    int err = job_api->ReserveJobs(job_api, (awl->m_BlockJobCount * 3u) + asset_job_count, optional_cancel_api, optional_cancel_token, &job_group);
     if (err)
     {
         LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "WriteAssets: Failed to reserve %u jobs for folder `%s`, %d", awl->m_BlockJobCount + awl->m_AssetJobCount, version_path, err)
@@ -3401,7 +4556,7 @@ static int WriteAssets(
         return err;
     }
 
-    struct WriteAssetsFromBlockJob* block_jobs = (struct WriteAssetsFromBlockJob*)Longtail_Alloc((size_t)(sizeof(struct WriteAssetsFromBlockJob) * awl->m_BlockJobCount));
+    struct WriteAssetsFromBlockJob* block_jobs = (struct WriteAssetsFromBlockJob*)Longtail_AllocTagged(LONGTAIL_MEMTAG_JOBS, (size_t)(sizeof(struct WriteAssetsFromBlockJob) * awl->m_BlockJobCount));
     LONGTAIL_FATAL_ASSERT(block_jobs, return ENOMEM)
     uint32_t j = 0;
     uint32_t block_job_count = 0;
@@ -3417,10 +4572,13 @@ static int WriteAssets(
         block_job->m_CompressionRegistryAPI = compression_registry_api;
         block_job->m_ContentFolder = content_path;
         block_job->m_BlockHash = content_index->m_BlockHashes[block_index];
-        Longtail_JobAPI_JobFunc decompress_funcs[1] = { BlockDecompressor };
-        void* decompress_ctxs[1] = {block_job};
+        block_job->m_BlockData = 0;
+        block_job->m_StoredBlockSize = 0;
+        memset(&block_job->m_Stats, 0, sizeof(block_job->m_Stats));
+        block_job->m_Err = EINVAL;
+        Longtail_JobAPI_Jobs read_job;
         Longtail_JobAPI_Jobs decompression_job;
-        err = job_api->CreateJobs(job_api, 1, decompress_funcs, decompress_ctxs, &decompression_job);
+        err = CreateBlockDecompressorJobs(job_api, job_group, block_job, &read_job, &decompression_job);
         LONGTAIL_FATAL_ASSERT(!err, return err)
 
         job->m_ContentStorageAPI = content_storage_api;
@@ -3431,6 +4589,9 @@ static int WriteAssets(
         job->m_BlockIndex = (uint64_t)block_index;
         job->m_ContentChunkLookup = content_lookup->m_ChunkHashToChunkIndex;
         job->m_AssetIndexes = &awl->m_BlockJobAssetIndexes[j];
+        job->m_CancelAPI = optional_cancel_api;
+        job->m_CancelToken = optional_cancel_token;
+        memset(&job->m_Stats, 0, sizeof(job->m_Stats));
         job->m_Err = EINVAL;
 
         job->m_AssetCount = 1;
@@ -3455,11 +4616,11 @@ static int WriteAssets(
         void* ctx[1] = { job };
 
         Longtail_JobAPI_Jobs block_write_job;
-        err = job_api->CreateJobs(job_api, 1, func, ctx, &block_write_job);
+        err = job_api->CreateJobs(job_api, job_group, LONGTAIL_JOB_CHANNEL_IO, 1, func, ctx, &block_write_job);
         LONGTAIL_FATAL_ASSERT(!err, return err)
         err = job_api->AddDependecies(job_api, 1, block_write_job, 1, decompression_job);
         LONGTAIL_FATAL_ASSERT(!err, return err)
-        err = job_api->ReadyJobs(job_api, 1, decompression_job);
+        err = job_api->ReadyJobs(job_api, 1, read_job);
         LONGTAIL_FATAL_ASSERT(!err, return err)
     }
 /*
@@ -3492,16 +4653,18 @@ Write Task Execute (When Decompressor Tasks [DecompressorCount] and WriteSync Ta
         Ready WriteSync Task
 */
 
-    struct WritePartialAssetFromBlocksJob* asset_jobs = (struct WritePartialAssetFromBlocksJob*)Longtail_Alloc(sizeof(struct WritePartialAssetFromBlocksJob) * awl->m_AssetJobCount);
+    struct WritePartialAssetFromBlocksJob* asset_jobs = (struct WritePartialAssetFromBlocksJob*)Longtail_AllocTagged(LONGTAIL_MEMTAG_JOBS, sizeof(struct WritePartialAssetFromBlocksJob) * awl->m_AssetJobCount);
     LONGTAIL_FATAL_ASSERT(asset_jobs, return ENOMEM)
     for (uint32_t a = 0; a < awl->m_AssetJobCount; ++a)
     {
+        memset(&asset_jobs[a].m_Stats, 0, sizeof(asset_jobs[a].m_Stats));
         Longtail_JobAPI_Jobs write_sync_job;
         err = CreatePartialAssetWriteJob(
             content_storage_api,
             version_storage_api,
             compression_registry_api,
             job_api,
+            job_group,
             content_index,
             version_index,
             content_path,
@@ -3517,26 +4680,46 @@ Write Task Execute (When Decompressor Tasks [DecompressorCount] and WriteSync Ta
         LONGTAIL_FATAL_ASSERT(!err, return err)
     }
 
-    err = job_api->WaitForAllJobs(job_api, job_progress_context, job_progress_func);
-    LONGTAIL_FATAL_ASSERT(!err, return err)
+    err = job_api->WaitForAllJobs(job_api, job_group, job_progress_context, job_progress_func);
+    LONGTAIL_FATAL_ASSERT(!err || err == ECANCELED, return err)
+    if (err == ECANCELED)
+    {
+        LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_INFO, "WriteAssets: Cancelled writing content from `%s` to folder `%s`", content_path, version_path)
+    }
 
-    err = 0;
-    for (uint32_t b = 0; b < block_job_count; ++b)
+    Stats_EndPhase(optional_stats, LONGTAIL_STATS_PHASE_WRITE_ASSETS, &stats_phase);
+    if (optional_stats)
     {
-        struct WriteAssetsFromBlockJob* job = &block_jobs[b];
-        if (job->m_Err)
+        for (uint32_t b = 0; b < block_job_count; ++b)
+        {
+            Stats_AddJobStats(optional_stats, &block_jobs[b].m_DecompressBlockJob.m_Stats);
+            Stats_AddJobStats(optional_stats, &block_jobs[b].m_Stats);
+        }
+        for (uint32_t a = 0; a < awl->m_AssetJobCount; ++a)
         {
-            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "WriteAssets: Failed to write single block assets content from `%s` to folder `%s`, %d", content_path, version_path, job->m_Err)
-            err = err ? err : job->m_Err;
+            Stats_AddJobStats(optional_stats, &asset_jobs[a].m_Stats);
         }
     }
-    for (uint32_t a = 0; a < awl->m_AssetJobCount; ++a)
+
+    if (!err)
     {
-        struct WritePartialAssetFromBlocksJob* job = &asset_jobs[a];
-        if (job->m_Err)
+        for (uint32_t b = 0; b < block_job_count; ++b)
+        {
+            struct WriteAssetsFromBlockJob* job = &block_jobs[b];
+            if (job->m_Err)
+            {
+                LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "WriteAssets: Failed to write single block assets content from `%s` to folder `%s`, %d", content_path, version_path, job->m_Err)
+                err = err ? err : job->m_Err;
+            }
+        }
+        for (uint32_t a = 0; a < awl->m_AssetJobCount; ++a)
         {
-            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "WriteAssets: Failed to write multi block assets content from `%s` to folder `%s`, %d", content_path, version_path, err)
-            err = err ? err : job->m_Err;
+            struct WritePartialAssetFromBlocksJob* job = &asset_jobs[a];
+            if (job->m_Err)
+            {
+                LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "WriteAssets: Failed to write multi block assets content from `%s` to folder `%s`, %d", content_path, version_path, err)
+                err = err ? err : job->m_Err;
+            }
         }
     }
 
@@ -3555,6 +4738,7 @@ int Longtail_WriteVersion(
     struct Longtail_JobAPI* job_api,
     Longtail_JobAPI_ProgressFunc job_progress_func,
     void* job_progress_context,
+    struct Longtail_Stats* optional_stats,
     const struct Longtail_ContentIndex* content_index,
     const struct Longtail_VersionIndex* version_index,
     const char* content_path,
@@ -3618,6 +4802,9 @@ int Longtail_WriteVersion(
         job_api,
         job_progress_func,
         job_progress_context,
+        0,
+        0,
+        optional_stats,
         content_index,
         version_index,
         content_path,
@@ -3631,6 +4818,7 @@ int Longtail_WriteVersion(
     DeleteContentLookup(content_lookup);
     content_lookup = 0;
 
+    Longtail_LogMemTagStats("Longtail_WriteVersion");
     return err;
 }
 
@@ -3680,14 +4868,16 @@ struct ScanBlockJob
     const char* m_ContentPath;
     const char* m_BlockPath;
     struct BlockIndex* m_BlockIndex;
+    struct JobStats m_Stats;
     int m_Err;
 };
 
-static void ScanBlock(void* context)
+static void ScanBlock(void* context, int is_cancelled)
 {
     LONGTAIL_FATAL_ASSERT(context != 0, return)
 
     struct ScanBlockJob* job = (struct ScanBlockJob*)context;
+    job->m_Stats.m_JobsRun += 1;
     struct Longtail_StorageAPI* storage_api = job->m_StorageAPI;
     const char* content_path = job->m_ContentPath;
     const char* block_path = job->m_BlockPath;
@@ -3696,6 +4886,7 @@ static void ScanBlock(void* context)
     job->m_Err = ReadBlockIndex(
         storage_api,
         full_block_path,
+        &job->m_Stats,
         &job->m_BlockIndex);
 
     Longtail_Free(full_block_path);
@@ -3708,6 +4899,7 @@ int Longtail_ReadContent(
     struct Longtail_JobAPI* job_api,
     Longtail_JobAPI_ProgressFunc job_progress_func,
     void* job_progress_context,
+    struct Longtail_Stats* optional_stats,
     const char* content_path,
     struct Longtail_ContentIndex** out_content_index)
 {
@@ -3738,7 +4930,11 @@ int Longtail_ReadContent(
     paths = context.m_Paths;
     context.m_Paths = 0;
 
-    err = job_api->ReserveJobs(job_api, *paths->m_PathCount);
+    struct StatsPhase stats_phase;
+    Stats_BeginPhase(optional_stats, &stats_phase);
+
+    Longtail_JobAPI_Group job_group = 0;
+    err = job_api->ReserveJobs(job_api, *paths->m_PathCount, 0, 0, &job_group);
     if (err)
     {
         LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_ReadContent: Failed to reserve jobs for `%s`, %d", content_path, err)
@@ -3749,7 +4945,7 @@ int Longtail_ReadContent(
 
     LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_INFO, "Longtail_ReadContent: Scanning %u files from `%s`", *paths->m_PathCount, content_path)
 
-    struct ScanBlockJob* scan_jobs = (struct ScanBlockJob*)Longtail_Alloc(sizeof(struct ScanBlockJob) * *paths->m_PathCount);
+    struct ScanBlockJob* scan_jobs = (struct ScanBlockJob*)Longtail_AllocTagged(LONGTAIL_MEMTAG_JOBS, sizeof(struct ScanBlockJob) * *paths->m_PathCount);
     LONGTAIL_FATAL_ASSERT(scan_jobs, return ENOMEM)
 
     for (uint32_t path_index = 0; path_index < *paths->m_PathCount; ++path_index)
@@ -3763,25 +4959,50 @@ int Longtail_ReadContent(
         job->m_ContentPath = content_path;
         job->m_BlockPath = block_path;
         job->m_BlockIndex = 0;
+        memset(&job->m_Stats, 0, sizeof(job->m_Stats));
         job->m_Err = EINVAL;
 
         Longtail_JobAPI_JobFunc job_func[] = {ScanBlock};
         void* ctx[] = {job};
         Longtail_JobAPI_Jobs jobs;
-        err = job_api->CreateJobs(job_api, 1, job_func, ctx, &jobs);
+        err = job_api->CreateJobs(job_api, job_group, LONGTAIL_JOB_CHANNEL_IO, 1, job_func, ctx, &jobs);
         LONGTAIL_FATAL_ASSERT(!err, return err)
         err = job_api->ReadyJobs(job_api, 1, jobs);
         LONGTAIL_FATAL_ASSERT(!err, return err)
     }
 
-    err = job_api->WaitForAllJobs(job_api, job_progress_context, job_progress_func);
-    LONGTAIL_FATAL_ASSERT(!err, return err)
+    err = job_api->WaitForAllJobs(job_api, job_group, job_progress_context, job_progress_func);
+    Stats_EndPhase(optional_stats, LONGTAIL_STATS_PHASE_SCAN_BLOCKS, &stats_phase);
+    if (err)
+    {
+        if (err == ECANCELED)
+        {
+            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_INFO, "Longtail_ReadContent: Cancelled scanning blocks in `%s`", content_path)
+        }
+        else
+        {
+            LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_ERROR, "Longtail_ReadContent: Failed to scan blocks in `%s`, %d", content_path, err)
+        }
+        for (uint32_t path_index = 0; path_index < *paths->m_PathCount; ++path_index)
+        {
+            struct ScanBlockJob* job = &scan_jobs[path_index];
+            Stats_AddJobStats(optional_stats, &job->m_Stats);
+            Longtail_Free(job->m_BlockIndex);
+            job->m_BlockIndex = 0;
+        }
+        Longtail_Free(scan_jobs);
+        scan_jobs = 0;
+        Longtail_Free(paths);
+        paths = 0;
+        return err;
+    }
 
     uint64_t block_count = 0;
     uint64_t chunk_count = 0;
     for (uint32_t path_index = 0; path_index < *paths->m_PathCount; ++path_index)
     {
         struct ScanBlockJob* job = &scan_jobs[path_index];
+        Stats_AddJobStats(optional_stats, &job->m_Stats);
         if (job->m_Err == 0)
         {
             ++block_count;
@@ -3792,7 +5013,7 @@ int Longtail_ReadContent(
     LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_INFO, "Longtail_ReadContent: Found %" PRIu64 " chunks in %" PRIu64 " blocks from `%s`", chunk_count, block_count, content_path)
 
     size_t content_index_size = GetContentIndexSize(block_count, chunk_count);
-    struct Longtail_ContentIndex* content_index = (struct Longtail_ContentIndex*)Longtail_Alloc(content_index_size);
+    struct Longtail_ContentIndex* content_index = (struct Longtail_ContentIndex*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, content_index_size);
     LONGTAIL_FATAL_ASSERT(content_index, return ENOMEM)
 
     content_index->m_Version = (uint32_t*)(void*)&((char*)content_index)[sizeof(struct Longtail_ContentIndex)];
@@ -3839,6 +5060,7 @@ int Longtail_ReadContent(
     paths = 0;
 
     *out_content_index = content_index;
+    Longtail_LogMemTagStats("Longtail_ReadContent");
     return 0;
 }
 
@@ -3889,9 +5111,9 @@ static int DiffHashes(
     LONGTAIL_FATAL_ASSERT(added_hashes != 0, return EINVAL)
     LONGTAIL_FATAL_ASSERT((removed_hash_count == 0 && removed_hashes == 0) || (removed_hash_count != 0 && removed_hashes != 0), return EINVAL)
 
-    TLongtail_Hash* refs = (TLongtail_Hash*)Longtail_Alloc((size_t)(sizeof(TLongtail_Hash) * reference_hash_count));
+    TLongtail_Hash* refs = (TLongtail_Hash*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, (size_t)(sizeof(TLongtail_Hash) * reference_hash_count));
     LONGTAIL_FATAL_ASSERT(refs, return ENOMEM)
-    TLongtail_Hash* news = (TLongtail_Hash*)Longtail_Alloc((size_t)(sizeof(TLongtail_Hash) * new_hash_count));
+    TLongtail_Hash* news = (TLongtail_Hash*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, (size_t)(sizeof(TLongtail_Hash) * new_hash_count));
     LONGTAIL_FATAL_ASSERT(news, return ENOMEM)
     memmove(refs, reference_hashes, (size_t)(sizeof(TLongtail_Hash) * reference_hash_count));
     memmove(news, new_hashes, (size_t)(sizeof(TLongtail_Hash) * new_hash_count));
@@ -3993,7 +5215,7 @@ int Longtail_CreateMissingContent(
 
     LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_DEBUG, "Longtail_CreateMissingContent: Checking for %u version chunks in %" PRIu64 " content chunks", *version_index->m_ChunkCount, *content_index->m_ChunkCount)
     uint64_t chunk_count = *version_index->m_ChunkCount;
-    TLongtail_Hash* added_hashes = (TLongtail_Hash*)Longtail_Alloc((size_t)(sizeof(TLongtail_Hash) * chunk_count));
+    TLongtail_Hash* added_hashes = (TLongtail_Hash*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, (size_t)(sizeof(TLongtail_Hash) * chunk_count));
     LONGTAIL_FATAL_ASSERT(added_hashes, return ENOMEM)
 
     uint64_t added_hash_count = 0;
@@ -4028,9 +5250,9 @@ int Longtail_CreateMissingContent(
         return err;
     }
 
-    uint32_t* diff_chunk_sizes = (uint32_t*)Longtail_Alloc((size_t)(sizeof(uint32_t) * added_hash_count));
+    uint32_t* diff_chunk_sizes = (uint32_t*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, (size_t)(sizeof(uint32_t) * added_hash_count));
     LONGTAIL_FATAL_ASSERT(diff_chunk_sizes, return ENOMEM)
-    uint32_t* diff_chunk_compression_types = (uint32_t*)Longtail_Alloc((size_t)(sizeof(uint32_t) * added_hash_count));
+    uint32_t* diff_chunk_compression_types = (uint32_t*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, (size_t)(sizeof(uint32_t) * added_hash_count));
     LONGTAIL_FATAL_ASSERT(diff_chunk_compression_types, return ENOMEM)
 
     struct HashToIndexItem* chunk_index_lookup = 0;
@@ -4127,7 +5349,7 @@ int Longtail_RetargetContent(
         hmput(chunk_to_remote_block_index_lookup, chunk_hash, block_index);
     }
 
-    TLongtail_Hash* requested_block_hashes = (TLongtail_Hash*)Longtail_Alloc(sizeof(TLongtail_Hash) * *reference_content_index->m_BlockCount);
+    TLongtail_Hash* requested_block_hashes = (TLongtail_Hash*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof(TLongtail_Hash) * *reference_content_index->m_BlockCount);
     if (requested_block_hashes == 0)
     {
         hmfree(chunk_to_remote_block_index_lookup);
@@ -4176,7 +5398,7 @@ int Longtail_RetargetContent(
     }
 
     size_t content_index_size = GetContentIndexSize(requested_block_count, chunk_count);
-    struct Longtail_ContentIndex* resulting_content_index = (struct Longtail_ContentIndex*)Longtail_Alloc(content_index_size);
+    struct Longtail_ContentIndex* resulting_content_index = (struct Longtail_ContentIndex*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, content_index_size);
     LONGTAIL_FATAL_ASSERT(resulting_content_index, return ENOMEM)
 
     resulting_content_index->m_Version = (uint32_t*)(void*)&((char*)resulting_content_index)[sizeof(struct Longtail_ContentIndex)];
@@ -4238,7 +5460,7 @@ int Longtail_MergeContentIndex(
     uint64_t block_count = local_block_count + remote_block_count;
     uint64_t chunk_count = local_chunk_count + remote_chunk_count;
     size_t content_index_size = GetContentIndexSize(block_count, chunk_count);
-    struct Longtail_ContentIndex* content_index = (struct Longtail_ContentIndex*)Longtail_Alloc(content_index_size);
+    struct Longtail_ContentIndex* content_index = (struct Longtail_ContentIndex*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, content_index_size);
     if (content_index == 0)
     {
         return ENOMEM;
@@ -4401,9 +5623,9 @@ int Longtail_CreateVersionDiff(
     uint32_t source_asset_count = *source_version->m_AssetCount;
     uint32_t target_asset_count = *target_version->m_AssetCount;
 
-    TLongtail_Hash* source_path_hashes = (TLongtail_Hash*)Longtail_Alloc(sizeof (TLongtail_Hash) * source_asset_count);
+    TLongtail_Hash* source_path_hashes = (TLongtail_Hash*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof (TLongtail_Hash) * source_asset_count);
     LONGTAIL_FATAL_ASSERT(source_path_hashes, return ENOMEM)
-    TLongtail_Hash* target_path_hashes = (TLongtail_Hash*)Longtail_Alloc(sizeof (TLongtail_Hash) * target_asset_count);
+    TLongtail_Hash* target_path_hashes = (TLongtail_Hash*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof (TLongtail_Hash) * target_asset_count);
     LONGTAIL_FATAL_ASSERT(target_path_hashes, return ENOMEM)
 
     for (uint32_t i = 0; i < source_asset_count; ++i)
@@ -4423,15 +5645,15 @@ int Longtail_CreateVersionDiff(
     qsort(source_path_hashes, source_asset_count, sizeof(TLongtail_Hash), CompareHashes);
     qsort(target_path_hashes, target_asset_count, sizeof(TLongtail_Hash), CompareHashes);
 
-    uint32_t* removed_source_asset_indexes = (uint32_t*)Longtail_Alloc(sizeof(uint32_t) * source_asset_count);
+    uint32_t* removed_source_asset_indexes = (uint32_t*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof(uint32_t) * source_asset_count);
     LONGTAIL_FATAL_ASSERT(removed_source_asset_indexes, return ENOMEM)
-    uint32_t* added_target_asset_indexes = (uint32_t*)Longtail_Alloc(sizeof(uint32_t) * target_asset_count);
+    uint32_t* added_target_asset_indexes = (uint32_t*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof(uint32_t) * target_asset_count);
     LONGTAIL_FATAL_ASSERT(added_target_asset_indexes, return ENOMEM)
 
     const uint32_t max_modified_count = source_asset_count < target_asset_count ? source_asset_count : target_asset_count;
-    uint32_t* modified_source_indexes = (uint32_t*)Longtail_Alloc(sizeof(uint32_t) * max_modified_count);
+    uint32_t* modified_source_indexes = (uint32_t*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof(uint32_t) * max_modified_count);
     LONGTAIL_FATAL_ASSERT(modified_source_indexes, return ENOMEM)
-    uint32_t* modified_target_indexes = (uint32_t*)Longtail_Alloc(sizeof(uint32_t) * max_modified_count);
+    uint32_t* modified_target_indexes = (uint32_t*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, sizeof(uint32_t) * max_modified_count);
     LONGTAIL_FATAL_ASSERT(modified_target_indexes, return ENOMEM)
 
     uint32_t source_removed_count = 0;
@@ -4516,7 +5738,7 @@ int Longtail_CreateVersionDiff(
         LONGTAIL_LOG(LONGTAIL_LOG_LEVEL_DEBUG, "Longtail_CreateVersionDiff: Mismatching content for %u assets found", modified_count)
     }
 
-    struct Longtail_VersionDiff* version_diff = (struct Longtail_VersionDiff*)Longtail_Alloc(GetVersionDiffSize(source_removed_count, target_added_count, modified_count));
+    struct Longtail_VersionDiff* version_diff = (struct Longtail_VersionDiff*)Longtail_AllocTagged(LONGTAIL_MEMTAG_INDEX, GetVersionDiffSize(source_removed_count, target_added_count, modified_count));
     LONGTAIL_FATAL_ASSERT(version_diff, return ENOMEM)
     uint32_t* counts_ptr = (uint32_t*)(void*)&version_diff[1];
     counts_ptr[0] = source_removed_count;
@@ -4567,6 +5789,9 @@ int Longtail_ChangeVersion(
     struct Longtail_JobAPI* job_api,
     Longtail_JobAPI_ProgressFunc job_progress_func,
     void* job_progress_context,
+    struct Longtail_CancelAPI* optional_cancel_api,
+    Longtail_CancelAPI_HCancelToken optional_cancel_token,
+    struct Longtail_Stats* optional_stats,
     struct Longtail_CompressionRegistryAPI* compression_registry_api,
     const struct Longtail_ContentIndex* content_index,
     const struct Longtail_VersionIndex* source_version,
@@ -4764,6 +5989,9 @@ int Longtail_ChangeVersion(
         job_api,
         job_progress_func,
         job_progress_context,
+        optional_cancel_api,
+        optional_cancel_token,
+        optional_stats,
         content_index,
         target_version,
         content_path,
@@ -4780,6 +6008,7 @@ int Longtail_ChangeVersion(
     DeleteContentLookup(content_lookup);
     content_lookup = 0;
 
+    Longtail_LogMemTagStats("Longtail_ChangeVersion");
     return err;
 }
 
@@ -4986,6 +6215,7 @@ struct Longtail_CompressionRegistryAPI* Longtail_CreateDefaultCompressionRegistr
 
     registry->m_CompressionRegistryAPI.m_API.Dispose = DefaultCompressionRegistry_Dispose;
     registry->m_CompressionRegistryAPI.GetCompressionType = Default_GetCompressionType;
+    registry->m_CompressionRegistryAPI.GetCompressionCandidates = 0;
 
     registry->m_Count = compression_type_count;
     char* p = (char*)&registry[1];
@@ -5004,6 +6234,78 @@ struct Longtail_CompressionRegistryAPI* Longtail_CreateDefaultCompressionRegistr
     return &registry->m_CompressionRegistryAPI;
 }
 
+struct BestOf_CompressionRegistry
+{
+    struct Longtail_CompressionRegistryAPI m_CompressionRegistryAPI;
+    struct Longtail_CompressionRegistryAPI* m_CompressionRegistry;
+    uint32_t m_BestOfCompressionType;
+    uint32_t m_CandidateCount;
+    uint32_t m_MaxSizeOverheadPercent;
+    uint32_t m_CandidateTypes[LONGTAIL_MAX_COMPRESSION_CANDIDATES];
+};
+
+static void BestOfCompressionRegistry_Dispose(struct Longtail_API* api)
+{
+    struct BestOf_CompressionRegistry* best_of_compression_registry = (struct BestOf_CompressionRegistry*)api;
+    best_of_compression_registry->m_CompressionRegistry->m_API.Dispose(&best_of_compression_registry->m_CompressionRegistry->m_API);
+    Longtail_Free(best_of_compression_registry);
+}
+
+static int BestOf_GetCompressionType(struct Longtail_CompressionRegistryAPI* compression_registry, uint32_t compression_type, struct Longtail_CompressionAPI** out_compression_api, Longtail_CompressionAPI_HSettings* out_settings)
+{
+    struct BestOf_CompressionRegistry* best_of_compression_registry = (struct BestOf_CompressionRegistry*)compression_registry;
+    struct Longtail_CompressionRegistryAPI* registry = best_of_compression_registry->m_CompressionRegistry;
+    return registry->GetCompressionType(registry, compression_type, out_compression_api, out_settings);
+}
+
+static int BestOf_GetCompressionCandidates(struct Longtail_CompressionRegistryAPI* compression_registry, uint32_t compression_type, uint32_t* out_candidate_count, const uint32_t** out_candidate_types, uint32_t* out_max_size_overhead_percent)
+{
+    struct BestOf_CompressionRegistry* best_of_compression_registry = (struct BestOf_CompressionRegistry*)compression_registry;
+    if (compression_type != best_of_compression_registry->m_BestOfCompressionType)
+    {
+        struct Longtail_CompressionRegistryAPI* registry = best_of_compression_registry->m_CompressionRegistry;
+        if (registry->GetCompressionCandidates)
+        {
+            return registry->GetCompressionCandidates(registry, compression_type, out_candidate_count, out_candidate_types, out_max_size_overhead_percent);
+        }
+        return ENOENT;
+    }
+    *out_candidate_count = best_of_compression_registry->m_CandidateCount;
+    *out_candidate_types = best_of_compression_registry->m_CandidateTypes;
+    *out_max_size_overhead_percent = best_of_compression_registry->m_MaxSizeOverheadPercent;
+    return 0;
+}
+
+struct Longtail_CompressionRegistryAPI* Longtail_CreateBestOfCompressionRegistry(
+    struct Longtail_CompressionRegistryAPI* compression_registry,
+    uint32_t best_of_compression_type,
+    uint32_t candidate_count,
+    const uint32_t* candidate_types,
+    uint32_t max_size_overhead_percent)
+{
+    LONGTAIL_FATAL_ASSERT(compression_registry != 0, return 0)
+    LONGTAIL_FATAL_ASSERT(best_of_compression_type != 0, return 0)
+    LONGTAIL_FATAL_ASSERT(candidate_count > 0 && candidate_count <= LONGTAIL_MAX_COMPRESSION_CANDIDATES, return 0)
+    LONGTAIL_FATAL_ASSERT(candidate_types != 0, return 0)
+
+    struct BestOf_CompressionRegistry* registry = (struct BestOf_CompressionRegistry*)Longtail_Alloc(sizeof(struct BestOf_CompressionRegistry));
+    if (!registry)
+    {
+        return 0;
+    }
+
+    registry->m_CompressionRegistryAPI.m_API.Dispose = BestOfCompressionRegistry_Dispose;
+    registry->m_CompressionRegistryAPI.GetCompressionType = BestOf_GetCompressionType;
+    registry->m_CompressionRegistryAPI.GetCompressionCandidates = BestOf_GetCompressionCandidates;
+    registry->m_CompressionRegistry = compression_registry;
+    registry->m_BestOfCompressionType = best_of_compression_type;
+    registry->m_CandidateCount = candidate_count;
+    registry->m_MaxSizeOverheadPercent = max_size_overhead_percent;
+    memmove(registry->m_CandidateTypes, candidate_types, sizeof(uint32_t) * candidate_count);
+
+    return &registry->m_CompressionRegistryAPI;
+}
+
 static uint32_t hashTable[] = {
     0x458be752, 0xc10748cc, 0xfbbcdbb8, 0x6ded5b68,
     0xb10a82b5, 0x20d75648, 0xdfc5665f, 0xa8428801,
@@ -5095,6 +6397,7 @@ struct Longtail_Chunker
     Longtail_Chunker_Feeder fFeeder;
     void* cFeederContext;
     uint64_t processed_count;
+    uint32_t capacity;
 };
 
 static uint32_t discriminatorFromAvg(double avg)
@@ -5107,6 +6410,17 @@ static uint32_t discriminatorFromAvg(double avg)
     Longtail_Chunker_Feeder feeder,
     void* context,
     struct Longtail_Chunker** out_chunker)
+{
+    LONGTAIL_FATAL_ASSERT(params != 0, return EINVAL)
+    return Longtail_CreateChunkerWithBufferSize(params, feeder, context, params->max, out_chunker);
+}
+
+ int Longtail_CreateChunkerWithBufferSize(
+    struct Longtail_ChunkerParams* params,
+    Longtail_Chunker_Feeder feeder,
+    void* context,
+    uint32_t buffer_size,
+    struct Longtail_Chunker** out_chunker)
 {
     LONGTAIL_FATAL_ASSERT(params != 0, return EINVAL)
     LONGTAIL_FATAL_ASSERT(feeder != 0, return EINVAL)
@@ -5114,8 +6428,9 @@ static uint32_t discriminatorFromAvg(double avg)
     LONGTAIL_FATAL_ASSERT(params->min <= params->max, return EINVAL)
     LONGTAIL_FATAL_ASSERT(params->min <= params->avg, return EINVAL)
     LONGTAIL_FATAL_ASSERT(params->avg <= params->max, return EINVAL)
+    LONGTAIL_FATAL_ASSERT(buffer_size >= params->max, return EINVAL)
 
-    struct Longtail_Chunker* c = (struct Longtail_Chunker*)Longtail_Alloc((size_t)((sizeof(struct Longtail_Chunker) + params->max)));
+    struct Longtail_Chunker* c = (struct Longtail_Chunker*)Longtail_AllocTagged(LONGTAIL_MEMTAG_BLOCK_DATA, (size_t)((sizeof(struct Longtail_Chunker) + buffer_size)));
     LONGTAIL_FATAL_ASSERT(c, return ENOMEM)
     c->params = *params;
     c->buf.data = (uint8_t*)&c[1];
@@ -5126,6 +6441,7 @@ static uint32_t discriminatorFromAvg(double avg)
     c->fFeeder = feeder;
     c->cFeederContext = context;
     c->processed_count = 0;
+    c->capacity = buffer_size;
     *out_chunker = c;
     return 0;
 }
@@ -5134,14 +6450,14 @@ static int FeedChunker(struct Longtail_Chunker* c)
 {
     LONGTAIL_FATAL_ASSERT(c != 0, return EINVAL)
 
-    if (c->off != 0)
+    if (c->off != 0 && (c->capacity - c->off) < c->params.max)
     {
         memmove(c->buf.data, &c->buf.data[c->off], c->buf.len - c->off);
         c->processed_count += c->off;
         c->buf.len -= c->off;
         c->off = 0;
     }
-    uint32_t feed_max = (uint32_t)(c->params.max - c->buf.len);
+    uint32_t feed_max = (uint32_t)(c->capacity - c->buf.len);
     uint32_t feed_count;
     int err = c->fFeeder(c->cFeederContext, c, feed_max, (char*)&c->buf.data[c->buf.len], &feed_count);
     c->buf.len += feed_count;
@@ -5185,7 +6501,7 @@ struct Longtail_ChunkRange Longtail_NextChunk(struct Longtail_Chunker* c)
     }
 
     uint32_t hash = 0;
-    struct Longtail_ChunkRange scoped_data = {&c->buf.data[c->off], c->processed_count + c->off, left};
+    struct Longtail_ChunkRange scoped_data = {&c->buf.data[c->off], c->processed_count + c->off, left < c->params.max ? left : c->params.max};
     {
         struct Longtail_ChunkRange window = {&scoped_data.buf[c->params.min - ChunkerWindowSize], c->processed_count + c->off + c->params.min - ChunkerWindowSize, ChunkerWindowSize};
         for (uint32_t i = 0; i < ChunkerWindowSize; ++i)
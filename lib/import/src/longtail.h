@@ -24,8 +24,17 @@ struct Longtail_HashAPI
     void (*Hash)(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext context, uint32_t length, const void* data);
     uint64_t (*EndContext)(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext context);
     int (*HashBuffer)(struct Longtail_HashAPI* hash_api, uint32_t length, const void* data, uint64_t* out_hash);
+
+    // In-place contexts let the caller provide the memory for the hash state so no allocation is made.
+    // The memory must be GetContextSize bytes, aligned to LONGTAIL_HASH_CONTEXT_ALIGNMENT and stay valid
+    // until EndContextInPlace. The context is fed with Hash like a context from BeginContext.
+    uint32_t (*GetContextSize)(struct Longtail_HashAPI* hash_api);
+    int (*BeginContextInPlace)(struct Longtail_HashAPI* hash_api, void* context_memory, Longtail_HashAPI_HContext* out_context);
+    uint64_t (*EndContextInPlace)(struct Longtail_HashAPI* hash_api, Longtail_HashAPI_HContext context);
 };
 
+#define LONGTAIL_HASH_CONTEXT_ALIGNMENT 16u
+
 typedef struct Longtail_StorageAPI_OpenFile* Longtail_StorageAPI_HOpenFile;
 typedef struct Longtail_StorageAPI_Iterator* Longtail_StorageAPI_HIterator;
 
@@ -70,29 +79,79 @@ struct Longtail_CompressionAPI
     struct Longtail_API m_API;
 
     size_t (*GetMaxCompressedSize)(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HSettings settings, size_t size);
-    int (*Compress)(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HSettings settings, const char* uncompressed, char* compressed, size_t uncompressed_size, size_t max_compressed_size, size_t* out_compressed_size);
-    int (*Decompress)(struct Longtail_CompressionAPI* compression_api, const char* compressed, char* uncompressed, size_t compressed_size, size_t max_uncompressed_size, size_t* out_uncompressed_size);
+
+    // Contexts hold the codec state between calls so it does not have to be set up for every block.
+    // A context may only be used by one thread at a time, implementations are free to recycle
+    // deleted contexts. A zero context is valid for Compress/Decompress and means one-shot operation.
+    int (*CreateCompressionContext)(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HSettings settings, Longtail_CompressionAPI_HCompressionContext* out_context);
+    void (*DeleteCompressionContext)(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HCompressionContext context);
+    int (*CreateDecompressionContext)(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HDecompressionContext* out_context);
+    void (*DeleteDecompressionContext)(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HDecompressionContext context);
+
+    // Optional, may be 0. Lets Compress calls with `context` use up to `worker_count` threads of their own,
+    // used to split up large blocks when there are fewer blocks left to compress than there are workers.
+    // A `worker_count` of 1 restores single threaded compression.
+    int (*SetCompressionWorkerCount)(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HCompressionContext context, uint32_t worker_count);
+
+    int (*Compress)(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HCompressionContext context, Longtail_CompressionAPI_HSettings settings, const char* uncompressed, char* compressed, size_t uncompressed_size, size_t max_compressed_size, size_t* out_compressed_size);
+    int (*Decompress)(struct Longtail_CompressionAPI* compression_api, Longtail_CompressionAPI_HDecompressionContext context, const char* compressed, char* uncompressed, size_t compressed_size, size_t max_uncompressed_size, size_t* out_uncompressed_size);
 };
 
+// Chunks with this bit set in their compression type are compressed with the compression type without
+// the bit, but Longtail_WriteContent stores blocks that do not compress well uncompressed (compression type 0)
+#define LONGTAIL_ADAPTIVE_COMPRESSION_FLAG  0x80000000u
+
 struct Longtail_CompressionRegistryAPI
 {
     struct Longtail_API m_API;
     int (*GetCompressionType)(struct Longtail_CompressionRegistryAPI* compression_registry, uint32_t compression_type, struct Longtail_CompressionAPI** out_compression_api, Longtail_CompressionAPI_HSettings* out_settings);
+
+    // Optional, may be 0. Returns ENOENT unless `compression_type` stands for a set of compression types that
+    // Longtail_WriteContent should try on each block, the block is then stored with the winning compression type.
+    // The winner is the smallest output, or the first candidate in the list whose output is at most
+    // `max_size_overhead_percent` larger than the smallest.
+    int (*GetCompressionCandidates)(struct Longtail_CompressionRegistryAPI* compression_registry, uint32_t compression_type, uint32_t* out_candidate_count, const uint32_t** out_candidate_types, uint32_t* out_max_size_overhead_percent);
+};
+
+typedef struct Longtail_CancelAPI_CancelToken* Longtail_CancelAPI_HCancelToken;
+
+struct Longtail_CancelAPI
+{
+    struct Longtail_API m_API;
+    int (*CreateToken)(struct Longtail_CancelAPI* cancel_api, Longtail_CancelAPI_HCancelToken* out_token);
+    // Safe to call from any thread, a cancelled token stays cancelled
+    int (*Cancel)(struct Longtail_CancelAPI* cancel_api, Longtail_CancelAPI_HCancelToken token);
+    int (*DisposeToken)(struct Longtail_CancelAPI* cancel_api, Longtail_CancelAPI_HCancelToken token);
+    // Returns ECANCELED if the token is cancelled, zero otherwise
+    int (*IsCancelled)(struct Longtail_CancelAPI* cancel_api, Longtail_CancelAPI_HCancelToken token);
 };
 
-typedef void (*Longtail_JobAPI_JobFunc)(void* context);
+// is_cancelled is set when the cancel token of the job group was cancelled before the job started,
+// the job should skip its work but still release any resources it owns
+typedef void (*Longtail_JobAPI_JobFunc)(void* context, int is_cancelled);
 typedef void (*Longtail_JobAPI_ProgressFunc)(void* context, uint32_t total_count, uint32_t done_count);
 typedef void* Longtail_JobAPI_Jobs;
+typedef struct Longtail_JobAPI_JobGroup* Longtail_JobAPI_Group;
+
+// Jobs on the CPU channel are run before jobs on the IO channel. A job API may run IO jobs on
+// separate workers so jobs that block on reads and writes do not hold up the compute bound jobs.
+#define LONGTAIL_JOB_CHANNEL_CPU 0u
+#define LONGTAIL_JOB_CHANNEL_IO  1u
+#define LONGTAIL_JOB_CHANNEL_COUNT 2u
 
 struct Longtail_JobAPI
 {
     struct Longtail_API m_API;
     uint32_t (*GetWorkerCount)(struct Longtail_JobAPI* job_api);
-    int (*ReserveJobs)(struct Longtail_JobAPI* job_api, uint32_t job_count);
-    int (*CreateJobs)(struct Longtail_JobAPI* job_api, uint32_t job_count, Longtail_JobAPI_JobFunc job_funcs[], void* job_contexts[], Longtail_JobAPI_Jobs* out_jobs);
+    // ReserveJobs creates a job group, jobs are created in a group and WaitForAllJobs waits for
+    // and releases one group. Groups are independent and can run concurrently on the same workers.
+    // If optional_cancel_api is set the jobs in the group are run with is_cancelled set once the token
+    // is cancelled and WaitForAllJobs returns ECANCELED.
+    int (*ReserveJobs)(struct Longtail_JobAPI* job_api, uint32_t job_count, struct Longtail_CancelAPI* optional_cancel_api, Longtail_CancelAPI_HCancelToken optional_cancel_token, Longtail_JobAPI_Group* out_job_group);
+    int (*CreateJobs)(struct Longtail_JobAPI* job_api, Longtail_JobAPI_Group job_group, uint32_t job_channel, uint32_t job_count, Longtail_JobAPI_JobFunc job_funcs[], void* job_contexts[], Longtail_JobAPI_Jobs* out_jobs);
     int (*AddDependecies)(struct Longtail_JobAPI* job_api, uint32_t job_count, Longtail_JobAPI_Jobs jobs, uint32_t dependency_job_count, Longtail_JobAPI_Jobs dependency_jobs);
     int (*ReadyJobs)(struct Longtail_JobAPI* job_api, uint32_t job_count, Longtail_JobAPI_Jobs jobs);
-    int (*WaitForAllJobs)(struct Longtail_JobAPI* job_api, void* context, Longtail_JobAPI_ProgressFunc process_func);
+    int (*WaitForAllJobs)(struct Longtail_JobAPI* job_api, Longtail_JobAPI_Group job_group, void* context, Longtail_JobAPI_ProgressFunc process_func);
 };
 
 typedef void (*Longtail_Assert)(const char* expression, const char* file, int line);
@@ -128,14 +187,102 @@ void Longtail_SetLogLevel(int level);
         Longtail_CallLogger(level, fmt, __VA_ARGS__);
 #endif
 
+// Records timed scopes for profiling. BeginScope and EndScope are called on the same thread,
+// `name` is a string literal that must stay valid for the lifetime of the trace API.
+struct Longtail_TraceAPI
+{
+    struct Longtail_API m_API;
+    uint64_t (*BeginScope)(struct Longtail_TraceAPI* trace_api);
+    void (*EndScope)(struct Longtail_TraceAPI* trace_api, const char* name, uint64_t begin);
+};
+
+// The trace API is global and optional, set it to zero to stop tracing
+void Longtail_SetTraceAPI(struct Longtail_TraceAPI* trace_api);
+struct Longtail_TraceAPI* Longtail_GetTraceAPI();
+
+#ifndef LONGTAIL_TRACE_BEGIN
+    #define LONGTAIL_TRACE_BEGIN(scope, name) \
+        struct Longtail_TraceAPI* scope##_trace_api = Longtail_GetTraceAPI(); \
+        const char* scope##_trace_name = name; \
+        uint64_t scope##_trace_begin = scope##_trace_api ? scope##_trace_api->BeginScope(scope##_trace_api) : 0;
+    #define LONGTAIL_TRACE_END(scope) \
+        if (scope##_trace_api) \
+        { \
+            scope##_trace_api->EndScope(scope##_trace_api, scope##_trace_name, scope##_trace_begin); \
+        }
+#endif
+
 
 typedef void* (*Longtail_Alloc_Func)(size_t s);
 typedef void (*Longtail_Free_Func)(void* p);
 void Longtail_SetAllocAndFree(Longtail_Alloc_Func alloc, Longtail_Free_Func free);
 
+// Alloc and Free may be called from any thread. Free is only called with memory returned by Alloc of the same allocator.
+struct Longtail_AllocatorAPI
+{
+    struct Longtail_API m_API;
+    void* (*Alloc)(struct Longtail_AllocatorAPI* allocator_api, size_t s);
+    void (*Free)(struct Longtail_AllocatorAPI* allocator_api, void* p);
+};
+
+// Takes precedence over Longtail_SetAllocAndFree, set it to zero to go back. Fails with EBUSY and keeps the
+// current allocator if anything allocated through Longtail_Alloc is still alive, not safe to call while other
+// threads allocate.
+int Longtail_SetAllocatorAPI(struct Longtail_AllocatorAPI* allocator_api);
+
+// Subsystem tags for Longtail_AllocTagged
+#define LONGTAIL_MEMTAG_OTHER       0   // Untagged allocations
+#define LONGTAIL_MEMTAG_INDEX       1   // Version, content and block indexes while built, read or diffed
+#define LONGTAIL_MEMTAG_BLOCK_DATA  2   // Asset, chunk and block data buffers
+#define LONGTAIL_MEMTAG_LOOKUP      3   // Hash maps and lookup tables
+#define LONGTAIL_MEMTAG_JOBS        4   // Job descriptors, job groups and job queues
+#define LONGTAIL_MEMTAG_COUNT       5
+
+struct Longtail_MemTagStats
+{
+    uint64_t m_CurrentBytes;
+    uint64_t m_PeakBytes;
+    uint64_t m_CurrentCount;
+    uint64_t m_TotalCount;
+};
+
+// Accounts memory allocated with Longtail_Alloc and Longtail_AllocTagged per tag. OnAlloc and OnFree may be called
+// from any thread, `size` is the requested size. ResetPeaks sets the peak of each tag to its current value.
+struct Longtail_MemTrackerAPI
+{
+    struct Longtail_API m_API;
+    void (*OnAlloc)(struct Longtail_MemTrackerAPI* mem_tracker_api, uint32_t tag, size_t size);
+    void (*OnFree)(struct Longtail_MemTrackerAPI* mem_tracker_api, uint32_t tag, size_t size);
+    int (*GetTagStats)(struct Longtail_MemTrackerAPI* mem_tracker_api, uint32_t tag, struct Longtail_MemTagStats* out_stats);
+    void (*ResetPeaks)(struct Longtail_MemTrackerAPI* mem_tracker_api);
+};
+
+// The memory tracker is global and optional, set it to zero to stop tracking. It can be changed while allocations are
+// alive, OnFree is only called for allocations that were reported to OnAlloc of the tracker that is set when they are
+// freed. Set the tracker before and clear it after the allocations it should account for.
+void Longtail_SetMemTrackerAPI(struct Longtail_MemTrackerAPI* mem_tracker_api);
+struct Longtail_MemTrackerAPI* Longtail_GetMemTrackerAPI();
+
+// Resets the peaks of the memory tracker, if set. The library never resets the peaks itself, call it before a top level
+// call to get the peaks of that call.
+void Longtail_ResetMemTagPeaks();
+
+// Logs the stats of each tag at LONGTAIL_LOG_LEVEL_INFO if a memory tracker is set, done at the end of each top level
+// call. The peaks cover everything since the tracker was set or its peaks were last reset, including other calls that
+// ran at the same time.
+void Longtail_LogMemTagStats(const char* context);
+const char* Longtail_GetMemTagName(uint32_t tag);
+
+void* Longtail_AllocTagged(uint32_t tag, size_t s);
 void* Longtail_Alloc(size_t s);
 void Longtail_Free(void* p);
 
+// Allocates the stb_ds arrays and hash maps through Longtail_AllocTagged tagged as LONGTAIL_MEMTAG_LOOKUP, every file
+// that includes ext/stb_ds.h defines STBDS_REALLOC and STBDS_FREE to these. The 16 byte Longtail_AllocTagged header
+// also gives the old size on realloc so stb_ds allocations do not carry a second header.
+void* Longtail_STBRealloc(void* context, void* old_p, size_t s);
+void Longtail_STBFree(void* context, void* p);
+
 typedef uint64_t TLongtail_Hash;
 struct Longtail_Paths;
 struct Longtail_FileInfos;
@@ -145,6 +292,34 @@ struct PathLookup;
 struct ChunkHashToAssetPart;
 struct Longtail_VersionDiff;
 
+// Phases that report time in Longtail_Stats
+#define LONGTAIL_STATS_PHASE_HASH_ASSETS    0   // Longtail_CreateVersionIndex reading, chunking and hashing assets
+#define LONGTAIL_STATS_PHASE_WRITE_BLOCKS   1   // Longtail_WriteContent reading, compressing and writing blocks
+#define LONGTAIL_STATS_PHASE_SCAN_BLOCKS    2   // Longtail_ReadContent reading block indexes
+#define LONGTAIL_STATS_PHASE_WRITE_ASSETS   3   // Longtail_WriteVersion and Longtail_ChangeVersion reading blocks and writing assets
+#define LONGTAIL_STATS_PHASE_COUNT          4
+
+// Filled in by functions that take an `optional_stats` argument. Values are added to what is already in the
+// struct so one struct can sum up several calls, clear it before the first call.
+struct Longtail_Stats
+{
+    uint64_t m_BytesRead;
+    uint64_t m_BytesWritten;
+    uint64_t m_BytesHashed;
+    uint64_t m_BytesCompressed;     // Size of the data before compression
+    uint64_t m_BytesDecompressed;   // Size of the data after decompression
+    uint64_t m_FilesOpened;
+    uint64_t m_BlocksRead;
+    uint64_t m_JobsRun;
+    // Times are zero unless clocks are set with Longtail_SetClocks. CPU time is for the whole process.
+    uint64_t m_PhaseWallTimeUS[LONGTAIL_STATS_PHASE_COUNT];
+    uint64_t m_PhaseCPUTimeUS[LONGTAIL_STATS_PHASE_COUNT];
+};
+
+// Both clocks return microseconds, the cpu clock returns the CPU time used by all threads of the process
+typedef uint64_t (*Longtail_Clock_Func)();
+void Longtail_SetClocks(Longtail_Clock_Func wall_clock, Longtail_Clock_Func cpu_clock);
+
 int EnsureParentPathExists(struct Longtail_StorageAPI* storage_api, const char* path);
 char* Longtail_Strdup(const char* path);
 
@@ -159,6 +334,9 @@ int Longtail_CreateVersionIndex(
     struct Longtail_JobAPI* job_api,
     Longtail_JobAPI_ProgressFunc job_progress_func,
     void* job_progress_context,
+    struct Longtail_CancelAPI* optional_cancel_api,
+    Longtail_CancelAPI_HCancelToken optional_cancel_token,
+    struct Longtail_Stats* optional_stats,
     const char* root_path,
     const struct Longtail_Paths* paths,
     const uint64_t* asset_sizes,
@@ -223,6 +401,9 @@ int Longtail_WriteContent(
     struct Longtail_JobAPI* job_api,
     Longtail_JobAPI_ProgressFunc job_progress_func,
     void* job_progress_context,
+    struct Longtail_CancelAPI* optional_cancel_api,
+    Longtail_CancelAPI_HCancelToken optional_cancel_token,
+    struct Longtail_Stats* optional_stats,
     struct Longtail_ContentIndex* content_index,
     struct Longtail_VersionIndex* version_index,
     const char* assets_folder,
@@ -234,6 +415,7 @@ int Longtail_ReadContent(
     struct Longtail_JobAPI* job_api,
     Longtail_JobAPI_ProgressFunc job_progress_func,
     void* job_progress_context,
+    struct Longtail_Stats* optional_stats,
     const char* content_path,
     struct Longtail_ContentIndex** out_content_index);
 
@@ -266,6 +448,7 @@ int Longtail_WriteVersion(
     struct Longtail_JobAPI* job_api,
     Longtail_JobAPI_ProgressFunc job_progress_func,
     void* job_progress_context,
+    struct Longtail_Stats* optional_stats,
     const struct Longtail_ContentIndex* content_index,
     const struct Longtail_VersionIndex* version_index,
     const char* content_path,
@@ -276,6 +459,8 @@ int Longtail_CreateVersionDiff(
     const struct Longtail_VersionIndex* target_version,
     struct Longtail_VersionDiff** out_version_diff);
 
+// If cancelled the version folder holds a mix of the source and target version, assets that were only
+// partly written are removed. Index the folder again and diff against that before retrying.
 int Longtail_ChangeVersion(
     struct Longtail_StorageAPI* content_storage_api,
     struct Longtail_StorageAPI* version_storage_api,
@@ -283,6 +468,9 @@ int Longtail_ChangeVersion(
     struct Longtail_JobAPI* job_api,
     Longtail_JobAPI_ProgressFunc job_progress_func,
     void* job_progress_context,
+    struct Longtail_CancelAPI* optional_cancel_api,
+    Longtail_CancelAPI_HCancelToken optional_cancel_token,
+    struct Longtail_Stats* optional_stats,
     struct Longtail_CompressionRegistryAPI* compression_registry,
     const struct Longtail_ContentIndex* content_index,
     const struct Longtail_VersionIndex* source_version,
@@ -369,6 +557,18 @@ extern struct Longtail_CompressionRegistryAPI* Longtail_CreateDefaultCompression
         const struct Longtail_CompressionAPI** compression_apis,
         const Longtail_CompressionAPI_HSettings* compression_settings);
 
+#define LONGTAIL_MAX_COMPRESSION_CANDIDATES 16
+
+// Takes ownership of `compression_registry` and adds `best_of_compression_type` which tries all of
+// `candidate_types` on each block, see Longtail_CompressionRegistryAPI::GetCompressionCandidates.
+// Order `candidate_types` from fastest to slowest to decompress.
+extern struct Longtail_CompressionRegistryAPI* Longtail_CreateBestOfCompressionRegistry(
+        struct Longtail_CompressionRegistryAPI* compression_registry,
+        uint32_t best_of_compression_type,
+        uint32_t candidate_count,
+        const uint32_t* candidate_types,
+        uint32_t max_size_overhead_percent);
+
 extern const uint32_t LONGTAIL_NO_COMPRESSION_TYPE;
 
 ///////////// Test functions
@@ -427,6 +627,15 @@ typedef int (*Longtail_Chunker_Feeder)(void* context, struct Longtail_Chunker* c
     void* context,
     struct Longtail_Chunker** out_chunker);
 
+// Same as Longtail_CreateChunker but with a feed buffer of buffer_size bytes, buffer_size must be at least params->max.
+// A larger buffer gives fewer and larger feeder calls and moves the buffered data less often.
+ int Longtail_CreateChunkerWithBufferSize(
+    struct Longtail_ChunkerParams* params,
+    Longtail_Chunker_Feeder feeder,
+    void* context,
+    uint32_t buffer_size,
+    struct Longtail_Chunker** out_chunker);
+
 #ifdef __cplusplus
 }
 #endif
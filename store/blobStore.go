@@ -4,16 +4,26 @@ import (
 	"context"
 	"fmt"
 	"io"
+	"os"
 
+	"cloud.google.com/go/storage"
 	"github.com/DanEngelbrecht/golongtail/lib"
+	"github.com/pkg/errors"
 )
 
 type BlobStore interface {
 	HasBlob(ctx context.Context, key string) bool
 	PutBlob(ctx context.Context, key string, contentType string, blob []byte) error
+	PutBlobIfAbsent(ctx context.Context, key string, contentType string, blob []byte) (bool, error)
 	GetBlob(ctx context.Context, key string) ([]byte, error)
 	PutContent(ctx context.Context, progressFunc lib.ProgressFunc, progressContext interface{}, contentIndex lib.Longtail_ContentIndex, fs lib.Longtail_StorageAPI, contentPath string) error
 	GetContent(ctx context.Context, progressFunc lib.ProgressFunc, progressContext interface{}, contentIndex lib.Longtail_ContentIndex, fs lib.Longtail_StorageAPI, contentPath string) error
 	io.Closer
 	fmt.Stringer
 }
+
+// IsNotExist reports whether err from GetBlob means that the blob does not exist
+func IsNotExist(err error) bool {
+	cause := errors.Cause(err)
+	return os.IsNotExist(cause) || cause == storage.ErrObjectNotExist
+}
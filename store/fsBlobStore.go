@@ -59,6 +59,40 @@ func (s FSBloblStore) PutBlob(ctx context.Context, key string, contentType strin
 	return nil
 }
 
+// PutBlobIfAbsent ...
+func (s FSBloblStore) PutBlobIfAbsent(ctx context.Context, key string, contentType string, blob []byte) (bool, error) {
+	blobPath := path.Join(s.root, key)
+	blobParent, _ := path.Split(blobPath)
+	err := os.MkdirAll(blobParent, os.ModePerm)
+	if err != nil {
+		return false, err
+	}
+	tmpFile, err := ioutil.TempFile(blobParent, "*.tmp")
+	if err != nil {
+		return false, err
+	}
+	tmpPath := tmpFile.Name()
+	defer os.Remove(tmpPath)
+	_, err = tmpFile.Write(blob)
+	if err != nil {
+		tmpFile.Close()
+		return false, err
+	}
+	err = tmpFile.Close()
+	if err != nil {
+		return false, err
+	}
+	// Linking fails if the blob exists so only one of several concurrent writers gets to create it
+	err = os.Link(tmpPath, blobPath)
+	if os.IsExist(err) {
+		return false, nil
+	}
+	if err != nil {
+		return false, err
+	}
+	return true, nil
+}
+
 // GetBlob ...
 func (s FSBloblStore) GetBlob(ctx context.Context, key string) ([]byte, error) {
 	blobPath := path.Join(s.root, key)
@@ -4,6 +4,7 @@ import (
 	"context"
 	"fmt"
 	"io/ioutil"
+	"net/http"
 	"net/url"
 	"os"
 	"runtime"
@@ -14,6 +15,7 @@ import (
 	"cloud.google.com/go/storage"
 	"github.com/DanEngelbrecht/golongtail/lib"
 	"github.com/pkg/errors"
+	"google.golang.org/api/googleapi"
 )
 
 // GCSBlobStore is the base object for all chunk and index stores with GCS backing
@@ -85,6 +87,29 @@ func (s GCSBlobStore) PutBlob(ctx context.Context, key string, contentType strin
 	return nil
 }
 
+// PutBlobIfAbsent ...
+func (s GCSBlobStore) PutBlobIfAbsent(ctx context.Context, key string, contentType string, blob []byte) (bool, error) {
+	objHandle := s.bucket.Object(key)
+	objWriter := objHandle.If(storage.Conditions{DoesNotExist: true}).NewWriter(ctx)
+	objWriter.ContentType = contentType
+
+	_, err := objWriter.Write(blob)
+	if err != nil {
+		objWriter.CloseWithError(err)
+		return false, errors.Wrap(err, s.String()+"/"+key)
+	}
+
+	err = objWriter.Close()
+	if apiErr, ok := err.(*googleapi.Error); ok && apiErr.Code == http.StatusPreconditionFailed {
+		return false, nil
+	}
+	if err != nil {
+		return false, errors.Wrap(err, s.String()+"/"+key)
+	}
+
+	return true, nil
+}
+
 // GetObjectBlob ...
 func (s GCSBlobStore) GetBlob(ctx context.Context, key string) ([]byte, error) {
 	objHandle := s.bucket.Object(key)